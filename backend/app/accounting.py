@@ -0,0 +1,79 @@
+"""
+Reader for the per-job accounting file written by safebox-executord.
+
+Every job that exits leaves one fixed-width record (see
+cgroup_agent/src/accounting.hpp for the layout and field meanings): what
+was requested, how long each launch phase took, wait4() rusage, and the
+cgroup's cpu.stat, memory.peak, memory.events and io.stat. -1 means the
+host could not provide that value. Members of a job array share one
+cgroup, so their cgroup counters cover all array_size of them.
+"""
+
+import os
+import struct
+from typing import Dict, Iterator, List, Optional
+
+
+DEFAULT_PATH = "/var/lib/safebox/accounting.bin"
+
+MAGIC = b"SBACCT\0\0"
+VERSION = 3
+
+# Same order as JobRecord; everything after the two strings is int64
+FIELDS = [
+    "app_hash", "job_id", "array_size", "cpu_percent", "memory_mb", "wall_limit_ms", "cpu_limit_ms",
+    "start_unix_ns", "wall_ns", "admit_ns", "cgroup_ns", "spawn_ns",
+    "exit_code", "signal", "deadline",
+    "ru_utime_us", "ru_stime_us", "ru_maxrss_kb", "ru_minflt", "ru_majflt",
+    "ru_inblock", "ru_oublock", "ru_nvcsw", "ru_nivcsw",
+    "cpu_usage_us", "cpu_user_us", "cpu_system_us", "cpu_nr_periods",
+    "cpu_nr_throttled", "cpu_throttled_us",
+    "memory_peak", "mem_events_low", "mem_events_high", "mem_events_max",
+    "mem_events_oom", "mem_events_oom_kill",
+    "io_rbytes", "io_wbytes", "io_rios", "io_wios",
+]
+
+HEADER = struct.Struct("=8sII")
+RECORD = struct.Struct("=64s128s" + "q" * len(FIELDS))
+
+
+class AccountingError(RuntimeError):
+    pass
+
+
+def default_path() -> str:
+    return os.environ.get("SAFEBOX_ACCOUNTING_PATH", DEFAULT_PATH)
+
+
+def _decode(raw: bytes) -> Dict:
+    values = RECORD.unpack(raw)
+    rec = {
+        "name": values[0].split(b"\0", 1)[0].decode("utf-8", errors="replace"),
+        "app": values[1].split(b"\0", 1)[0].decode("utf-8", errors="replace"),
+    }
+    rec.update(zip(FIELDS, values[2:]))
+    return rec
+
+
+def iter_records(path: Optional[str] = None) -> Iterator[Dict]:
+    """Yield every record in file order (oldest first)."""
+    path = path or default_path()
+    with open(path, "rb") as f:
+        header = f.read(HEADER.size)
+        if not header:
+            return
+        magic, version, size = HEADER.unpack(header)
+        if magic != MAGIC or version != VERSION or size != RECORD.size:
+            raise AccountingError(f"{path}: not a version {VERSION} accounting file")
+        while True:
+            raw = f.read(RECORD.size)
+            if len(raw) < RECORD.size:  # a torn tail from a crash is ignored
+                return
+            yield _decode(raw)
+
+
+def query(name: Optional[str] = None, limit: int = 100, path: Optional[str] = None) -> List[Dict]:
+    """Records for `name` (all jobs if None), newest first."""
+    matches = [r for r in iter_records(path) if name is None or r["name"] == name]
+    matches.reverse()
+    return matches[:limit] if limit else matches
@@ -1,5 +1,5 @@
 import subprocess
-from typing import Sequence
+from typing import List, Sequence, Tuple
 
 
 class CgroupClient:
@@ -22,3 +22,17 @@ class CgroupClient:
         self._run(["cpu.set", group, str(quota), str(period)])
 
 
+
+    def apply(self, writes: Sequence[Tuple[str, str, str]]) -> List[str]:
+        """
+        Many (group, file, value) writes through one safebox_cgroup process;
+        returns its "ok"/"error ..." line for each.
+        """
+        if not writes:
+            return []
+        lines = "".join(f"{group}\t{file}\t{value}\n" for group, file, value in writes)
+        try:
+            r = subprocess.run([self.binary_path, "apply"], input=lines, capture_output=True, text=True, check=False)
+        except OSError as e:
+            return [f"error {self.binary_path}: {e}"] * len(writes)
+        return r.stdout.splitlines()
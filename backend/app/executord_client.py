@@ -0,0 +1,262 @@
+"""
+Thin client for the native executor daemon (cgroup_agent/src/executord.cpp).
+
+When safebox-executord is running, SystemExecutor hands every job to it:
+admission, cgroup setup, sandbox launch and reaping then happen in one
+native process instead of Python spawning safebox_cgroup three times and
+safebox once per job.
+"""
+
+import json
+import os
+import socket
+import threading
+from typing import Dict, List, Optional, Tuple
+
+from .latency import LatencySnapshot
+
+
+DEFAULT_SOCKET = "/run/safebox/executord.sock"
+
+
+class ExecutordError(RuntimeError):
+    pass
+
+
+class ExecutordClient:
+    """Line protocol client: tab-separated request, one JSON object back."""
+
+    def __init__(self, socket_path: str = DEFAULT_SOCKET, timeout: Optional[float] = None) -> None:
+        self.socket_path = socket_path
+        self.timeout = timeout
+        self._sock: Optional[socket.socket] = None
+        self._rfile = None
+        self._lock = threading.Lock()
+
+    @classmethod
+    def connect_if_running(cls, socket_path: Optional[str] = None) -> Optional["ExecutordClient"]:
+        """Return a connected client, or None when no daemon is listening."""
+        path = socket_path or os.environ.get("SAFEBOX_EXECUTORD_SOCKET", DEFAULT_SOCKET)
+        if not os.path.exists(path):
+            return None
+        client = cls(path)
+        try:
+            client.call("PING")
+        except (OSError, ExecutordError):
+            client.close()
+            return None
+        return client
+
+    def _connect(self) -> None:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.settimeout(self.timeout)
+        sock.connect(self.socket_path)
+        self._sock = sock
+        self._rfile = sock.makefile("rb")
+
+    def close(self) -> None:
+        if self._rfile is not None:
+            self._rfile.close()
+        if self._sock is not None:
+            self._sock.close()
+        self._sock = None
+        self._rfile = None
+
+    def call(self, *fields: str) -> Dict:
+        for f in fields:
+            if "\t" in f or "\n" in f:
+                raise ExecutordError(f"field may not contain tabs or newlines: {f!r}")
+        line = ("\t".join(fields) + "\n").encode()
+        with self._lock:
+            if self._sock is None:
+                self._connect()
+            try:
+                self._sock.sendall(line)
+                reply = self._rfile.readline()
+            except OSError:
+                self.close()
+                raise
+            if not reply:
+                self.close()
+                raise ExecutordError("executord closed the connection")
+        # Job output is raw bytes from the workload; don't let one bad byte
+        # sink the whole reply
+        return json.loads(reply.decode("utf-8", errors="replace"))
+
+    # ------------------------------------------------------------------
+    # SystemExecutor-compatible API
+    # ------------------------------------------------------------------
+
+    @staticmethod
+    def _limit_fields(wall_limit_s: Optional[float], cpu_limit_s: Optional[float]) -> List[str]:
+        fields = []
+        if wall_limit_s:
+            fields.append(f"wall_ms={int(wall_limit_s * 1000)}")
+        if cpu_limit_s:
+            fields.append(f"cpu_ms={int(cpu_limit_s * 1000)}")
+        return fields
+
+    def request_job(
+        self,
+        job_name: str,
+        app_path: str,
+        app_args: List[str],
+        cpu_percent: int,
+        memory_mb: int,
+        wall_limit_s: Optional[float] = None,
+        cpu_limit_s: Optional[float] = None,
+    ) -> Tuple[bool, str, Optional[int]]:
+        r = self.call("RUN", job_name, str(cpu_percent), str(memory_mb),
+                      *self._limit_fields(wall_limit_s, cpu_limit_s), app_path, *app_args)
+        return r["ok"], r["message"], r.get("job_id")
+
+    def release_job(self, job_id: int) -> Tuple[bool, str]:
+        r = self.call("RELEASE", str(job_id))
+        return r["ok"], r["message"]
+
+    def get_system_state(self) -> Dict:
+        state = self.call("STATE")
+        # JSON object keys are strings; match the int-keyed dicts SystemExecutor returns
+        state["jobs"] = {int(k): v for k, v in state.get("jobs", {}).items()}
+        banker = state.get("banker", {})
+        banker["processes"] = {int(k): v for k, v in banker.get("processes", {}).items()}
+        state["arrays"] = {int(k): v for k, v in state.get("arrays", {}).items()}
+        return state
+
+    def get_profile(self, app_path: Optional[str] = None) -> Dict:
+        """
+        Usage profile built from exit accounting: CPU% and peak-memory
+        quantiles over recent runs and, once there are enough runs, the
+        recommended limits (margin included). Without app_path, every app.
+        Submitting with cpu_percent or memory_mb 0 uses the recommendation.
+        """
+        r = self.call("PROFILE", *([app_path] if app_path else []))
+        if not r.get("ok"):
+            raise ExecutordError(r.get("message", "PROFILE failed"))
+        return r["profile"] if app_path else {p["app"]: p for p in r["profiles"]}
+
+    def get_controller(self, limit: int = 100) -> Dict:
+        """
+        The closed-loop limit controller (--controller): per job cgroup the
+        cpu.max percent and memory.high bytes it has set inside the Banker
+        reservation, plus the newest `limit` decisions with their reasons.
+        """
+        r = self.call("CONTROL", str(limit))
+        if not r.get("ok"):
+            raise ExecutordError(r.get("message", "CONTROL failed"))
+        controller = r["controller"]
+        controller["groups"] = {int(k): v for k, v in controller.get("groups", {}).items()}
+        return controller
+
+    def list_metrics(self, prefix: str = "") -> Dict:
+        """
+        Names of the metric series the daemon keeps history for ("host.*",
+        "job.<id>.*") starting with `prefix`, and the store's size.
+        """
+        r = self.call("METRICS", prefix)
+        if not r.get("ok"):
+            raise ExecutordError(r.get("message", "METRICS failed"))
+        return {"series": r["series"], "stats": r["stats"]}
+
+    def query_metrics(self, series: str, from_ms: int, to_ms: int) -> List[Tuple[int, float]]:
+        """(epoch ms, value) points of one series with from_ms <= t <= to_ms."""
+        r = self.call("METRICS", series, str(int(from_ms)), str(int(to_ms)))
+        if not r.get("ok"):
+            raise ExecutordError(r.get("message", "METRICS failed"))
+        return [(t, v) for t, v in r["points"]]
+
+    def query_rollups(self, series: str, from_ms: int, to_ms: int,
+                      step_ms: int = 0) -> Tuple[int, List[Tuple[int, float, float, float, float]]]:
+        """
+        (step used, [(bucket start ms, min, max, avg, p95)]) of one series
+        over the range. The daemon rounds the step up to a resolution it
+        keeps; 0 picks about 300 buckets.
+        """
+        r = self.call("METRICS", series, str(int(from_ms)), str(int(to_ms)), str(int(step_ms)))
+        if not r.get("ok"):
+            raise ExecutordError(r.get("message", "METRICS failed"))
+        return r["step_ms"], [tuple(p) for p in r["points"]]
+
+    def cpu_profile(self, job_id: int, seconds: int, fmt: str = "folded", hz: int = 99) -> Dict:
+        """
+        Sample the job's cgroup for `seconds` (blocking that long) and return
+        {"samples", "lost", "stacks", "profile", ...}: "profile" is folded
+        stacks text for flamegraph.pl, or with fmt="speedscope" a speedscope
+        document.
+        """
+        r = self.call("CPU_PROFILE", str(job_id), str(seconds), fmt, str(hz))
+        if not r.get("ok"):
+            raise ExecutordError(r.get("message", "CPU_PROFILE failed"))
+        return r
+
+    def latency(self) -> Dict[str, LatencySnapshot]:
+        """Admission, cgroup, launch and completion histograms since the daemon started."""
+        r = self.call("LATENCY", "json")
+        if not r.get("ok"):
+            raise ExecutordError(r.get("message", "LATENCY failed"))
+        return {stage: LatencySnapshot.from_json(h) for stage, h in r["stages"].items()}
+
+    # ------------------------------------------------------------------
+    # Job arrays
+    # ------------------------------------------------------------------
+
+    def submit_array(
+        self,
+        job_name: str,
+        count: int,
+        app_path: str,
+        app_args: List[str],
+        cpu_percent: int,
+        memory_mb: int,
+        wall_limit_s: Optional[float] = None,
+        cpu_limit_s: Optional[float] = None,
+    ) -> Tuple[bool, str, Optional[int], List[int]]:
+        """
+        Launch `count` identical jobs as one gang.
+
+        cpu_percent/memory_mb are per member; the Banker reserves count times
+        that in a single all-or-none decision. Returns
+        (success, message, array_id, member_job_ids).
+        """
+        r = self.call("ARRAY", job_name, str(count), str(cpu_percent), str(memory_mb),
+                      *self._limit_fields(wall_limit_s, cpu_limit_s), app_path, *app_args)
+        return r["ok"], r["message"], r.get("array_id"), r.get("job_ids", [])
+
+    def wait_array(self, array_id: int) -> Dict:
+        """Block until every member has exited; returns their exit codes."""
+        return self.call("WAIT_ARRAY", str(array_id))
+
+    def release_array(self, array_id: int) -> Tuple[bool, str]:
+        r = self.call("RELEASE_ARRAY", str(array_id))
+        return r["ok"], r["message"]
+
+    # ------------------------------------------------------------------
+    # Streaming
+    # ------------------------------------------------------------------
+
+    def submit_job(
+        self,
+        job_name: str,
+        app_path: str,
+        app_args: List[str],
+        cpu_percent: int,
+        memory_mb: int,
+        wall_limit_s: Optional[float] = None,
+        cpu_limit_s: Optional[float] = None,
+    ) -> Tuple[bool, str, Optional[int]]:
+        """Admit and launch without waiting; follow it with read_output()."""
+        r = self.call("SUBMIT", job_name, str(cpu_percent), str(memory_mb),
+                      *self._limit_fields(wall_limit_s, cpu_limit_s), app_path, *app_args)
+        return r["ok"], r["message"], r.get("job_id")
+
+    def read_output(self, job_id: int, stdout_offset: int = 0, stderr_offset: int = 0,
+                    wait_ms: int = 1000) -> Dict:
+        """
+        Long-poll for output past the given offsets.
+
+        Blocks up to wait_ms until there is something new or the job exits.
+        Pass the returned stdout_offset/stderr_offset to the next call; a
+        non-zero skipped_stdout/skipped_stderr means the reader fell behind
+        the daemon's per-job buffer and that many bytes were dropped.
+        """
+        return self.call("OUTPUT", str(job_id), str(stdout_offset), str(stderr_offset), str(wait_ms))
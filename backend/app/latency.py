@@ -0,0 +1,160 @@
+"""
+Latency histograms with the same bucket layout as the native ones
+(cgroup_agent/src/latency_histogram.hpp).
+
+Values are nanoseconds: exact below 128, then 64 log-linear buckets per
+power of two up to 2^44 ns, so a reported value is within 1.6% of what was
+recorded. Each recording thread counts into its own dict and snapshot()
+merges them; a snapshot from the daemon's LATENCY JSON (from_json) merges
+with a local one bucket for bucket.
+
+    h = LatencyHistogram()
+    h.record(time.monotonic_ns() - t0)
+    h.snapshot().percentile(0.99)
+"""
+
+import math
+import threading
+from typing import Dict, List
+
+SUB_BITS = 6
+LINEAR = 2 << SUB_BITS
+HALF = LINEAR // 2
+MAX_BITS = 44
+BUCKETS = LINEAR + (MAX_BITS - SUB_BITS - 1) * HALF
+
+STAGES = ["admission", "cgroup", "launch", "completion"]
+
+
+def bucket_of(ns: int) -> int:
+    if ns < LINEAR:
+        return max(0, ns)
+    msb = ns.bit_length() - 1
+    if msb >= MAX_BITS:
+        return BUCKETS - 1
+    shift = msb - SUB_BITS
+    return LINEAR + (shift - 1) * HALF + ((ns >> shift) - HALF)
+
+
+def bucket_high(index: int) -> int:
+    if index < LINEAR:
+        return index
+    k = index - LINEAR
+    return ((k % HALF + HALF + 1) << (k // HALF + 1)) - 1
+
+
+class LatencySnapshot:
+    """A merged copy: sparse bucket counts plus exact count/sum/min/max."""
+
+    def __init__(self) -> None:
+        self.counts: Dict[int, int] = {}
+        self.count = 0
+        self.sum_ns = 0
+        self.min_ns = 0
+        self.max_ns = 0
+
+    def merge(self, other: "LatencySnapshot") -> "LatencySnapshot":
+        if other.count == 0:
+            return self
+        for b, c in other.counts.items():
+            self.counts[b] = self.counts.get(b, 0) + c
+        self.min_ns = min(self.min_ns, other.min_ns) if self.count else other.min_ns
+        self.max_ns = max(self.max_ns, other.max_ns)
+        self.count += other.count
+        self.sum_ns += other.sum_ns
+        return self
+
+    def percentile(self, q: float) -> int:
+        """Highest value of the bucket holding the q-quantile (0..1), at most max_ns."""
+        if self.count == 0:
+            return 0
+        rank = max(1, math.ceil(q * self.count))
+        seen = 0
+        for b in sorted(self.counts):
+            seen += self.counts[b]
+            if seen >= rank:
+                return min(bucket_high(b), self.max_ns)
+        return self.max_ns
+
+    def to_json(self) -> Dict:
+        """The daemon's LATENCY stage shape; times in ns."""
+        return {
+            "count": self.count, "sum_ns": self.sum_ns, "min_ns": self.min_ns, "max_ns": self.max_ns,
+            "mean_ns": self.sum_ns // self.count if self.count else 0,
+            "p50_ns": self.percentile(0.5), "p90_ns": self.percentile(0.9),
+            "p99_ns": self.percentile(0.99), "p999_ns": self.percentile(0.999),
+            "sub_bits": SUB_BITS, "buckets": [[b, self.counts[b]] for b in sorted(self.counts)],
+        }
+
+    @classmethod
+    def from_json(cls, d: Dict) -> "LatencySnapshot":
+        if d.get("sub_bits", SUB_BITS) != SUB_BITS:
+            raise ValueError(f"histogram has sub_bits {d['sub_bits']}, expected {SUB_BITS}")
+        s = cls()
+        s.counts = {int(b): int(c) for b, c in d.get("buckets", [])}
+        s.count, s.sum_ns = int(d.get("count", 0)), int(d.get("sum_ns", 0))
+        s.min_ns, s.max_ns = int(d.get("min_ns", 0)), int(d.get("max_ns", 0))
+        return s
+
+    def to_openmetrics(self, name: str, help_text: str, labels: str = "") -> str:
+        """One histogram family in seconds, le at 1-2-5 steps from 1 us to 1000 s, like the daemon's."""
+        sep = labels + "," if labels else ""
+        lines = [f"# TYPE {name} histogram", f"# UNIT {name} seconds", f"# HELP {name} {help_text}"]
+        order = sorted(self.counts)
+        i, below = 0, 0
+        for exp in range(3, 13):
+            for step in (1, 2, 5):
+                bound = step * 10 ** exp
+                if bound > 10 ** 12:
+                    break
+                while i < len(order) and bucket_high(order[i]) <= bound:
+                    below += self.counts[order[i]]
+                    i += 1
+                lines.append(f'{name}_bucket{{{sep}le="{bound / 1e9:g}"}} {below}')
+        lines.append(f'{name}_bucket{{{sep}le="+Inf"}} {self.count}')
+        braces = "{" + labels + "}" if labels else ""
+        lines.append(f"{name}_count{braces} {self.count}")
+        lines.append(f"{name}_sum{braces} {self.sum_ns / 1e9:.9f}")
+        return "\n".join(lines) + "\n"
+
+
+class LatencyHistogram:
+    """Recording side: one shard per thread, merged on snapshot()."""
+
+    def __init__(self) -> None:
+        self._local = threading.local()
+        self._shards: List[LatencySnapshot] = []
+        self._lock = threading.Lock()
+
+    def record(self, ns: int) -> None:
+        shard = getattr(self._local, "shard", None)
+        if shard is None:
+            shard = self._local.shard = LatencySnapshot()
+            with self._lock:
+                self._shards.append(shard)
+        b = bucket_of(ns)
+        shard.counts[b] = shard.counts.get(b, 0) + 1
+        shard.min_ns = min(shard.min_ns, ns) if shard.count else ns
+        shard.max_ns = max(shard.max_ns, ns)
+        shard.sum_ns += ns
+        shard.count += 1
+
+    def snapshot(self) -> LatencySnapshot:
+        out = LatencySnapshot()
+        with self._lock:
+            shards = list(self._shards)
+        for s in shards:
+            # Copied first: its thread may be recording into it
+            copy = LatencySnapshot()
+            copy.counts = dict(s.counts)
+            copy.count, copy.sum_ns, copy.min_ns, copy.max_ns = s.count, s.sum_ns, s.min_ns, s.max_ns
+            out.merge(copy)
+        return out
+
+
+def stages_openmetrics(stages: Dict[str, LatencySnapshot], prefix: str = "safebox_job") -> str:
+    """An OpenMetrics exposition with one family per stage, ended with # EOF."""
+    text = "".join(s.to_openmetrics(f"{prefix}_{name}_seconds", f"job {name} latency")
+                   for name, s in stages.items())
+    return text + "# EOF\n"
+
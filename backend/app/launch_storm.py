@@ -0,0 +1,617 @@
+"""
+Launch storm: the highest job rate SafeBox sustains, per entry point.
+
+Submits quick_job open-loop, with Poisson arrivals at each offered rate
+of a 1-2-5 sweep from 10 to 10000 jobs/s, through:
+
+    safebox   the sandbox binary, one process per job (root only)
+    executor  SystemExecutor.request_job() + release_job()
+    daemon    ExecutordClient SUBMIT, WAIT, RELEASE
+    api       POST /api/v1/jobs on a running backend (--api URL), then
+              WAIT/RELEASE on its daemon
+
+The daemon entry point pipelines SUBMITs over a few connections
+(--connections) and collects exits with WAITs on others, so the
+generator never waits on a job itself. safebox and executor calls block
+until the job exits, so they run on up to --max-inflight threads, and api
+submissions hold a thread until the backend replies. Arrivals keep to
+the schedule until --max-inflight jobs are outstanding; then the next one
+waits for a slot and the step is generator-limited (below). Every latency
+is measured from the job's scheduled arrival, so a backlog shows as
+latency instead of a lower offered rate:
+
+    admission   until the entry point accepted the job (daemon/api: the
+                SUBMIT reply, which comes once the job is admitted and its
+                cgroup created and launched; not available for safebox or
+                for executor, whose request_job() returns at exit)
+    launch      until quick_job started running (the CLOCK_MONOTONIC
+                start_ns on its last line)
+    completion  until the exit was seen
+
+After each step the generator waits for in-flight jobs and counts the
+job cgroups (safebox*) left behind under the cgroup root. A step where
+the generator itself could not keep up (arrivals under 95% of the
+scheduled rate, or every in-flight slot taken when a job was due) is
+generator-limited: it says nothing about SafeBox, so it neither saturates
+nor moves the knee. Otherwise a rate saturates when completions fall
+below 90% of it, more than 1% of jobs are rejected or fail, or the p99
+completion latency exceeds 10x the lowest rate's; the knee is the last
+rate before the first one that saturates, and the sweep stops after two
+saturated or generator-limited rates in a row.
+
+Without --socket it starts its own safebox-executord on a scratch socket
+and, without --cgroup-root, a scratch directory as the cgroup root, so
+everything but the safebox entry point runs unprivileged:
+
+    cd backend && python3 -m app.launch_storm --apps ../src \\
+        --executord ../build/safebox-executord --entry daemon,executor
+"""
+
+import argparse
+import collections
+import json
+import os
+import random
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.error
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+from typing import Callable, Dict, List, Optional
+
+from .executord_client import ExecutordClient, ExecutordError
+
+
+ENTRY_POINTS = ["safebox", "executor", "daemon", "api"]
+RATES = [10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000]
+
+SATURATED_THROUGHPUT = 0.9   # completions per offered arrival
+SATURATED_ERRORS = 0.01      # rejected + failed per arrival
+SATURATED_LATENCY = 10.0     # p99 completion over the lowest rate's
+GENERATOR_SHORT = 0.95       # arrivals per scheduled below this: the generator fell behind
+
+
+def _start_ns(output: str) -> Optional[int]:
+    """quick_job's start_ns from its last JSON line, if it printed one."""
+    for line in reversed(output.splitlines()):
+        if line.startswith("{"):
+            try:
+                return int(json.loads(line)["start_ns"])
+            except (ValueError, KeyError, TypeError):
+                return None
+    return None
+
+
+def _percentiles(values: List[float]) -> Optional[Dict[str, float]]:
+    if not values:
+        return None
+    v = sorted(values)
+    at = lambda q: v[min(len(v) - 1, int(q * len(v)))]
+    return {"p50": at(0.50), "p90": at(0.90), "p99": at(0.99), "max": v[-1], "mean": sum(v) / len(v)}
+
+
+class Outcome:
+    """One job: timestamps in CLOCK_MONOTONIC ns, None where not seen."""
+    __slots__ = ("arrival", "admitted", "started", "done", "status")
+
+    def __init__(self, arrival: int) -> None:
+        self.arrival = arrival
+        self.admitted: Optional[int] = None
+        self.started: Optional[int] = None
+        self.done: Optional[int] = None
+        self.status = "timeout"   # until the job is over: ok | rejected | failed
+
+
+class Target:
+    """
+    An entry point. start() begins one job and returns; the outcome is
+    filled in and `done` called once the job is over. Blocking entry points
+    implement run() and get a thread each from a pool of --max-inflight.
+    """
+    name = ""
+
+    def __init__(self, opts: argparse.Namespace) -> None:
+        self.opts = opts
+        self.app = os.path.abspath(os.path.join(opts.apps, "quick_job"))
+        self.args = [str(opts.count)]
+        self._pool: Optional[ThreadPoolExecutor] = None
+
+    def cgroup_root(self) -> str:
+        return self.opts.cgroup_root
+
+    def start(self, out: Outcome, done: Callable[[Outcome], None]) -> None:
+        if self._pool is None:
+            self._pool = ThreadPoolExecutor(max_workers=self.opts.max_inflight)
+        self._pool.submit(self._run_then, out, done)
+
+    def _run_then(self, out: Outcome, done: Callable[[Outcome], None]) -> None:
+        try:
+            self.run(out)
+        except (OSError, ExecutordError, ValueError) as e:
+            out.status = "failed"
+            if self.opts.verbose:
+                print(f"⚠️  {self.name}: {e}", file=sys.stderr)
+        finally:
+            done(out)
+
+    def run(self, out: Outcome) -> None:
+        raise NotImplementedError
+
+    def close(self) -> None:
+        if self._pool is not None:
+            self._pool.shutdown(wait=True)
+
+
+class SafeboxTarget(Target):
+    name = "safebox"
+
+    def __init__(self, opts: argparse.Namespace) -> None:
+        super().__init__(opts)
+        self.binary = os.path.join(opts.apps, "safebox")
+
+    def cgroup_root(self) -> str:
+        # safebox always uses the real hierarchy
+        return "/sys/fs/cgroup"
+
+    def run(self, out: Outcome) -> None:
+        p = subprocess.Popen([self.binary, self.app, *self.args], stdout=subprocess.PIPE,
+                             stderr=subprocess.DEVNULL)
+        try:
+            stdout, _ = p.communicate(timeout=self.opts.drain_timeout)
+        except subprocess.TimeoutExpired:
+            p.kill()
+            p.communicate()
+            return
+        out.done = time.monotonic_ns()
+        out.started = _start_ns(stdout.decode(errors="replace"))
+        out.status = "ok" if p.returncode == 0 else "failed"
+
+
+class _Pipe:
+    """
+    One daemon connection with any number of requests in flight. The daemon
+    answers a connection's requests in order, so each reply goes to the
+    callback queued with its request; a callback gets None if the
+    connection closes first. Callbacks run on the reader thread and may
+    send on other pipes, never their own.
+    """
+
+    def __init__(self, path: str) -> None:
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self._rfile = self.sock.makefile("rb")
+        self._pending: collections.deque = collections.deque()
+        self._lock = threading.Lock()
+        self._reader = threading.Thread(target=self._read, daemon=True)
+        self._reader.start()
+
+    def send(self, fields: List[str], on_reply: Callable[[Optional[Dict]], None]) -> None:
+        line = ("\t".join(fields) + "\n").encode()
+        with self._lock:
+            self._pending.append(on_reply)
+            try:
+                self.sock.sendall(line)
+            except OSError:
+                self._pending.pop()
+                raise
+
+    def _next(self) -> Optional[Callable[[Optional[Dict]], None]]:
+        with self._lock:
+            return self._pending.popleft() if self._pending else None
+
+    def _read(self) -> None:
+        try:
+            for line in self._rfile:
+                reply = json.loads(line.decode("utf-8", errors="replace"))
+                on_reply = self._next()
+                if on_reply is not None:
+                    on_reply(reply)
+        except (OSError, ValueError):
+            pass
+        on_reply = self._next()
+        while on_reply is not None:
+            on_reply(None)
+            on_reply = self._next()
+
+    def close(self) -> None:
+        try:
+            self.sock.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+        self._reader.join()
+        self._rfile.close()
+        self.sock.close()
+
+
+class DaemonTarget(Target):
+    """
+    SUBMITs go round-robin over --connections pipes. The daemon answers
+    a WAIT only at the job's exit and holds the connection's later requests
+    until then, so each WAIT gets a connection of its own: an idle one, or
+    a new one while every open one has a job in it (at most --max-inflight,
+    the most jobs ever outstanding). RELEASEs share one more pipe.
+    """
+    name = "daemon"
+
+    def __init__(self, opts: argparse.Namespace) -> None:
+        super().__init__(opts)
+        self._submit = [_Pipe(opts.socket) for _ in range(max(1, opts.connections))]
+        self._release = _Pipe(opts.socket)
+        self._waits: List[_Pipe] = []
+        self._idle: List[_Pipe] = []
+        self._next = 0
+        self._lock = threading.Lock()
+
+    def _submit_pipe(self) -> _Pipe:
+        with self._lock:
+            self._next += 1
+            return self._submit[self._next % len(self._submit)]
+
+    def _wait_pipe(self) -> _Pipe:
+        with self._lock:
+            if self._idle:
+                return self._idle.pop()
+        pipe = _Pipe(self.opts.socket)
+        with self._lock:
+            self._waits.append(pipe)
+        return pipe
+
+    def start(self, out: Outcome, done: Callable[[Outcome], None]) -> None:
+        def submitted(r: Optional[Dict]) -> None:
+            out.admitted = time.monotonic_ns()
+            self.accepted(r, out, done)
+
+        fields = ["SUBMIT", "launch_storm", str(self.opts.job_cpu), str(self.opts.job_memory), self.app, *self.args]
+        try:
+            self._submit_pipe().send(fields, submitted)
+        except OSError:
+            out.status = "failed"
+            done(out)
+
+    def accepted(self, r: Optional[Dict], out: Outcome, done: Callable[[Outcome], None]) -> None:
+        """A SUBMIT reply: queue the WAIT, or finish a rejected job."""
+        if r is None or not r.get("ok"):
+            out.status = "failed" if r is None else "rejected"
+            done(out)
+            return
+        job_id = str(r["job_id"])
+        try:
+            pipe = self._wait_pipe()
+        except OSError:
+            out.status = "failed"
+            done(out)
+            return
+
+        def exited(w: Optional[Dict]) -> None:
+            out.done = time.monotonic_ns()
+            if w is not None:
+                with self._lock:
+                    self._idle.append(pipe)
+            if w is None:
+                out.status = "failed"
+            else:
+                out.started = _start_ns(w.get("stdout", ""))
+                out.status = "ok" if w.get("ok") and w.get("exit_code") == 0 else "failed"
+                try:
+                    self._release.send(["RELEASE", job_id], lambda _: None)
+                except OSError:
+                    pass
+            done(out)
+
+        try:
+            pipe.send(["WAIT", job_id], exited)
+        except OSError:
+            out.status = "failed"
+            done(out)
+
+    def close(self) -> None:
+        super().close()
+        for p in [*self._submit, *self._waits, self._release]:
+            p.close()
+
+
+class ApiTarget(DaemonTarget):
+    """POST /api/v1/jobs blocks a pool thread until the backend replies;
+    exits are collected on the daemon's pipes as for the daemon target."""
+    name = "api"
+
+    def start(self, out: Outcome, done: Callable[[Outcome], None]) -> None:
+        Target.start(self, out, done)
+
+    def _run_then(self, out: Outcome, done: Callable[[Outcome], None]) -> None:
+        try:
+            r = self.submit()
+        except (OSError, ValueError) as e:
+            out.status = "failed"
+            if self.opts.verbose:
+                print(f"⚠️  {self.name}: {e}", file=sys.stderr)
+            done(out)
+            return
+        out.admitted = time.monotonic_ns()
+        self.accepted(r, out, done)
+
+    def submit(self) -> Dict:
+        body = json.dumps({"name": "launch_storm", "app_path": self.app, "args": self.args,
+                           "cpu_percent": self.opts.job_cpu, "memory_mb": self.opts.job_memory}).encode()
+        req = urllib.request.Request(self.opts.api.rstrip("/") + "/api/v1/jobs", data=body,
+                                     headers={"Content-Type": "application/json"})
+        try:
+            with urllib.request.urlopen(req, timeout=self.opts.drain_timeout) as resp:
+                return json.loads(resp.read())
+        except urllib.error.HTTPError as e:
+            return json.loads(e.read() or b"{}")
+
+
+class ExecutorTarget(Target):
+    name = "executor"
+
+    def __init__(self, opts: argparse.Namespace) -> None:
+        super().__init__(opts)
+        from .system_executor import SystemExecutor
+        self._make = lambda: SystemExecutor(use_daemon=not opts.no_daemon)
+        # With the daemon each thread gets its own executor, like separate
+        # backend clients; the in-process path keeps state (job ids, the
+        # Banker) in one instance and so takes one job at a time
+        self._local = threading.local()
+        self._shared = self._make() if opts.no_daemon else None
+        self._shared_lock = threading.Lock()
+
+    def cgroup_root(self) -> str:
+        return "/sys/fs/cgroup" if self.opts.no_daemon else self.opts.cgroup_root
+
+    def run(self, out: Outcome) -> None:
+        if self._shared is not None:
+            with self._shared_lock:
+                self._run(self._shared, out)
+            return
+        ex = getattr(self._local, "executor", None)
+        if ex is None:
+            ex = self._local.executor = self._make()
+        self._run(ex, out)
+
+    def _run(self, ex, out: Outcome) -> None:
+        ok, msg, job_id = ex.request_job("launch_storm", self.app, self.args, self.opts.job_cpu,
+                                         self.opts.job_memory)
+        out.done = time.monotonic_ns()
+        if not ok:
+            out.status = "rejected" if "UNSAFE" in msg or "REJECTED" in msg else "failed"
+            return
+        out.started = _start_ns(msg)
+        out.status = "ok" if out.started is not None else "failed"
+        ex.release_job(job_id)
+
+
+TARGETS = {"safebox": SafeboxTarget, "executor": ExecutorTarget, "daemon": DaemonTarget, "api": ApiTarget}
+
+
+def _job_cgroups(root: str) -> set:
+    try:
+        return {e.name for e in os.scandir(root) if e.is_dir() and e.name.startswith("safebox")}
+    except OSError:
+        return set()
+
+
+def run_step(target: Target, rate: float, opts: argparse.Namespace) -> Dict:
+    """Offer `rate` jobs/s for opts.seconds, drain, and summarise."""
+    before = _job_cgroups(target.cgroup_root())
+    jobs = max(1, int(rate * opts.seconds))
+    outcomes: List[Outcome] = []
+    # One slot per outstanding job, given back when it is over
+    inflight = threading.Semaphore(opts.max_inflight)
+    capped = False
+    lag: List[float] = []
+    finished: List[Outcome] = []
+    finished_lock = threading.Lock()
+
+    def done(out: Outcome) -> None:
+        with finished_lock:
+            finished.append(out)
+        inflight.release()
+
+    rng = random.Random(opts.seed)
+    start = time.monotonic_ns() + 10_000_000
+    t = float(start)
+    for _ in range(jobs):
+        t += rng.expovariate(rate) * 1e9
+        arrival = int(t)
+        delay = (arrival - time.monotonic_ns()) / 1e9
+        if delay > 0:
+            time.sleep(delay)
+        # Every slot taken: the arrival waits (and that shows in its
+        # latency), and the step is generator-limited
+        if not inflight.acquire(blocking=False):
+            capped = True
+            inflight.acquire()
+        lag.append((time.monotonic_ns() - arrival) / 1e6)
+        out = Outcome(arrival)
+        outcomes.append(out)
+        target.start(out, done)
+    window = (time.monotonic_ns() - start) / 1e9
+    scheduled = (t - start) / 1e9
+    deadline = time.monotonic() + opts.drain_timeout
+    drained = 0
+    while drained < opts.max_inflight and inflight.acquire(timeout=max(0.0, deadline - time.monotonic())):
+        drained += 1
+    # A job not over by now counts as a timeout whatever it does later;
+    # let it finish (every call has drain_timeout to) before the next step
+    # so it cannot skew it
+    with finished_lock:
+        over = {id(o) for o in finished}
+    statuses = [o.status if id(o) in over else "timeout" for o in outcomes]
+    deadline = time.monotonic() + opts.drain_timeout
+    while drained < opts.max_inflight and inflight.acquire(timeout=max(0.0, deadline - time.monotonic())):
+        drained += 1
+    time.sleep(0.1)
+    leaked = sorted(_job_cgroups(target.cgroup_root()) - before)
+
+    ms = lambda a, b: (b - a) / 1e6
+    ok = [o for o, s in zip(outcomes, statuses) if s == "ok"]
+    counts = {s: statuses.count(s) for s in ("ok", "rejected", "failed", "timeout")}
+    last = max((o.done for o in ok), default=start)
+    # Against the drawn schedule rather than `rate`, so a sparse Poisson
+    # draw is not taken for a slow generator
+    short = window > scheduled / GENERATOR_SHORT
+    return {
+        "offered_per_sec": rate,
+        "jobs": jobs,
+        "arrived_per_sec": jobs / window if window > 0 else 0.0,
+        "completed_per_sec": len(ok) / max(window, (last - start) / 1e9) if ok else 0.0,
+        **counts,
+        "admission_ms": _percentiles([ms(o.arrival, o.admitted) for o in ok if o.admitted]),
+        "launch_ms": _percentiles([ms(o.arrival, o.started) for o in ok if o.started]),
+        "completion_ms": _percentiles([ms(o.arrival, o.done) for o in ok]),
+        "generator_lag_ms": _percentiles(lag),
+        "inflight_capped": capped,
+        "generator_limited": capped or short,
+        "leaked_cgroups": len(leaked),
+        "leaked": leaked[:10],
+    }
+
+
+def saturated(step: Dict, baseline_p99: Optional[float]) -> bool:
+    if step["completed_per_sec"] < SATURATED_THROUGHPUT * step["offered_per_sec"]:
+        return True
+    if (step["rejected"] + step["failed"] + step["timeout"]) > SATURATED_ERRORS * step["jobs"]:
+        return True
+    p99 = step["completion_ms"]["p99"] if step["completion_ms"] else None
+    return baseline_p99 is not None and p99 is not None and p99 > SATURATED_LATENCY * baseline_p99
+
+
+def sweep(target: Target, rates: List[float], opts: argparse.Namespace,
+          report: Callable[[str, Dict], None]) -> Dict:
+    steps, knee, baseline, over = [], None, None, 0
+    for rate in rates:
+        step = run_step(target, rate, opts)
+        if baseline is None and step["completion_ms"] and not step["generator_limited"]:
+            baseline = step["completion_ms"]["p99"]
+        # A generator-limited step measured the generator: it neither
+        # saturates nor moves the knee, but ends the sweep like one that does
+        step["saturated"] = not step["generator_limited"] and saturated(step, baseline)
+        steps.append(step)
+        report(target.name, step)
+        if step["saturated"] or step["generator_limited"]:
+            over += 1
+            if over == 2:
+                break
+        else:
+            if over == 0:
+                knee = rate
+    return {"entry": target.name, "max_sustainable_per_sec": knee, "steps": steps}
+
+
+def _print_step(entry: str, s: Dict) -> None:
+    p = lambda d: f"{d['p50']:8.1f} {d['p99']:8.1f}" if d else f"{'-':>8} {'-':>8}"
+    print(f"{entry:<9} {s['offered_per_sec']:>7g} {s['completed_per_sec']:>9.1f} {s['rejected'] + s['failed']:>6} "
+          f"{s['timeout']:>5} {p(s['admission_ms'])} {p(s['launch_ms'])} {p(s['completion_ms'])} "
+          f"{s['leaked_cgroups']:>6} {'SAT' if s['saturated'] else ''}{'GEN' if s['generator_limited'] else ''}",
+          flush=True)
+
+
+def _start_daemon(opts: argparse.Namespace, scratch: str) -> subprocess.Popen:
+    opts.socket = os.path.join(scratch, "executord.sock")
+    if not opts.cgroup_root:
+        opts.cgroup_root = os.path.join(scratch, "cgroup")
+        os.mkdir(opts.cgroup_root)
+    cmd = [opts.executord, "--socket", opts.socket, "--cgroup-root", opts.cgroup_root, "--no-accounting",
+           "--cpu", str(opts.pool_cpu), "--memory", str(opts.pool_memory)]
+    if os.geteuid() != 0:
+        cmd.append("--no-sandbox")
+    daemon = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    for _ in range(100):
+        if ExecutordClient.connect_if_running(opts.socket) is not None:
+            return daemon
+        time.sleep(0.05)
+    daemon.kill()
+    raise RuntimeError(f"{opts.executord} did not start")
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    ap = argparse.ArgumentParser(description="Open-loop quick_job launch storm against SafeBox entry points")
+    ap.add_argument("--entry", default="safebox,executor,daemon,api",
+                    help="comma-separated entry points (%(default)s); unavailable ones are skipped")
+    ap.add_argument("--apps", default="src", help="directory with safebox and quick_job")
+    ap.add_argument("--rates", default=",".join(map(str, RATES)), help="offered jobs/s, in order")
+    ap.add_argument("--seconds", type=float, default=5.0, help="arrival window per rate")
+    ap.add_argument("--max-inflight", type=int, default=256,
+                    help="most jobs outstanding at once, and threads for blocking entry points")
+    ap.add_argument("--connections", type=int, default=4, help="daemon connections SUBMITs are pipelined over")
+    ap.add_argument("--drain-timeout", type=float, default=30.0, help="wait for in-flight jobs after a step")
+    ap.add_argument("--count", type=int, default=100, help="quick_job's item count")
+    ap.add_argument("--job-cpu", type=int, default=1, help="cpu_percent per job")
+    ap.add_argument("--job-memory", type=int, default=8, help="memory_mb per job")
+    ap.add_argument("--socket", help="use this running safebox-executord instead of starting one")
+    ap.add_argument("--no-daemon", action="store_true",
+                    help="executor uses SystemExecutor's in-process path (root); daemon and api are skipped")
+    ap.add_argument("--executord", default="build/safebox-executord", help="daemon binary to start")
+    ap.add_argument("--cgroup-root", help="the daemon's cgroup root (default: a scratch directory)")
+    ap.add_argument("--pool-cpu", type=int, default=100000, help="started daemon's --cpu pool")
+    ap.add_argument("--pool-memory", type=int, default=1000000, help="started daemon's --memory pool (MB)")
+    ap.add_argument("--api", help="backend base URL for the api entry point, e.g. http://127.0.0.1:8000")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--out", help="write the results as JSON")
+    ap.add_argument("--verbose", action="store_true")
+    opts = ap.parse_args(argv)
+    entries = [e for e in opts.entry.split(",") if e]
+    rates = [float(r) for r in opts.rates.split(",") if r]
+    if any(e not in TARGETS for e in entries) or not rates or min(rates) <= 0:
+        ap.error(f"entry points are {', '.join(ENTRY_POINTS)}; rates must be positive")
+
+    skip = {}
+    if os.geteuid() != 0:
+        skip["safebox"] = "needs root (namespaces and /sys/fs/cgroup)"
+        if opts.no_daemon:
+            skip["executor"] = "the in-process path needs root"
+    if opts.no_daemon:
+        skip["daemon"] = skip["api"] = "--no-daemon"
+    elif not opts.api or not opts.socket:
+        # The backend talks to its own daemon, so WAIT/RELEASE must too
+        skip["api"] = "needs --api and the backend daemon's --socket"
+
+    scratch = tempfile.mkdtemp(prefix="safebox_storm_")
+    daemon = None
+    results = []
+    try:
+        if not opts.no_daemon and not opts.socket and any(e in ("executor", "daemon") for e in entries):
+            daemon = _start_daemon(opts, scratch)
+        if opts.socket:
+            # SystemExecutor finds the daemon through this
+            os.environ["SAFEBOX_EXECUTORD_SOCKET"] = opts.socket
+        opts.cgroup_root = opts.cgroup_root or os.environ.get("SAFEBOX_CGROUP_ROOT", "/sys/fs/cgroup")
+
+        print(f"{'entry':<9} {'offered':>7} {'done/s':>9} {'errors':>6} {'t/o':>5} "
+              f"{'admit50':>8} {'admit99':>8} {'launch50':>8} {'launch99':>8} {'done50':>8} {'done99':>8} "
+              f"{'leaked':>6}")
+        for entry in entries:
+            if entry in skip:
+                print(f"⚠️  {entry}: {skip[entry]}; skipped", file=sys.stderr)
+                continue
+            target = TARGETS[entry](opts)
+            try:
+                results.append(sweep(target, rates, opts, _print_step))
+            finally:
+                target.close()
+    finally:
+        if daemon is not None:
+            daemon.terminate()
+            daemon.wait()
+        shutil.rmtree(scratch, ignore_errors=True)
+
+    for r in results:
+        knee = r["max_sustainable_per_sec"]
+        print(f"{r['entry']}: max sustainable rate "
+              f"{f'below {rates[0]:g}' if knee is None else f'{knee:g}'} jobs/s")
+    doc = {"rates": rates, "seconds": opts.seconds, "count": opts.count, "results": results}
+    print(json.dumps(doc))
+    if opts.out:
+        with open(opts.out, "w") as f:
+            json.dump(doc, f, indent=1)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
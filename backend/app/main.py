@@ -1,57 +1,307 @@
-from fastapi import FastAPI, WebSocket
-from fastapi.responses import JSONResponse
+from fastapi import FastAPI, Query, WebSocket
+from fastapi.responses import JSONResponse, PlainTextResponse
+from pydantic import BaseModel
+from typing import List, Optional
 import asyncio
-from .metrics import collect_system_metrics, collect_cgroup_metrics
+import time
+from . import accounting
+from .executord_client import ExecutordClient, ExecutordError
+from .latency import stages_openmetrics
+from .metrics import collect_system_metrics, collect_job_group_metrics, summarize_job_groups
+from .metrics_hub import MetricsHub
+from .metrics_stream import Subscription
 from .optimizer import Optimizer
 
 app = FastAPI(title="SafeBox Backend", version="0.1.0")
 optimizer = Optimizer()
+metrics_hub = MetricsHub()
 
 
 @app.get("/api/v1/status")
 async def status():
     sys_metrics = collect_system_metrics()
-    cg_metrics = collect_cgroup_metrics("sandbox")
-    # Create a simple utilization summary compatible with docs/snippets
-    mem_current = cg_metrics.get("memory_current") or 0
-    mem_max = cg_metrics.get("memory_max") or 0
-    mem_ratio = (mem_current / mem_max) if (mem_current and mem_max) else 0.0
-
-    cpu_cfg = cg_metrics.get("cpu_max") or {}
-    quota = cpu_cfg.get("quota")
-    period = cpu_cfg.get("period") or 100000
-    cpu_limit_ratio = (quota / period) if (quota is not None and period) else None
-
+    sweep = await asyncio.to_thread(collect_job_group_metrics)
+    summary = summarize_job_groups(sweep)
     return JSONResponse({
         "system_load": sys_metrics.get("load"),
         "memory_info": sys_metrics.get("memory"),
-        "cgroup": cg_metrics,
+        "cgroups": sweep,
+        "cgroup": summary,   # deprecated: the old single-group key, now the job groups' totals
         "resource_utilization": {
-            "memory_usage_ratio": mem_ratio,       # 0.0..1.0 of cgroup cap
-            "cpu_limit_ratio": cpu_limit_ratio     # 0.0..1.0 of one full core equivalent
+            "job_groups": summary["groups"],
+            "memory_usage_ratio": summary["memory_usage_ratio"],   # 0.0..1.0 of the groups' caps
+            "cpu_quota_cores": summary["cpu_quota_cores"],         # sum of cpu.max over the groups
+            "cpu_limit_ratio": summary["cpu_quota_cores"],         # deprecated name of cpu_quota_cores
         }
     })
 
 
 @app.websocket("/ws/metrics")
 async def ws_metrics(ws: WebSocket):
+    """
+    {"system": ..., "cgroups": ..., "seq": n, "t": unix} once a second, plus
+    "cgroup", a deprecated copy of "cgroups" for older clients. Every
+    viewer gets the same frame from one shared sampler (metrics_hub.py); a
+    viewer too slow to keep up skips frames, which shows as gaps in "seq".
+
+    With any of ?groups=, ?fields=, ?every=, ?keyframe= (or ?delta=1) the
+    socket instead carries binary frames with only the chosen values that
+    changed, plus keyframes (metrics_stream.py has the format and a decoder).
+    """
     await ws.accept()
+    params = ws.query_params
+    delta = any(k in params for k in ("delta", "groups", "fields", "every", "keyframe"))
+    try:
+        sub = Subscription.from_query(params) if delta else None
+    except ValueError as e:
+        await ws.send_json({"type": "error", "message": str(e)})
+        await ws.close()
+        return
+    mailbox = metrics_hub.subscribe(sub)
     try:
         while True:
-            data = {
-                "system": collect_system_metrics(),
-                "cgroup": collect_cgroup_metrics("sandbox")
-            }
-            await ws.send_json(data)
-            await asyncio.sleep(1.0)
+            frame = await mailbox.get()
+            if delta:
+                await ws.send_bytes(frame)
+            else:
+                await ws.send_text(frame)
     except Exception:
-        await ws.close()
+        pass
+    finally:
+        metrics_hub.unsubscribe(mailbox)
 
 
 @app.api_route("/api/v1/optimize", methods=["GET", "POST"])
 async def optimize():
-    recommendation = optimizer.compute_recommendation()
-    optimizer.apply(recommendation)
-    return JSONResponse({"applied": recommendation})
+    recommendation = await asyncio.to_thread(optimizer.compute_recommendation)
+    errors = await asyncio.to_thread(optimizer.apply, recommendation)
+    return JSONResponse({"applied": recommendation, "errors": errors})
+
+
+# ----------------------------------------------------------------------
+# Jobs (requires safebox-executord)
+# ----------------------------------------------------------------------
+
+class JobRequest(BaseModel):
+    name: str
+    app_path: str
+    args: List[str] = []
+    # 0 = the app's recommended limit from past runs (see /api/v1/jobs/profile)
+    cpu_percent: int = 0
+    memory_mb: int = 0
+    wall_limit_s: Optional[float] = None
+    cpu_limit_s: Optional[float] = None
+
+
+@app.post("/api/v1/jobs")
+async def submit_job(req: JobRequest):
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        return JSONResponse({"ok": False, "message": "safebox-executord is not running"}, status_code=503)
+    try:
+        ok, msg, job_id = await asyncio.to_thread(
+            client.submit_job, req.name, req.app_path, req.args, req.cpu_percent, req.memory_mb,
+            req.wall_limit_s, req.cpu_limit_s)
+    finally:
+        client.close()
+    return JSONResponse({"ok": ok, "message": msg, "job_id": job_id}, status_code=200 if ok else 409)
+
+
+class JobArrayRequest(JobRequest):
+    count: int
+
+
+@app.post("/api/v1/job-arrays")
+async def submit_job_array(req: JobArrayRequest):
+    """Admit req.count copies of one job all-or-none; members stream like any job."""
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        return JSONResponse({"ok": False, "message": "safebox-executord is not running"}, status_code=503)
+    try:
+        ok, msg, array_id, job_ids = await asyncio.to_thread(
+            client.submit_array, req.name, req.count, req.app_path, req.args, req.cpu_percent,
+            req.memory_mb, req.wall_limit_s, req.cpu_limit_s)
+    finally:
+        client.close()
+    return JSONResponse({"ok": ok, "message": msg, "array_id": array_id, "job_ids": job_ids},
+                        status_code=200 if ok else 409)
+
+
+@app.get("/api/v1/jobs/accounting")
+async def job_accounting(name: Optional[str] = None, limit: int = 100):
+    """Exit records written by safebox-executord, newest first."""
+    try:
+        records = await asyncio.to_thread(accounting.query, name, limit)
+    except FileNotFoundError:
+        records = []
+    except accounting.AccountingError as e:
+        return JSONResponse({"ok": False, "message": str(e)}, status_code=500)
+    return JSONResponse({"ok": True, "records": records})
+
+
+@app.get("/api/v1/jobs/profile")
+async def job_profile(app_path: Optional[str] = None):
+    """Per-app usage quantiles and recommended limits, from exit accounting."""
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        return JSONResponse({"ok": False, "message": "safebox-executord is not running"}, status_code=503)
+    try:
+        profile = await asyncio.to_thread(client.get_profile, app_path)
+    except ExecutordError as e:
+        return JSONResponse({"ok": False, "message": str(e)}, status_code=409)
+    finally:
+        client.close()
+    return JSONResponse({"ok": True, "profiles": profile if app_path is None else {app_path: profile}})
+
 
+@app.get("/api/v1/jobs/controller")
+async def job_controller(limit: int = 100):
+    """Limits the closed-loop controller currently holds, and its newest decisions."""
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        return JSONResponse({"ok": False, "message": "safebox-executord is not running"}, status_code=503)
+    try:
+        controller = await asyncio.to_thread(client.get_controller, limit)
+    except ExecutordError as e:
+        return JSONResponse({"ok": False, "message": str(e)}, status_code=409)
+    finally:
+        client.close()
+    return JSONResponse({"ok": True, "controller": controller})
+
+
+@app.get("/api/v1/jobs/{job_id}/cpu-profile")
+async def job_cpu_profile(job_id: int, seconds: int = 10, format: str = "folded", hz: int = 99):
+    """
+    Sample the job for `seconds` and return its symbolised stacks: folded
+    text (flamegraph.pl) or, with format=speedscope, a speedscope document.
+    """
+    if format not in ("folded", "speedscope"):
+        return JSONResponse({"ok": False, "message": "format must be folded or speedscope"}, status_code=400)
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        return JSONResponse({"ok": False, "message": "safebox-executord is not running"}, status_code=503)
+    try:
+        r = await asyncio.to_thread(client.cpu_profile, job_id, seconds, format, hz)
+    except ExecutordError as e:
+        return JSONResponse({"ok": False, "message": str(e)}, status_code=409)
+    finally:
+        client.close()
+    if format == "folded":
+        return PlainTextResponse(r["profile"])
+    return JSONResponse(r["profile"])
+
+
+@app.get("/api/v1/metrics/latency")
+async def metrics_latency(format: str = "json"):
+    """
+    The daemon's per-stage job latency (admission, cgroup, launch,
+    completion) since it started: p50..p999 and buckets in ns, or with
+    format=openmetrics an exposition a Prometheus-style scraper can take.
+    """
+    if format not in ("json", "openmetrics"):
+        return JSONResponse({"ok": False, "message": "format must be json or openmetrics"}, status_code=400)
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        return JSONResponse({"ok": False, "message": "safebox-executord is not running"}, status_code=503)
+    try:
+        stages = await asyncio.to_thread(client.latency)
+    except ExecutordError as e:
+        return JSONResponse({"ok": False, "message": str(e)}, status_code=409)
+    finally:
+        client.close()
+    if format == "openmetrics":
+        return PlainTextResponse(stages_openmetrics(stages),
+                                 media_type="application/openmetrics-text; version=1.0.0; charset=utf-8")
+    return JSONResponse({"ok": True, "stages": {name: s.to_json() for name, s in stages.items()}})
+
+
+def metric_series(group: str, metric: str) -> str:
+    """The daemon's series for ?group=host|<job id>|safebox_job_<id>&metric=..."""
+    if group == "host":
+        return f"host.{metric}"
+    job_id = group[len("safebox_job_"):] if group.startswith("safebox_job_") else group
+    if not job_id.isdigit():
+        raise ValueError(f"unknown group {group!r}: expected host, a job id or safebox_job_<id>")
+    return f"job.{int(job_id)}.{metric}"
+
+
+@app.get("/api/v1/metrics/query")
+async def metrics_query(group: str, metric: str, from_: Optional[float] = Query(None, alias="from"),
+                        to: Optional[float] = None, step: float = 0):
+    """
+    min/max/avg/p95 of one metric per step over [from, to] (epoch seconds;
+    the last hour by default). The step is rounded up to the daemon's next
+    rollup (10 s, 1 min, 10 min, or a multiple of it), and 0 picks about 300
+    points, so a 24 h panel reads 144 ten-minute buckets.
+    """
+    try:
+        series = metric_series(group, metric)
+    except ValueError as e:
+        return JSONResponse({"ok": False, "message": str(e)}, status_code=400)
+    to = time.time() if to is None else to
+    from_ = to - 3600 if from_ is None else from_
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        return JSONResponse({"ok": False, "message": "safebox-executord is not running"}, status_code=503)
+    try:
+        step_ms, points = await asyncio.to_thread(
+            client.query_rollups, series, int(from_ * 1000), int(to * 1000), int(step * 1000))
+    except ExecutordError as e:
+        return JSONResponse({"ok": False, "message": str(e)}, status_code=409)
+    finally:
+        client.close()
+    return JSONResponse({
+        "ok": True,
+        "series": series,
+        "step": step_ms / 1000,
+        "points": [{"t": t / 1000, "min": lo, "max": hi, "avg": avg, "p95": p95}
+                   for t, lo, hi, avg, p95 in points],
+    })
 
+
+@app.websocket("/ws/jobs/{job_id}/output")
+async def ws_job_output(ws: WebSocket, job_id: int):
+    """
+    Stream a job's stdout/stderr as it is produced.
+
+    Frames: {"type": "output", "stream": "stdout"|"stderr", "data": ...},
+    {"type": "skipped", "stream": ..., "bytes": n} when this client fell
+    behind the daemon's ring buffer, and a final {"type": "exit", ...}.
+    The daemon never buffers on behalf of a slow socket: we only ask for
+    the next chunk once the previous one has been sent.
+    """
+    await ws.accept()
+    # One connection per socket: OUTPUT long-polls and would otherwise
+    # serialise every viewer behind the slowest job
+    client = ExecutordClient.connect_if_running()
+    if client is None:
+        await ws.send_json({"type": "error", "message": "safebox-executord is not running"})
+        await ws.close()
+        return
+    offsets = {"stdout": 0, "stderr": 0}
+    try:
+        while True:
+            r = await asyncio.to_thread(
+                client.read_output, job_id, offsets["stdout"], offsets["stderr"], 1000)
+            if not r.get("ok"):
+                await ws.send_json({"type": "error", "message": r.get("message")})
+                break
+            for stream in ("stdout", "stderr"):
+                if r[f"skipped_{stream}"]:
+                    await ws.send_json({"type": "skipped", "stream": stream, "bytes": r[f"skipped_{stream}"]})
+                if r[stream]:
+                    await ws.send_json({"type": "output", "stream": stream, "data": r[stream]})
+                offsets[stream] = r[f"{stream}_offset"]
+            # "exited" is only set once both streams have been read to the end
+            if r["exited"]:
+                await ws.send_json({"type": "exit", "exit_code": r["exit_code"], "signal": r["signal"],
+                                    "deadline": r["deadline"]})
+                break
+        await ws.close()
+    except (OSError, ExecutordError) as e:
+        await ws.send_json({"type": "error", "message": str(e)})
+        await ws.close()
+    except Exception:
+        pass
+    finally:
+        client.close()
@@ -1,8 +1,15 @@
 import os
 import platform
+import time
+from typing import Dict, List, Optional
+
 import psutil
 
 
+# Groups the native executor creates: one per job, one per job array
+JOB_GROUP_PREFIXES = ("safebox_job_", "safebox_array_")
+
+
 def collect_system_metrics() -> dict:
     load = os.getloadavg() if hasattr(os, "getloadavg") else (0.0, 0.0, 0.0)
     vm = psutil.virtual_memory()
@@ -66,3 +73,113 @@ def collect_cgroup_metrics(group_name: str) -> dict:
     return metrics
 
 
+
+
+def cgroup_root() -> str:
+    return os.environ.get("SAFEBOX_CGROUP_ROOT") or "/sys/fs/cgroup"
+
+
+def discover_job_groups(root: Optional[str] = None) -> List[str]:
+    """Every safebox_job_<id> / safebox_array_<id> group directly under the root."""
+    try:
+        with os.scandir(root or cgroup_root()) as it:
+            return sorted(e.name for e in it if e.name.startswith(JOB_GROUP_PREFIXES) and e.is_dir())
+    except OSError:
+        return []
+
+
+def _read_at(dir_fd: int, name: str) -> Optional[str]:
+    try:
+        fd = os.open(name, os.O_RDONLY, dir_fd=dir_fd)
+    except OSError:
+        return None
+    try:
+        return os.read(fd, 4096).decode()
+    except OSError:
+        return None
+    finally:
+        os.close(fd)
+
+
+def _int_or_none(text: Optional[str]) -> Optional[int]:
+    try:
+        return int(text) if text is not None else None
+    except ValueError:
+        return None  # "max"
+
+
+def _kv(text: Optional[str]) -> Dict[str, int]:
+    data = {}
+    for line in (text or "").splitlines():
+        parts = line.split()
+        if len(parts) == 2 and parts[1].isdigit():
+            data[parts[0]] = int(parts[1])
+    return data
+
+
+def _pressure_totals(text: Optional[str]) -> Dict[str, int]:
+    """'some avg10=0.00 ... total=1234' lines -> {"some": 1234, "full": ...} (microseconds)."""
+    data = {}
+    for line in (text or "").splitlines():
+        parts = line.split()
+        for field in parts[1:]:
+            if field.startswith("total=") and field[6:].isdigit():
+                data[parts[0]] = int(field[6:])
+    return data
+
+
+def read_job_group(root: str, group: str) -> Optional[dict]:
+    """
+    One group's limits and cumulative counters, read relative to a single
+    directory fd. None when the group has gone away.
+    """
+    try:
+        dir_fd = os.open(os.path.join(root, group), os.O_RDONLY | os.O_DIRECTORY)
+    except OSError:
+        return None
+    try:
+        cpu_max = None
+        parts = (_read_at(dir_fd, "cpu.max") or "").split()
+        if len(parts) == 2:
+            cpu_max = {"quota": _int_or_none(parts[0]), "period": int(parts[1])}
+        return {
+            "t": time.monotonic(),
+            "cpu_max": cpu_max,
+            "cpu_stat": _kv(_read_at(dir_fd, "cpu.stat")),
+            "cpu_pressure": _pressure_totals(_read_at(dir_fd, "cpu.pressure")),
+            "memory_current": _int_or_none(_read_at(dir_fd, "memory.current")),
+            "memory_max": _int_or_none(_read_at(dir_fd, "memory.max")),
+            "memory_high": _int_or_none(_read_at(dir_fd, "memory.high")),
+            "memory_events": _kv(_read_at(dir_fd, "memory.events")),
+        }
+    finally:
+        os.close(dir_fd)
+
+
+def collect_job_group_metrics(root: Optional[str] = None) -> Dict[str, dict]:
+    """One sweep over every managed job group: {group: read_job_group()}."""
+    root = root or cgroup_root()
+    sweep = {}
+    for group in discover_job_groups(root):
+        m = read_job_group(root, group)
+        if m is not None:
+            sweep[group] = m
+    return sweep
+
+
+def summarize_job_groups(sweep: Dict[str, dict]) -> dict:
+    """Totals over a sweep: memory in use against the caps, CPU quota in cores."""
+    mem_current = sum(m.get("memory_current") or 0 for m in sweep.values())
+    mem_max = sum(m.get("memory_max") or 0 for m in sweep.values())
+    cpu_quota = 0.0
+    for m in sweep.values():
+        cpu = m.get("cpu_max") or {}
+        if cpu.get("quota") is not None and cpu.get("period"):
+            cpu_quota += cpu["quota"] / cpu["period"]
+    return {
+        "groups": len(sweep),
+        "memory_current": mem_current,
+        "memory_max": mem_max,
+        "memory_usage_ratio": (mem_current / mem_max) if mem_max else 0.0,
+        "cpu_quota_cores": cpu_quota,
+    }
@@ -0,0 +1,173 @@
+"""
+One sampler for every /ws/metrics viewer.
+
+The hub collects the host and job-group metrics once per period and fans
+the result out, so the cost of sampling does not grow with the number of
+dashboards. Each subscriber has a one-frame mailbox, and the sampler only
+runs while someone is subscribed.
+
+Plain viewers get the JSON frame, serialised once for all of them; one that
+has not sent the previous frame by the time the next is ready has it
+replaced, and the frame's "seq" tells it how many it missed.
+
+Subscribers with a Subscription (metrics_stream.py) get binary delta frames.
+Viewers with the same subscription share a channel, which encodes each
+frame once. A delta cannot be skipped, so a viewer that falls behind gets
+the channel's current keyframe in place of the frame it missed.
+"""
+
+import asyncio
+import json
+import time
+from typing import Callable, Dict, Optional, Set
+
+from .metrics import collect_job_group_metrics, collect_system_metrics, summarize_job_groups
+from .metrics_stream import FrameEncoder, Subscription, flatten
+
+
+def collect_frame() -> dict:
+    sweep = collect_job_group_metrics()
+    return {
+        "system": collect_system_metrics(),
+        "cgroups": summarize_job_groups(sweep),
+        "groups": sweep,    # only delta subscribers see these
+    }
+
+
+class _Mailbox:
+    def __init__(self):
+        self.queue: asyncio.Queue = asyncio.Queue(maxsize=1)
+        self.resync = True     # next frame must be a keyframe
+
+    async def get(self):
+        return await self.queue.get()
+
+
+class _Channel:
+    """Subscribers sharing one Subscription, and its encoder."""
+
+    def __init__(self, sub: Subscription):
+        self.sub = sub
+        self.encoder = FrameEncoder()
+        self.mailboxes: Set[_Mailbox] = set()
+        self.wanted: Dict[str, bool] = {}   # Subscription.wants() by key
+        self.ticks = 0
+        self.frames = 0
+        self.bytes = 0          # encoded, once per frame however many receive it
+
+    def tick(self, flat: dict, seq: int, t: float) -> int:
+        """Encode and hand out this period's frame; returns frames replaced."""
+        self.ticks += 1
+        if (self.ticks - 1) % self.sub.every:
+            return 0
+        periodic = self.frames % self.sub.keyframe == 0
+        if periodic:
+            self.wanted.clear()   # forget keys of groups that have gone
+        values = {}
+        for k, v in flat.items():
+            want = self.wanted.get(k)
+            if want is None:
+                want = self.wanted[k] = self.sub.wants(k)
+            if want:
+                values[k] = v
+        delta = self.encoder.update(values, seq, t)
+        self.frames += 1
+        keyframe = self.encoder.keyframe(seq, t, renumber=True) if periodic else None
+        self.bytes += len(keyframe or delta)
+        dropped = 0
+        for box in self.mailboxes:
+            if box.queue.full():
+                box.queue.get_nowait()
+                box.resync = True
+                dropped += 1
+            if box.resync and keyframe is None:
+                keyframe = self.encoder.keyframe(seq, t)
+            box.queue.put_nowait(keyframe if box.resync or periodic else delta)
+            box.resync = False
+        return dropped
+
+
+class MetricsHub:
+    def __init__(self, collect: Callable[[], dict] = collect_frame, period: float = 1.0):
+        self.collect = collect
+        self.period = period
+        self.seq = 0
+        self.frames = 0         # frames produced
+        self.dropped = 0        # frames replaced before a slow client sent them
+        self._subscribers: Set[asyncio.Queue] = set()
+        self._channels: Dict[tuple, _Channel] = {}
+        self._latest: Optional[str] = None
+        self._task: Optional[asyncio.Task] = None
+
+    def subscribe(self, sub: Optional[Subscription] = None):
+        """
+        A mailbox (await .get()) that receives every frame from now on:
+        the JSON frame, starting with the latest, or with `sub` the binary
+        stream, starting with a keyframe at the channel's next frame.
+        """
+        if sub is None:
+            box = asyncio.Queue(maxsize=1)
+            if self._latest is not None:
+                box.put_nowait(self._latest)
+            self._subscribers.add(box)
+        else:
+            channel = self._channels.get(sub.key())
+            if channel is None:
+                channel = self._channels[sub.key()] = _Channel(sub)
+            box = _Mailbox()
+            channel.mailboxes.add(box)
+        if self._task is None or self._task.done():
+            self._task = asyncio.get_running_loop().create_task(self._run())
+        return box
+
+    def unsubscribe(self, box) -> None:
+        self._subscribers.discard(box)
+        for key, channel in list(self._channels.items()):
+            channel.mailboxes.discard(box)
+            if not channel.mailboxes:
+                del self._channels[key]
+        if not self._subscribers and not self._channels and self._task is not None:
+            self._task.cancel()
+            self._task = None
+            self._latest = None
+
+    def stats(self) -> Dict[str, int]:
+        return {
+            "subscribers": len(self._subscribers) + sum(len(c.mailboxes) for c in self._channels.values()),
+            "channels": len(self._channels),
+            "frames": self.frames,
+            "dropped": self.dropped,
+            "stream_bytes": sum(c.bytes for c in self._channels.values()),
+        }
+
+    def publish(self, frame: str) -> None:
+        self._latest = frame
+        for queue in self._subscribers:
+            if queue.full():
+                queue.get_nowait()
+                self.dropped += 1
+            queue.put_nowait(frame)
+
+    async def _run(self) -> None:
+        loop = asyncio.get_running_loop()
+        next_at = loop.time()
+        while self._subscribers or self._channels:
+            data = await asyncio.to_thread(self.collect)
+            self.seq += 1
+            self.frames += 1
+            t = time.time()
+            if self._subscribers:
+                # "cgroup" is the pre-job-group key, kept for one release
+                self.publish(json.dumps({"system": data.get("system"), "cgroups": data.get("cgroups"),
+                                         "cgroup": data.get("cgroups"), "seq": self.seq, "t": t}))
+            if self._channels:
+                flat = flatten(data)
+                for channel in list(self._channels.values()):
+                    self.dropped += channel.tick(flat, self.seq, t)
+            # On the period's grid, not period-after-collection; a slow
+            # collection skips ticks instead of piling them up
+            next_at += self.period
+            now = loop.time()
+            if next_at < now:
+                next_at = now
+            await asyncio.sleep(next_at - now)
@@ -0,0 +1,279 @@
+"""
+Delta-encoded /ws/metrics subscriptions.
+
+A client picks the job groups and fields it wants and how often, and gets
+binary frames carrying only the values that changed since the previous
+frame, with a full keyframe every so often and whenever it fell behind.
+
+Every metric is a flat key: "system.load.1m", "cgroups.memory_usage_ratio",
+"group.<cgroup>.cpu_stat.usage_usec". A subscription's `fields` are key
+prefixes, matched against group keys with the cgroup name taken out
+("group.memory_current" selects every group's memory.current); `groups`
+limits which cgroups are included at all.
+
+Frame layout (little-endian):
+
+    header   "SM" u8 kind (0 keyframe, 1 delta) u8 version u32 seq f64 t
+             u32 new_keys u32 values u32 removed
+    new_keys varint index, u8 shared, varint length, UTF-8 suffix
+                                   (a keyframe lists all keys)
+    values   varint index, u8 tag, payload
+    removed  varint index
+
+A new key is sent as the length of the prefix it shares with the key before
+it in the same frame plus the rest, so a group's keys cost little more than
+their last component. Tags: 0 null, 1 int (zigzag varint), 2 int as a zigzag varint difference from
+the key's previous value, 3 float64, 4 string (varint length, UTF-8),
+5 true, 6 false. Counters that grow by about the same amount each frame thus
+cost a few bytes. Key indexes are only valid until the next keyframe, which
+may renumber them.
+"""
+
+import struct
+from typing import Dict, Iterable, List, Optional, Tuple, Union
+
+Scalar = Union[None, bool, int, float, str]
+
+MAGIC = b"SM"
+VERSION = 1
+KEYFRAME, DELTA = 0, 1
+HEADER = struct.Struct("<2sBBIdIII")
+FLOAT = struct.Struct("<d")
+
+T_NULL, T_INT, T_INT_DELTA, T_FLOAT, T_STR, T_TRUE, T_FALSE = range(7)
+
+DEFAULT_KEYFRAME_S = 30
+
+
+class Subscription:
+    """What a client asked for; equal subscriptions share one encoder."""
+
+    def __init__(self, groups: Optional[Iterable[str]] = None, fields: Optional[Iterable[str]] = None,
+                 every: int = 1, keyframe: int = DEFAULT_KEYFRAME_S):
+        self.groups = frozenset(groups) if groups else None
+        self.fields = tuple(sorted(set(fields))) if fields else None
+        self.every = max(1, int(every))                               # hub periods per frame
+        self.keyframe = max(1, int(keyframe) // self.every)           # frames per keyframe
+
+    @classmethod
+    def from_query(cls, params) -> "Subscription":
+        """?groups=a,b&fields=system.load,group.memory_current&every=5&keyframe=60"""
+        def split(name: str) -> Optional[List[str]]:
+            value = params.get(name)
+            return [v for v in value.split(",") if v] if value else None
+        return cls(split("groups"), split("fields"), int(params.get("every", 1)),
+                   int(params.get("keyframe", DEFAULT_KEYFRAME_S)))
+
+    def key(self) -> tuple:
+        return (self.groups, self.fields, self.every, self.keyframe)
+
+    def wants(self, key: str) -> bool:
+        if key.startswith("group."):
+            name, _, rest = key[6:].partition(".")
+            if self.groups is not None and name not in self.groups:
+                return False
+            key = "group." + rest
+        return self.fields is None or any(key == f or key.startswith(f + ".") for f in self.fields)
+
+
+def flatten(frame: dict) -> Dict[str, Scalar]:
+    """collect_frame() output -> flat keys; the groups' monotonic "t" is left out."""
+    out: Dict[str, Scalar] = {}
+
+    def walk(prefix: str, value) -> None:
+        if isinstance(value, dict):
+            for k, v in value.items():
+                walk(f"{prefix}.{k}", v)
+        else:
+            out[prefix] = value
+
+    walk("system", frame.get("system", {}))
+    walk("cgroups", frame.get("cgroups", {}))
+    for group, m in frame.get("groups", {}).items():
+        for k, v in m.items():
+            if k != "t":
+                walk(f"group.{group}.{k}", v)
+    return out
+
+
+def _varint(n: int, out: bytearray) -> None:
+    while n >= 0x80:
+        out.append((n & 0x7F) | 0x80)
+        n >>= 7
+    out.append(n)
+
+
+def _key(i: int, key: bytes, previous: bytes, out: bytearray) -> None:
+    shared = 0
+    limit = min(len(key), len(previous), 127)
+    while shared < limit and key[shared] == previous[shared]:
+        shared += 1
+    _varint(i, out)
+    out.append(shared)
+    _varint(len(key) - shared, out)
+    out += key[shared:]
+
+
+def _zigzag(n: int) -> int:
+    return (n << 1) if n >= 0 else ((-n << 1) - 1)
+
+
+def _value(v: Scalar, previous: Scalar, out: bytearray) -> None:
+    if v is None:
+        out.append(T_NULL)
+    elif v is True:
+        out.append(T_TRUE)
+    elif v is False:
+        out.append(T_FALSE)
+    elif isinstance(v, int):
+        if isinstance(previous, int) and not isinstance(previous, bool):
+            out.append(T_INT_DELTA)
+            _varint(_zigzag(v - previous), out)
+        else:
+            out.append(T_INT)
+            _varint(_zigzag(v), out)
+    elif isinstance(v, float):
+        out.append(T_FLOAT)
+        out += FLOAT.pack(v)
+    else:
+        data = str(v).encode()
+        out.append(T_STR)
+        _varint(len(data), out)
+        out += data
+
+
+class FrameEncoder:
+    """Key table and last values of one subscription's stream."""
+
+    def __init__(self):
+        self.index: Dict[str, int] = {}
+        self.values: Dict[str, Scalar] = {}
+        self.free: List[int] = []    # indexes of removed keys, reused from the next frame on
+        self.next = 0
+
+    def keyframe(self, seq: int, t: float, renumber: bool = False) -> bytes:
+        """
+        Every current value. With `renumber` the keys are numbered densely
+        again, which every subscriber has to see; a keyframe that resyncs
+        one subscriber keeps the numbering the others' deltas use.
+        """
+        if renumber:
+            self.index = {k: i for i, k in enumerate(self.values)}
+            self.free = []
+            self.next = len(self.index)
+        body = bytearray()
+        previous = b""
+        for k, i in self.index.items():
+            data = k.encode()
+            _key(i, data, previous, body)
+            previous = data
+        for k, i in self.index.items():
+            _varint(i, body)
+            _value(self.values[k], None, body)
+        n = len(self.index)
+        return HEADER.pack(MAGIC, KEYFRAME, VERSION, seq, t, n, n, 0) + bytes(body)
+
+    def update(self, values: Dict[str, Scalar], seq: int, t: float) -> bytes:
+        """Adopt `values` and return the delta frame from the previous ones."""
+        keys, changed, removed = bytearray(), bytearray(), bytearray()
+        n_keys = n_changed = n_removed = 0
+        # Decoders drop removed keys last, so their indexes wait a frame
+        freed = []
+        previous_key = b""
+        for k in [k for k in self.values if k not in values]:
+            i = self.index.pop(k)
+            del self.values[k]
+            freed.append(i)
+            _varint(i, removed)
+            n_removed += 1
+        for k, v in values.items():
+            i = self.index.get(k)
+            if i is None:
+                if self.free:
+                    i = self.free.pop()
+                else:
+                    i, self.next = self.next, self.next + 1
+                self.index[k] = i
+                data = k.encode()
+                _key(i, data, previous_key, keys)
+                previous_key = data
+                n_keys += 1
+                previous = None
+            else:
+                previous = self.values[k]
+                if previous == v and type(previous) is type(v):
+                    continue
+            _varint(i, changed)
+            _value(v, previous, changed)
+            n_changed += 1
+            self.values[k] = v
+        self.free += freed
+        return HEADER.pack(MAGIC, DELTA, VERSION, seq, t, n_keys, n_changed, n_removed) + \
+            bytes(keys) + bytes(changed) + bytes(removed)
+
+
+class FrameDecoder:
+    """Client side: apply frames in order; `values` is the current state."""
+
+    def __init__(self):
+        self.keys: Dict[int, str] = {}
+        self.values: Dict[str, Scalar] = {}
+        self.seq = 0
+        self.t = 0.0
+
+    def apply(self, frame: bytes) -> Tuple[int, Dict[str, Scalar]]:
+        magic, kind, version, self.seq, self.t, n_keys, n_values, n_removed = HEADER.unpack_from(frame)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("not a metrics stream frame")
+        pos = HEADER.size
+
+        def varint() -> int:
+            nonlocal pos
+            n, shift = 0, 0
+            while True:
+                b = frame[pos]
+                pos += 1
+                n |= (b & 0x7F) << shift
+                if b < 0x80:
+                    return n
+                shift += 7
+
+        def zigzag() -> int:
+            n = varint()
+            return (n >> 1) ^ -(n & 1)
+
+        if kind == KEYFRAME:
+            self.keys, self.values = {}, {}
+        previous = b""
+        for _ in range(n_keys):
+            i = varint()
+            shared = frame[pos]
+            pos += 1
+            length = varint()
+            key = previous[:shared] + frame[pos:pos + length]
+            pos += length
+            self.keys[i] = key.decode()
+            previous = key
+        for _ in range(n_values):
+            key = self.keys[varint()]
+            tag = frame[pos]
+            pos += 1
+            if tag == T_NULL:
+                v: Scalar = None
+            elif tag == T_INT:
+                v = zigzag()
+            elif tag == T_INT_DELTA:
+                v = self.values[key] + zigzag()
+            elif tag == T_FLOAT:
+                v = FLOAT.unpack_from(frame, pos)[0]
+                pos += FLOAT.size
+            elif tag == T_STR:
+                length = varint()
+                v = frame[pos:pos + length].decode()
+                pos += length
+            else:
+                v = tag == T_TRUE
+            self.values[key] = v
+        for _ in range(n_removed):
+            self.values.pop(self.keys.pop(varint()), None)
+        return self.seq, self.values
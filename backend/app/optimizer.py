@@ -1,55 +1,176 @@
-from .metrics import collect_system_metrics, collect_cgroup_metrics
-from .cgroups_client import CgroupClient
+"""
+Optimizer over every job cgroup the executor manages.
 
+Each cycle discovers all safebox_job_<id> / safebox_array_<id> groups, reads
+them in one sweep and computes a global CPU allocation: every group gets
+what it needs up to its Banker reservation, and the slack idle groups leave
+is lent to throttled groups in proportion to how far short they are, so the
+quotas never add up to more than the reservations. memory.max stays at the
+reservation; memory.high follows usage inside it.
 
-class Optimizer:
-    def __init__(self, group_name: str = "sandbox") -> None:
-        self.group_name = group_name
-        self.client = CgroupClient()
+This is the on-demand counterpart of the daemon's --controller loop
+(cgroup_agent/src/controller.cpp, same policy at 100 ms). When that loop is
+running it owns the limits, and compute_recommendation() only reports it.
+"""
 
-    def compute_recommendation(self) -> dict:
-        sys_m = collect_system_metrics()
-        cg_m = collect_cgroup_metrics(self.group_name)
+import math
+from typing import Dict, List, Optional, Tuple
+
+from .cgroups_client import CgroupClient
+from .executord_client import ExecutordClient, ExecutordError
+from .metrics import cgroup_root, collect_job_group_metrics
+
+PERIOD = 100000
+THROTTLE_TARGET = 0.05   # share of the interval a group may spend throttled or stalled
+KP = 0.8                 # relative quota change per unit of throttling error
+RELEASE = 0.3            # share of unused quota given up per cycle
+HEADROOM = 1.25          # quota >= measured usage x this
+MEM_HEADROOM = 1.5       # memory.high target over memory.current
 
-        mem_used = cg_m.get("memory_current") or 0
-        mem_max = cg_m.get("memory_max") or 0
 
-        recommendation: dict = {"group": self.group_name}
+class Optimizer:
+    def __init__(self, cgroup_root_dir: Optional[str] = None, client: Optional[CgroupClient] = None) -> None:
+        self.root = cgroup_root_dir or cgroup_root()
+        self.client = client or CgroupClient()
+        self._last: Dict[str, dict] = {}              # previous sweep, per group
+        self._reserved: Dict[str, Tuple[int, int]] = {}  # first-seen limits when no daemon
 
-        # Simple policy: if memory usage > 80% of cap, raise by 20%, else if < 40%, lower by 10%
-        if mem_max and mem_used:
-            ratio = mem_used / max(1, mem_max)
-            if ratio > 0.8:
-                recommendation["memory.max"] = int(mem_max * 1.2)
-            elif ratio < 0.4:
-                recommendation["memory.max"] = int(mem_max * 0.9)
+    def _reservations(self, sweep: Dict[str, dict]) -> Dict[str, Tuple[int, int]]:
+        """(cpu_percent, memory_bytes) the Banker granted each group."""
+        reserved: Dict[str, Tuple[int, int]] = {}
+        daemon = ExecutordClient.connect_if_running()
+        if daemon is not None:
+            try:
+                state = daemon.get_system_state()
+            except (OSError, ExecutordError):
+                state = {}
+            finally:
+                daemon.close()
+            for job in state.get("jobs", {}).values():
+                if "array" not in job:
+                    reserved[job["cgroup"]] = (job["cpu"], job["memory"] << 20)
+            for arr in state.get("arrays", {}).values():
+                reserved[arr["cgroup"]] = (arr["cpu"] * arr["count"], (arr["memory"] * arr["count"]) << 20)
+        # Without the daemon the limits a group had when first seen stand in
+        for group, m in sweep.items():
+            if group in reserved:
+                continue
+            if group not in self._reserved:
+                cpu = m.get("cpu_max") or {}
+                quota = cpu.get("quota")
+                cpu_pct = math.ceil(100 * quota / cpu["period"]) if quota is not None else 100
+                self._reserved[group] = (cpu_pct, m.get("memory_max") or 0)
+            reserved[group] = self._reserved[group]
+        return reserved
 
-        # CPU: if system load 1m > logical cores, increase to 80%; else 50%
-        cpu_target_quota = None
-        load1 = sys_m.get("load", {}).get("1m", 0.0)
+    @staticmethod
+    def _daemon_controller() -> Optional[dict]:
+        daemon = ExecutordClient.connect_if_running()
+        if daemon is None:
+            return None
         try:
-            import psutil
-
-            cores = psutil.cpu_count(logical=True) or 1
-        except Exception:
-            cores = 1
-        busy = load1 > cores
-        period = 100000
-        if busy:
-            cpu_target_quota = int(0.8 * period)
+            return daemon.get_controller(limit=20)
+        except (OSError, ExecutordError):
+            return None
+        finally:
+            daemon.close()
+
+    def _cpu_want(self, group: str, m: dict, reserved_cpu: int) -> Optional[dict]:
+        """PI-lite step on one group; None until there are two samples."""
+        last = self._last.get(group)
+        cpu = m.get("cpu_max") or {}
+        stat, prev = m.get("cpu_stat", {}), (last or {}).get("cpu_stat", {})
+        if last is None or cpu.get("quota") is None or "usage_usec" not in stat or "usage_usec" not in prev:
+            return None
+        dt_us = max(1.0, (m["t"] - last["t"]) * 1e6)
+        used = 100.0 * (stat["usage_usec"] - prev["usage_usec"]) / dt_us
+        throttled = min(1.0, (stat.get("throttled_usec", 0) - prev.get("throttled_usec", 0)) / dt_us)
+        hit = stat.get("nr_throttled", 0) > prev.get("nr_throttled", 0)
+        # cpu.pressure only means the quota is short if the group also hit it
+        psi, prev_psi = m.get("cpu_pressure", {}), last.get("cpu_pressure", {})
+        stalled = 0.0
+        if "some" in psi and "some" in prev_psi:
+            stalled = min(1.0, max(0, psi["some"] - prev_psi["some"]) / dt_us)
+        pressure = max(throttled, stalled) if hit or throttled > 0 else throttled
+        quota = 100.0 * cpu["quota"] / cpu["period"]
+
+        if pressure > THROTTLE_TARGET:
+            want = quota * (1 + KP * (pressure - THROTTLE_TARGET))
+            if throttled > 0.5:  # it was lending and needs its share back now
+                want = max(want, reserved_cpu)
         else:
-            cpu_target_quota = int(0.5 * period)
-        recommendation["cpu.max"] = {"quota": cpu_target_quota, "period": period}
+            want = quota - RELEASE * (quota - used * HEADROOM)
+        want = max(want, used * HEADROOM, max(1, reserved_cpu // 10))
+        return {"quota": quota, "want": math.ceil(want), "used": used, "throttled": throttled, "stalled": stalled}
+
+    def compute_recommendation(self) -> dict:
+        controller = self._daemon_controller()
+        if controller is not None:
+            return {"managed_by": "safebox-executord --controller", "controller": controller}
+
+        sweep = collect_job_group_metrics(self.root)
+        plan = self.plan(sweep, self._reservations(sweep))
+        self._reserved = {g: r for g, r in self._reserved.items() if g in sweep}
+        return plan
 
-        return recommendation
+    def plan(self, sweep: Dict[str, dict], reserved: Dict[str, Tuple[int, int]]) -> dict:
+        """
+        One cycle over a sweep (collect_job_group_metrics() shape) given each
+        group's (cpu_percent, memory_bytes) reservation. No I/O, so recorded
+        sweeps can be replayed through it (app.replay_policy).
+        """
+        total_cpu = sum(reserved[g][0] for g in sweep)
+        wants = {g: self._cpu_want(g, m, reserved[g][0]) for g, m in sweep.items()}
+        self._last = sweep
 
-    def apply(self, plan: dict) -> None:
-        mem = plan.get("memory.max")
-        if mem is not None:
-            self.client.set_memory_max(self.group_name, mem)
+        # Own reservation first, then lend what the rest hold back. A group
+        # seen for the first time keeps its quota up to its reservation;
+        # anything above that was borrowed before this sweep and is a
+        # shortfall like any other, as in allocate_cpu().
+        for g, w in wants.items():
+            cpu = sweep[g].get("cpu_max") or {}
+            if w is None and cpu.get("quota") is not None:
+                quota = math.ceil(100 * cpu["quota"] / cpu["period"])
+                if quota > reserved[g][0]:
+                    wants[g] = {"quota": quota, "want": quota, "first": True}
+        pool = sum(reserved[g][0] - min(w["want"], reserved[g][0]) for g, w in wants.items() if w and "first" not in w)
+        short = sum(max(0, w["want"] - reserved[g][0]) for g, w in wants.items() if w)
+        share = pool / short if short > pool else 1.0
 
-        cpu = plan.get("cpu.max")
-        if isinstance(cpu, dict) and cpu.get("quota") is not None:
-            self.client.set_cpu_max(self.group_name, int(cpu["quota"]), int(cpu["period"]))
+        groups: Dict[str, dict] = {}
+        for group, m in sweep.items():
+            cpu_res, mem_res = reserved[group]
+            plan: dict = {"reserved_cpu_percent": cpu_res, "reserved_memory": mem_res}
+            w = wants[group]
+            if w:
+                lent = math.floor(max(0, w["want"] - cpu_res) * share)
+                percent = min(w["want"], cpu_res) + lent
+                plan["cpu_percent"] = percent
+                if percent != round(w["quota"]):
+                    plan["cpu.max"] = {"quota": percent * PERIOD // 100, "period": PERIOD}
+                if "first" in w:
+                    plan["reason"] = "first sweep" + (f", borrowing {lent}%" if lent else "")
+                else:
+                    plan["reason"] = f"throttled {w['throttled']:.0%}, stalled {w['stalled']:.0%}, " \
+                        f"used {w['used']:.0f}%" + (f", borrowing {lent}%" if lent else "")
+            current = m.get("memory_current")
+            if current is not None and mem_res:
+                high = max(mem_res // 4, min(mem_res, int(current * MEM_HEADROOM)))
+                if high != (m.get("memory_high") or mem_res):
+                    plan["memory.high"] = high
+            groups[group] = plan
 
+        allocated = sum(p["cpu_percent"] for p in groups.values() if "cpu_percent" in p)
+        return {"groups": groups, "swept": len(sweep), "reserved_cpu_percent": total_cpu,
+                "allocated_cpu_percent": allocated}
 
+    def apply(self, plan: dict) -> List[str]:
+        """Every change in one safebox_cgroup call; returns any errors."""
+        writes = []
+        for group, p in plan.get("groups", {}).items():
+            cpu = p.get("cpu.max")
+            if cpu:
+                writes.append((group, "cpu.max", f"{cpu['quota']} {cpu['period']}"))
+            if p.get("memory.high") is not None:
+                writes.append((group, "memory.high", str(p["memory.high"])))
+        return [r for r in self.client.apply(writes) if r != "ok"]
@@ -0,0 +1,70 @@
+"""
+The Python Optimizer as a safebox-replay policy (cgroup_agent/src/replay.cpp).
+
+safebox-replay runs this as a child process and, every simulated tick, writes
+each group's limits and counters to its stdin; the Optimizer plans over them
+as if they had been read from the cgroups, and its writes go back on stdout in
+the `safebox_cgroup apply` form. Time is the replay's, so a run is repeatable.
+
+    safebox-replay --trace demo.sbt --policy-cmd "cd backend && python3 -m app.replay_policy"
+"""
+
+import sys
+from typing import Dict, Iterator, List, Optional, TextIO, Tuple
+
+from .optimizer import PERIOD, Optimizer
+
+
+def _limit(value: str) -> Optional[int]:
+    n = int(value)
+    return n if n > 0 else None
+
+
+def _group(fields: List[str], t: float) -> Tuple[str, dict, Tuple[int, int]]:
+    """One "group" line -> (cgroup, read_job_group()-shaped dict, reservation)."""
+    (name, res_cpu, res_mem, cpu_percent, high, limit, usage, periods, throttled, throttled_us, cpu_some,
+     current, high_events, max_events, oom_kill) = fields
+    m = {
+        "t": t,
+        "cpu_max": {"quota": int(cpu_percent) * PERIOD // 100, "period": PERIOD},
+        "cpu_stat": {"usage_usec": int(usage), "nr_periods": int(periods), "nr_throttled": int(throttled),
+                     "throttled_usec": int(throttled_us)},
+        "cpu_pressure": {"some": int(cpu_some)},
+        "memory_current": int(current),
+        "memory_max": _limit(limit),
+        "memory_high": _limit(high),
+        "memory_events": {"high": int(high_events), "max": int(max_events), "oom_kill": int(oom_kill)},
+    }
+    return name, m, (int(res_cpu), int(res_mem))
+
+
+def _ticks(stream: TextIO) -> Iterator[Tuple[float, Dict[str, dict], Dict[str, Tuple[int, int]]]]:
+    t, sweep, reserved = 0.0, {}, {}
+    for line in stream:
+        fields = line.rstrip("\n").split("\t")
+        if fields[0] == "tick":
+            t, sweep, reserved = float(fields[1]), {}, {}
+        elif fields[0] == "group" and len(fields) == 16:
+            name, m, res = _group(fields[1:], t)
+            sweep[name], reserved[name] = m, res
+        elif fields[0] == "end":
+            yield t, sweep, reserved
+
+
+def main(stdin: TextIO = sys.stdin, stdout: TextIO = sys.stdout) -> int:
+    optimizer = Optimizer(cgroup_root_dir="/nonexistent")
+    for _, sweep, reserved in _ticks(stdin):
+        plan = optimizer.plan(sweep, reserved)
+        for group, p in plan["groups"].items():
+            cpu = p.get("cpu.max")
+            if cpu:
+                stdout.write(f"{group}\tcpu.max\t{cpu['quota']} {cpu['period']}\n")
+            if p.get("memory.high") is not None:
+                stdout.write(f"{group}\tmemory.high\t{p['memory.high']}\n")
+        stdout.write("end\n")
+        stdout.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
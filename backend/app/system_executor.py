@@ -11,9 +11,12 @@ import os
 import sys
 import json
 import psutil
+import time
 from typing import Dict, List, Tuple, Optional
 from pathlib import Path
 from .banker import BankerAlgorithm
+from .executord_client import ExecutordClient, ExecutordError
+from .latency import STAGES, LatencyHistogram, LatencySnapshot
 
 
 # ============================================================================
@@ -35,13 +38,16 @@ class SystemExecutor:
     4. Real application execution
     """
     
-    def __init__(self, total_cpu_percent: int = 100, total_memory_mb: int = 1024):
+    def __init__(self, total_cpu_percent: int = 100, total_memory_mb: int = 1024,
+                 use_daemon: Optional[bool] = None):
         """
         Initialize the system executor.
         
         Args:
             total_cpu_percent: Total CPU percentage available (0-100)
             total_memory_mb: Total memory in MB available
+            use_daemon: Hand jobs to safebox-executord. None = use it if it
+                is running; the daemon's own --cpu/--memory pool then applies.
         """
         # Initialize Banker's Algorithm with [CPU%, Memory MB]
         self.banker = BankerAlgorithm(
@@ -55,6 +61,16 @@ class SystemExecutor:
         
         self.job_counter = 0
         self.active_jobs: Dict[int, Dict] = {}
+        # Per-stage latency of the in-process path; "launch" stays empty, as
+        # safebox only returns once the app has exited
+        self.latency = {stage: LatencyHistogram() for stage in STAGES}
+
+        # Native executor daemon: whole pipeline in one process, Python is a thin client
+        self.daemon: Optional[ExecutordClient] = None
+        if use_daemon is not False:
+            self.daemon = ExecutordClient.connect_if_running()
+            if use_daemon and self.daemon is None:
+                raise RuntimeError("safebox-executord is not running")
     
     # ========================================================================
     # PREREQUISITES CHECK
@@ -66,6 +82,9 @@ class SystemExecutor:
         
     def check_prerequisites(self) -> Tuple[bool, str]:
         """Check if all required components are available."""
+        if self.daemon is not None:
+            return True, f"✅ Using safebox-executord at {self.daemon.socket_path}"
+
         errors = []
         
         # Check if running on Linux
@@ -109,7 +128,9 @@ class SystemExecutor:
         app_path: str,
         app_args: List[str],
         cpu_percent: int,
-        memory_mb: int
+        memory_mb: int,
+        wall_limit_s: Optional[float] = 30.0,
+        cpu_limit_s: Optional[float] = None
     ) -> Tuple[bool, str, Optional[int]]:
         """
         Request to run a job with specified resource limits.
@@ -128,10 +149,20 @@ class SystemExecutor:
             app_args: Arguments for the application
             cpu_percent: CPU percentage limit (0-100)
             memory_mb: Memory limit in MB
+            wall_limit_s: Kill the job after this many seconds (None = never)
+            cpu_limit_s: Kill the job once it has used this much CPU time.
+                Only enforced by safebox-executord, which kills the whole
+                cgroup; without it the wall limit only stops the safebox
+                wrapper.
             
         Returns:
             (success, message, job_id)
         """
+        if self.daemon is not None:
+            return self.daemon.request_job(job_name, app_path, app_args, cpu_percent, memory_mb,
+                                           wall_limit_s, cpu_limit_s)
+
+        t0 = time.monotonic_ns()
         # Validate application exists
         if not os.path.exists(app_path):
             return False, f"❌ Application not found: {app_path}", None
@@ -161,6 +192,8 @@ class SystemExecutor:
         
         # SAFE! Proceed with execution
         cgroup_name = f"safebox_job_{job_id}"
+        t1 = time.monotonic_ns()
+        self.latency["admission"].record(t1 - t0)
         
         try:
             # STEP 4: Create cgroup
@@ -171,9 +204,12 @@ class SystemExecutor:
             # STEP 5: Apply resource limits
             self._apply_cpu_limit(cgroup_name, cpu_percent)
             self._apply_memory_limit(cgroup_name, memory_mb)
+            t2 = time.monotonic_ns()
+            self.latency["cgroup"].record(t2 - t1)
             
             # STEP 6 & 7: Launch SafeBox sandbox with application
-            output = self._run_in_sandbox(cgroup_name, app_path, app_args)
+            output = self._run_in_sandbox(cgroup_name, app_path, app_args, wall_limit_s)
+            self.latency["completion"].record(time.monotonic_ns() - t2)
             
             # Store job info
             self.active_jobs[job_id] = {
@@ -262,7 +298,8 @@ class SystemExecutor:
     # - Seccomp filtering (can only use safe system calls)
     # - Security boundaries (can't escape the sandbox)
     
-    def _run_in_sandbox(self, cgroup_name: str, app_path: str, app_args: List[str]) -> str:
+    def _run_in_sandbox(self, cgroup_name: str, app_path: str, app_args: List[str],
+                        timeout: Optional[float] = 30.0) -> str:
         """Run application in SafeBox sandbox."""
         try:
             # Build command: safebox <app> <args>
@@ -275,7 +312,7 @@ class SystemExecutor:
                 cmd,
                 capture_output=True,
                 text=True,
-                timeout=30,  # 30 second timeout
+                timeout=timeout,
                 cwd=str(self.project_root)
             )
             
@@ -284,7 +321,7 @@ class SystemExecutor:
             return output
             
         except subprocess.TimeoutExpired:
-            return "❌ Execution timed out (30s limit)"
+            return f"❌ Execution timed out ({timeout:g}s limit)"
         except Exception as e:
             return f"❌ Execution error: {str(e)}"
     
@@ -308,6 +345,9 @@ class SystemExecutor:
     
     def release_job(self, job_id: int) -> Tuple[bool, str]:
         """Release resources for a completed job."""
+        if self.daemon is not None:
+            return self.daemon.release_job(job_id)
+
         if job_id not in self.active_jobs:
             return False, f"❌ Job {job_id} not found"
         
@@ -335,6 +375,9 @@ class SystemExecutor:
     
     def get_system_state(self) -> Dict:
         """Get current system state."""
+        if self.daemon is not None:
+            return self.daemon.get_system_state()
+
         banker_state = self.banker.get_system_state()
         
         return {
@@ -347,6 +390,12 @@ class SystemExecutor:
             'available_memory': self.banker.available[1]
         }
     
+    def get_latency(self) -> Dict[str, LatencySnapshot]:
+        """Admission, cgroup, launch and completion histograms; the daemon's when it runs the jobs."""
+        if self.daemon is not None:
+            return self.daemon.latency()
+        return {stage: h.snapshot() for stage, h in self.latency.items()}
+    
     def list_available_apps(self) -> List[Dict]:
         """List available test applications."""
         apps = []
@@ -372,6 +421,19 @@ class SystemExecutor:
                 'suggested_cpu': 10,
                 'suggested_memory': 30
             })
+
+        # Right-sized limits from past runs replace the guesses above
+        if self.daemon is not None:
+            try:
+                profiles = self.daemon.get_profile()
+            except (OSError, ExecutordError):
+                profiles = {}
+            for app in apps:
+                recommended = profiles.get(app['path'], {}).get('recommended')
+                if recommended:
+                    app['suggested_cpu'] = recommended['cpu_percent']
+                    app['suggested_memory'] = recommended['memory_mb']
+                    app['profile_runs'] = profiles[app['path']]['runs']
         
         return apps
 
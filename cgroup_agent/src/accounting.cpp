@@ -0,0 +1,151 @@
+#include "accounting.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "json_util.hpp"
+
+namespace safebox {
+
+#define FIELD(f) {#f, &JobRecord::f}
+const std::vector<RecordField> JOB_RECORD_FIELDS = {
+    FIELD(app_hash), FIELD(job_id), FIELD(array_size), FIELD(cpu_percent), FIELD(memory_mb), FIELD(wall_limit_ms), FIELD(cpu_limit_ms),
+    FIELD(start_unix_ns), FIELD(wall_ns), FIELD(admit_ns), FIELD(cgroup_ns), FIELD(spawn_ns),
+    FIELD(exit_code), FIELD(signal), FIELD(deadline),
+    FIELD(ru_utime_us), FIELD(ru_stime_us), FIELD(ru_maxrss_kb), FIELD(ru_minflt), FIELD(ru_majflt),
+    FIELD(ru_inblock), FIELD(ru_oublock), FIELD(ru_nvcsw), FIELD(ru_nivcsw),
+    FIELD(cpu_usage_us), FIELD(cpu_user_us), FIELD(cpu_system_us), FIELD(cpu_nr_periods),
+    FIELD(cpu_nr_throttled), FIELD(cpu_throttled_us),
+    FIELD(memory_peak), FIELD(mem_events_low), FIELD(mem_events_high), FIELD(mem_events_max),
+    FIELD(mem_events_oom), FIELD(mem_events_oom_kill),
+    FIELD(io_rbytes), FIELD(io_wbytes), FIELD(io_rios), FIELD(io_wios),
+};
+#undef FIELD
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+static_assert(sizeof(FileHeader) == 16, "header is 16 bytes on disk");
+
+static std::string fixed_str(const char* s, size_t cap) {
+    return std::string(s, strnlen(s, cap));
+}
+
+std::string record_json(const JobRecord& r) {
+    std::string out = "{\"name\":\"" + json_escape(fixed_str(r.name, sizeof(r.name))) +
+                      "\",\"app\":\"" + json_escape(fixed_str(r.app, sizeof(r.app))) + "\"";
+    for (const auto& f : JOB_RECORD_FIELDS) {
+        out += ",\"";
+        out += f.name;
+        out += "\":" + std::to_string(r.*(f.member));
+    }
+    return out + "}";
+}
+
+uint64_t app_key(const std::string& path) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : path) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+AccountingStore::AccountingStore(const std::string& path) : path_(path) {
+    std::string dir = path.substr(0, path.rfind('/'));
+    if (!dir.empty() && dir != path) mkdir(dir.c_str(), 0755);
+
+    int fd = open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "⚠️  Warning: accounting disabled: " << path << ": " << std::strerror(errno) << "\n";
+        return;
+    }
+    FileHeader want {};
+    std::memcpy(want.magic, ACCOUNTING_MAGIC, sizeof(want.magic));
+    want.version = ACCOUNTING_VERSION;
+    want.record_size = sizeof(JobRecord);
+
+    FileHeader have {};
+    ssize_t r = pread(fd, &have, sizeof(have), 0);
+    if (r > 0 && r < (ssize_t)sizeof(have)) {
+        // The header itself was torn, so no record made it either
+        std::cerr << "⚠️  Warning: " << path << ": truncating a partial header\n";
+        r = ftruncate(fd, 0) == 0 ? 0 : -1;
+    }
+    if (r == 0) {
+        if (::write(fd, &want, sizeof(want)) != (ssize_t)sizeof(want)) r = -1;
+        else have = want;
+    }
+    if (r < 0 || std::memcmp(&have, &want, sizeof(want)) != 0) {
+        std::cerr << "⚠️  Warning: accounting disabled: " << path
+                  << " is not a version " << ACCOUNTING_VERSION << " record file\n";
+        close(fd);
+        return;
+    }
+    fd_ = fd;
+    if (!trim_tail()) {
+        std::cerr << "⚠️  Warning: accounting disabled: " << path << ": " << std::strerror(errno) << "\n";
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool AccountingStore::trim_tail() {
+    struct stat st;
+    if (fstat(fd_, &st) != 0) return false;
+    const off_t base = (off_t)sizeof(FileHeader);
+    const off_t torn = st.st_size > base ? (st.st_size - base) % (off_t)sizeof(JobRecord) : 0;
+    if (torn == 0) return true;
+    std::cerr << "⚠️  Warning: " << path_ << ": truncating a partial record (" << torn << " bytes)\n";
+    return ftruncate(fd_, st.st_size - torn) == 0;
+}
+
+AccountingStore::~AccountingStore() {
+    if (fd_ >= 0) close(fd_);
+}
+
+bool AccountingStore::append(const JobRecord& r) {
+    if (fd_ < 0) return false;
+    // O_APPEND + a single write keeps records whole between threads
+    std::lock_guard<std::mutex> lock(append_mu_);
+    ssize_t w;
+    do {
+        w = ::write(fd_, &r, sizeof(r));
+    } while (w < 0 && errno == EINTR);
+    if (w == (ssize_t)sizeof(r)) return true;
+    if (w > 0) trim_tail();
+    return false;
+}
+
+std::vector<JobRecord> AccountingStore::query(const std::string& name, size_t limit) const {
+    std::vector<JobRecord> out;
+    if (fd_ < 0) return out;
+    struct stat st;
+    if (fstat(fd_, &st) != 0) return out;
+    const off_t base = (off_t)sizeof(FileHeader);
+    off_t count = st.st_size > base ? (st.st_size - base) / (off_t)sizeof(JobRecord) : 0;
+
+    // Newest first, a block of records at a time from the end
+    std::vector<JobRecord> block(1024);
+    while (count > 0 && (limit == 0 || out.size() < limit)) {
+        off_t n = std::min<off_t>(count, (off_t)block.size());
+        count -= n;
+        size_t bytes = (size_t)n * sizeof(JobRecord);
+        if (pread(fd_, block.data(), bytes, base + count * (off_t)sizeof(JobRecord)) != (ssize_t)bytes) break;
+        for (off_t i = n - 1; i >= 0 && (limit == 0 || out.size() < limit); --i) {
+            const JobRecord& r = block[(size_t)i];
+            if (name.empty() || fixed_str(r.name, sizeof(r.name)) == name) out.push_back(r);
+        }
+    }
+    return out;
+}
+
+}  // namespace safebox
@@ -0,0 +1,129 @@
+// accounting.hpp - per-job resource record written when a job exits.
+//
+// One fixed-width binary record per job, appended to a flat file after a
+// 16-byte header. Every numeric field is a host-order int64 so the layout
+// has no padding and can be read column by column with a single struct
+// format (backend/app/accounting.py mirrors it). Values the host cannot
+// provide (no cgroup v2 controller, fake root) are stored as -1.
+//
+// Bump ACCOUNTING_VERSION whenever JobRecord changes; an existing file with
+// a different version or record size is left untouched and accounting is
+// turned off rather than mixing layouts. A torn last record (disk full,
+// crash mid-write) is truncated away on open so later ones stay aligned.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace safebox {
+
+static const char ACCOUNTING_MAGIC[8] = {'S', 'B', 'A', 'C', 'C', 'T', '\0', '\0'};
+static const uint32_t ACCOUNTING_VERSION = 3;
+
+struct JobRecord {
+    char name[64];
+    char app[128];       // cut to 127 bytes; app_hash tells long paths apart
+    int64_t app_hash;    // app_key() of the whole path
+
+    // Request
+    int64_t job_id;
+    int64_t array_size;  // jobs sharing the cgroup counters below, 1 standalone
+    int64_t cpu_percent;
+    int64_t memory_mb;
+    int64_t wall_limit_ms;
+    int64_t cpu_limit_ms;
+
+    // Timeline (start is wall clock, the rest durations)
+    int64_t start_unix_ns;
+    int64_t wall_ns;
+    int64_t admit_ns;
+    int64_t cgroup_ns;
+    int64_t spawn_ns;
+
+    // Outcome
+    int64_t exit_code;   // -1 when killed by a signal
+    int64_t signal;
+    int64_t deadline;    // 0 none, 1 wall time, 2 CPU time
+
+    // wait4() rusage of the job's direct child and its reaped descendants
+    int64_t ru_utime_us;
+    int64_t ru_stime_us;
+    int64_t ru_maxrss_kb;
+    int64_t ru_minflt;
+    int64_t ru_majflt;
+    int64_t ru_inblock;
+    int64_t ru_oublock;
+    int64_t ru_nvcsw;
+    int64_t ru_nivcsw;
+
+    // cpu.stat: the whole cgroup, orphans included
+    int64_t cpu_usage_us;
+    int64_t cpu_user_us;
+    int64_t cpu_system_us;
+    int64_t cpu_nr_periods;
+    int64_t cpu_nr_throttled;
+    int64_t cpu_throttled_us;
+
+    // memory.peak and memory.events
+    int64_t memory_peak;
+    int64_t mem_events_low;
+    int64_t mem_events_high;
+    int64_t mem_events_max;
+    int64_t mem_events_oom;
+    int64_t mem_events_oom_kill;
+
+    // io.stat, summed over devices
+    int64_t io_rbytes;
+    int64_t io_wbytes;
+    int64_t io_rios;
+    int64_t io_wios;
+};
+
+static_assert(sizeof(JobRecord) == 192 + 40 * 8, "JobRecord must stay padding-free");
+
+// Field names in layout order, for JSON output
+struct RecordField {
+    const char* name;
+    int64_t JobRecord::*member;
+};
+extern const std::vector<RecordField> JOB_RECORD_FIELDS;
+
+std::string record_json(const JobRecord& r);
+
+// 64-bit FNV-1a of an app path: what profiles are keyed by, since the
+// record's copy of the path may be truncated
+uint64_t app_key(const std::string& path);
+
+class AccountingStore {
+public:
+    // Opens (creating if needed) `path`; check ok() afterwards
+    explicit AccountingStore(const std::string& path);
+    ~AccountingStore();
+
+    AccountingStore(const AccountingStore&) = delete;
+    AccountingStore& operator=(const AccountingStore&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    const std::string& path() const { return path_; }
+
+    // One write(2) of one record; safe from any thread. A short write
+    // (disk full) is cut back off so the next record stays aligned.
+    bool append(const JobRecord& r);
+    // Most recent records first, optionally only those named `name`;
+    // limit 0 = all
+    std::vector<JobRecord> query(const std::string& name, size_t limit) const;
+
+private:
+    // Truncate a partial record left at the end of the file; false if the
+    // file could not be checked or cut
+    bool trim_tail();
+
+    std::string path_;
+    int fd_ = -1;
+    std::mutex append_mu_;   // a short write is trimmed before the next append
+};
+
+}  // namespace safebox
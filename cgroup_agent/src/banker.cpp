@@ -0,0 +1,155 @@
+#include "banker.hpp"
+
+#include <sstream>
+
+#include "json_util.hpp"
+
+namespace safebox {
+
+Banker::Banker(std::vector<long> total_resources, std::vector<std::string> resource_names)
+    : total_(std::move(total_resources)), names_(std::move(resource_names)), available_(total_) {
+    if (names_.size() != total_.size()) {
+        names_.clear();
+        for (size_t i = 0; i < total_.size(); ++i) names_.push_back("R" + std::to_string(i));
+    }
+}
+
+bool Banker::add_process(int pid, const std::string& name, const std::vector<long>& max_resources) {
+    if (max_resources.size() != total_.size()) return false;
+    for (size_t i = 0; i < total_.size(); ++i) {
+        if (max_resources[i] > total_[i]) return false;
+    }
+    ProcessState p;
+    p.pid = pid;
+    p.name = name;
+    p.max_resources = max_resources;
+    p.allocated.assign(total_.size(), 0);
+    p.need = max_resources;
+    processes_[pid] = std::move(p);
+    return true;
+}
+
+std::pair<bool, std::string> Banker::request_resources(int pid, const std::vector<long>& request) {
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) return {false, "Process " + std::to_string(pid) + " not found"};
+    ProcessState& process = it->second;
+    const size_t n = total_.size();
+
+    for (size_t i = 0; i < n; ++i) {
+        if (request[i] > process.need[i]) {
+            return {false, "Request exceeds maximum need for " + names_[i]};
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (request[i] > available_[i]) {
+            return {false, "Request exceeds available " + names_[i]};
+        }
+    }
+
+    // Tentatively allocate resources
+    for (size_t i = 0; i < n; ++i) {
+        available_[i] -= request[i];
+        process.allocated[i] += request[i];
+        process.need[i] -= request[i];
+    }
+
+    auto [safe, sequence] = is_safe_state();
+    if (safe) {
+        std::ostringstream msg;
+        msg << "Request granted. Safe sequence: [";
+        for (size_t i = 0; i < sequence.size(); ++i) msg << (i ? ", " : "") << sequence[i];
+        msg << "]";
+        return {true, msg.str()};
+    }
+
+    // Rollback allocation
+    for (size_t i = 0; i < n; ++i) {
+        available_[i] += request[i];
+        process.allocated[i] -= request[i];
+        process.need[i] += request[i];
+    }
+    return {false, "Request denied: Would lead to unsafe state (potential deadlock)"};
+}
+
+std::pair<bool, std::string> Banker::release_resources(int pid, const std::vector<long>& release) {
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) return {false, "Process " + std::to_string(pid) + " not found"};
+    ProcessState& process = it->second;
+    const size_t n = total_.size();
+
+    for (size_t i = 0; i < n; ++i) {
+        if (release[i] > process.allocated[i]) {
+            return {false, "Cannot release more " + names_[i] + " than allocated"};
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        available_[i] += release[i];
+        process.allocated[i] -= release[i];
+        process.need[i] += release[i];
+    }
+    return {true, "Resources released successfully"};
+}
+
+bool Banker::remove_process(int pid) {
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) return false;
+    for (size_t i = 0; i < total_.size(); ++i) available_[i] += it->second.allocated[i];
+    processes_.erase(it);
+    return true;
+}
+
+std::pair<bool, std::vector<int>> Banker::is_safe_state() const {
+    // Same search order as the Python implementation: after each process
+    // that can finish, restart the scan from the lowest pid.
+    std::vector<long> work = available_;
+    std::vector<const ProcessState*> procs;
+    procs.reserve(processes_.size());
+    for (const auto& kv : processes_) procs.push_back(&kv.second);
+    std::vector<char> finish(procs.size(), 0);
+    std::vector<int> sequence;
+    sequence.reserve(procs.size());
+
+    while (sequence.size() < procs.size()) {
+        bool found = false;
+        for (size_t p = 0; p < procs.size(); ++p) {
+            if (finish[p]) continue;
+            bool can_finish = true;
+            for (size_t i = 0; i < work.size(); ++i) {
+                if (procs[p]->need[i] > work[i]) { can_finish = false; break; }
+            }
+            if (can_finish) {
+                for (size_t i = 0; i < work.size(); ++i) work[i] += procs[p]->allocated[i];
+                finish[p] = 1;
+                sequence.push_back(procs[p]->pid);
+                found = true;
+                break;
+            }
+        }
+        if (!found) return {false, {}};
+    }
+    return {true, sequence};
+}
+
+std::string Banker::state_json() const {
+    auto [safe, sequence] = is_safe_state();
+    std::ostringstream o;
+    o << "{\"total_resources\":" << json_ints(total_)
+      << ",\"available\":" << json_ints(available_)
+      << ",\"resource_names\":[";
+    for (size_t i = 0; i < names_.size(); ++i) o << (i ? "," : "") << '"' << json_escape(names_[i]) << '"';
+    o << "],\"processes\":{";
+    bool first = true;
+    for (const auto& [pid, p] : processes_) {
+        o << (first ? "" : ",") << '"' << pid << "\":{\"name\":\"" << json_escape(p.name)
+          << "\",\"max\":" << json_ints(p.max_resources)
+          << ",\"allocated\":" << json_ints(p.allocated)
+          << ",\"need\":" << json_ints(p.need) << "}";
+        first = false;
+    }
+    o << "},\"is_safe\":" << (safe ? "true" : "false") << ",\"safe_sequence\":[";
+    for (size_t i = 0; i < sequence.size(); ++i) o << (i ? "," : "") << sequence[i];
+    o << "],\"total_processes\":" << processes_.size() << "}";
+    return o.str();
+}
+
+}  // namespace safebox
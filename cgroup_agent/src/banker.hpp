@@ -0,0 +1,49 @@
+// banker.hpp - native port of backend/app/banker.py for the executor daemon.
+//
+// Same state machine and messages as the Python BankerAlgorithm, so clients
+// see identical admission decisions whichever side runs the check. Not
+// thread-safe; the Executor serialises access.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace safebox {
+
+struct ProcessState {
+    int pid = 0;
+    std::string name;
+    std::vector<long> max_resources;  // Maximum resources needed
+    std::vector<long> allocated;      // Currently allocated resources
+    std::vector<long> need;           // Still needed resources (max - allocated)
+};
+
+class Banker {
+public:
+    Banker(std::vector<long> total_resources, std::vector<std::string> resource_names);
+
+    bool add_process(int pid, const std::string& name, const std::vector<long>& max_resources);
+    std::pair<bool, std::string> request_resources(int pid, const std::vector<long>& request);
+    std::pair<bool, std::string> release_resources(int pid, const std::vector<long>& release);
+    bool remove_process(int pid);
+    std::pair<bool, std::vector<int>> is_safe_state() const;
+
+    const std::vector<long>& total_resources() const { return total_; }
+    const std::vector<long>& available() const { return available_; }
+    const std::vector<std::string>& resource_names() const { return names_; }
+    const std::map<int, ProcessState>& processes() const { return processes_; }
+
+    // get_system_state() of the Python class, serialised as JSON
+    std::string state_json() const;
+
+private:
+    std::vector<long> total_;
+    std::vector<std::string> names_;
+    std::vector<long> available_;
+    std::map<int, ProcessState> processes_;  // ordered like the Python dict (ids are monotonic)
+};
+
+}  // namespace safebox
@@ -0,0 +1,194 @@
+#include "cgroup_fs.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+namespace safebox {
+
+static const char* CG_BASE = "/sys/fs/cgroup";
+static const long CGROUP_SUPER_MAGIC_V1 = 0x27e0eb;
+static const long CGROUP2_SUPER_MAGIC_V2 = 0x63677270;
+
+CgroupFs::CgroupFs(std::string root) : root_(std::move(root)) {
+    while (root_.size() > 1 && root_.back() == '/') root_.pop_back();
+    struct statfs st;
+    if (statfs(root_.c_str(), &st) == 0) {
+        is_cgroupfs_ = (long)st.f_type == CGROUP2_SUPER_MAGIC_V2 ||
+                       (long)st.f_type == CGROUP_SUPER_MAGIC_V1;
+    }
+}
+
+std::string CgroupFs::default_root() {
+    const char* env = std::getenv("SAFEBOX_CGROUP_ROOT");
+    return (env && *env) ? env : CG_BASE;
+}
+
+int CgroupFs::create(const std::string& group) const {
+    std::string p = path(group);
+    if (mkdir(p.c_str(), 0755) != 0 && errno != EEXIST) return -1;
+    return open(p.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+int CgroupFs::open_group(const std::string& group) const {
+    return open(path(group).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+bool CgroupFs::exists(const std::string& group) const {
+    struct stat st;
+    return stat(path(group).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool CgroupFs::write(int group_fd, const char* file, const std::string& value) const {
+    // O_CREAT only matters for a fake root; kernfs files always exist
+    int flags = O_WRONLY | O_CLOEXEC | (is_cgroupfs_ ? 0 : O_CREAT | O_TRUNC);
+    int fd = openat(group_fd, file, flags, 0644);
+    if (fd < 0) return false;
+    ssize_t w = ::write(fd, value.data(), value.size());
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return w == (ssize_t)value.size();
+}
+
+std::optional<std::string> CgroupFs::read(int group_fd, const char* file) const {
+    int fd = openat(group_fd, file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::nullopt;
+    std::string out;
+    char buf[4096];
+    ssize_t r;
+    while ((r = ::read(fd, buf, sizeof(buf))) > 0) out.append(buf, (size_t)r);
+    close(fd);
+    if (r < 0) return std::nullopt;
+    return out;
+}
+
+std::optional<int64_t> CgroupFs::read_int(int group_fd, const char* file) const {
+    auto s = read(group_fd, file);
+    if (!s) return std::nullopt;
+    char* end = nullptr;
+    errno = 0;
+    long long v = std::strtoll(s->c_str(), &end, 10);
+    if (errno != 0 || end == s->c_str()) return std::nullopt;  // e.g. "max"
+    return (int64_t)v;
+}
+
+std::map<std::string, int64_t> CgroupFs::read_kv(int group_fd, const char* file) const {
+    std::map<std::string, int64_t> data;
+    auto s = read(group_fd, file);
+    if (!s) return data;
+    size_t pos = 0;
+    while (pos < s->size()) {
+        size_t eol = s->find('\n', pos);
+        if (eol == std::string::npos) eol = s->size();
+        size_t sp = s->find(' ', pos);
+        if (sp != std::string::npos && sp < eol) {
+            char* end = nullptr;
+            long long v = std::strtoll(s->c_str() + sp + 1, &end, 10);
+            if (end != s->c_str() + sp + 1) data[s->substr(pos, sp - pos)] = (int64_t)v;
+        }
+        pos = eol + 1;
+    }
+    return data;
+}
+
+bool CgroupFs::attach(int group_fd, pid_t pid) const {
+    return write(group_fd, "cgroup.procs", std::to_string(pid) + "\n");
+}
+
+bool CgroupFs::set_memory_max(int group_fd, int64_t bytes) const {
+    return write(group_fd, "memory.max", std::to_string(bytes) + "\n");
+}
+
+bool CgroupFs::set_memory_high(int group_fd, int64_t bytes) const {
+    return write(group_fd, "memory.high", std::to_string(bytes) + "\n");
+}
+
+bool CgroupFs::reclaim_memory(int group_fd, int64_t bytes) const {
+    return write(group_fd, "memory.reclaim", std::to_string(bytes) + "\n");
+}
+
+bool CgroupFs::set_cpu_max(int group_fd, int64_t quota, int64_t period) const {
+    return write(group_fd, "cpu.max", std::to_string(quota) + " " + std::to_string(period) + "\n");
+}
+
+bool CgroupFs::set_cpuset(int group_fd, const std::string& cpus, const std::string& mems) const {
+    return write(group_fd, "cpuset.cpus", cpus + "\n") && write(group_fd, "cpuset.mems", mems + "\n");
+}
+
+std::vector<pid_t> CgroupFs::procs(int group_fd) const {
+    std::vector<pid_t> pids;
+    auto s = read(group_fd, "cgroup.procs");
+    if (!s) return pids;
+    const char* p = s->c_str();
+    char* end = nullptr;
+    for (;;) {
+        long v = std::strtol(p, &end, 10);
+        if (end == p) break;
+        if (v > 0) pids.push_back((pid_t)v);  // a fake root may hold the child's "0"
+        p = end;
+    }
+    return pids;
+}
+
+int CgroupFs::signal(int group_fd, int sig) const {
+    int n = 0;
+    for (pid_t pid : procs(group_fd)) {
+        if (::kill(pid, sig) == 0) ++n;
+    }
+    return n;
+}
+
+bool CgroupFs::kill(int group_fd) const {
+    // In a fake root cgroup.kill is just a file; only real kernfs kills
+    if (is_cgroupfs_ && write(group_fd, "cgroup.kill", "1")) return true;
+    signal(group_fd, SIGKILL);
+    return false;
+}
+
+bool CgroupFs::wait_empty(int group_fd, int timeout_ms) const {
+    if (!is_cgroupfs_) return true;
+    int fd = openat(group_fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return true;  // v1: nothing to wait on
+    bool empty = false;
+    for (;;) {
+        char buf[256];
+        ssize_t r = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (r < 0) break;
+        buf[r] = '\0';
+        if (std::strstr(buf, "populated 0")) {
+            empty = true;
+            break;
+        }
+        // kernfs signals a change to cgroup.events with POLLPRI
+        struct pollfd p = {fd, POLLPRI, 0};
+        int n = poll(&p, 1, timeout_ms);
+        if (n <= 0 && !(n < 0 && errno == EINTR)) break;
+    }
+    close(fd);
+    return empty;
+}
+
+bool CgroupFs::remove(const std::string& group) const {
+    std::string p = path(group);
+    if (!is_cgroupfs_) {
+        if (DIR* d = opendir(p.c_str())) {
+            int dfd = dirfd(d);
+            while (struct dirent* e = readdir(d)) {
+                if (e->d_type != DT_DIR) unlinkat(dfd, e->d_name, 0);
+            }
+            closedir(d);
+        }
+    }
+    return rmdir(p.c_str()) == 0 || errno == ENOENT;
+}
+
+}  // namespace safebox
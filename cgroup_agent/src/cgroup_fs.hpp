@@ -0,0 +1,78 @@
+// cgroup_fs.hpp - cgroup v2 filesystem access shared by the CLI agent and
+// the native executor.
+//
+// Control files are written through a directory fd per group (openat), so
+// the hot path never re-resolves /sys/fs/cgroup/<group>/... from scratch.
+// The root can be pointed at a plain directory (SAFEBOX_CGROUP_ROOT) to run
+// the executor and its benchmarks without root or a cgroup mount.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace safebox {
+
+class CgroupFs {
+public:
+    explicit CgroupFs(std::string root = default_root());
+
+    // $SAFEBOX_CGROUP_ROOT if set, otherwise /sys/fs/cgroup
+    static std::string default_root();
+
+    const std::string& root() const { return root_; }
+    std::string path(const std::string& group) const { return root_ + "/" + group; }
+
+    // false when the root is an ordinary directory standing in for cgroupfs
+    bool is_cgroupfs() const { return is_cgroupfs_; }
+
+    // mkdir the group (EEXIST is fine) and return an O_DIRECTORY fd, or -1
+    int create(const std::string& group) const;
+    // O_DIRECTORY fd for an existing group, or -1
+    int open_group(const std::string& group) const;
+    bool exists(const std::string& group) const;
+
+    // Write/read a control file relative to a group directory fd
+    bool write(int group_fd, const char* file, const std::string& value) const;
+    std::optional<std::string> read(int group_fd, const char* file) const;
+    std::optional<int64_t> read_int(int group_fd, const char* file) const;
+    // "key value" files such as cpu.stat, memory.stat, memory.events
+    std::map<std::string, int64_t> read_kv(int group_fd, const char* file) const;
+
+    bool attach(int group_fd, pid_t pid) const;
+    bool set_memory_max(int group_fd, int64_t bytes) const;
+    // Throttle-and-reclaim threshold below memory.max
+    bool set_memory_high(int group_fd, int64_t bytes) const;
+    // Ask the kernel to reclaim `bytes` from the group now (memory.reclaim,
+    // 5.19+). Fails with EAGAIN when it could not free that much.
+    bool reclaim_memory(int group_fd, int64_t bytes) const;
+    bool set_cpu_max(int group_fd, int64_t quota, int64_t period) const;
+    // cpuset.cpus / cpuset.mems as cpu lists ("0-3,8"); needs the cpuset
+    // controller enabled in the parent
+    bool set_cpuset(int group_fd, const std::string& cpus, const std::string& mems) const;
+
+    // Members listed in cgroup.procs
+    std::vector<pid_t> procs(int group_fd) const;
+    // Send `sig` to every member; returns how many were signalled
+    int signal(int group_fd, int sig) const;
+    // SIGKILL the whole group at once via cgroup.kill (5.14+). Without it,
+    // signals each member instead and returns false.
+    bool kill(int group_fd) const;
+    // Block until cgroup.events reports "populated 0" or timeout_ms passes.
+    // Always true in a fake root, which has no way to tell.
+    bool wait_empty(int group_fd, int timeout_ms) const;
+
+    // rmdir the group; in a fake root the stand-in control files go first
+    bool remove(const std::string& group) const;
+
+private:
+    std::string root_;
+    bool is_cgroupfs_ = false;
+};
+
+}  // namespace safebox
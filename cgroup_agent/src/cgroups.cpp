@@ -1,37 +1,64 @@
+#include <unistd.h>
+
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-namespace fs = std::filesystem;
+#include "cgroup_fs.hpp"
 
-static const char* CG_BASE = "/sys/fs/cgroup";
+namespace fs = std::filesystem;
 
 static void usage() {
     std::cerr << "Usage:\n"
               << "  safebox_cgroup create <group>\n"
               << "  safebox_cgroup attach <group> <pid>\n"
               << "  safebox_cgroup mem.set <group> <bytes>\n"
-              << "  safebox_cgroup cpu.set <group> <quota> <period>\n";
+              << "  safebox_cgroup cpu.set <group> <quota> <period>\n"
+              << "  safebox_cgroup apply            (stdin: <group> TAB <file> TAB <value> per line)\n";
 }
 
-static bool write_file(const fs::path& p, const std::string& v) {
-    try {
-        std::ofstream f(p);
-        f << v;
-        return f.good();
-    } catch (...) {
-        return false;
+// Many writes in one process: each group's directory is opened once. Prints
+// one "ok"/"error ..." line per input line; exit 0 only if every write landed.
+static int apply_batch(const safebox::CgroupFs& cg) {
+    std::unordered_map<std::string, int> fds;
+    std::string line;
+    int failed = 0;
+    while (std::getline(std::cin, line)) {
+        if (line.empty()) continue;
+        size_t a = line.find('\t'), b = a == std::string::npos ? a : line.find('\t', a + 1);
+        if (b == std::string::npos) {
+            std::cout << "error malformed line\n";
+            failed++;
+            continue;
+        }
+        std::string group = line.substr(0, a), file = line.substr(a + 1, b - a - 1);
+        auto it = fds.find(group);
+        if (it == fds.end()) it = fds.emplace(group, cg.open_group(group)).first;
+        if (it->second < 0) {
+            std::cout << "error group does not exist: " << group << "\n";
+            failed++;
+        } else if (!cg.write(it->second, file.c_str(), line.substr(b + 1) + "\n")) {
+            std::cout << "error failed to set " << file << " for " << group << "\n";
+            failed++;
+        } else {
+            std::cout << "ok\n";
+        }
+    }
+    for (auto& [group, fd] : fds) {
+        if (fd >= 0) close(fd);
     }
+    return failed ? 7 : 0;
 }
 
 int main(int argc, char** argv) {
+    if (argc == 2 && std::string(argv[1]) == "apply") return apply_batch(safebox::CgroupFs());
     if (argc < 3) { usage(); return 1; }
     std::string cmd = argv[1];
     std::string group = argv[2];
-    fs::path base(CG_BASE);
-    fs::path grp = base / group;
+    safebox::CgroupFs cg;
+    fs::path grp = cg.path(group);
 
     if (cmd == "create") {
         try {
@@ -44,7 +71,8 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (!fs::exists(grp)) {
+    int gfd = cg.open_group(group);
+    if (gfd < 0) {
         std::cerr << "group does not exist: " << grp << "\n";
         return 3;
     }
@@ -52,7 +80,7 @@ int main(int argc, char** argv) {
     if (cmd == "attach") {
         if (argc < 4) { usage(); return 1; }
         std::string pid = argv[3];
-        if (!write_file(grp / "cgroup.procs", pid + "\n")) {
+        if (!cg.write(gfd, "cgroup.procs", pid + "\n")) {
             std::cerr << "failed to attach pid" << "\n";
             return 4;
         }
@@ -63,7 +91,7 @@ int main(int argc, char** argv) {
     if (cmd == "mem.set") {
         if (argc < 4) { usage(); return 1; }
         std::string bytes = argv[3];
-        if (!write_file(grp / "memory.max", bytes + "\n")) {
+        if (!cg.write(gfd, "memory.max", bytes + "\n")) {
             std::cerr << "failed to set memory.max" << "\n";
             return 5;
         }
@@ -75,7 +103,7 @@ int main(int argc, char** argv) {
         if (argc < 5) { usage(); return 1; }
         std::string quota = argv[3];
         std::string period = argv[4];
-        if (!write_file(grp / "cpu.max", quota + " " + period + "\n")) {
+        if (!cg.write(gfd, "cpu.max", quota + " " + period + "\n")) {
             std::cerr << "failed to set cpu.max" << "\n";
             return 6;
         }
@@ -0,0 +1,660 @@
+#include "controller.hpp"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+
+#include "json_util.hpp"
+
+namespace safebox {
+
+// epoll tokens: group id + GROUP_TOKEN for PSI triggers
+static const uint64_t WAKE_TOKEN = 0;
+static const uint64_t TIMER_TOKEN = 1;
+static const uint64_t GROUP_TOKEN = 2;
+
+// memory.pressure trigger: 100 ms of "some" stall within any 1 s window
+static const char* MEMORY_TRIGGER = "some 100000 1000000";
+static const size_t RECENT_DECISIONS = 1024;
+static const int64_t PAGE = 4096;
+static const double INTEGRAL_LIMIT = 1.0;   // anti-windup clamp, error-seconds
+
+// Growth of a cumulative counter, -1 when either side is missing or it went back
+static int64_t delta(int64_t now, int64_t before) {
+    return now >= 0 && before >= 0 && now >= before ? now - before : -1;
+}
+
+static uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static std::string pct(double fraction) {
+    return std::to_string((int)std::lround(fraction * 100.0)) + "%";
+}
+
+static std::string mb(int64_t bytes) {
+    return std::to_string(bytes / (1024 * 1024)) + "MB";
+}
+
+// Forecast upper bound of memory.current over the horizon, with margin; 0
+// until the forecast has warmed up
+static double memory_ahead(const ControlTuning& t, const ControlState& st) {
+    if (t.forecast.horizon <= 0 || !st.mem_forecast.ready()) return 0.0;
+    return st.mem_forecast.upper(t.forecast) * t.forecast_margin;
+}
+
+static std::string accuracy_json(const ForecastAccuracy& a) {
+    std::ostringstream o;
+    o << "{\"scored\":" << a.scored << ",\"wape\":" << a.wape() << ",\"coverage\":" << a.coverage() << "}";
+    return o.str();
+}
+
+// Sets state.cpu_want from the PI loop; allocate_cpu() decides the quota
+static void cpu_step(const ControlTuning& t, const ControlBounds& b, ControlState& st, const GroupSample& now,
+                     double dt_us) {
+    const int64_t used = delta(now.cpu_usage_us, st.last.cpu_usage_us);
+    if (used < 0 || st.cpu_percent <= 0) return;
+
+    // Share of the tick spent throttled. throttled_usec sums over CPUs, so
+    // it is capped at the whole tick; without it, fall back to the share of
+    // enforcement periods that throttled.
+    double throttled = 0;
+    const int64_t thr_us = delta(now.cpu_throttled_us, st.last.cpu_throttled_us);
+    const int64_t periods = delta(now.cpu_nr_periods, st.last.cpu_nr_periods);
+    const int64_t thr_n = delta(now.cpu_nr_throttled, st.last.cpu_nr_throttled);
+    const double hit = periods > 0 && thr_n >= 0 ? (double)thr_n / (double)periods : 0.0;
+    if (thr_us >= 0) throttled = std::min(1.0, (double)thr_us / dt_us);
+    else throttled = hit;
+
+    // cpu.pressure "some": runnable but not running. It only says the quota
+    // is short when the group also hit it (throttled in some period);
+    // otherwise it is contention for cores more quota would not fix.
+    const double usage_pct = 100.0 * (double)used / dt_us;
+    const int64_t stall_us = delta(now.cpu_some_us, st.last.cpu_some_us);
+    const double stall = stall_us >= 0 ? std::min(1.0, (double)stall_us / dt_us) : 0.0;
+    const bool demand = hit > 0 || throttled > 0;
+    const double pressure = std::max(throttled, demand ? stall : 0.0);
+
+    const int top = std::max(b.cpu_ceiling, b.cpu_burst);
+    const double e = pressure - t.throttle_target;
+    double want;
+    if (e > 0) {
+        // Anti-windup: stop accumulating once the output is pinned at the top
+        if (st.cpu_want < top) st.integral = std::min(st.integral + e * dt_us / 1e6, INTEGRAL_LIMIT);
+        want = st.cpu_percent * (1.0 + t.kp * e + t.ki * st.integral);
+    } else {
+        // Quota not binding: let go of part of what is unused each tick
+        st.integral = std::max(0.0, st.integral + e * dt_us / 1e6);
+        want = st.cpu_percent - t.release * (st.cpu_percent - usage_pct * t.usage_headroom);
+    }
+    want = std::max(want, usage_pct * t.usage_headroom);
+    // Ahead of a rise the trend already shows
+    st.cpu_forecast.update(usage_pct, t.forecast);
+    if (t.forecast.horizon > 0 && st.cpu_forecast.ready()) {
+        want = std::max(want, st.cpu_forecast.upper(t.forecast));
+    }
+    // Mostly throttled below its own reservation: it was lending and needs
+    // it back now, not over several ticks
+    if (throttled > 0.5) want = std::max(want, (double)b.cpu_ceiling);
+    st.cpu_want = std::clamp((int)std::ceil(want), b.cpu_floor, top);
+    st.cpu_throttled = throttled;
+    st.cpu_stalled = stall;
+    st.cpu_used = usage_pct;
+}
+
+// Pressure is measured since the last decision (st.mem_last), tick or not;
+// only a tick feeds the forecast and counts towards calm
+static void memory_step(const ControlTuning& t, const ControlBounds& b, ControlState& st, const GroupSample& now,
+                        bool tick, int id, std::vector<ControlDecision>& out) {
+    const int64_t cur = now.memory_current;
+    if (cur < 0 || st.memory_high <= 0 || b.mem_ceiling <= 0) return;
+    const GroupSample& base = st.mem_last.t_ns != 0 ? st.mem_last : st.last;
+    if (now.t_ns <= base.t_ns) return;
+    const double dt_us = (double)(now.t_ns - base.t_ns) / 1000.0;
+    if (tick && st.pool_wait > 0) --st.pool_wait;
+    // memory.max, when part of the reservation is lent out
+    const int64_t top = st.memory_max > 0 ? std::min(st.memory_max, b.mem_ceiling) : b.mem_ceiling;
+    if (tick) st.mem_forecast.update((double)cur, t.forecast);
+    const double ahead = memory_ahead(t, st);
+
+    const int64_t stall_us = delta(now.mem_some_us, base.mem_some_us);
+    const double stall = stall_us >= 0 ? (double)stall_us / dt_us : 0.0;
+    const int64_t high_events = delta(now.mem_events_high, base.mem_events_high);
+    const int64_t oom_kills = delta(now.mem_events_oom_kill, base.mem_events_oom_kill);
+
+    int64_t next = st.memory_high;
+    std::string why;
+    bool grow = true;
+    if (oom_kills > 0) {
+        // Give everything back and hold off stepping down for a while
+        next = b.mem_ceiling;
+        st.calm = -3 * t.calm_ticks;
+        why = "oom_kill";
+    } else if (stall > t.mem_stall || high_events > 0) {
+        next = (int64_t)(std::max(st.memory_high, cur) * t.mem_increase);
+        st.calm = std::min(st.calm, 0);
+        why = "stalled " + pct(stall) + ", " + std::to_string(std::max<int64_t>(high_events, 0)) + " high events";
+    } else if (ahead > st.memory_high) {
+        // Predicted to reach memory.high within the horizon: raise it first,
+        // by twice the predicted growth so the next raise is a horizon away
+        next = (int64_t)(ahead + std::max(0.0, ahead - (double)cur));
+        st.calm = std::min(st.calm, 0);
+        why = "forecast " + mb((int64_t)st.mem_forecast.upper(t.forecast)) + " within " +
+              std::to_string(t.forecast.horizon) + " ticks at " + mb(cur);
+    } else if (cur < st.memory_high * t.mem_idle && ahead < st.memory_high * t.mem_idle) {
+        // Calm now and over the horizon
+        if (!tick || ++st.calm < t.calm_ticks) return;
+        st.calm = 0;
+        next = std::max({st.memory_high - (int64_t)(t.mem_decrease * b.mem_ceiling), (int64_t)(cur / t.mem_idle),
+                         (int64_t)ahead});
+        why = "calm at " + mb(cur);
+        grow = false;
+    } else {
+        st.calm = std::min(st.calm, 0);
+        return;
+    }
+
+    next = std::clamp(next / PAGE * PAGE, b.mem_floor, b.mem_ceiling);
+    if (grow && next > top && st.pool_wait == 0) {
+        // Growing into what it lent: ask for all of it back. Only a request
+        // until the pool grants it.
+        ControlDecision d;
+        d.id = id;
+        d.knob = "memory.max";
+        d.from = st.memory_max;
+        d.to = b.mem_ceiling;
+        d.reason = why + ", wants lent memory back";
+        out.push_back(std::move(d));
+    }
+    // Growth never lowers memory.high, even above a lent memory.max
+    next = std::min(next, std::max(top, st.memory_high));
+    if (next == st.memory_high) return;
+    ControlDecision d;
+    d.id = id;
+    d.knob = "memory.high";
+    d.from = st.memory_high;
+    d.to = next;
+    d.reason = why;
+    out.push_back(std::move(d));
+    st.memory_high = next;
+}
+
+// Every reclaim_period ticks (longer after refaults), on a memory.stat sample
+static void reclaim_step(const ControlTuning& t, const ControlBounds& b, ControlState& st, const GroupSample& now,
+                         int id, std::vector<ControlDecision>& out) {
+    if (!st.reclaim) return;
+    if (st.reclaim_wait > 0) --st.reclaim_wait;
+    const int64_t cur = now.memory_current;
+    if (now.mem_inactive < 0 || now.mem_refault < 0 || cur < 0) return;
+    const GroupSample prev = st.reclaim_last;
+    st.reclaim_last = now;
+    st.reclaim_wait = t.reclaim_period * st.reclaim_backoff;
+    const int64_t used = delta(now.cpu_usage_us, prev.cpu_usage_us);
+    if (prev.t_ns == 0 || now.t_ns <= prev.t_ns || used < 0) return;
+
+    const double cpu = 100.0 * (double)used / ((double)(now.t_ns - prev.t_ns) / 1000.0);
+    const int64_t refault = std::max<int64_t>(delta(now.mem_refault, prev.mem_refault), 0) * PAGE;
+    if (st.reclaim_step > 0) {
+        if (refault > t.reclaim_refault * st.reclaim_step) {
+            // What the last step pushed out is coming back: it was not cold
+            st.reclaim_backoff = std::min(st.reclaim_backoff * 2, t.reclaim_backoff_max);
+            st.reclaim_wait = t.reclaim_period * st.reclaim_backoff;
+            st.reclaim_step = 0;
+            return;
+        }
+        st.reclaim_backoff = std::max(1, st.reclaim_backoff / 2);
+        st.reclaim_step = 0;
+    }
+    const bool idle = cpu < t.reclaim_idle_cpu;
+    const bool cold = now.mem_inactive >= t.reclaim_inactive * cur && refault <= t.reclaim_refault * t.reclaim_min &&
+                      delta(now.mem_events_high, prev.mem_events_high) <= 0;
+    if (!idle || !cold || st.calm < 0) return;
+
+    const int64_t step = std::min(std::clamp((int64_t)(now.mem_inactive * t.reclaim_share) / PAGE * PAGE,
+                                             t.reclaim_min, t.reclaim_max),
+                                  now.mem_inactive / PAGE * PAGE);
+    if (step > 0) {
+        ControlDecision d;
+        d.id = id;
+        d.knob = "memory.reclaim";
+        d.from = cur;
+        d.to = cur - step;
+        d.reason = "idle at " + std::to_string((int)std::lround(cpu)) + "%, " + mb(now.mem_inactive) + " inactive";
+        out.push_back(std::move(d));
+        st.reclaim_step = step;
+        st.reclaimed += step;
+    }
+
+    // Lend what usage no longer needs, in whole MB, keeping headroom
+    if (st.memory_max <= 0 || st.pool_wait > 0) return;
+    const int64_t MB = 1 << 20;
+    int64_t target = std::max({(int64_t)(cur * t.lend_headroom) + t.lend_min, (int64_t)memory_ahead(t, st),
+                               b.mem_floor});
+    target = (target + MB - 1) / MB * MB;
+    if (target > st.memory_max - t.lend_min) return;
+    ControlDecision d;
+    d.id = id;
+    d.knob = "memory.max";
+    d.from = st.memory_max;
+    d.to = target;
+    d.reason = "cold at " + mb(cur) + ", lending " + mb(st.memory_max - target);
+    out.push_back(std::move(d));
+    st.memory_max = target;
+}
+
+void control_step(const ControlTuning& tuning, const ControlBounds& bounds, ControlState& state,
+                  const GroupSample& now, int id, std::vector<ControlDecision>& out, bool tick) {
+    if (state.last.t_ns != 0 && now.t_ns > state.last.t_ns) {
+        const double dt_us = (double)(now.t_ns - state.last.t_ns) / 1000.0;
+        if (tick) cpu_step(tuning, bounds, state, now, dt_us);
+        memory_step(tuning, bounds, state, now, tick, id, out);
+    }
+    if (!tick) {
+        if (state.last.t_ns != 0) state.mem_last = now;
+        return;
+    }
+    reclaim_step(tuning, bounds, state, now, id, out);
+    state.last = now;
+    state.mem_last = now;
+}
+
+// Move one group's quota to `next` unless the change is inside the deadband
+static void set_quota(const ControlTuning& t, const ControlTarget& g, int next, int lent,
+                      std::vector<ControlDecision>& out) {
+    const ControlBounds& b = *g.bounds;
+    ControlState& st = *g.state;
+    if (next == st.cpu_percent) return;
+    // Small moves are skipped, except to land on a bound or to hand back
+    // borrowed CPU
+    const int band = std::max(1, (int)std::lround(t.cpu_deadband * b.cpu_ceiling));
+    const bool boundary = next == b.cpu_ceiling || next == b.cpu_floor || st.cpu_percent > b.cpu_ceiling;
+    if (std::abs(next - st.cpu_percent) < band && !boundary) return;
+
+    ControlDecision d;
+    d.id = g.id;
+    d.knob = "cpu.max";
+    d.from = st.cpu_percent;
+    d.to = next;
+    d.reason = "throttled " + pct(st.cpu_throttled) + ", stalled " + pct(st.cpu_stalled) + ", used " +
+               std::to_string((int)std::lround(st.cpu_used)) + "%" +
+               (lent > 0 ? ", borrowing " + std::to_string(lent) + "%" : "");
+    out.push_back(std::move(d));
+    st.cpu_percent = next;
+}
+
+void allocate_cpu(const ControlTuning& tuning, std::vector<ControlTarget>& groups,
+                  std::vector<ControlDecision>& out) {
+    // Groups wanting no more than their reservation settle first. The pool
+    // is what they then actually hold back (a move skipped by the deadband
+    // lends nothing), so the total never passes the reservations.
+    int64_t pool = 0, short_total = 0;
+    for (auto& g : groups) {
+        ControlState& st = *g.state;
+        if (st.cpu_percent <= 0) continue;
+        const int ceiling = g.bounds->cpu_ceiling;
+        if (st.cpu_want <= 0) st.cpu_want = st.cpu_percent;
+        if (st.cpu_want > ceiling) {
+            short_total += st.cpu_want - ceiling;
+            continue;
+        }
+        set_quota(tuning, g, std::max(g.bounds->cpu_floor, st.cpu_want), 0, out);
+        pool += ceiling - std::min(st.cpu_percent, ceiling);
+    }
+
+    // Then the rest: their own reservation plus a share of the pool in
+    // proportion to the shortfall, rounded down so the sum holds
+    const double share = short_total > pool ? (double)pool / (double)short_total : 1.0;
+    for (auto& g : groups) {
+        ControlState& st = *g.state;
+        const int ceiling = g.bounds->cpu_ceiling;
+        if (st.cpu_percent <= 0 || st.cpu_want <= ceiling) continue;
+        const int lent = (int)std::floor((st.cpu_want - ceiling) * share);
+        const int next = ceiling + lent;
+        // An increase may be skipped by the deadband; a decrease never is
+        set_quota(tuning, g, next, lent, out);
+    }
+}
+
+std::string decision_json(const ControlDecision& d) {
+    std::ostringstream o;
+    o << "{\"t_ms\":" << d.t_ns / 1000000 << ",\"id\":" << d.id << ",\"knob\":\"" << d.knob << "\",\"from\":" << d.from
+      << ",\"to\":" << d.to << ",\"reason\":\"" << json_escape(d.reason) << "\"}";
+    return o.str();
+}
+
+LimitController::LimitController(const CgroupFs& cg, int period_ms, ControlTuning tuning, const std::string& log_path,
+                                 MemoryPool pool)
+    : cg_(cg), period_ms_(std::max(1, period_ms)), tuning_(tuning), pool_(std::move(pool)) {
+    if (!log_path.empty()) {
+        log_ = std::fopen(log_path.c_str(), "a");
+        if (!log_) {
+            std::cerr << "⚠️  Warning: cannot open controller log " << log_path << ": " << std::strerror(errno) << "\n";
+        }
+    }
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec its {};
+    its.it_interval.tv_sec = period_ms_ / 1000;
+    its.it_interval.tv_nsec = (long)(period_ms_ % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    timerfd_settime(timer_fd_, 0, &its, nullptr);
+
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKE_TOKEN;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    ev.data.u64 = TIMER_TOKEN;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, timer_fd_, &ev);
+    thread_ = std::thread(&LimitController::run, this);
+}
+
+LimitController::~LimitController() {
+    uint64_t one = 1;
+    ssize_t w = write(wake_fd_, &one, sizeof(one));
+    (void)w;
+    thread_.join();
+    groups_.clear();
+    close(timer_fd_);
+    close(wake_fd_);
+    close(epfd_);
+    if (log_) std::fclose(log_);
+}
+
+bool LimitController::add(int id, const std::string& cgroup, int group_fd, const ControlBounds& bounds) {
+    Group g;
+    g.cgroup = cgroup;
+    g.probe = GroupProbe(group_fd);
+    if (g.probe.group_fd() < 0) return false;
+    g.bounds = bounds;
+    // A knob the group does not have (controller not enabled) stays at 0,
+    // which control_step() leaves alone
+    const int fd = g.probe.group_fd();
+    if (faccessat(fd, "cpu.max", W_OK, 0) == 0) g.state.cpu_percent = g.state.cpu_want = bounds.cpu_ceiling;
+    // memory.high comes with memory.max (and a fake root only has the latter)
+    if (faccessat(fd, "memory.max", W_OK, 0) == 0) {
+        g.state.memory_high = bounds.mem_ceiling;   // same as "max" while memory.max is the ceiling
+        if (pool_) g.state.memory_max = bounds.mem_ceiling;
+    }
+    if (faccessat(fd, "memory.reclaim", W_OK, 0) == 0) {
+        g.state.reclaim = true;
+        g.state.reclaim_wait = tuning_.reclaim_period;
+    }
+    g.probe.sample(g.state.last, g.state.reclaim);
+    g.state.reclaim_last = g.state.last;
+
+    std::lock_guard<std::mutex> lock(mu_);
+    if (groups_.count(id)) return false;
+    g.trigger_fd = g.probe.arm_memory_trigger(MEMORY_TRIGGER);
+    if (g.trigger_fd >= 0) {
+        struct epoll_event ev {};
+        ev.events = EPOLLPRI;
+        ev.data.u64 = GROUP_TOKEN + (uint64_t)id;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, g.trigger_fd, &ev);
+    }
+    if (trace_.is_open()) {
+        TraceGroupInfo info;
+        info.id = id;
+        info.cgroup = cgroup;
+        info.cpu_reserved = bounds.cpu_ceiling;
+        info.cpu_floor = bounds.cpu_floor;
+        info.cpu_burst = bounds.cpu_burst;
+        info.mem_reserved = bounds.mem_ceiling;
+        info.mem_floor = bounds.mem_floor;
+        trace_.group(info);
+    }
+    groups_.emplace(id, std::move(g));
+    return true;
+}
+
+void LimitController::remove(int id) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = groups_.find(id);
+    if (it == groups_.end()) return;
+    if (it->second.trigger_fd >= 0) epoll_ctl(epfd_, EPOLL_CTL_DEL, it->second.trigger_fd, nullptr);
+    retired_memory_.merge(it->second.state.mem_forecast.accuracy());
+    retired_cpu_.merge(it->second.state.cpu_forecast.accuracy());
+    trace_.exit(id);
+    groups_.erase(it);
+}
+
+bool LimitController::start_trace(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mu_);
+    return trace_.open(path, period_ms_);
+}
+
+ControlStats LimitController::stats() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    ControlStats st;
+    st.groups = groups_.size();
+    st.ticks = ticks_;
+    st.last_sweep_ns = last_sweep_ns_;
+    st.max_sweep_ns = max_sweep_ns_;
+    st.decisions = decisions_;
+    st.reclaimed = reclaimed_;
+    st.memory_forecast = retired_memory_;
+    st.cpu_forecast = retired_cpu_;
+    for (const auto& [id, g] : groups_) {
+        if (g.state.memory_max > 0) st.memory_lent += g.bounds.mem_ceiling - g.state.memory_max;
+        st.memory_forecast.merge(g.state.mem_forecast.accuracy());
+        st.cpu_forecast.merge(g.state.cpu_forecast.accuracy());
+    }
+    return st;
+}
+
+void LimitController::run() {
+    struct epoll_event evs[64];
+    for (;;) {
+        int n = epoll_wait(epfd_, evs, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            const uint64_t tok = evs[i].data.u64;
+            if (tok == WAKE_TOKEN) return;
+            if (tok == TIMER_TOKEN) {
+                uint64_t expirations;
+                ssize_t r = read(timer_fd_, &expirations, sizeof(expirations));
+                (void)r;
+                sweep();
+                continue;
+            }
+            // A group started stalling on memory: decide its memory.high
+            // now, not next tick. Everything else waits for the sweep, so
+            // the forecasts and the integral stay at one sample a tick.
+            std::lock_guard<std::mutex> lock(mu_);
+            auto it = groups_.find((int)(tok - GROUP_TOKEN));
+            if (it == groups_.end()) continue;
+            std::vector<ControlDecision> decisions;
+            step(it->first, it->second, decisions, false);
+            commit(decisions);
+        }
+        settle();
+    }
+}
+
+// Every group sampled and stepped, then one global CPU allocation
+void LimitController::sweep() {
+    const auto t0 = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mu_);
+    std::vector<ControlDecision> decisions;
+    std::vector<ControlTarget> targets;
+    targets.reserve(groups_.size());
+    trace_.tick((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t0.time_since_epoch()).count());
+    for (auto& [id, g] : groups_) {
+        step(id, g, decisions, true);
+        targets.push_back({id, &g.bounds, &g.state});
+    }
+    allocate_cpu(tuning_, targets, decisions);
+    commit(decisions);
+    trace_.flush();
+    ++ticks_;
+    last_sweep_ns_ = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - t0).count();
+    max_sweep_ns_ = std::max(max_sweep_ns_, last_sweep_ns_);
+    lock.unlock();
+    settle();
+}
+
+// Sample and decide one group; mu_ held. A sweep's samples are traced with
+// the limits they were taken under; between sweeps only memory.high moves.
+void LimitController::step(int id, Group& g, std::vector<ControlDecision>& out, bool sweeping) {
+    GroupSample s;
+    if (!g.probe.sample(s, sweeping && wants_memory_stat(g.state))) return;
+    if (sweeping && trace_.is_open()) {
+        const ControlState& st = g.state;
+        TraceLimits limits;
+        if (st.cpu_percent > 0) limits.cpu_percent = st.cpu_percent;
+        if (st.memory_high > 0) {
+            limits.memory_high = st.memory_high;
+            limits.memory_max = st.memory_max > 0 ? st.memory_max : g.bounds.mem_ceiling;
+        }
+        trace_.sample(id, s, limits);
+    }
+    control_step(tuning_, g.bounds, g.state, s, id, out, sweeping);
+}
+
+// Write, log and remember decisions; mu_ held. memory.max moves go on to
+// settle(): a lent one once written, a request before anything else.
+void LimitController::commit(std::vector<ControlDecision>& decisions) {
+    const uint64_t now = realtime_ns();
+    for (auto& d : decisions) {
+        d.t_ns = now;
+        const bool limit = std::strcmp(d.knob, "memory.max") == 0;
+        const long moved_mb = (long)((d.to - d.from) / (1 << 20));
+        if (limit && d.to > d.from) {
+            moves_.push_back({std::move(d), moved_mb});
+            continue;
+        }
+        auto it = groups_.find(d.id);
+        if (it != groups_.end() && !apply(it->second, d)) continue;
+        if (limit) moves_.push_back({d, moved_mb});
+        record(d);
+    }
+    if (log_ && !decisions.empty()) std::fflush(log_);
+}
+
+void LimitController::record(ControlDecision d) {
+    ++decisions_;
+    if (std::strcmp(d.knob, "memory.reclaim") == 0) reclaimed_ += d.from - d.to;
+    if (log_) std::fputs((decision_json(d) + "\n").c_str(), log_);
+    recent_.push_back(std::move(d));
+    if (recent_.size() > RECENT_DECISIONS) recent_.pop_front();
+}
+
+// Hand lent memory to the pool and ask it for memory back, without mu_ (the
+// pool is the Executor's Banker, behind its own lock)
+void LimitController::settle() {
+    std::vector<PoolMove> moves;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        moves.swap(moves_);
+    }
+    if (moves.empty()) return;
+    std::vector<char> granted(moves.size());
+    for (size_t i = 0; i < moves.size(); ++i) {
+        granted[i] = pool_ && pool_(moves[i].decision.id, moves[i].mb);
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    for (size_t i = 0; i < moves.size(); ++i) {
+        ControlDecision& d = moves[i].decision;
+        if (moves[i].mb < 0) continue;   // lent: written and recorded already
+        auto it = groups_.find(d.id);
+        if (it == groups_.end()) continue;   // released meanwhile; the grant goes with the reservation
+        ControlState& st = it->second.state;
+        if (!granted[i]) {
+            // Admitted jobs hold it for now; the group stays capped and retries later
+            st.pool_wait = tuning_.calm_ticks;
+            continue;
+        }
+        d.t_ns = realtime_ns();
+        st.memory_max = d.to;
+        st.pool_wait = 3 * tuning_.calm_ticks;   // and no lending straight back
+        if (apply(it->second, d)) record(d);
+    }
+    if (log_) std::fflush(log_);
+}
+
+// A failed write hands the knob back to its reservation for good
+bool LimitController::apply(Group& g, ControlDecision& d) {
+    const int fd = g.probe.group_fd();
+    bool ok;
+    if (std::strcmp(d.knob, "cpu.max") == 0) {
+        ok = cg_.set_cpu_max(fd, d.to * 1000, 100000);
+        if (!ok) g.state.cpu_percent = 0;
+    } else if (std::strcmp(d.knob, "memory.high") == 0) {
+        ok = cg_.set_memory_high(fd, d.to);
+        if (!ok) g.state.memory_high = 0;
+    } else if (std::strcmp(d.knob, "memory.reclaim") == 0) {
+        ok = cg_.reclaim_memory(fd, d.from - d.to);
+        // EAGAIN: the kernel freed less than asked, which the refaults judge
+        if (!ok && errno == EAGAIN) {
+            d.reason += ", partly freed";
+            ok = true;
+        }
+        if (!ok) g.state.reclaim = false;
+    } else {
+        ok = cg_.set_memory_max(fd, d.to);
+        // Nothing is lent if lowering failed; if raising did, what was
+        // granted stays reserved and unused until the job is released
+        if (!ok) g.state.memory_max = 0;
+    }
+    if (!ok) {
+        std::cerr << "⚠️  Warning: controller stops managing " << d.knob << " on " << g.cgroup << ": "
+                  << std::strerror(errno) << "\n";
+    }
+    return ok;
+}
+
+std::string LimitController::state_json(size_t limit) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::ostringstream o;
+    int64_t lent = 0;
+    ForecastAccuracy mem_acc = retired_memory_, cpu_acc = retired_cpu_;
+    for (const auto& [id, g] : groups_) {
+        if (g.state.memory_max > 0) lent += g.bounds.mem_ceiling - g.state.memory_max;
+        mem_acc.merge(g.state.mem_forecast.accuracy());
+        cpu_acc.merge(g.state.cpu_forecast.accuracy());
+    }
+    o << "{\"period_ms\":" << period_ms_ << ",\"ticks\":" << ticks_ << ",\"decisions_total\":" << decisions_
+      << ",\"reclaimed_bytes\":" << reclaimed_ << ",\"memory_lent_bytes\":" << lent
+      << ",\"forecast\":{\"memory\":" << accuracy_json(mem_acc) << ",\"cpu\":" << accuracy_json(cpu_acc) << "}"
+      << ",\"sweep_us\":" << last_sweep_ns_ / 1000 << ",\"max_sweep_us\":" << max_sweep_ns_ / 1000 << ",\"groups\":{";
+    bool first = true;
+    for (const auto& [id, g] : groups_) {
+        o << (first ? "" : ",") << '"' << id << "\":{\"cgroup\":\"" << json_escape(g.cgroup)
+          << "\",\"cpu_percent\":" << g.state.cpu_percent << ",\"cpu_floor\":" << g.bounds.cpu_floor
+          << ",\"cpu_ceiling\":" << g.bounds.cpu_ceiling << ",\"cpu_burst\":" << g.bounds.cpu_burst
+          << ",\"cpu_want\":" << g.state.cpu_want << ",\"cpu_throttled\":" << g.state.cpu_throttled
+          << ",\"cpu_stalled\":" << g.state.cpu_stalled << ",\"memory_high\":" << g.state.memory_high
+          << ",\"memory_max\":" << (g.state.memory_max > 0 ? g.state.memory_max : g.bounds.mem_ceiling)
+          << ",\"reclaimed\":" << g.state.reclaimed
+          << ",\"memory_forecast\":" << (int64_t)memory_ahead(tuning_, g.state)
+          << ",\"memory_floor\":" << g.bounds.mem_floor
+          << ",\"memory_ceiling\":" << g.bounds.mem_ceiling
+          << ",\"psi_trigger\":" << (g.trigger_fd >= 0 ? "true" : "false") << "}";
+        first = false;
+    }
+    o << "},\"decisions\":[";
+    const size_t skip = recent_.size() > limit ? recent_.size() - limit : 0;
+    for (size_t i = skip; i < recent_.size(); ++i) o << (i > skip ? "," : "") << decision_json(recent_[i]);
+    o << "]}";
+    return o.str();
+}
+
+}  // namespace safebox
@@ -0,0 +1,256 @@
+// controller.hpp - closed-loop cpu.max / memory.high control over every job
+// cgroup.
+//
+// Every period (100 ms by default) all controlled groups are sampled in one
+// sweep. control_step() turns each group's sample into the CPU it would like
+// and any memory.high change:
+//
+//   cpu.max      PI on the group's own CPU pressure: the fraction of the
+//                tick it spent throttled (cpu.stat throttled_usec, or the
+//                nr_throttled/nr_periods rate), or its cpu.pressure stall
+//                while it is up against the quota. The target is small but
+//                non-zero so a busy job keeps just enough quota; while it is
+//                not under pressure, a share of the unused quota is released
+//                each tick. Never below what the job actually used last tick
+//                plus headroom, so a quota cannot starve a job into looking
+//                idle.
+//   memory.high  AIMD: multiplicative increase as soon as the group stalls
+//                on memory (PSI) or trips memory.high, additive decrease only
+//                after a run of calm ticks well below it. memory.max stays at
+//                the reservation, so the kernel reclaims at memory.high long
+//                before anything is OOM-killed.
+//   memory.reclaim  about once a second, a group that is idle on CPU and
+//                whose memory.stat shows a cold working set (a good share
+//                inactive, few refaults) is asked to give back a small step
+//                of it. Refaults of what was pushed out double the wait
+//                before the next step. Once usage has come down, memory.max
+//                is lowered to usage plus headroom and the difference goes
+//                back to the Banker (MemoryPool) as admissible capacity; the
+//                group asks for it back as soon as it stalls or trips
+//                memory.high against the lowered cap.
+//
+// Both knobs also look ahead: each group keeps a Holt forecast (level plus
+// damped trend, forecast.hpp) of its memory.current and CPU use, and
+// memory.high is raised before the forecast's upper bound reaches it (and
+// not stepped down below it), as is the CPU a group asks for. A ramping
+// job gets its headroom a second before it would have tripped memory.high.
+//
+// allocate_cpu() then shares out the CPU the groups' Banker reservations add
+// up to: each group first gets what it wants up to its own reservation, and
+// the slack idle groups leave is lent to throttled groups in proportion to
+// how far short they are. The total never exceeds the reservations, and a
+// lender that starts throttling gets its whole reservation back on the next
+// tick. Memory is not lent: memory.max cannot be taken back quickly.
+//
+// Both knobs have a deadband, so small errors leave the file alone and the
+// loop does not chatter. A PSI trigger on memory.pressure wakes the loop
+// between ticks when a group starts stalling; that wakeup only decides
+// memory.high, and the forecasts and the PI integral still see one sample
+// per tick. Every change is kept in a ring
+// of recent decisions and optionally appended to a JSON-lines log.
+//
+// control_step() and allocate_cpu() are pure functions of the samples so a
+// trace can be replayed through them without a cgroup.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cgroup_fs.hpp"
+#include "forecast.hpp"
+#include "sampler.hpp"
+#include "trace_file.hpp"
+
+namespace safebox {
+
+// What the Banker allows: ceilings are the reservation
+struct ControlBounds {
+    int cpu_floor = 1;          // percent of one CPU
+    int cpu_ceiling = 100;
+    int cpu_burst = 0;          // most it may borrow up to; <= cpu_ceiling => never borrows
+    int64_t mem_floor = 0;      // bytes
+    int64_t mem_ceiling = 0;
+};
+
+struct ControlTuning {
+    double throttle_target = 0.05;   // fraction of wall time spent throttled
+    double kp = 0.8;                 // relative quota change per unit of error
+    double ki = 0.2;                 // ... per unit of accumulated error-seconds
+    double release = 0.3;            // share of unused quota given up per unthrottled tick
+    double usage_headroom = 1.25;    // quota >= last tick's usage x this
+    double cpu_deadband = 0.03;      // ignore changes under this fraction of the ceiling
+    double mem_stall = 0.02;         // PSI some share of the tick that counts as stalling
+    double mem_increase = 1.5;       // multiplicative step up
+    double mem_decrease = 0.05;      // additive step down, fraction of the ceiling
+    double mem_idle = 0.7;           // usage below this fraction of memory.high is calm
+    int calm_ticks = 10;             // calm ticks before stepping down
+    ForecastTuning forecast;         // horizon 0 => react only
+    double forecast_margin = 1.1;    // memory.high >= forecast upper bound x this
+
+    int reclaim_period = 10;         // ticks between memory.stat reads
+    double reclaim_idle_cpu = 5;     // percent of one CPU: below this over the period is idle
+    double reclaim_inactive = 0.1;   // inactive share of memory.current that makes it cold
+    double reclaim_share = 0.25;     // step: this share of the inactive pages ...
+    int64_t reclaim_min = 1 << 20;   // ... clamped to these, bytes
+    int64_t reclaim_max = 64 << 20;
+    double reclaim_refault = 0.25;   // refaulted share of the last step that backs off
+    int reclaim_backoff_max = 32;    // periods
+    double lend_headroom = 1.5;      // lent memory.max >= memory.current x this ...
+    int64_t lend_min = 16 << 20;     // ... and changes in steps of at least this
+};
+
+struct ControlState {
+    int cpu_percent = 0;        // current cpu.max quota, 0 => not managed
+    int cpu_want = 0;           // what control_step() asked for
+    double cpu_throttled = 0;   // last tick: share of it throttled
+    double cpu_stalled = 0;     //            share of it runnable but waiting (cpu.pressure)
+    double cpu_used = 0;        //            percent of one CPU used
+    int64_t memory_high = 0;    // current memory.high
+    double integral = 0;        // PI accumulator, error-seconds
+    int calm = 0;               // consecutive calm ticks (negative: back-off after an OOM)
+    GroupSample last;           // previous tick's sample, t_ns 0 before the first
+    GroupSample mem_last;       // memory pressure baseline: the last sample memory.high was decided on
+    HoltForecast mem_forecast;  // memory.current, bytes
+    HoltForecast cpu_forecast;  // percent of one CPU used
+
+    int64_t memory_max = 0;     // current memory.max, 0 => never lent
+    int pool_wait = 0;          // ticks before asking the pool again after a refusal
+    bool reclaim = false;       // memory.reclaim available
+    int reclaim_wait = 0;       // ticks until the next memory.stat read
+    int reclaim_backoff = 1;    // periods per wait, doubled on refaults
+    int64_t reclaim_step = 0;   // bytes asked for last time, 0 => none pending
+    int64_t reclaimed = 0;      // bytes asked for in total
+    GroupSample reclaim_last;   // sample at the previous memory.stat read
+};
+
+// Whether the next sample for this group should include memory.stat
+inline bool wants_memory_stat(const ControlState& st) {
+    return st.reclaim && st.reclaim_wait <= 1;
+}
+
+struct ControlDecision {
+    uint64_t t_ns = 0;          // CLOCK_REALTIME
+    int id = 0;
+    const char* knob = "";      // "cpu.max", "memory.high", "memory.max" or "memory.reclaim"
+    int64_t from = 0;           // percent or bytes
+    int64_t to = 0;
+    std::string reason;
+};
+
+// Advance one group by one sample: sets state.cpu_want, and appends (and
+// adopts) memory.high, memory.reclaim and lending memory.max decisions. A
+// memory.max decision that raises it is only a request: the caller adopts
+// it once the MemoryPool grants the difference. The caller applies
+// decisions. `tick` false is an extra sample between ticks (a PSI wakeup):
+// it only reacts to memory pressure since the last decision and leaves the
+// CPU want, the forecasts, the integral and reclaim to the next tick.
+void control_step(const ControlTuning& tuning, const ControlBounds& bounds, ControlState& state,
+                  const GroupSample& now, int id, std::vector<ControlDecision>& out, bool tick = true);
+
+struct ControlTarget {
+    int id = 0;
+    const ControlBounds* bounds = nullptr;
+    ControlState* state = nullptr;
+};
+
+// Share the groups' reservations out by cpu_want (see above); appends a
+// cpu.max decision per group whose quota moved past the deadband
+void allocate_cpu(const ControlTuning& tuning, std::vector<ControlTarget>& groups,
+                  std::vector<ControlDecision>& out);
+
+std::string decision_json(const ControlDecision& d);
+
+struct ControlStats {
+    size_t groups = 0;
+    uint64_t ticks = 0;
+    uint64_t last_sweep_ns = 0;   // sample + decide + write, every group
+    uint64_t max_sweep_ns = 0;
+    uint64_t decisions = 0;
+    int64_t reclaimed = 0;        // bytes asked of memory.reclaim
+    int64_t memory_lent = 0;      // bytes of reservations currently back in the pool
+    ForecastAccuracy memory_forecast;   // every group's, including removed ones
+    ForecastAccuracy cpu_forecast;
+};
+
+// Moves whole MB of a group's memory reservation to (mb < 0) or from
+// (mb > 0) the admission pool; false if the pool refuses. Called without
+// the controller's lock held.
+using MemoryPool = std::function<bool(int id, long mb)>;
+
+class LimitController {
+public:
+    // `log_path` "" => decisions are only kept in memory; without `pool`
+    // memory.max is never lent
+    LimitController(const CgroupFs& cg, int period_ms, ControlTuning tuning = {}, const std::string& log_path = "",
+                    MemoryPool pool = nullptr);
+    ~LimitController();
+
+    // Take over a group whose cpu.max/memory.max are already at the
+    // ceilings; `group_fd` is duplicated
+    bool add(int id, const std::string& cgroup, int group_fd, const ControlBounds& bounds);
+    void remove(int id);
+
+    // Record every sweep's samples and limits to a trace file (trace_file.hpp)
+    // for offline replay; call before groups are added
+    bool start_trace(const std::string& path);
+
+    // Controlled groups and the newest `limit` decisions as JSON
+    std::string state_json(size_t limit) const;
+    ControlStats stats() const;
+
+private:
+    struct Group {
+        std::string cgroup;
+        GroupProbe probe;
+        ControlBounds bounds;
+        ControlState state;
+        int trigger_fd = -1;   // PSI trigger owned by probe, -1 if unsupported
+    };
+
+    void run();
+    void sweep();
+    void step(int id, Group& g, std::vector<ControlDecision>& out, bool sweeping = false);
+    void commit(std::vector<ControlDecision>& decisions);
+    bool apply(Group& g, ControlDecision& d);
+    void record(ControlDecision d);
+    void settle();
+
+    // memory.max moves waiting on the pool, which is called without mu_
+    struct PoolMove {
+        ControlDecision decision;
+        long mb = 0;   // < 0 lent, > 0 requested
+    };
+
+    const CgroupFs& cg_;
+    const int period_ms_;
+    const ControlTuning tuning_;
+    const MemoryPool pool_;
+    FILE* log_ = nullptr;
+
+    mutable std::mutex mu_;   // guards everything below
+    std::unordered_map<int, Group> groups_;
+    std::deque<ControlDecision> recent_;
+    uint64_t ticks_ = 0;
+    uint64_t last_sweep_ns_ = 0;   // wall time of the newest sweep
+    uint64_t max_sweep_ns_ = 0;
+    uint64_t decisions_ = 0;
+    int64_t reclaimed_ = 0;
+    ForecastAccuracy retired_memory_, retired_cpu_;   // forecasts of removed groups
+    std::vector<PoolMove> moves_;
+    TraceWriter trace_;
+
+    int epfd_ = -1;
+    int timer_fd_ = -1;
+    int wake_fd_ = -1;        // eventfd that stops the loop
+    std::thread thread_;
+};
+
+}  // namespace safebox
@@ -0,0 +1,460 @@
+#include "cpu_profiler.hpp"
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "json_util.hpp"
+
+namespace safebox {
+
+namespace {
+
+const int DRAIN_MS = 100;
+const uint64_t KERNEL_START = 0xffff800000000000ULL;
+
+uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+int perf_event_open(perf_event_attr* attr, int pid, int cpu, int group_fd, unsigned long flags) {
+    return (int)syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+// One CPU's event and its ring buffer
+struct Ring {
+    int fd = -1;
+    void* base = MAP_FAILED;
+    size_t map_bytes = 0;
+    size_t data_bytes = 0;   // power of two, after the metadata page
+
+    perf_event_mmap_page* meta() const { return (perf_event_mmap_page*)base; }
+    const char* data() const { return (const char*)base + (map_bytes - data_bytes); }
+};
+
+struct Mapping {
+    uint64_t start = 0;
+    uint64_t end = 0;
+    uint64_t offset = 0;     // into the file
+    std::string file;        // "<dev> <inode>", the key into files
+    std::string path;
+};
+
+struct Process {
+    std::string comm;
+    std::vector<Mapping> maps;   // executable ones, by start
+};
+
+struct ElfSymbol {
+    uint64_t addr = 0;
+    uint64_t size = 0;
+    std::string name;
+};
+
+struct ElfFile {
+    struct Load {
+        uint64_t offset, vaddr, size;
+    };
+    std::vector<Load> loads;
+    std::vector<ElfSymbol> symbols;   // by addr
+    bool loaded = false;
+};
+
+// Everything gathered while sampling, resolved afterwards
+struct Capture {
+    // pid followed by the callchain as the kernel gave it (leaf first,
+    // with its PERF_CONTEXT_* markers) -> samples
+    std::map<std::vector<uint64_t>, uint64_t> chains;
+    std::unordered_map<int, Process> processes;
+    std::unordered_map<std::string, int> files;   // "<dev> <inode>" -> fd
+    uint64_t samples = 0;
+    uint64_t lost = 0;
+
+    ~Capture() {
+        for (auto& [key, fd] : files) close(fd);
+    }
+};
+
+void note_process(Capture& cap, int pid) {
+    Process& p = cap.processes[pid];
+    const std::string proc = "/proc/" + std::to_string(pid);
+    std::ifstream comm(proc + "/comm");
+    if (!std::getline(comm, p.comm) || p.comm.empty()) p.comm = "[pid " + std::to_string(pid) + "]";
+    std::ifstream maps(proc + "/maps");
+    std::string line;
+    while (std::getline(maps, line)) {
+        // start-end perms offset dev inode path
+        std::istringstream in(line);
+        std::string range, perms, dev, path;
+        uint64_t offset = 0, inode = 0;
+        if (!(in >> range >> perms >> std::hex >> offset >> dev >> std::dec >> inode)) continue;
+        std::getline(in >> std::ws, path);
+        if (perms.size() < 3 || perms[2] != 'x' || inode == 0 || path.empty() || path[0] != '/') continue;
+        Mapping m;
+        if (std::sscanf(range.c_str(), "%lx-%lx", (unsigned long*)&m.start, (unsigned long*)&m.end) != 2) continue;
+        m.offset = offset;
+        m.file = dev + " " + std::to_string(inode);
+        m.path = path;
+        if (!cap.files.count(m.file)) {
+            int fd = open((proc + "/map_files/" + range).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) fd = open((proc + "/root" + path).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) cap.files[m.file] = fd;
+        }
+        p.maps.push_back(std::move(m));
+    }
+    std::sort(p.maps.begin(), p.maps.end(), [](const Mapping& a, const Mapping& b) { return a.start < b.start; });
+}
+
+void on_record(Capture& cap, const char* rec, const perf_event_header& h) {
+    if (h.type == PERF_RECORD_LOST && h.size >= sizeof(h) + 16) {
+        uint64_t lost;
+        std::memcpy(&lost, rec + sizeof(h) + 8, 8);
+        cap.lost += lost;
+        return;
+    }
+    if (h.type != PERF_RECORD_SAMPLE) return;
+    // PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN
+    const char* p = rec + sizeof(h);
+    const char* end = rec + h.size;
+    if (end - p < 24) return;
+    uint32_t pid;
+    uint64_t nr;
+    std::memcpy(&pid, p + 8, 4);
+    std::memcpy(&nr, p + 16, 8);
+    p += 24;
+    if (nr > (uint64_t)(end - p) / 8) return;
+    std::vector<uint64_t> key(nr + 1);
+    key[0] = pid;
+    std::memcpy(key.data() + 1, p, nr * 8);
+    ++cap.chains[std::move(key)];
+    ++cap.samples;
+    if (!cap.processes.count((int)pid)) note_process(cap, (int)pid);
+}
+
+// Consume everything the kernel has written since the last drain
+void drain(Ring& r, Capture& cap, std::vector<char>& buf) {
+    perf_event_mmap_page* m = r.meta();
+    const uint64_t head = __atomic_load_n(&m->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = m->data_tail;
+    const char* data = r.data();
+    auto copy = [&](uint64_t at, size_t n, char* to) {
+        const size_t off = at & (r.data_bytes - 1);
+        const size_t first = std::min(n, r.data_bytes - off);
+        std::memcpy(to, data + off, first);
+        std::memcpy(to + first, data, n - first);
+    };
+    while (tail + sizeof(perf_event_header) <= head) {
+        perf_event_header h;
+        copy(tail, sizeof(h), (char*)&h);
+        if (h.size < sizeof(h) || tail + h.size > head) break;
+        buf.resize(h.size);
+        copy(tail, h.size, buf.data());
+        on_record(cap, buf.data(), h);
+        tail += h.size;
+    }
+    __atomic_store_n(&m->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+bool open_ring(int cgroup_fd, int cpu, int hz, bool kernel, Ring& r, int& err) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = (uint64_t)hz;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = kernel ? 0 : 1;
+    attr.watermark = 1;
+    attr.wakeup_watermark = 32 * 1024;   // half the largest ring; drains run every 100 ms anyway
+    r.fd = perf_event_open(&attr, cgroup_fd, cpu, -1, PERF_FLAG_PID_CGROUP | PERF_FLAG_FD_CLOEXEC);
+    if (r.fd < 0) {
+        err = errno;
+        return false;
+    }
+    // Smaller rings when locked memory is short (perf_event_mlock_kb)
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (size_t pages = 16; pages >= 2; pages /= 2) {
+        r.map_bytes = (pages + 1) * page;
+        r.base = mmap(nullptr, r.map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, r.fd, 0);
+        if (r.base != MAP_FAILED) {
+            r.data_bytes = pages * page;
+            return true;
+        }
+    }
+    err = errno;
+    close(r.fd);
+    r.fd = -1;
+    return false;
+}
+
+void close_ring(Ring& r) {
+    if (r.base != MAP_FAILED) munmap(r.base, r.map_bytes);
+    if (r.fd >= 0) close(r.fd);
+    r.base = MAP_FAILED;
+    r.fd = -1;
+}
+
+std::string demangle(const char* name) {
+    int status = 0;
+    std::unique_ptr<char, void (*)(void*)> d(abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free);
+    return status == 0 && d ? std::string(d.get()) : std::string(name);
+}
+
+void load_elf(int fd, ElfFile& f) {
+    f.loaded = true;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Elf64_Ehdr)) return;
+    const size_t size = (size_t)st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return;
+    const char* base = (const char*)map;
+    auto in_file = [&](uint64_t off, uint64_t n) { return off <= size && n <= size - off; };
+    const Elf64_Ehdr* eh = (const Elf64_Ehdr*)base;
+    if (std::memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+        !in_file(eh->e_phoff, (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr)) ||
+        !in_file(eh->e_shoff, (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr))) {
+        munmap(map, size);
+        return;
+    }
+    const Elf64_Phdr* ph = (const Elf64_Phdr*)(base + eh->e_phoff);
+    for (int i = 0; i < eh->e_phnum; ++i) {
+        if (ph[i].p_type == PT_LOAD) f.loads.push_back({ph[i].p_offset, ph[i].p_vaddr, ph[i].p_filesz});
+    }
+    // .symtab when the file was not stripped, else the exported .dynsym
+    const Elf64_Shdr* sh = (const Elf64_Shdr*)(base + eh->e_shoff);
+    for (uint32_t want : {(uint32_t)SHT_SYMTAB, (uint32_t)SHT_DYNSYM}) {
+        for (int i = 0; i < eh->e_shnum && f.symbols.empty(); ++i) {
+            if (sh[i].sh_type != want || sh[i].sh_link >= eh->e_shnum) continue;
+            const Elf64_Shdr& strs = sh[sh[i].sh_link];
+            if (!in_file(sh[i].sh_offset, sh[i].sh_size) || !in_file(strs.sh_offset, strs.sh_size)) continue;
+            const Elf64_Sym* sym = (const Elf64_Sym*)(base + sh[i].sh_offset);
+            const size_t n = sh[i].sh_size / sizeof(Elf64_Sym);
+            for (size_t k = 0; k < n; ++k) {
+                const int type = ELF64_ST_TYPE(sym[k].st_info);
+                if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym[k].st_value == 0 ||
+                    sym[k].st_name >= strs.sh_size) {
+                    continue;
+                }
+                const char* name = base + strs.sh_offset + sym[k].st_name;
+                f.symbols.push_back({sym[k].st_value, sym[k].st_size,
+                                     std::string(name, strnlen(name, strs.sh_size - sym[k].st_name))});
+            }
+        }
+        if (!f.symbols.empty()) break;
+    }
+    munmap(map, size);
+    std::sort(f.symbols.begin(), f.symbols.end(),
+              [](const ElfSymbol& a, const ElfSymbol& b) { return a.addr < b.addr; });
+}
+
+class Symbolizer {
+public:
+    explicit Symbolizer(Capture& cap) : cap_(cap) {}
+
+    std::string user(int pid, uint64_t addr) {
+        auto p = cap_.processes.find(pid);
+        if (p == cap_.processes.end()) return "[unknown]";
+        const auto& maps = p->second.maps;
+        auto m = std::upper_bound(maps.begin(), maps.end(), addr,
+                                  [](uint64_t a, const Mapping& mm) { return a < mm.start; });
+        if (m == maps.begin() || addr >= (--m)->end) return "[unknown]";
+        const std::string module = "[" + m->path.substr(m->path.rfind('/') + 1) + "]";
+        auto fd = cap_.files.find(m->file);
+        if (fd == cap_.files.end()) return module;
+        ElfFile& f = elves_[m->file];
+        if (!f.loaded) load_elf(fd->second, f);
+        // Mapped address -> file offset -> the ELF's own addresses
+        const uint64_t off = addr - m->start + m->offset;
+        for (const ElfFile::Load& l : f.loads) {
+            if (off < l.offset || off >= l.offset + l.size) continue;
+            return lookup(f.symbols, off - l.offset + l.vaddr, f, module);
+        }
+        return module;
+    }
+
+    std::string kernel(uint64_t addr) {
+        if (!kallsyms_loaded_) load_kallsyms();
+        auto s = std::upper_bound(kallsyms_.begin(), kallsyms_.end(), addr,
+                                  [](uint64_t a, const ElfSymbol& k) { return a < k.addr; });
+        if (s == kallsyms_.begin()) return "[kernel]_[k]";
+        return (--s)->name + "_[k]";
+    }
+
+private:
+    std::string lookup(const std::vector<ElfSymbol>& syms, uint64_t vaddr, ElfFile& f, const std::string& module) {
+        auto s = std::upper_bound(syms.begin(), syms.end(), vaddr,
+                                  [](uint64_t a, const ElfSymbol& k) { return a < k.addr; });
+        if (s == syms.begin()) return module;
+        --s;
+        if (s->size != 0 && vaddr >= s->addr + s->size) return module;
+        auto& name = demangled_[&f][s->addr];
+        if (name.empty()) name = demangle(s->name.c_str());
+        return name;
+    }
+
+    void load_kallsyms() {
+        kallsyms_loaded_ = true;
+        std::ifstream in("/proc/kallsyms");
+        std::string line;
+        while (std::getline(in, line)) {
+            char type;
+            char name[256];
+            unsigned long long addr;
+            if (std::sscanf(line.c_str(), "%llx %c %255s", &addr, &type, name) != 3) continue;
+            if (addr == 0 || (type != 't' && type != 'T')) continue;   // hidden by kptr_restrict
+            kallsyms_.push_back({addr, 0, name});
+        }
+        std::sort(kallsyms_.begin(), kallsyms_.end(),
+                  [](const ElfSymbol& a, const ElfSymbol& b) { return a.addr < b.addr; });
+    }
+
+    Capture& cap_;
+    std::unordered_map<std::string, ElfFile> elves_;
+    std::unordered_map<const ElfFile*, std::unordered_map<uint64_t, std::string>> demangled_;
+    std::vector<ElfSymbol> kallsyms_;
+    bool kallsyms_loaded_ = false;
+};
+
+void resolve(Capture& cap, CpuProfile& out) {
+    Symbolizer sym(cap);
+    std::vector<std::string> frames;
+    for (const auto& [key, count] : cap.chains) {
+        const int pid = (int)key[0];
+        frames.clear();
+        bool user = false;
+        bool leaf = true;
+        for (size_t i = 1; i < key.size(); ++i) {
+            const uint64_t ip = key[i];
+            if (ip >= (uint64_t)PERF_CONTEXT_MAX) {
+                user = ip == (uint64_t)PERF_CONTEXT_USER;
+                leaf = true;
+                continue;
+            }
+            // Past the leaf these are return addresses: look up the call
+            const uint64_t at = leaf ? ip : ip - 1;
+            leaf = false;
+            std::string name = user || at < KERNEL_START ? sym.user(pid, at) : sym.kernel(at);
+            std::replace(name.begin(), name.end(), ';', ':');
+            frames.push_back(std::move(name));
+        }
+        auto p = cap.processes.find(pid);
+        std::string stack = p != cap.processes.end() ? p->second.comm : "[pid " + std::to_string(pid) + "]";
+        std::replace(stack.begin(), stack.end(), ';', ':');
+        for (auto f = frames.rbegin(); f != frames.rend(); ++f) stack += ";" + *f;
+        out.stacks[stack] += count;
+    }
+}
+
+}  // namespace
+
+bool profile_cgroup(int cgroup_fd, const CpuProfileOptions& options, CpuProfile& out, std::string& error) {
+    out = CpuProfile();
+    out.hz = std::max(1, options.hz);
+    const int ncpu = (int)sysconf(_SC_NPROCESSORS_CONF);
+    std::vector<Ring> rings;
+    int err = 0;
+    // Kernel frames need root or perf_event_paranoid <= 1; fall back to user only
+    bool kernel = true;
+    for (int cpu = 0; cpu < ncpu; ++cpu) {
+        Ring r;
+        if (!open_ring(cgroup_fd, cpu, out.hz, kernel, r, err) && kernel && (err == EACCES || err == EPERM)) {
+            kernel = false;
+            for (Ring& o : rings) close_ring(o);
+            rings.clear();
+            cpu = -1;
+            continue;
+        }
+        if (r.fd >= 0) rings.push_back(r);   // ENODEV: offline CPU
+    }
+    if (rings.empty()) {
+        error = std::string("perf_event_open: ") + std::strerror(err);
+        return false;
+    }
+    out.cpus = (int)rings.size();
+
+    Capture cap;
+    std::vector<char> buf;
+    std::vector<pollfd> pfds;
+    for (const Ring& r : rings) pfds.push_back({r.fd, POLLIN, 0});
+    for (const Ring& r : rings) ioctl(r.fd, PERF_EVENT_IOC_ENABLE, 0);
+    const uint64_t end = monotonic_ms() + (uint64_t)std::max(0, options.duration_ms);
+    for (uint64_t now = monotonic_ms(); now < end; now = monotonic_ms()) {
+        poll(pfds.data(), pfds.size(), (int)std::min<uint64_t>(DRAIN_MS, end - now));
+        for (Ring& r : rings) drain(r, cap, buf);
+    }
+    for (Ring& r : rings) ioctl(r.fd, PERF_EVENT_IOC_DISABLE, 0);
+    for (Ring& r : rings) {
+        drain(r, cap, buf);
+        close_ring(r);
+    }
+
+    out.samples = cap.samples;
+    out.lost = cap.lost;
+    resolve(cap, out);
+    return true;
+}
+
+std::string folded_stacks(const CpuProfile& profile) {
+    std::string s;
+    for (const auto& [stack, count] : profile.stacks) s += stack + " " + std::to_string(count) + "\n";
+    return s;
+}
+
+std::string speedscope_json(const CpuProfile& profile, const std::string& name) {
+    std::unordered_map<std::string, size_t> index;
+    std::vector<const std::string*> frames;
+    std::ostringstream samples, weights;
+    const double ms = 1000.0 / std::max(1, profile.hz);
+    uint64_t total = 0;
+    bool first = true;
+    for (const auto& [stack, count] : profile.stacks) {
+        samples << (first ? "" : ",") << "[";
+        size_t from = 0;
+        for (bool head = true; from <= stack.size(); head = false) {
+            size_t to = stack.find(';', from);
+            if (to == std::string::npos) to = stack.size();
+            auto it = index.emplace(stack.substr(from, to - from), frames.size()).first;
+            if (it->second == frames.size()) frames.push_back(&it->first);
+            samples << (head ? "" : ",") << it->second;
+            from = to + 1;
+        }
+        samples << "]";
+        weights << (first ? "" : ",") << (double)count * ms;
+        total += count;
+        first = false;
+    }
+    std::ostringstream o;
+    o << "{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\",\"exporter\":\"safebox-executord\""
+      << ",\"name\":\"" << json_escape(name) << "\",\"shared\":{\"frames\":[";
+    for (size_t i = 0; i < frames.size(); ++i) o << (i ? "," : "") << "{\"name\":\"" << json_escape(*frames[i]) << "\"}";
+    o << "]},\"profiles\":[{\"type\":\"sampled\",\"name\":\"" << json_escape(name)
+      << "\",\"unit\":\"milliseconds\",\"startValue\":0,\"endValue\":" << (double)total * ms
+      << ",\"samples\":[" << samples.str() << "],\"weights\":[" << weights.str() << "]}]}";
+    return o.str();
+}
+
+}  // namespace safebox
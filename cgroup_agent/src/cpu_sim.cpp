@@ -0,0 +1,402 @@
+// safebox-cpu-sim - how much work a set of job groups gets done under each
+// cpu.max policy, replaying one CPU demand trace through each in simulated
+// time, with no processes or cgroups.
+//
+// Every tick (100 ms) each group is offered work from its trace. What it
+// cannot run is queued, not lost. A group runs at most min(threads, quota)
+// CPUs of its backlog, and the host's cores are split fairly between
+// runnable groups. Each group's simulated cpu.stat and cpu.pressure counters
+// advance as the kernel's would, so the controller sees the same signals:
+//
+//   loadavg     the old Optimizer: cpu.max = 80% of one CPU for every group
+//               while the 1-minute load average is above the core count,
+//               50% otherwise
+//   reserved    cpu.max fixed at each group's Banker reservation
+//   controller  control_step() + allocate_cpu(), as the daemon's
+//               --controller runs them
+//
+// work_done is the CPU time delivered, in core-seconds. backlog is what was
+// offered but not yet run at the end. mean_delay is the average backlog
+// divided by the offered rate (Little's law): how long work waited.
+//
+// A trace file has one directive per line ('#' comments):
+//
+//   group <id> <reserved_percent> <threads>
+//   at <second> <id> <demand_percent>       demand holds until the next "at"
+//   work <second> <id> <core_seconds>       a one-off batch of work
+//
+//   safebox-cpu-sim --synthetic 16 --seconds 600 --seed 3
+//   safebox-cpu-sim --trace demand.trace --cores 8
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "controller.hpp"
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  safebox-cpu-sim [--trace <file> | --synthetic <groups>] [--seconds <s>] [--cores <n>]\n"
+              << "                  [--tick-ms <ms>] [--seed <n>] [--loadavg-period-ms <ms>]\n";
+}
+
+static const int64_t PERIOD_US = 100000;   // cpu.max period
+static const double LOAD_EXP = 0.920044;     // exp(-5/60): the kernel's 1-minute loadavg decay per 5 s
+
+struct SimOptions {
+    std::string trace;
+    int synthetic = 16;
+    double seconds = 600;
+    int cores = 0;               // 0 => enough for the reservations
+    int tick_ms = 100;
+    unsigned seed = 1;
+    int loadavg_period_ms = 1000;   // how often the old policy was applied
+};
+
+// One group's offered load, per tick, in percent of one CPU; plus batches
+struct TraceGroup {
+    int id = 0;
+    int reserved = 100;          // percent of one CPU
+    int threads = 1;
+    std::string shape;
+    std::vector<double> demand;  // per tick
+    std::vector<double> batch;   // core-seconds arriving at a tick
+};
+
+static std::vector<TraceGroup> load_trace(const std::string& path, size_t ticks, int tick_ms) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << path << ": cannot open\n";
+        return {};
+    }
+    std::map<int, TraceGroup> groups;
+    std::map<int, std::vector<std::pair<size_t, double>>> steps;
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        ++lineno;
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream is(line);
+        std::string kind;
+        is >> kind;
+        if (kind == "group") {
+            TraceGroup g;
+            is >> g.id >> g.reserved >> g.threads;
+            g.shape = "group" + std::to_string(g.id);
+            if (!is || g.reserved < 1 || g.threads < 1) {
+                std::cerr << path << ":" << lineno << ": bad group line\n";
+                return {};
+            }
+            groups[g.id] = g;
+            continue;
+        }
+        double at = 0, v = 0;
+        int id = 0;
+        is >> at >> id >> v;
+        if (!is || (kind != "at" && kind != "work") || !groups.count(id) || at < 0) {
+            std::cerr << path << ":" << lineno << ": bad line\n";
+            return {};
+        }
+        const size_t tick = (size_t)(at * 1000.0 / tick_ms);
+        if (kind == "at") {
+            steps[id].push_back({tick, v});
+        } else if (tick < ticks) {
+            auto& b = groups[id].batch;
+            b.resize(ticks, 0.0);
+            b[tick] += v;
+        }
+    }
+    std::vector<TraceGroup> out;
+    for (auto& [id, g] : groups) {
+        g.demand.assign(ticks, 0.0);
+        g.batch.resize(ticks, 0.0);
+        auto& s = steps[id];
+        std::stable_sort(s.begin(), s.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        double level = 0;
+        size_t k = 0;
+        for (size_t t = 0; t < ticks; ++t) {
+            while (k < s.size() && s[k].first <= t) level = s[k++].second;
+            g.demand[t] = level;
+        }
+        out.push_back(std::move(g));
+    }
+    return out;
+}
+
+// The src/ workloads and the services jobs typically run, cycled through
+static std::vector<TraceGroup> synthesize(const SimOptions& o, size_t ticks) {
+    std::mt19937_64 rng(o.seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    const double tick_s = o.tick_ms / 1000.0;
+    std::vector<TraceGroup> out;
+    for (int i = 0; i < o.synthetic; ++i) {
+        TraceGroup g;
+        g.id = i + 1;
+        g.demand.assign(ticks, 0.0);
+        g.batch.assign(ticks, 0.0);
+        switch (i % 5) {
+        case 0:   // cpu_intensive: one thread flat out
+            g.shape = "steady";
+            g.reserved = 100;
+            g.threads = 1;
+            for (auto& d : g.demand) d = 95.0;
+            break;
+        case 1: { // a parallel batch: a pile of work at a random start
+            g.shape = "batch";
+            g.reserved = 100;
+            g.threads = 4;
+            const size_t at = (size_t)(u(rng) * (double)ticks * 0.5);
+            g.batch[at] = 0.4 * o.seconds;   // core-seconds
+            break;
+        }
+        case 2: { // request bursts: 3 s of 3.5 CPUs every 20 s
+            g.shape = "bursty";
+            g.reserved = 100;
+            g.threads = 4;
+            const double phase = u(rng) * 20.0;
+            for (size_t t = 0; t < ticks; ++t) {
+                double s = std::fmod(t * tick_s + phase, 20.0);
+                g.demand[t] = s < 3.0 ? 350.0 : 1.0;
+            }
+            break;
+        }
+        case 3:   // sleep_job / io_intensive: mostly idle
+            g.shape = "idle";
+            g.reserved = 50;
+            g.threads = 1;
+            for (auto& d : g.demand) d = std::max(0.0, 2.0 + noise(rng));
+            break;
+        default: { // periodic service: 1 +- 0.9 CPU over two minutes
+            g.shape = "periodic";
+            g.reserved = 100;
+            g.threads = 2;
+            const double phase = u(rng) * 120.0;
+            for (size_t t = 0; t < ticks; ++t) {
+                g.demand[t] = std::max(0.0, 100.0 + 90.0 * std::sin(2 * M_PI * (t * tick_s + phase) / 120.0) +
+                                                5.0 * noise(rng));
+            }
+        }
+        }
+        out.push_back(std::move(g));
+    }
+    return out;
+}
+
+enum class Policy { LOADAVG, RESERVED, CONTROLLER };
+
+static const char* policy_name(Policy p) {
+    switch (p) {
+    case Policy::LOADAVG: return "loadavg";
+    case Policy::RESERVED: return "reserved";
+    default: return "controller";
+    }
+}
+
+struct SimResult {
+    double offered = 0;          // core-seconds
+    double work_done = 0;
+    double backlog = 0;          // left at the end
+    double mean_delay_s = 0;
+    double throttled = 0;        // mean share of group-time throttled
+    double stalled = 0;          // ... waiting for a core (cpu.pressure some)
+    double quota_cores = 0;      // mean sum of cpu.max, cores
+    double utilization = 0;      // work_done / (cores x time)
+    uint64_t decisions = 0;      // cpu.max writes
+    std::map<std::string, double> work_by_shape;
+};
+
+// Max-min fair split of `capacity` over `want`, as CFS with equal weights
+static std::vector<double> fair_share(const std::vector<double>& want, double capacity) {
+    std::vector<double> got(want.size(), 0.0);
+    std::vector<size_t> order(want.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return want[a] < want[b]; });
+    double left = capacity;
+    for (size_t k = 0; k < order.size(); ++k) {
+        const double even = left / (double)(order.size() - k);
+        got[order[k]] = std::min(want[order[k]], even);
+        left -= got[order[k]];
+    }
+    return got;
+}
+
+static SimResult simulate(const SimOptions& o, const std::vector<TraceGroup>& trace, size_t ticks, int cores,
+                          Policy policy) {
+    const size_t n = trace.size();
+    const double dt_us = o.tick_ms * 1000.0;
+    const double capacity = cores * 100.0;   // percent of one CPU
+    const int64_t periods = std::max<int64_t>(1, (int64_t)dt_us / PERIOD_US);
+
+    safebox::ControlTuning tuning;
+    std::vector<safebox::ControlBounds> bounds(n);
+    std::vector<safebox::ControlState> state(n);
+    std::vector<safebox::GroupSample> counters(n);
+    std::vector<double> backlog_us(n, 0.0);
+    std::vector<safebox::ControlDecision> decisions;
+    for (size_t i = 0; i < n; ++i) {
+        // As Executor::control() bounds a job
+        bounds[i].cpu_ceiling = trace[i].reserved;
+        bounds[i].cpu_floor = std::max(1, trace[i].reserved / 10);
+        bounds[i].cpu_burst = std::max(trace[i].reserved, (int)capacity);
+        state[i].cpu_percent = state[i].cpu_want = trace[i].reserved;
+        counters[i].cpu_usage_us = counters[i].cpu_nr_periods = counters[i].cpu_nr_throttled = 0;
+        counters[i].cpu_throttled_us = counters[i].cpu_some_us = 0;
+        state[i].last = counters[i];
+    }
+
+    SimResult r;
+    double load1 = 0, backlog_sum = 0, throttled_sum = 0, stalled_sum = 0, quota_sum = 0;
+    const int load_every = std::max(1, 5000 / o.tick_ms);
+    const int old_every = std::max(1, o.loadavg_period_ms / o.tick_ms);
+    std::vector<int> quota(n);
+    for (size_t i = 0; i < n; ++i) quota[i] = trace[i].reserved;
+
+    for (size_t t = 0; t < ticks; ++t) {
+        if (policy == Policy::LOADAVG && t % old_every == 0) {
+            const int q = load1 > cores ? 80 : 50;
+            for (size_t i = 0; i < n; ++i) {
+                if (quota[i] != q) ++r.decisions;
+                quota[i] = q;
+            }
+        } else if (policy == Policy::CONTROLLER) {
+            for (size_t i = 0; i < n; ++i) quota[i] = state[i].cpu_percent;
+        }
+
+        // What each group can run this tick: its backlog, its threads, its quota
+        std::vector<double> runnable(n), capped(n);
+        for (size_t i = 0; i < n; ++i) {
+            const double offered = trace[i].demand[t] * dt_us / 100.0 + trace[i].batch[t] * 1e6;
+            backlog_us[i] += offered;
+            r.offered += offered / 1e6;
+            runnable[i] = std::min(trace[i].threads * 100.0, 100.0 * backlog_us[i] / dt_us);
+            capped[i] = std::min(runnable[i], (double)quota[i]);
+        }
+        const std::vector<double> got = fair_share(capped, capacity);
+
+        double tasks = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const double ran = got[i] * dt_us / 100.0;
+            backlog_us[i] = std::max(0.0, backlog_us[i] - ran);
+            r.work_done += ran / 1e6;
+            r.work_by_shape[trace[i].shape] += ran / 1e6;
+            quota_sum += quota[i];
+
+            // The counters the kernel would show for this tick
+            auto& c = counters[i];
+            c.t_ns = (uint64_t)((t + 1) * dt_us * 1000.0);
+            c.cpu_usage_us += (int64_t)ran;
+            c.cpu_nr_periods += runnable[i] > 0 ? periods : 0;
+            double throttled = 0, stalled = 0;
+            if (runnable[i] > quota[i]) {
+                throttled = 1.0 - quota[i] / runnable[i];
+                c.cpu_nr_throttled += periods;
+                // throttled_usec adds up over the CPUs the group ran on
+                c.cpu_throttled_us += (int64_t)(throttled * dt_us * std::ceil(runnable[i] / 100.0));
+            }
+            if (capped[i] > 0 && got[i] < capped[i]) stalled = 1.0 - got[i] / capped[i];
+            c.cpu_some_us += (int64_t)(stalled * dt_us);
+            throttled_sum += throttled;
+            stalled_sum += stalled;
+            tasks += std::ceil(got[i] / 100.0);
+            if (stalled > 0) tasks += std::ceil((capped[i] - got[i]) / 100.0);
+        }
+        for (double b : backlog_us) backlog_sum += b / 1e6;
+        if ((t + 1) % load_every == 0) load1 = load1 * LOAD_EXP + tasks * (1.0 - LOAD_EXP);
+
+        if (policy == Policy::CONTROLLER) {
+            decisions.clear();
+            std::vector<safebox::ControlTarget> targets;
+            targets.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                safebox::control_step(tuning, bounds[i], state[i], counters[i], (int)i, decisions);
+                targets.push_back({(int)i, &bounds[i], &state[i]});
+            }
+            safebox::allocate_cpu(tuning, targets, decisions);
+            r.decisions += decisions.size();
+        }
+    }
+
+    const double seconds = ticks * o.tick_ms / 1000.0;
+    for (double b : backlog_us) r.backlog += b / 1e6;
+    const double rate = r.offered / seconds;
+    r.mean_delay_s = rate > 0 ? backlog_sum / (double)ticks / rate : 0.0;
+    r.throttled = throttled_sum / (double)(ticks * n);
+    r.stalled = stalled_sum / (double)(ticks * n);
+    r.quota_cores = quota_sum / (double)ticks / 100.0;
+    r.utilization = r.work_done / (cores * seconds);
+    return r;
+}
+
+static void print_result(Policy p, const SimResult& r) {
+    std::printf("%-10s work_done=%.1f core-s backlog=%.1f core-s mean_delay=%.2fs utilization=%.0f%%\n",
+                policy_name(p), r.work_done, r.backlog, r.mean_delay_s, 100 * r.utilization);
+    std::printf("%-10s throttled=%.1f%% stalled=%.1f%% quota=%.2f cores cpu.max writes=%llu\n", "",
+                100 * r.throttled, 100 * r.stalled, r.quota_cores, (unsigned long long)r.decisions);
+    std::printf("%-10s", "");
+    for (const auto& [shape, w] : r.work_by_shape) std::printf(" %s=%.1f", shape.c_str(), w);
+    std::printf("\n");
+}
+
+static void print_json(Policy p, const SimResult& r) {
+    std::printf("{\"policy\":\"%s\",\"offered\":%.3f,\"work_done\":%.3f,\"backlog\":%.3f,\"mean_delay_s\":%.3f,"
+                "\"utilization\":%.4f,\"throttled\":%.4f,\"stalled\":%.4f,\"quota_cores\":%.3f,\"decisions\":%llu}\n",
+                policy_name(p), r.offered, r.work_done, r.backlog, r.mean_delay_s, r.utilization, r.throttled,
+                r.stalled, r.quota_cores, (unsigned long long)r.decisions);
+}
+
+int main(int argc, char** argv) {
+    SimOptions o;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) { usage(); std::exit(1); }
+            return argv[++i];
+        };
+        if (a == "--trace") o.trace = next();
+        else if (a == "--synthetic") o.synthetic = std::max(1, std::atoi(next()));
+        else if (a == "--seconds") o.seconds = std::max(1.0, std::atof(next()));
+        else if (a == "--cores") o.cores = std::max(1, std::atoi(next()));
+        else if (a == "--tick-ms") o.tick_ms = std::max(10, std::atoi(next()));
+        else if (a == "--seed") o.seed = (unsigned)std::atoi(next());
+        else if (a == "--loadavg-period-ms") o.loadavg_period_ms = std::max(1, std::atoi(next()));
+        else { usage(); return 1; }
+    }
+
+    const size_t ticks = (size_t)(o.seconds * 1000.0 / o.tick_ms);
+    std::vector<TraceGroup> trace = o.trace.empty() ? synthesize(o, ticks) : load_trace(o.trace, ticks, o.tick_ms);
+    if (trace.empty()) {
+        std::cerr << "no groups in the trace\n";
+        return 2;
+    }
+    // By default the Banker has booked the whole host
+    int reserved = 0;
+    for (const auto& g : trace) reserved += g.reserved;
+    const int cores = o.cores > 0 ? o.cores : std::max(1, (reserved + 99) / 100);
+
+    std::printf("trace=%s groups=%zu seconds=%.0f cores=%d reserved=%d%% tick=%dms\n",
+                o.trace.empty() ? "synthetic" : o.trace.c_str(), trace.size(), o.seconds, cores, reserved, o.tick_ms);
+    const Policy policies[] = {Policy::LOADAVG, Policy::RESERVED, Policy::CONTROLLER};
+    std::vector<SimResult> results;
+    for (Policy p : policies) {
+        results.push_back(simulate(o, trace, ticks, cores, p));
+        print_result(p, results.back());
+    }
+    const SimResult& old = results[0];
+    const SimResult& ctl = results[2];
+    std::printf("controller vs loadavg: work %.2fx, mean delay %.2fx, throttled %.1f%% -> %.1f%%\n",
+                old.work_done > 0 ? ctl.work_done / old.work_done : 0.0,
+                ctl.mean_delay_s > 0 ? old.mean_delay_s / ctl.mean_delay_s : 0.0, 100 * old.throttled,
+                100 * ctl.throttled);
+    for (size_t k = 0; k < results.size(); ++k) print_json(policies[k], results[k]);
+    return 0;
+}
@@ -0,0 +1,1051 @@
+#include "executor.hpp"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "json_util.hpp"
+#include "work_pool.hpp"
+
+namespace safebox {
+
+// epoll tokens: job id in the high bits, what became readable in the low two
+static const uint64_t WAKE_TOKEN = ~0ull;
+static const uint64_t KIND_PIDFD = 2;
+static const uint64_t KIND_TIMER = 3;
+static uint64_t token(int job_id, uint64_t kind) { return ((uint64_t)job_id << 2) | kind; }
+
+// Accounting records read back at startup to seed the usage profiles
+static const size_t PROFILE_SEED_RECORDS = 65536;
+
+const char* deadline_name(Deadline d) {
+    switch (d) {
+        case Deadline::WallTime: return "wall_time";
+        case Deadline::CpuTime: return "cpu_time";
+        default: return nullptr;
+    }
+}
+
+uint64_t raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return 0;
+    std::ifstream nr("/proc/sys/fs/nr_open");
+    rlim_t most = rl.rlim_max;
+    if (!(nr >> most)) most = rl.rlim_max;
+    struct rlimit want = {most, std::max(most, rl.rlim_max)};
+    if (most > rl.rlim_max && setrlimit(RLIMIT_NOFILE, &want) == 0) return most;
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur;
+}
+
+Job::~Job() {
+    close_process_fds(proc);
+    if (cgroup_fd >= 0) close(cgroup_fd);
+    if (timer_fd >= 0) close(timer_fd);
+}
+
+Executor::Executor(ExecutorConfig cfg)
+    : cfg_(std::move(cfg)),
+      cg_(cfg_.cgroup_root),
+      launcher_(cfg_.sandbox),
+      banker_({cfg_.total_cpu_percent, cfg_.total_memory_mb}, {"CPU%", "Memory_MB"}) {
+    // A scratch group rather than the root, which may not take members
+    const int probe_fd = cg_.create("safebox_probe");
+    if (probe_fd >= 0) {
+        launcher_.probe(probe_fd);
+        close(probe_fd);
+        cg_.remove("safebox_probe");
+    }
+    if (!cfg_.accounting_path.empty()) {
+        accounting_ = std::make_unique<AccountingStore>(cfg_.accounting_path);
+        if (!accounting_->ok()) accounting_.reset();
+    }
+    if (accounting_) {
+        profiles_ = std::make_unique<ProfileStore>(cfg_.profile_window, cfg_.profile_min_runs, cfg_.profile_margin);
+        // Seed from the newest records, replayed oldest first
+        auto past = accounting_->query("", PROFILE_SEED_RECORDS);
+        for (auto it = past.rbegin(); it != past.rend(); ++it) profiles_->observe(*it);
+    }
+    if (cfg_.workers > 0) pool_ = std::make_unique<WorkStealingPool>(cfg_.workers, cfg_.pin_workers);
+    if (cfg_.placement) {
+        placer_ = std::make_unique<Placer>(pool_ ? pool_->topology() : CpuTopology::detect(), cfg_.total_memory_mb);
+    }
+    if (cfg_.controller) {
+        controller_ = std::make_unique<LimitController>(cg_, cfg_.controller_period_ms, ControlTuning{},
+                                                        cfg_.controller_log,
+                                                        [this](int id, long mb) { return move_memory(id, mb); });
+        if (!cfg_.controller_record.empty()) controller_->start_trace(cfg_.controller_record);
+    }
+    if (cfg_.metrics_interval_ms > 0) {
+        MetricStoreOptions mo;
+        mo.retention_ms = cfg_.metrics_retention_s * 1000;
+        mo.max_bytes = cfg_.metrics_max_mb << 20;
+        metrics_ = std::make_unique<MetricsFeed>(cg_, mo, cfg_.metrics_interval_ms);
+    }
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKE_TOKEN;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    supervisor_ = std::thread(&Executor::supervise, this);
+}
+
+Executor::~Executor() {
+    controller_.reset();
+    metrics_.reset();
+    uint64_t one = 1;
+    ssize_t w = write(wake_fd_, &one, sizeof(one));
+    (void)w;
+    supervisor_.join();
+    pool_.reset();  // finishes queued launches and reaps
+    close(wake_fd_);
+    close(epfd_);
+}
+
+uint64_t Executor::now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+SubmitResult Executor::submit(const JobSpec& spec) {
+    return submit_async(spec).get();
+}
+
+std::future<SubmitResult> Executor::submit_async(const JobSpec& spec) {
+    auto done = std::make_shared<std::promise<SubmitResult>>();
+    std::future<SubmitResult> result = done->get_future();
+    std::string grant_msg;
+    std::shared_ptr<Job> job = admit(spec, grant_msg);
+    if (!job) {
+        done->set_value({false, grant_msg, -1});
+    } else if (!pool_) {
+        done->set_value(launch(job, grant_msg));
+    } else {
+        // Straight to the least-loaded worker's deque; idle ones steal
+        pool_->push(-1, [this, job, grant_msg, done] { done->set_value(launch(job, grant_msg)); });
+    }
+    return result;
+}
+
+// Fill a 0 cpu/memory from the app's usage profile and, with right_size,
+// lower explicit limits to it. "" or the rejection; `note` describes any
+// change for the grant message.
+std::string Executor::size_limits(JobSpec& spec, std::string& note) const {
+    if (!profiles_) return "";
+    const bool unset = spec.cpu_percent == 0 || spec.memory_mb == 0;
+    if (!unset && !cfg_.right_size) return "";
+    const LimitAdvice a = profiles_->advise(spec.app_path);
+    if (!a.ok) {
+        if (!unset) return "";
+        return "❌ No usage profile for " + spec.app_path + " yet (" + std::to_string(a.runs) + " of " +
+               std::to_string(cfg_.profile_min_runs) + " runs); pass cpu_percent and memory_mb";
+    }
+    const int cpu0 = spec.cpu_percent, mem0 = spec.memory_mb;
+    if (cpu0 == 0 || (cfg_.right_size && a.cpu_percent < cpu0)) spec.cpu_percent = a.cpu_percent;
+    if (mem0 == 0 || (cfg_.right_size && a.memory_mb < mem0)) spec.memory_mb = a.memory_mb;
+    if (spec.cpu_percent != cpu0 || spec.memory_mb != mem0) {
+        auto show = [](int before, int after) {
+            return (before && before != after ? std::to_string(before) + "→" : std::string()) + std::to_string(after);
+        };
+        note = "\n📐 Sized from " + std::to_string(a.runs) + " runs: CPU=" + show(cpu0, spec.cpu_percent) +
+               "%, Memory=" + show(mem0, spec.memory_mb) + "MB";
+    }
+    return "";
+}
+
+// "" when the spec is acceptable, otherwise the rejection message
+std::string Executor::validate(const JobSpec& spec) const {
+    // Validate application exists
+    struct stat st;
+    if (stat(spec.app_path.c_str(), &st) != 0) {
+        return "❌ Application not found: " + spec.app_path;
+    }
+    // Validate resource limits
+    if (spec.cpu_percent < 1 || spec.cpu_percent > 100) {
+        return "❌ Invalid CPU percentage: " + std::to_string(spec.cpu_percent);
+    }
+    if (spec.memory_mb < 1) {
+        return "❌ Invalid memory limit: " + std::to_string(spec.memory_mb) + "MB";
+    }
+    return "";
+}
+
+// Banker add + request as one step; `msg` gets the grant or the rejection
+bool Executor::reserve(int banker_id, const std::string& name, const std::vector<long>& max_resources,
+                       std::string& msg) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!banker_.add_process(banker_id, name, max_resources)) {
+        msg = "❌ Failed to add process to banker";
+        return false;
+    }
+    auto [ok, why] = banker_.request_resources(banker_id, max_resources);
+    if (!ok) {
+        banker_.remove_process(banker_id);
+        msg = "🚫 UNSAFE: " + why + "\n❌ Request REJECTED by Banker's Algorithm";
+        return false;
+    }
+    msg = std::move(why);
+    return true;
+}
+
+void Executor::unreserve(int banker_id) {
+    std::lock_guard<std::mutex> lock(mu_);
+    release_held(banker_id);
+    banker_.remove_process(banker_id);
+    if (placer_) placer_->release(banker_id);
+}
+
+// Where an admitted reservation goes; nullopt without --placement or when
+// the CPUs cannot hold it (the Banker pool can be larger than the host)
+std::optional<Placement> Executor::place(int banker_id, long cpu_percent, long memory_mb) {
+    if (!placer_) return std::nullopt;
+    std::lock_guard<std::mutex> lock(mu_);
+    auto p = placer_->place(banker_id, (int)cpu_percent, memory_mb);
+    if (!p) std::cerr << "⚠️  Warning: no CPU placement for " << banker_id << ", running unpinned\n";
+    return p;
+}
+
+// cpuset.cpus/mems for the group; without the cpuset controller (or in a
+// fake root) the launcher pins each process it starts to the same CPUs
+void Executor::apply_placement(int cgroup_fd, const Placement& p, std::vector<int>& affinity) {
+    if (cg_.is_cgroupfs() && cg_.set_cpuset(cgroup_fd, cpu_list(p.cpus), cpu_list(p.mems))) return;
+    static std::atomic<bool> warned{false};
+    if (cg_.is_cgroupfs() && !warned.exchange(true)) {
+        std::cerr << "⚠️  Warning: cpuset unavailable (" << std::strerror(errno)
+                  << "), pinning jobs with sched_setaffinity\n";
+    }
+    affinity = p.cpus;
+}
+
+// The controller lending part of a reservation back (mb < 0) or taking it
+// back (mb > 0): a partial release leaves it in the process's need, so the
+// safety check keeps every later admission compatible with the return
+bool Executor::move_memory(int banker_id, long mb) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!banker_.processes().count(banker_id)) return false;
+    if (mb < 0) return banker_.release_resources(banker_id, {0, -mb}).first;
+    return banker_.request_resources(banker_id, {0, mb}).first;
+}
+
+// Whatever the process holds now, which is less than it reserved while the
+// controller has memory lent out; mu_ held
+std::pair<bool, std::string> Executor::release_held(int banker_id) {
+    auto it = banker_.processes().find(banker_id);
+    if (it == banker_.processes().end()) return {false, "Process " + std::to_string(banker_id) + " not found"};
+    const std::vector<long> held = it->second.allocated;
+    return banker_.release_resources(banker_id, held);
+}
+
+// Hand a launched group to the controller, bounded by its reservation:
+// cpu.max may drop to a tenth of it and memory.high to a quarter, and it
+// may borrow other groups' unused CPU up to the whole pool. The metrics
+// feed samples it from launch too.
+void Executor::control(int id, const std::string& cgroup, int cgroup_fd, long cpu_percent, long memory_mb) {
+    if (metrics_ && !metrics_->add(id, cgroup_fd)) {
+        std::cerr << "⚠️  Warning: " << cgroup << " has no metric history\n";
+    }
+    if (!controller_) return;
+    ControlBounds b;
+    b.cpu_ceiling = (int)cpu_percent;
+    b.cpu_floor = std::max(1, b.cpu_ceiling / 10);
+    b.cpu_burst = (int)std::max(cpu_percent, cfg_.total_cpu_percent);
+    b.mem_ceiling = (int64_t)memory_mb * 1024 * 1024;
+    b.mem_floor = b.mem_ceiling / 4;
+    if (!controller_->add(id, cgroup, cgroup_fd, b)) {
+        std::cerr << "⚠️  Warning: " << cgroup << " runs without the limit controller\n";
+    }
+}
+
+// Validation + Banker check. Returns the admitted job, or nullptr with the
+// rejection in `msg`.
+std::shared_ptr<Job> Executor::admit(const JobSpec& requested, std::string& msg) {
+    const uint64_t t0 = now_ns();
+    JobSpec spec = requested;
+    std::string note;
+    msg = size_limits(spec, note);
+    if (!msg.empty()) return nullptr;
+    msg = validate(spec);
+    if (!msg.empty()) return nullptr;
+    const int job_id = ++job_counter_;
+    if (!reserve(job_id, spec.name, {spec.cpu_percent, spec.memory_mb}, msg)) return nullptr;
+    msg += note;
+
+    auto job = std::make_shared<Job>(cfg_.output_buffer_bytes);
+    job->id = job_id;
+    job->spec = spec;
+    job->cgroup = "safebox_job_" + std::to_string(job_id);
+    job->placement = place(job_id, spec.cpu_percent, spec.memory_mb);
+    job->timings.admit_ns = now_ns() - t0;
+    latency_[ADMISSION].record(job->timings.admit_ns);
+    return job;
+}
+
+// cgroup + clone for an admitted job; runs on a pool worker when there is one
+SubmitResult Executor::launch(const std::shared_ptr<Job>& job, const std::string& grant_msg) {
+    const JobSpec& spec = job->spec;
+    const int job_id = job->id;
+    const uint64_t t1 = now_ns();
+    job->worker = WorkStealingPool::current();
+
+    auto fail = [&](const std::string& why) -> SubmitResult {
+        if (controller_) controller_->remove(job_id);
+        if (metrics_) metrics_->remove(job_id);
+        unreserve(job_id);
+        cg_.remove(job->cgroup);
+        return {false, "❌ Execution failed: " + why, -1};
+    };
+
+    job->cgroup_fd = cg_.create(job->cgroup);
+    if (job->cgroup_fd < 0) return fail("Failed to create cgroup");
+    const bool cpu_applied = cg_.set_cpu_max(job->cgroup_fd, (int64_t)spec.cpu_percent * 1000, 100000);
+    if (!cpu_applied) {
+        std::cerr << "⚠️  Warning: Failed to apply CPU limit: " << std::strerror(errno) << "\n";
+    }
+    // How fast the job can spend a CPU-time budget: its quota, or every core
+    // when nothing enforces one (fake root)
+    job->cpu_rate = cpu_applied && cg_.is_cgroupfs() ? spec.cpu_percent / 100.0
+                                                     : (double)std::max(1u, std::thread::hardware_concurrency());
+    if (!cg_.set_memory_max(job->cgroup_fd, (int64_t)spec.memory_mb * 1024 * 1024)) {
+        std::cerr << "⚠️  Warning: Failed to apply memory limit: " << std::strerror(errno) << "\n";
+    }
+    if (job->placement) apply_placement(job->cgroup_fd, *job->placement, job->affinity);
+    const uint64_t t2 = now_ns();
+    job->timings.cgroup_ns = t2 - t1;
+    latency_[CGROUP].record(job->timings.cgroup_ns);
+
+    // Controlled before it runs, so even a job that exits at once is removed by its reap
+    control(job_id, job->cgroup, job->cgroup_fd, spec.cpu_percent, spec.memory_mb);
+    int err = spawn(job, job->cgroup_fd);
+    if (err != 0) return fail(std::strerror(err));
+    return {true, "✅ SUCCESS: " + grant_msg, job_id};
+}
+
+// clone into `cgroup_fd`, then publish the job and start supervising it.
+// Returns 0 or an errno.
+int Executor::spawn(const std::shared_ptr<Job>& job, int cgroup_fd) {
+    const uint64_t t0 = now_ns();
+    LaunchSpec ls;
+    ls.path = job->spec.app_path;
+    ls.args = job->spec.args;
+    ls.cgroup_fd = cgroup_fd;
+    ls.cwd = cfg_.cwd;
+    ls.cpus = job->affinity;
+    int err = launcher_.launch(ls, job->proc);
+    if (err != 0) return err;
+    job->start_ns = now_ns();
+    job->timings.spawn_ns = job->start_ns - t0;
+    latency_[LAUNCH].record(job->timings.spawn_ns);
+
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        jobs_[job->id] = job;
+    }
+    watch(job);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Job arrays
+// ---------------------------------------------------------------------------
+//
+// `count` copies of one spec cost one validation, one Banker reservation
+// for the aggregate, and one cgroup whose cpu.max/memory.max cover the
+// whole gang; members are cloned straight into it. There are no
+// per-member cgroups: each member holds its own descriptor of the gang's,
+// so everything that goes through a job's cgroup acts on the whole gang.
+// A deadline's SIGTERM and cgroup.kill reach every member, a member's CPU
+// budget is checked against the gang's usage per member, and a member's
+// accounting record carries the gang's cgroup counters with array_size set
+// to the gang size.
+
+ArrayResult Executor::submit_array(const JobSpec& requested, int count) {
+    const uint64_t t0 = now_ns();
+    ArrayResult r;
+    if (count < 1 || count > MAX_ARRAY_SIZE) {
+        r.message = "❌ Invalid array size: " + std::to_string(count);
+        return r;
+    }
+    JobSpec spec = requested;
+    std::string note;
+    r.message = size_limits(spec, note);
+    if (!r.message.empty()) return r;
+    r.message = validate(spec);
+    if (!r.message.empty()) return r;
+
+    auto arr = std::make_shared<JobArray>();
+    arr->id = ++job_counter_;
+    arr->spec = spec;
+    arr->count = count;
+    arr->cgroup = "safebox_array_" + std::to_string(arr->id);
+    const std::vector<long> total = {(long)spec.cpu_percent * count, (long)spec.memory_mb * count};
+    std::string grant_msg;
+    if (!reserve(arr->id, spec.name + "[" + std::to_string(count) + "]", total, grant_msg)) {
+        r.message = grant_msg;
+        return r;
+    }
+    grant_msg += note;
+    arr->placement = place(arr->id, total[0], total[1]);
+    const uint64_t t1 = now_ns();
+
+    arr->cgroup_fd = cg_.create(arr->cgroup);
+    if (arr->cgroup_fd < 0) {
+        unreserve(arr->id);
+        cg_.remove(arr->cgroup);
+        r.message = "❌ Execution failed: Failed to create cgroup";
+        return r;
+    }
+    const bool cpu_applied = cg_.set_cpu_max(arr->cgroup_fd, total[0] * 1000, 100000);
+    if (!cpu_applied) std::cerr << "⚠️  Warning: Failed to apply CPU limit: " << std::strerror(errno) << "\n";
+    if (!cg_.set_memory_max(arr->cgroup_fd, (int64_t)total[1] * 1024 * 1024)) {
+        std::cerr << "⚠️  Warning: Failed to apply memory limit: " << std::strerror(errno) << "\n";
+    }
+    std::vector<int> affinity;
+    if (arr->placement) apply_placement(arr->cgroup_fd, *arr->placement, affinity);
+    const uint64_t t2 = now_ns();
+    // One admission and one cgroup for the whole gang
+    latency_[ADMISSION].record(t1 - t0);
+    latency_[CGROUP].record(t2 - t1);
+
+    // A member's CPU budget is checked against the gang's usage per member
+    // (cpu_usage_us), which grows at most at the gang quota over count; with
+    // no quota in force a member reads its own process and can use every core
+    const double cores = std::max(1u, std::thread::hardware_concurrency());
+    const double cpu_rate = cpu_applied && cg_.is_cgroupfs() ? std::min(total[0] / 100.0, cores) / count : cores;
+    std::vector<std::shared_ptr<Job>> members;
+    for (int i = 0; i < count; ++i) {
+        auto job = std::make_shared<Job>(cfg_.output_buffer_bytes);
+        job->cgroup_fd = fcntl(arr->cgroup_fd, F_DUPFD_CLOEXEC, 0);
+        if (job->cgroup_fd < 0) {
+            const int err = errno;
+            members.clear();
+            unreserve(arr->id);
+            close(arr->cgroup_fd);
+            cg_.remove(arr->cgroup);
+            r.message = "❌ Execution failed: " + std::string(std::strerror(err));
+            return r;
+        }
+        job->id = ++job_counter_;
+        job->array_id = arr->id;
+        job->array_size = count;
+        job->spec = spec;
+        job->spec.name = spec.name + "[" + std::to_string(i) + "]";
+        job->cgroup = arr->cgroup;
+        job->cpu_rate = cpu_rate;
+        job->placement = arr->placement;
+        job->affinity = affinity;
+        // The gang's fixed costs, shared out per member
+        job->timings.admit_ns = (t1 - t0) / (uint64_t)count;
+        job->timings.cgroup_ns = (t2 - t1) / (uint64_t)count;
+        arr->job_ids.push_back(job->id);
+        members.push_back(std::move(job));
+    }
+
+    control(arr->id, arr->cgroup, arr->cgroup_fd, total[0], total[1]);
+    // Fan the clones out over the pool, or do them here
+    std::vector<int> errs(count, 0);
+    if (pool_) {
+        std::vector<std::future<void>> done;
+        for (int i = 0; i < count; ++i) {
+            auto p = std::make_shared<std::promise<void>>();
+            done.push_back(p->get_future());
+            pool_->push(-1, [this, &members, &errs, &arr, i, p] {
+                members[i]->worker = WorkStealingPool::current();
+                errs[i] = spawn(members[i], arr->cgroup_fd);
+                p->set_value();
+            });
+        }
+        for (auto& f : done) f.wait();
+    } else {
+        for (int i = 0; i < count; ++i) errs[i] = spawn(members[i], arr->cgroup_fd);
+    }
+
+    int err = 0;
+    for (int e : errs) if (e) err = e;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        arrays_[arr->id] = arr;
+    }
+    if (err != 0) {
+        // All or none: take down whichever members did start
+        release_array(arr->id);
+        r.message = "❌ Execution failed: " + std::string(std::strerror(err));
+        return r;
+    }
+    r.ok = true;
+    r.array_id = arr->id;
+    r.job_ids = arr->job_ids;
+    r.message = "✅ SUCCESS: " + grant_msg;
+    return r;
+}
+
+std::shared_ptr<const JobArray> Executor::array(int array_id) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = arrays_.find(array_id);
+    return it == arrays_.end() ? nullptr : it->second;
+}
+
+std::pair<bool, std::string> Executor::release_array(int array_id) {
+    std::shared_ptr<JobArray> arr;
+    std::vector<std::shared_ptr<Job>> members;
+    std::pair<bool, std::string> res;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = arrays_.find(array_id);
+        if (it == arrays_.end()) return {false, "❌ Array " + std::to_string(array_id) + " not found"};
+        arr = it->second;
+        arrays_.erase(it);
+        for (int id : arr->job_ids) {
+            auto j = jobs_.find(id);
+            if (j == jobs_.end()) continue;  // never started
+            members.push_back(j->second);
+            jobs_.erase(j);
+        }
+        res = release_held(array_id);
+        banker_.remove_process(array_id);
+        if (placer_) placer_->release(array_id);
+    }
+    if (controller_) controller_->remove(array_id);
+    if (metrics_) metrics_->remove(array_id);
+    cg_.kill(arr->cgroup_fd);
+    for (auto& j : members) {
+        syscall(SYS_pidfd_send_signal, j->proc.pidfd, SIGKILL, nullptr, 0);
+        wait_exited(*j);
+    }
+    if (!cg_.wait_empty(arr->cgroup_fd, 1000)) {
+        std::cerr << "⚠️  Warning: " << arr->cgroup << " still populated after kill\n";
+    }
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (auto& j : members) {
+            close(j->cgroup_fd);
+            j->cgroup_fd = -1;
+        }
+        close(arr->cgroup_fd);
+        arr->cgroup_fd = -1;
+    }
+    cg_.remove(arr->cgroup);
+    return {res.first, "✅ Released array " + std::to_string(array_id) + ": " + res.second};
+}
+
+std::shared_ptr<Job> Executor::find(int job_id) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = jobs_.find(job_id);
+    return it == jobs_.end() ? nullptr : it->second;
+}
+
+bool Executor::wait(int job_id) {
+    std::shared_ptr<Job> job = find(job_id);
+    if (!job) return false;
+    wait_exited(*job);
+    return true;
+}
+
+void Executor::wait_exited(Job& job) {
+    std::unique_lock<std::mutex> lk(job.mu);
+    job.cv.wait(lk, [&] { return job.state == JobState::Exited; });
+}
+
+bool Executor::read_output(int job_id, const uint64_t offsets[2], size_t max_bytes, int timeout_ms,
+                           OutputChunk& chunk) {
+    std::shared_ptr<Job> job = find(job_id);
+    if (!job) return false;
+
+    std::unique_lock<std::mutex> lk(job->mu);
+    auto has_news = [&] {
+        return job->state == JobState::Exited || job->output[STDOUT].end() > offsets[STDOUT] ||
+               job->output[STDERR].end() > offsets[STDERR];
+    };
+    job->cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), has_news);
+
+    for (int s = STDOUT; s <= STDERR; ++s) {
+        chunk.next_offset[s] = job->output[s].read(offsets[s], max_bytes, chunk.data[s], chunk.skipped[s]);
+    }
+    chunk.exited = job->state == JobState::Exited &&
+                   chunk.next_offset[STDOUT] == job->output[STDOUT].end() &&
+                   chunk.next_offset[STDERR] == job->output[STDERR].end();
+    chunk.wait_status = job->wait_status;
+    chunk.deadline_hit = job->deadline_hit;
+    return true;
+}
+
+std::string Executor::output_of(Job& job) const {
+    std::lock_guard<std::mutex> lk(job.mu);
+    std::string out = job.output[STDOUT].contents();
+    return out.empty() ? job.output[STDERR].contents() : out;
+}
+
+SubmitResult Executor::request_job(const JobSpec& spec) {
+    SubmitResult r = submit(spec);
+    if (!r.ok) return r;
+    std::shared_ptr<Job> j = find(r.job_id);
+    if (!j) return r;
+    wait_exited(*j);
+    r.message += "\n📊 Output:\n" + output_of(*j);
+    if (j->deadline_hit == Deadline::WallTime) {
+        r.message += "\n⏱️  Killed: wall-time limit of " + std::to_string(j->spec.wall_limit_ms) + "ms exceeded";
+    } else if (j->deadline_hit == Deadline::CpuTime) {
+        r.message += "\n⏱️  Killed: CPU-time limit of " + std::to_string(j->spec.cpu_limit_ms) + "ms exceeded";
+    }
+    return r;
+}
+
+std::pair<bool, std::string> Executor::release_job(int job_id) {
+    std::shared_ptr<Job> job;
+    std::pair<bool, std::string> res;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = jobs_.find(job_id);
+        if (it == jobs_.end()) return {false, "❌ Job " + std::to_string(job_id) + " not found"};
+        job = it->second;
+        if (job->array_id) {
+            return {false, "❌ Job " + std::to_string(job_id) + " is part of array " +
+                               std::to_string(job->array_id) + "; release the array"};
+        }
+        jobs_.erase(it);
+        res = release_held(job_id);
+        banker_.remove_process(job_id);
+        if (placer_) placer_->release(job_id);
+    }
+    if (controller_) controller_->remove(job_id);
+    if (metrics_) metrics_->remove(job_id);
+    // Released while still running: it no longer holds a reservation, and
+    // neither do any processes it left behind in its cgroup.
+    kill_job(*job);
+    wait_exited(*job);
+    // cgroup.kill is asynchronous; rmdir fails with EBUSY until it lands
+    if (!cg_.wait_empty(job->cgroup_fd, 1000)) {
+        std::cerr << "⚠️  Warning: " << job->cgroup << " still populated after kill\n";
+    }
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        close(job->cgroup_fd);
+        job->cgroup_fd = -1;
+    }
+    cg_.remove(job->cgroup);
+    return {res.first, "✅ Released job " + std::to_string(job_id) + ": " + res.second};
+}
+
+std::shared_ptr<const Job> Executor::job(int job_id) const {
+    return find(job_id);
+}
+
+// Under mu_, so release_job()/release_array() cannot close the descriptor
+// (and its number be reused) between the lookup and the dup
+int Executor::dup_cgroup(int job_id) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = jobs_.find(job_id);
+    if (it == jobs_.end() || it->second->cgroup_fd < 0) return -1;
+    return fcntl(it->second->cgroup_fd, F_DUPFD_CLOEXEC, 0);
+}
+
+std::string Executor::system_state_json() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::ostringstream o;
+    o << "{\"banker\":" << banker_.state_json()
+      << ",\"active_jobs\":" << jobs_.size() << ",\"jobs\":{";
+    bool first = true;
+    for (const auto& [id, j] : jobs_) {
+        o << (first ? "" : ",") << '"' << id << "\":{\"name\":\"" << json_escape(j->spec.name)
+          << "\",\"app\":\"" << json_escape(j->spec.app_path) << "\",\"args\":[";
+        for (size_t i = 0; i < j->spec.args.size(); ++i) {
+            o << (i ? "," : "") << '"' << json_escape(j->spec.args[i]) << '"';
+        }
+        bool running;
+        {
+            std::lock_guard<std::mutex> jl(j->mu);
+            running = j->state == JobState::Running;
+        }
+        o << "],\"cpu\":" << j->spec.cpu_percent << ",\"memory\":" << j->spec.memory_mb
+          << ",\"cgroup\":\"" << json_escape(j->cgroup) << "\",\"state\":\""
+          << (running ? "running" : "exited") << "\"";
+        if (j->array_id) o << ",\"array\":" << j->array_id;
+        if (j->placement) {
+            o << ",\"cpus\":\"" << cpu_list(j->placement->cpus) << "\",\"mems\":\"" << cpu_list(j->placement->mems) << "\"";
+        }
+        o << "}";
+        first = false;
+    }
+    o << "},\"arrays\":{";
+    first = true;
+    for (const auto& [id, a] : arrays_) {
+        o << (first ? "" : ",") << '"' << id << "\":{\"name\":\"" << json_escape(a->spec.name)
+          << "\",\"count\":" << a->count << ",\"cpu\":" << a->spec.cpu_percent
+          << ",\"memory\":" << a->spec.memory_mb << ",\"cgroup\":\"" << json_escape(a->cgroup)
+          << "\",\"jobs\":" << json_ints(a->job_ids) << "}";
+        first = false;
+    }
+    o << "},\"total_cpu\":" << banker_.total_resources()[0]
+      << ",\"total_memory\":" << banker_.total_resources()[1]
+      << ",\"available_cpu\":" << banker_.available()[0]
+      << ",\"available_memory\":" << banker_.available()[1];
+    if (placer_) o << ",\"placement\":" << placer_->state_json();
+    if (controller_) o << ",\"controller\":" << controller_->state_json(0);
+    o << "}";
+    return o.str();
+}
+
+// ---------------------------------------------------------------------------
+// Supervisor
+// ---------------------------------------------------------------------------
+
+void Executor::watch(const std::shared_ptr<Job>& job) {
+    {
+        std::lock_guard<std::mutex> lock(live_mu_);
+        live_[job->id] = job;
+    }
+    // The timer is armed before it is registered, so the supervisor never
+    // sees it half set up
+    if (job->spec.wall_limit_ms || job->spec.cpu_limit_ms) {
+        job->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (job->timer_fd < 0) {
+            std::cerr << "⚠️  Warning: job " << job->id << " runs without deadlines: timerfd_create: "
+                      << std::strerror(errno) << "\n";
+        } else {
+            if (job->spec.wall_limit_ms) job->wall_deadline_ns = job->start_ns + job->spec.wall_limit_ms * 1000000ull;
+            if (job->spec.cpu_limit_ms) {
+                job->cpu_check_ns = job->start_ns + (uint64_t)(job->spec.cpu_limit_ms * 1e6 / job->cpu_rate);
+            }
+            arm_deadline(*job, 0);
+        }
+    }
+    const int fds[4] = {job->proc.stdout_fd, job->proc.stderr_fd, job->proc.pidfd, job->timer_fd};
+    for (uint64_t kind = 0; kind < 4; ++kind) {
+        if (fds[kind] < 0) continue;
+        struct epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = token(job->id, kind);
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, fds[kind], &ev);
+    }
+}
+
+void Executor::supervise() {
+    struct epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(epfd_, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "supervisor: epoll_wait failed: " << std::strerror(errno) << "\n";
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint64_t tok = events[i].data.u64;
+            if (tok == WAKE_TOKEN) return;
+
+            // Jobs leave live_ when reaped, so stale events later in this
+            // batch (for fds that are already closed) are simply skipped.
+            std::shared_ptr<Job> job;
+            {
+                std::lock_guard<std::mutex> lock(live_mu_);
+                auto it = live_.find((int)(tok >> 2));
+                if (it == live_.end()) continue;
+                job = it->second;
+            }
+            uint64_t kind = tok & 3;
+            if (kind == KIND_PIDFD) on_exit(job);
+            else if (kind == KIND_TIMER) on_deadline(*job);
+            else on_output(*job, (int)kind);
+        }
+    }
+}
+
+// Move up to `budget` bytes from one of the job's pipes into its ring. The
+// caller holds job.mu. Returns true once the stream is finished.
+static bool pump_stream(Job& job, int stream, size_t budget, bool& appended) {
+    thread_local char buf[65536];
+    int fd = stream == STDOUT ? job.proc.stdout_fd : job.proc.stderr_fd;
+    while (budget > 0) {
+        ssize_t r = read(fd, buf, std::min(sizeof(buf), budget));
+        if (r > 0) {
+            job.output[stream].append(buf, (size_t)r);
+            appended = true;
+            budget -= (size_t)r;
+            continue;
+        }
+        if (r < 0 && errno == EINTR) continue;
+        return r == 0 || errno != EAGAIN;
+    }
+    return false;
+}
+
+// Bounded per wakeup so one noisy job cannot starve the rest; epoll is
+// level-triggered and comes back for the remainder.
+void Executor::on_output(Job& job, int stream) {
+    bool appended = false;
+    {
+        std::lock_guard<std::mutex> lk(job.mu);
+        if (!job.stream_open[stream]) return;
+        if (pump_stream(job, stream, 256 * 1024, appended)) {
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, stream == STDOUT ? job.proc.stdout_fd : job.proc.stderr_fd, nullptr);
+            job.stream_open[stream] = false;
+            appended = true;
+        }
+    }
+    if (appended) job.cv.notify_all();
+}
+
+// Supervisor side of an exit: stop watching the pidfd and the deadline
+// timer (both are supervisor-owned), then hand the reap to the worker that
+// launched the job, or do it inline without a pool.
+void Executor::on_exit(const std::shared_ptr<Job>& job) {
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, job->proc.pidfd, nullptr);
+    // A job that hit a deadline loses whatever it left behind too, instead
+    // of orphans holding on past the grace period
+    if (job->kill_at_ns) cg_.kill(job->cgroup_fd);
+    if (job->timer_fd >= 0) {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, job->timer_fd, nullptr);
+        close(job->timer_fd);
+        job->timer_fd = -1;
+    }
+    if (pool_) pool_->push(job->worker, [this, job] { reap(*job); });
+    else reap(*job);
+}
+
+void Executor::reap(Job& job) {
+    int status = 0;
+    struct rusage ru {};
+    while (wait4(job.proc.pid, &status, 0, &ru) < 0 && errno == EINTR) {
+    }
+    {
+        std::lock_guard<std::mutex> lk(job.mu);
+        // Whatever the child wrote before exiting is already in the pipes. A
+        // grandchild still holding them open must not keep the job alive, so
+        // take what is there (at most one ring's worth) and stop.
+        for (int s = STDOUT; s <= STDERR; ++s) {
+            if (!job.stream_open[s]) continue;
+            bool appended = false;
+            pump_stream(job, s, cfg_.output_buffer_bytes, appended);
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, s == STDOUT ? job.proc.stdout_fd : job.proc.stderr_fd, nullptr);
+            job.stream_open[s] = false;
+        }
+        close(job.proc.stdout_fd);
+        close(job.proc.stderr_fd);
+        job.proc.stdout_fd = job.proc.stderr_fd = -1;
+        job.wait_status = status;
+        job.usage = ru;
+        job.end_ns = now_ns();
+    }
+    latency_[COMPLETION].record(job.end_ns - job.start_ns);
+    if (controller_ && !job.array_id) controller_->remove(job.id);
+    if (metrics_ && !job.array_id) metrics_->remove(job.id);
+    // Before anyone can see the exit: release_job() removes the cgroup
+    // whose counters go into the record
+    if (accounting_) record_exit(job);
+    {
+        std::lock_guard<std::mutex> lk(job.mu);
+        job.state = JobState::Exited;
+    }
+    job.cv.notify_all();
+
+    std::lock_guard<std::mutex> lock(live_mu_);
+    live_.erase(job.id);
+}
+
+// ---------------------------------------------------------------------------
+// Accounting
+// ---------------------------------------------------------------------------
+
+static int64_t kv_or(const std::map<std::string, int64_t>& kv, const char* key) {
+    auto it = kv.find(key);
+    return it == kv.end() ? -1 : it->second;
+}
+
+static int64_t tv_us(const struct timeval& tv) {
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Sum rbytes/wbytes/rios/wios over every device line of io.stat
+static void read_io_stat(const std::string& text, JobRecord& r) {
+    int64_t* dst[4] = {&r.io_rbytes, &r.io_wbytes, &r.io_rios, &r.io_wios};
+    const char* keys[4] = {"rbytes=", "wbytes=", "rios=", "wios="};
+    for (int k = 0; k < 4; ++k) *dst[k] = 0;
+    std::istringstream in(text);
+    std::string tok;
+    while (in >> tok) {
+        for (int k = 0; k < 4; ++k) {
+            if (tok.rfind(keys[k], 0) == 0) *dst[k] += std::strtoll(tok.c_str() + std::strlen(keys[k]), nullptr, 10);
+        }
+    }
+}
+
+// Runs on the supervisor after the reap; the cgroup is still there until
+// release_job(), so its counters cover every process the job ever had (an
+// array member's cover the whole gang).
+void Executor::record_exit(const Job& job) {
+    JobRecord r;
+    std::memset(&r, 0, sizeof(r));
+    std::strncpy(r.name, job.spec.name.c_str(), sizeof(r.name) - 1);
+    std::strncpy(r.app, job.spec.app_path.c_str(), sizeof(r.app) - 1);
+    r.app_hash = (int64_t)app_key(job.spec.app_path);
+
+    r.job_id = job.id;
+    r.array_size = job.array_size;
+    r.cpu_percent = job.spec.cpu_percent;
+    r.memory_mb = job.spec.memory_mb;
+    r.wall_limit_ms = (int64_t)job.spec.wall_limit_ms;
+    r.cpu_limit_ms = (int64_t)job.spec.cpu_limit_ms;
+
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    const int64_t now_real = (int64_t)real.tv_sec * 1000000000 + real.tv_nsec;
+    r.start_unix_ns = now_real - (int64_t)(now_ns() - job.start_ns);
+    r.wall_ns = (int64_t)(job.end_ns - job.start_ns);
+    r.admit_ns = (int64_t)job.timings.admit_ns;
+    r.cgroup_ns = (int64_t)job.timings.cgroup_ns;
+    r.spawn_ns = (int64_t)job.timings.spawn_ns;
+
+    r.exit_code = WIFEXITED(job.wait_status) ? WEXITSTATUS(job.wait_status) : -1;
+    r.signal = WIFSIGNALED(job.wait_status) ? WTERMSIG(job.wait_status) : 0;
+    r.deadline = (int64_t)job.deadline_hit;
+
+    r.ru_utime_us = tv_us(job.usage.ru_utime);
+    r.ru_stime_us = tv_us(job.usage.ru_stime);
+    r.ru_maxrss_kb = job.usage.ru_maxrss;
+    r.ru_minflt = job.usage.ru_minflt;
+    r.ru_majflt = job.usage.ru_majflt;
+    r.ru_inblock = job.usage.ru_inblock;
+    r.ru_oublock = job.usage.ru_oublock;
+    r.ru_nvcsw = job.usage.ru_nvcsw;
+    r.ru_nivcsw = job.usage.ru_nivcsw;
+
+    auto cpu = cg_.read_kv(job.cgroup_fd, "cpu.stat");
+    r.cpu_usage_us = kv_or(cpu, "usage_usec");
+    r.cpu_user_us = kv_or(cpu, "user_usec");
+    r.cpu_system_us = kv_or(cpu, "system_usec");
+    r.cpu_nr_periods = kv_or(cpu, "nr_periods");
+    r.cpu_nr_throttled = kv_or(cpu, "nr_throttled");
+    r.cpu_throttled_us = kv_or(cpu, "throttled_usec");
+
+    r.memory_peak = cg_.read_int(job.cgroup_fd, "memory.peak").value_or(-1);
+    auto ev = cg_.read_kv(job.cgroup_fd, "memory.events");
+    r.mem_events_low = kv_or(ev, "low");
+    r.mem_events_high = kv_or(ev, "high");
+    r.mem_events_max = kv_or(ev, "max");
+    r.mem_events_oom = kv_or(ev, "oom");
+    r.mem_events_oom_kill = kv_or(ev, "oom_kill");
+
+    auto io = cg_.read(job.cgroup_fd, "io.stat");
+    if (io) read_io_stat(*io, r);
+    else r.io_rbytes = r.io_wbytes = r.io_rios = r.io_wios = -1;
+
+    if (!accounting_->append(r)) {
+        std::cerr << "⚠️  Warning: failed to write accounting record for job " << job.id << ": "
+                  << std::strerror(errno) << "\n";
+    }
+    profiles_->observe(r, job.spec.app_path);
+}
+
+// ---------------------------------------------------------------------------
+// Deadlines
+// ---------------------------------------------------------------------------
+//
+// A wall deadline is a single expiry. CPU time is never polled: the job can
+// burn at most cpu_rate CPU-seconds per wall second (its cpu.max quota, or
+// every core when none is enforced), so the timer is set for the earliest
+// moment the remaining budget could be gone, cpu.stat is read then, and the
+// timer is pushed out again by whatever budget is left.
+
+// (Re)arm the job's timerfd for `at_ns`, or for its nearest pending deadline
+// when at_ns is 0.
+void Executor::arm_deadline(Job& job, uint64_t at_ns) {
+    if (at_ns == 0) {
+        at_ns = job.wall_deadline_ns;
+        if (job.cpu_check_ns && (!at_ns || job.cpu_check_ns < at_ns)) at_ns = job.cpu_check_ns;
+    }
+    struct itimerspec its {};
+    its.it_value.tv_sec = (time_t)(at_ns / 1000000000ull);
+    its.it_value.tv_nsec = (long)(at_ns % 1000000000ull);
+    timerfd_settime(job.timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+// An array member's share of its gang's usage, see submit_array()
+uint64_t Executor::cpu_usage_us(const Job& job) const {
+    auto stat = cg_.read_kv(job.cgroup_fd, "cpu.stat");
+    auto it = stat.find("usage_usec");
+    if (it != stat.end()) return (uint64_t)it->second / (uint64_t)job.array_size;
+
+    // No v2 cpu controller (fake root, v1 host): the job's own process and
+    // its reaped children are the best we can see
+    std::ifstream f("/proc/" + std::to_string(job.proc.pid) + "/stat");
+    std::string line;
+    if (!std::getline(f, line)) return 0;
+    size_t rp = line.rfind(')');
+    if (rp == std::string::npos) return 0;
+    std::istringstream in(line.substr(rp + 2));
+    std::string field;
+    uint64_t ticks = 0;
+    for (int i = 3; i <= 17 && in >> field; ++i) {
+        if (i >= 14) ticks += std::strtoull(field.c_str(), nullptr, 10);  // utime stime cutime cstime
+    }
+    return ticks * 1000000ull / (uint64_t)sysconf(_SC_CLK_TCK);
+}
+
+void Executor::kill_job(Job& job) {
+    cg_.kill(job.cgroup_fd);
+    // The pidfd reaches the job itself even where the cgroup cannot (fake root)
+    syscall(SYS_pidfd_send_signal, job.proc.pidfd, SIGKILL, nullptr, 0);
+}
+
+void Executor::on_deadline(Job& job) {
+    uint64_t expirations;
+    if (read(job.timer_fd, &expirations, sizeof(expirations)) < 0) return;  // spurious
+    const uint64_t now = now_ns();
+
+    if (job.kill_at_ns) {
+        // Grace period over; the pidfd reports the exit
+        if (now >= job.kill_at_ns) kill_job(job);
+        else arm_deadline(job, job.kill_at_ns);
+        return;
+    }
+
+    Deadline hit = Deadline::None;
+    if (job.wall_deadline_ns && now >= job.wall_deadline_ns) {
+        hit = Deadline::WallTime;
+    } else if (job.cpu_check_ns && now >= job.cpu_check_ns) {
+        const uint64_t limit_us = job.spec.cpu_limit_ms * 1000;
+        const uint64_t used_us = cpu_usage_us(job);
+        if (used_us >= limit_us) {
+            hit = Deadline::CpuTime;
+        } else {
+            uint64_t wait_ns = (uint64_t)((limit_us - used_us) * 1000 / job.cpu_rate);
+            job.cpu_check_ns = now + std::max<uint64_t>(wait_ns, 1000000);  // >= 1ms apart
+        }
+    }
+    if (hit == Deadline::None) {
+        arm_deadline(job, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(job.mu);
+        job.deadline_hit = hit;
+    }
+    if (cfg_.kill_grace_ms <= 0) {
+        kill_job(job);
+        return;
+    }
+    cg_.signal(job.cgroup_fd, SIGTERM);
+    syscall(SYS_pidfd_send_signal, job.proc.pidfd, SIGTERM, nullptr, 0);
+    job.kill_at_ns = now + (uint64_t)cfg_.kill_grace_ms * 1000000ull;
+    arm_deadline(job, job.kill_at_ns);
+}
+
+}  // namespace safebox
@@ -0,0 +1,285 @@
+// executor.hpp - the request_job pipeline of backend/app/system_executor.py
+// run in a single process: Banker admission -> cgroup -> sandbox -> reap.
+//
+// Thread-safe. Admission and the job table sit behind one mutex; the cgroup
+// writes and clone run outside it so independent jobs proceed in parallel.
+// A supervisor thread owns every running job's pipes and pidfd through one
+// epoll set: it drains output into bounded rings as it is produced, reaps
+// jobs the moment they exit, and enforces wall/CPU deadlines off one
+// timerfd per limited job.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "accounting.hpp"
+#include "banker.hpp"
+#include "cgroup_fs.hpp"
+#include "controller.hpp"
+#include "latency_histogram.hpp"
+#include "launcher.hpp"
+#include "metrics_feed.hpp"
+#include "output_ring.hpp"
+#include "placement.hpp"
+#include "profile.hpp"
+#include "work_pool.hpp"
+
+namespace safebox {
+
+struct ExecutorConfig {
+    long total_cpu_percent = 100;
+    long total_memory_mb = 1024;
+    bool sandbox = true;                           // namespaces + seccomp + drop to nobody
+    std::string cgroup_root = CgroupFs::default_root();
+    std::string cwd;                               // working directory for jobs ("" => inherit)
+    size_t output_buffer_bytes = 256 * 1024;       // retained per stream per job
+    int kill_grace_ms = 2000;                      // SIGTERM .. cgroup.kill after a deadline
+    std::string accounting_path;                   // JobRecord per exit, "" => none
+    int workers = 0;                               // launch/reap pool, 0 => caller + supervisor threads
+    bool pin_workers = true;                       // one CPU per worker, NUMA node order
+    // Usage profiles (built from accounting, so only with accounting_path):
+    // a job submitted with cpu or memory 0 gets its app's recommendation
+    bool right_size = false;                       // also lower explicit limits to it
+    size_t profile_window = 64;                    // newest runs kept per app
+    size_t profile_min_runs = 5;                   // before anything is recommended
+    double profile_margin = 0.25;                  // headroom over p95 CPU / max memory
+    bool placement = false;                        // bin-pack jobs onto CPUs and NUMA nodes (cpuset)
+    // Closed-loop cpu.max / memory.high control inside each reservation
+    bool controller = false;
+    int controller_period_ms = 100;
+    std::string controller_log;                    // JSON line per decision, "" => none
+    std::string controller_record;                 // binary trace of every sweep, "" => none
+    // Host and per-job metric history (metrics_feed.hpp), queried with METRICS
+    int metrics_interval_ms = 1000;                // 0 => no history
+    int64_t metrics_retention_s = 24 * 3600;
+    size_t metrics_max_mb = 100;                   // 0 => retention only
+};
+
+struct JobSpec {
+    std::string name;
+    std::string app_path;
+    std::vector<std::string> args;
+    int cpu_percent = 0;
+    int memory_mb = 0;
+    uint64_t wall_limit_ms = 0;   // 0 = no deadline
+    uint64_t cpu_limit_ms = 0;    // cpu.stat usage_usec budget, 0 = none
+};
+
+// Nanosecond durations of each launch phase
+struct LaunchTimings {
+    uint64_t admit_ns = 0;   // validation + Banker safety check
+    uint64_t cgroup_ns = 0;  // mkdir + cpu.max + memory.max
+    uint64_t spawn_ns = 0;   // clone .. clone returned in the parent
+};
+
+enum class JobState { Running, Exited };
+enum JobStream { STDOUT = 0, STDERR = 1 };
+enum class Deadline { None, WallTime, CpuTime };
+
+// "wall_time" / "cpu_time", or nullptr for Deadline::None
+const char* deadline_name(Deadline d);
+
+// Lift RLIMIT_NOFILE as far as the process may (to fs.nr_open with
+// CAP_SYS_RESOURCE): a running job holds about 4 fds and a controlled
+// group 6 more. Returns the new soft limit.
+uint64_t raise_fd_limit();
+
+struct Job {
+    explicit Job(size_t ring_bytes) : output{OutputRing(ring_bytes), OutputRing(ring_bytes)} {}
+    ~Job();
+
+    int id = 0;
+    JobSpec spec;
+    std::string cgroup;
+    int cgroup_fd = -1;      // array members: a dup of the gang's
+    LaunchedProcess proc;
+    LaunchTimings timings;
+    uint64_t start_ns = 0;   // monotonic, taken when clone() returned
+    int worker = -1;         // pool worker that launched it; its reap goes there too
+    int array_id = 0;        // owning JobArray, 0 for a standalone job
+    int array_size = 1;      // jobs sharing the cgroup behind cgroup_fd
+    std::optional<Placement> placement;   // with ExecutorConfig::placement
+    std::vector<int> affinity;            // pinned from the child when cpuset is unavailable
+
+    // Deadline watchdog, touched only by the supervisor thread
+    int timer_fd = -1;            // -1 when the job has no limits
+    double cpu_rate = 1.0;        // most CPU-seconds the job can burn per wall second
+    uint64_t wall_deadline_ns = 0;
+    uint64_t cpu_check_ns = 0;    // earliest moment the CPU budget could run out
+    uint64_t kill_at_ns = 0;      // end of the grace period once a deadline hit
+
+    std::mutex mu;                // guards everything below
+    std::condition_variable cv;   // signalled on new output and on exit
+    JobState state = JobState::Running;
+    uint64_t end_ns = 0;          // monotonic, taken after wait4()
+    int wait_status = 0;
+    struct rusage usage {};
+    OutputRing output[2];         // indexed by JobStream
+    bool stream_open[2] = {true, true};
+    Deadline deadline_hit = Deadline::None;
+};
+
+// One poll of a job's output, see Executor::read_output()
+struct OutputChunk {
+    std::string data[2];
+    uint64_t next_offset[2] = {0, 0};
+    uint64_t skipped[2] = {0, 0};   // bytes overwritten before this reader got to them
+    bool exited = false;            // and both streams fully delivered
+    int wait_status = 0;
+    Deadline deadline_hit = Deadline::None;
+};
+
+// A gang of identical jobs admitted as one Banker process and sharing one
+// cgroup (see Executor::submit_array)
+struct JobArray {
+    int id = 0;              // also its Banker process id
+    JobSpec spec;            // per member
+    int count = 0;
+    std::string cgroup;
+    int cgroup_fd = -1;
+    std::vector<int> job_ids;
+    std::optional<Placement> placement;   // of the whole gang
+};
+
+struct ArrayResult {
+    bool ok = false;
+    std::string message;
+    int array_id = -1;
+    std::vector<int> job_ids;
+};
+
+static const int MAX_ARRAY_SIZE = 4096;
+
+// Mirrors the (success, message, job_id) tuple returned by SystemExecutor
+struct SubmitResult {
+    bool ok = false;
+    std::string message;
+    int job_id = -1;
+};
+
+class Executor {
+public:
+    explicit Executor(ExecutorConfig cfg);
+    ~Executor();
+
+    // Admit, create the cgroup and launch; returns as soon as the job runs
+    SubmitResult submit(const JobSpec& spec);
+    // Admission runs on the caller; with a worker pool the launch is queued
+    // on the least-loaded worker and the future resolves once it has run
+    std::future<SubmitResult> submit_async(const JobSpec& spec);
+    // Block until the job has exited and been reaped; false for unknown ids
+    bool wait(int job_id);
+    // Long-poll a job's output from the given per-stream offsets: returns as
+    // soon as there is anything new, the job exits, or timeout_ms passes.
+    bool read_output(int job_id, const uint64_t offsets[2], size_t max_bytes, int timeout_ms,
+                     OutputChunk& chunk);
+    // submit() + wait(), with the same messages as SystemExecutor.request_job
+    SubmitResult request_job(const JobSpec& spec);
+    // Return the job's reservation to the Banker and remove its cgroup
+    std::pair<bool, std::string> release_job(int job_id);
+
+    // Admit `count` copies of `spec` all-or-none against one reservation of
+    // count x (cpu, memory) and launch them into one shared cgroup. Members
+    // are ordinary jobs for wait()/read_output() but are released together.
+    ArrayResult submit_array(const JobSpec& spec, int count);
+    std::pair<bool, std::string> release_array(int array_id);
+    std::shared_ptr<const JobArray> array(int array_id) const;
+
+    std::shared_ptr<const Job> job(int job_id) const;
+    // A new O_CLOEXEC descriptor of the job's cgroup (an array member's is
+    // the gang's) for the caller to close, or -1 once the job is released
+    int dup_cgroup(int job_id) const;
+    // SystemExecutor.get_system_state() as JSON
+    std::string system_state_json() const;
+
+    const CgroupFs& cgroups() const { return cg_; }
+    const ExecutorConfig& config() const { return cfg_; }
+    // nullptr when accounting is off
+    const AccountingStore* accounting() const { return accounting_.get(); }
+    // nullptr without --workers
+    const WorkStealingPool* pool() const { return pool_.get(); }
+    // nullptr when accounting is off
+    const ProfileStore* profiles() const { return profiles_.get(); }
+    // nullptr without ExecutorConfig::controller
+    const LimitController* controller() const { return controller_.get(); }
+    // nullptr with ExecutorConfig::metrics_interval_ms 0
+    const MetricStore* metrics() const { return metrics_ ? &metrics_->store() : nullptr; }
+    const MetricRollups* metric_rollups() const { return metrics_ ? &metrics_->rollups() : nullptr; }
+    // Per-stage latency of every job since start: admit(), cgroup setup,
+    // clone, and launch to reap
+    const LatencyHistogram& latency(LatencyStage stage) const { return latency_[stage]; }
+
+private:
+    static uint64_t now_ns();
+    std::shared_ptr<Job> find(int job_id) const;
+    std::string size_limits(JobSpec& spec, std::string& note) const;
+    std::string validate(const JobSpec& spec) const;
+    bool reserve(int banker_id, const std::string& name, const std::vector<long>& max_resources,
+                 std::string& msg);
+    void unreserve(int banker_id);
+    std::pair<bool, std::string> release_held(int banker_id);
+    bool move_memory(int banker_id, long mb);
+    std::optional<Placement> place(int banker_id, long cpu_percent, long memory_mb);
+    void apply_placement(int cgroup_fd, const Placement& p, std::vector<int>& affinity);
+    void control(int id, const std::string& cgroup, int cgroup_fd, long cpu_percent, long memory_mb);
+    std::shared_ptr<Job> admit(const JobSpec& spec, std::string& msg);
+    SubmitResult launch(const std::shared_ptr<Job>& job, const std::string& grant_msg);
+    int spawn(const std::shared_ptr<Job>& job, int cgroup_fd);
+    void wait_exited(Job& job);
+    std::string output_of(Job& job) const;
+
+    // Supervisor thread: epoll over every running job's pipes and pidfd.
+    // With a pool it only watches; reaping runs on the workers.
+    void supervise();
+    void watch(const std::shared_ptr<Job>& job);
+    void on_output(Job& job, int stream);
+    void on_exit(const std::shared_ptr<Job>& job);
+    void reap(Job& job);
+    void on_deadline(Job& job);
+    void arm_deadline(Job& job, uint64_t at_ns);
+    uint64_t cpu_usage_us(const Job& job) const;
+    void kill_job(Job& job);
+    void record_exit(const Job& job);
+
+    ExecutorConfig cfg_;
+    CgroupFs cg_;
+    Launcher launcher_;
+    std::unique_ptr<AccountingStore> accounting_;
+    std::unique_ptr<ProfileStore> profiles_;
+    LatencyHistogram latency_[LATENCY_STAGES];
+
+    // Guards banker_, placer_, jobs_ and arrays_, and the closing of every
+    // job's and array's cgroup_fd
+    mutable std::mutex mu_;
+    Banker banker_;
+    std::unique_ptr<Placer> placer_;
+    std::map<int, std::shared_ptr<Job>> jobs_;
+    std::map<int, std::shared_ptr<JobArray>> arrays_;
+    std::atomic<int> job_counter_{0};
+
+    int epfd_ = -1;
+    int wake_fd_ = -1;            // eventfd that stops the supervisor
+    std::mutex live_mu_;          // guards live_
+    std::unordered_map<int, std::shared_ptr<Job>> live_;  // jobs registered with epfd_
+    std::thread supervisor_;
+    std::unique_ptr<WorkStealingPool> pool_;
+    std::unique_ptr<MetricsFeed> metrics_;
+    std::unique_ptr<LimitController> controller_;   // last: stopped before the jobs it watches
+};
+
+}  // namespace safebox
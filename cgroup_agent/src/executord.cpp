@@ -0,0 +1,591 @@
+// safebox-executord - native job executor daemon.
+//
+// Runs the whole request_job flow (Banker admission, cgroup setup, sandbox
+// launch, reap) in one process; backend/app/executord_client.py is the thin
+// Python side. One request per line, fields separated by tabs:
+//
+//   RUN     <name> <cpu%> <memory_mb> [limits...] <app_path> [args...]
+//                                          admit, launch, wait
+//   SUBMIT  <name> <cpu%> <memory_mb> [limits...] <app_path> [args...]
+//                                          admit, launch
+//   ARRAY   <name> <count> <cpu%> <memory_mb> [limits...] <app_path> [args...]
+//                                          admit count copies as one gang, launch
+//   WAIT    <job_id>                       wait for exit
+//   WAIT_ARRAY <array_id>                  wait for every member
+//   OUTPUT  <job_id> <stdout_offset> <stderr_offset> [wait_ms]
+//                                          long-poll output
+//   RELEASE <job_id>
+//   RELEASE_ARRAY <array_id>
+//   ACCOUNT [name [limit]]                 exit records, newest first
+//   PROFILE [app_path]                     usage profile + recommended limits
+//   CONTROL [limit]                        controlled groups + newest decisions
+//   METRICS [prefix]                       metric series names + store size
+//   METRICS <series> <from_ms> <to_ms> [step_ms]
+//                                          a series' points in the range, or
+//                                          min/max/avg/p95 per step
+//   CPU_PROFILE <job_id> <seconds> [folded|speedscope] [hz]
+//                                          sample the job's cgroup, symbolised stacks
+//   LATENCY [json|openmetrics]             per-stage latency histograms
+//   STATE
+//   PING
+//
+// Every request gets exactly one JSON object on a single line back.
+//
+// Limits are optional wall_ms=<n> / cpu_ms=<n> fields. A job past either is
+// sent SIGTERM, then its whole cgroup is killed after --kill-grace-ms; WAIT
+// and OUTPUT report which one fired as "deadline".
+//
+// ACCOUNT reads the per-job records kept in --accounting (one is written
+// whenever a job exits); an empty or missing name matches every job.
+//
+// The same records feed per-application usage profiles. RUN/SUBMIT/ARRAY
+// with cpu or memory 0 take the app's recommended value; --right-size also
+// lowers explicit requests to it. PROFILE without an app lists every app.
+//
+// --placement bin-packs every admitted job (or array) onto CPUs and a NUMA
+// node and writes it to the group's cpuset; STATE then shows each job's
+// "cpus"/"mems" and the free capacity per node and CPU under "placement".
+//
+// --controller runs a closed loop every --controller-period-ms over each
+// job's cgroup, moving cpu.max and memory.high inside its reservation on
+// throttling and memory pressure, and ahead of it on a short forecast of
+// each job's use. Idle jobs with a cold working set are shrunk through
+// memory.reclaim and lend the freed memory back to the Banker until they
+// need it again. CONTROL shows the current settings, forecast accuracy and
+// the newest decisions (default 100); --controller-log appends every
+// decision to a JSON-lines file, and --controller-record writes every
+// sweep's samples to a binary trace that safebox-replay runs policies on.
+//
+// Every --metrics-interval-ms (1 s; 0 turns it off) the host's CPU, memory
+// and load and each job's usage, throttling, pressure, memory events and
+// limits are sampled into a compressed in-memory history kept for
+// --metrics-retention-s (24 h) or until it reaches --metrics-max-mb (100;
+// 0 => no size limit), whichever comes first. At 1000 jobs that is the
+// size limit: about 10 MB an hour, so the raw seconds reach back ~10 h;
+// a full day fits up to ~400 jobs.
+// Series are "host.<metric>" and "job.<id>.<metric>"; METRICS ranges are
+// in epoch milliseconds, both ends inclusive. With a step (0 picks about 300
+// buckets) they come from 10 s / 1 min / 10 min rollups kept as the points
+// arrive, in stores of their own (1 h, 24 h, 24 h), so a day-long panel
+// never scans the raw seconds and outlives them.
+//
+// CPU_PROFILE samples the CPU clock of every task in the job's cgroup (an
+// array member's: the gang's) at hz (99) per CPU for the given seconds, then
+// symbolises the stacks and replies with them folded (flamegraph.pl) or as
+// speedscope JSON. Only one runs at a time, and none outside a request.
+//
+// LATENCY reports every job's admission (validation + Banker), cgroup
+// setup, launch (clone) and completion (launch to reap) times since the
+// daemon started, as histograms with p50..p999 (JSON, in ns) or as an
+// OpenMetrics exposition in seconds.
+//
+// OUTPUT returns whatever each stream has past the given offsets (capped per
+// reply) plus the offsets to ask for next. Jobs keep only the newest
+// output_buffer_bytes per stream, so a reader that falls behind is moved
+// forward and told how much it skipped instead of the daemon buffering for it.
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "executor.hpp"
+#include "json_util.hpp"
+
+using safebox::json_escape;
+
+static const char* DEFAULT_SOCKET = "/run/safebox/executord.sock";
+static const char* DEFAULT_ACCOUNTING = "/var/lib/safebox/accounting.bin";
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  safebox-executord [--socket <path>] [--cpu <percent>] [--memory <mb>]\n"
+              << "                    [--cgroup-root <dir>] [--cwd <dir>] [--no-sandbox]\n"
+              << "                    [--kill-grace-ms <ms>] [--accounting <file> | --no-accounting]\n"
+              << "                    [--workers <n>] [--right-size] [--profile-margin <fraction>]\n"
+              << "                    [--profile-window <runs>] [--profile-min-runs <runs>] [--placement]\n"
+              << "                    [--controller] [--controller-period-ms <ms>] [--controller-log <file>]\n"
+              << "                    [--controller-record <trace>] [--metrics-interval-ms <ms>]\n"
+              << "                    [--metrics-retention-s <s>] [--metrics-max-mb <mb>]\n";
+}
+
+static std::vector<std::string> split_tabs(const std::string& line) {
+    std::vector<std::string> out;
+    size_t pos = 0;
+    for (;;) {
+        size_t tab = line.find('\t', pos);
+        out.push_back(line.substr(pos, tab == std::string::npos ? std::string::npos : tab - pos));
+        if (tab == std::string::npos) break;
+        pos = tab + 1;
+    }
+    return out;
+}
+
+static bool parse_int(const std::string& s, int& out) {
+    char* end = nullptr;
+    errno = 0;
+    long v = std::strtol(s.c_str(), &end, 10);
+    if (errno != 0 || end == s.c_str() || *end != '\0') return false;
+    out = (int)v;
+    return true;
+}
+
+static const size_t OUTPUT_REPLY_BYTES = 64 * 1024;  // per stream per OUTPUT reply
+static const int OUTPUT_MAX_WAIT_MS = 30000;
+static const int CPU_PROFILE_MAX_S = 300;
+static const int CPU_PROFILE_MAX_HZ = 999;
+// One CPU profile at a time, so profiling never costs more than one
+static std::atomic<bool> profiling{false};
+
+static bool parse_u64(const std::string& s, uint64_t& out) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long v = std::strtoull(s.c_str(), &end, 10);
+    if (errno != 0 || end == s.c_str() || *end != '\0') return false;
+    out = (uint64_t)v;
+    return true;
+}
+
+static std::string error_json(const std::string& msg) {
+    return "{\"ok\":false,\"message\":\"" + json_escape(msg) + "\"}";
+}
+
+static std::string exit_fields(int status, safebox::Deadline deadline) {
+    const char* d = safebox::deadline_name(deadline);
+    return ",\"exit_code\":" + std::to_string(WIFEXITED(status) ? WEXITSTATUS(status) : -1) +
+           ",\"signal\":" + std::to_string(WIFSIGNALED(status) ? WTERMSIG(status) : 0) +
+           ",\"deadline\":" + (d ? "\"" + std::string(d) + "\"" : std::string("null"));
+}
+
+// Consume leading wall_ms=/cpu_ms= fields starting at f[i]
+static bool parse_limits(const std::vector<std::string>& f, size_t& i, safebox::JobSpec& spec) {
+    for (; i < f.size(); ++i) {
+        uint64_t* dst;
+        size_t skip;
+        if (f[i].rfind("wall_ms=", 0) == 0) { dst = &spec.wall_limit_ms; skip = 8; }
+        else if (f[i].rfind("cpu_ms=", 0) == 0) { dst = &spec.cpu_limit_ms; skip = 7; }
+        else return true;
+        if (!parse_u64(f[i].substr(skip), *dst)) return false;
+    }
+    return true;
+}
+
+static std::string handle(safebox::Executor& ex, const std::string& line) {
+    std::vector<std::string> f = split_tabs(line);
+    const std::string& cmd = f[0];
+
+    if (cmd == "PING") return "{\"ok\":true}";
+    if (cmd == "STATE") return ex.system_state_json();
+
+    if (cmd == "RUN" || cmd == "SUBMIT") {
+        const std::string usage_msg = "usage: " + cmd + " name cpu memory [wall_ms=N] [cpu_ms=N] app [args...]";
+        if (f.size() < 5) return error_json(usage_msg);
+        safebox::JobSpec spec;
+        spec.name = f[1];
+        if (!parse_int(f[2], spec.cpu_percent) || !parse_int(f[3], spec.memory_mb)) {
+            return error_json("cpu and memory must be integers");
+        }
+        size_t i = 4;
+        if (!parse_limits(f, i, spec)) return error_json("wall_ms and cpu_ms must be integers");
+        if (i >= f.size()) return error_json(usage_msg);
+        spec.app_path = f[i];
+        spec.args.assign(f.begin() + (long)i + 1, f.end());
+
+        safebox::SubmitResult r = cmd == "RUN" ? ex.request_job(spec) : ex.submit(spec);
+        std::ostringstream o;
+        o << "{\"ok\":" << (r.ok ? "true" : "false") << ",\"message\":\"" << json_escape(r.message)
+          << "\",\"job_id\":";
+        if (r.ok) o << r.job_id; else o << "null";
+        o << "}";
+        return o.str();
+    }
+
+    if (cmd == "ARRAY") {
+        const std::string usage_msg = "usage: ARRAY name count cpu memory [wall_ms=N] [cpu_ms=N] app [args...]";
+        if (f.size() < 6) return error_json(usage_msg);
+        safebox::JobSpec spec;
+        int count = 0;
+        spec.name = f[1];
+        if (!parse_int(f[2], count) || !parse_int(f[3], spec.cpu_percent) || !parse_int(f[4], spec.memory_mb)) {
+            return error_json("count, cpu and memory must be integers");
+        }
+        size_t i = 5;
+        if (!parse_limits(f, i, spec)) return error_json("wall_ms and cpu_ms must be integers");
+        if (i >= f.size()) return error_json(usage_msg);
+        spec.app_path = f[i];
+        spec.args.assign(f.begin() + (long)i + 1, f.end());
+
+        safebox::ArrayResult r = ex.submit_array(spec, count);
+        std::ostringstream o;
+        o << "{\"ok\":" << (r.ok ? "true" : "false") << ",\"message\":\"" << json_escape(r.message)
+          << "\",\"array_id\":";
+        if (r.ok) o << r.array_id; else o << "null";
+        o << ",\"job_ids\":" << safebox::json_ints(r.job_ids) << "}";
+        return o.str();
+    }
+
+    if (cmd == "WAIT_ARRAY" || cmd == "RELEASE_ARRAY") {
+        int id = 0;
+        if (f.size() != 2 || !parse_int(f[1], id)) return error_json("usage: " + cmd + " array_id");
+        if (cmd == "RELEASE_ARRAY") {
+            auto [ok, msg] = ex.release_array(id);
+            return std::string("{\"ok\":") + (ok ? "true" : "false") + ",\"message\":\"" + json_escape(msg) + "\"}";
+        }
+        auto arr = ex.array(id);
+        if (!arr) return error_json("❌ Array " + std::to_string(id) + " not found");
+        std::vector<int> codes;
+        int failed = 0;
+        for (int jid : arr->job_ids) {
+            ex.wait(jid);
+            auto j = ex.job(jid);
+            int code = j && WIFEXITED(j->wait_status) ? WEXITSTATUS(j->wait_status) : -1;
+            if (code != 0) ++failed;
+            codes.push_back(code);
+        }
+        return "{\"ok\":true,\"array_id\":" + std::to_string(id) + ",\"failed\":" + std::to_string(failed) +
+               ",\"exit_codes\":" + safebox::json_ints(codes) + "}";
+    }
+
+    if (cmd == "WAIT" || cmd == "RELEASE") {
+        int id = 0;
+        if (f.size() != 2 || !parse_int(f[1], id)) return error_json("usage: " + cmd + " job_id");
+        if (cmd == "RELEASE") {
+            auto [ok, msg] = ex.release_job(id);
+            return std::string("{\"ok\":") + (ok ? "true" : "false") + ",\"message\":\"" + json_escape(msg) + "\"}";
+        }
+        if (!ex.wait(id)) return error_json("❌ Job " + std::to_string(id) + " not found");
+        // Everything still retained, in one reply
+        const uint64_t from_start[2] = {0, 0};
+        safebox::OutputChunk c;
+        if (!ex.read_output(id, from_start, ex.config().output_buffer_bytes, 0, c)) {
+            return error_json("❌ Job " + std::to_string(id) + " not found");
+        }
+        std::ostringstream o;
+        o << "{\"ok\":true,\"job_id\":" << id << exit_fields(c.wait_status, c.deadline_hit)
+          << ",\"stdout\":\"" << json_escape(c.data[safebox::STDOUT])
+          << "\",\"stderr\":\"" << json_escape(c.data[safebox::STDERR])
+          << "\",\"skipped_stdout\":" << c.skipped[safebox::STDOUT]
+          << ",\"skipped_stderr\":" << c.skipped[safebox::STDERR] << "}";
+        return o.str();
+    }
+
+    if (cmd == "OUTPUT") {
+        int id = 0, wait_ms = 0;
+        uint64_t offsets[2];
+        if (f.size() < 4 || f.size() > 5 || !parse_int(f[1], id) || !parse_u64(f[2], offsets[0]) ||
+            !parse_u64(f[3], offsets[1]) || (f.size() == 5 && !parse_int(f[4], wait_ms))) {
+            return error_json("usage: OUTPUT job_id stdout_offset stderr_offset [wait_ms]");
+        }
+        wait_ms = std::max(0, std::min(wait_ms, OUTPUT_MAX_WAIT_MS));
+        safebox::OutputChunk c;
+        if (!ex.read_output(id, offsets, OUTPUT_REPLY_BYTES, wait_ms, c)) {
+            return error_json("❌ Job " + std::to_string(id) + " not found");
+        }
+        std::ostringstream o;
+        o << "{\"ok\":true,\"job_id\":" << id
+          << ",\"stdout\":\"" << json_escape(c.data[safebox::STDOUT])
+          << "\",\"stderr\":\"" << json_escape(c.data[safebox::STDERR])
+          << "\",\"stdout_offset\":" << c.next_offset[safebox::STDOUT]
+          << ",\"stderr_offset\":" << c.next_offset[safebox::STDERR]
+          << ",\"skipped_stdout\":" << c.skipped[safebox::STDOUT]
+          << ",\"skipped_stderr\":" << c.skipped[safebox::STDERR]
+          << ",\"exited\":" << (c.exited ? "true" : "false");
+        if (c.exited) o << exit_fields(c.wait_status, c.deadline_hit);
+        o << "}";
+        return o.str();
+    }
+
+    if (cmd == "ACCOUNT") {
+        int limit = 100;
+        if (f.size() > 3 || (f.size() == 3 && !parse_int(f[2], limit))) {
+            return error_json("usage: ACCOUNT [name [limit]]");
+        }
+        const safebox::AccountingStore* store = ex.accounting();
+        if (!store) return error_json("accounting is disabled");
+        std::string out = "{\"ok\":true,\"records\":[";
+        bool first = true;
+        for (const auto& r : store->query(f.size() > 1 ? f[1] : "", (size_t)std::max(0, limit))) {
+            if (!first) out += ",";
+            out += safebox::record_json(r);
+            first = false;
+        }
+        return out + "]}";
+    }
+
+    if (cmd == "PROFILE") {
+        if (f.size() > 2) return error_json("usage: PROFILE [app_path]");
+        const safebox::ProfileStore* profiles = ex.profiles();
+        if (!profiles) return error_json("usage profiles need accounting");
+        if (f.size() == 2 && !f[1].empty()) {
+            return "{\"ok\":true,\"profile\":" + safebox::advice_json(f[1], profiles->advise(f[1])) + "}";
+        }
+        std::string out = "{\"ok\":true,\"profiles\":[";
+        bool first = true;
+        for (const auto& [app, advice] : profiles->all()) {
+            if (!first) out += ",";
+            out += safebox::advice_json(app, advice);
+            first = false;
+        }
+        return out + "]}";
+    }
+
+    if (cmd == "CONTROL") {
+        int limit = 100;
+        if (f.size() > 2 || (f.size() == 2 && !parse_int(f[1], limit))) return error_json("usage: CONTROL [limit]");
+        const safebox::LimitController* ctl = ex.controller();
+        if (!ctl) return error_json("the limit controller is off (--controller)");
+        return "{\"ok\":true,\"controller\":" + ctl->state_json((size_t)std::max(0, limit)) + "}";
+    }
+
+    if (cmd == "METRICS") {
+        const safebox::MetricStore* store = ex.metrics();
+        if (!store) return error_json("metric history is off (--metrics-interval-ms 0)");
+        std::ostringstream o;
+        char num[32];
+        if (f.size() <= 2) {
+            const safebox::MetricStoreStats st = store->stats();
+            const safebox::MetricStoreStats rt = ex.metric_rollups()->stats();
+            o << "{\"ok\":true,\"stats\":{\"series\":" << st.series << ",\"chunks\":" << st.chunks
+              << ",\"points\":" << st.points << ",\"bytes\":" << st.bytes
+              << ",\"expired_chunks\":" << st.expired_chunks << ",\"rollups\":{\"series\":" << rt.series
+              << ",\"chunks\":" << rt.chunks << ",\"points\":" << rt.points << ",\"bytes\":" << rt.bytes
+              << ",\"expired_chunks\":" << rt.expired_chunks << "}},\"series\":[";
+            bool first = true;
+            for (const auto& name : store->list(f.size() == 2 ? f[1] : "")) {
+                o << (first ? "" : ",") << "\"" << json_escape(name) << "\"";
+                first = false;
+            }
+            o << "]}";
+            return o.str();
+        }
+        uint64_t from = 0, to = 0, step = 0;
+        if ((f.size() != 4 && f.size() != 5) || !parse_u64(f[2], from) || !parse_u64(f[3], to) ||
+            (f.size() == 5 && !parse_u64(f[4], step))) {
+            return error_json("usage: METRICS [prefix] | METRICS series from_ms to_ms [step_ms]");
+        }
+        if (f.size() == 5) {
+            std::vector<safebox::RollupPoint> buckets;
+            step = (uint64_t)ex.metric_rollups()->query(f[1], (int64_t)from, (int64_t)to, (int64_t)step, buckets);
+            o << "{\"ok\":true,\"series\":\"" << json_escape(f[1]) << "\",\"step_ms\":" << step
+              << ",\"points\":[";
+            for (size_t i = 0; i < buckets.size(); ++i) {
+                const safebox::RollupPoint& b = buckets[i];
+                o << (i ? "," : "") << "[" << b.t_ms;
+                for (double v : {b.min, b.max, b.avg, b.p95}) {
+                    std::snprintf(num, sizeof(num), "%.10g", v);
+                    o << "," << num;
+                }
+                o << "]";
+            }
+            o << "]}";
+            return o.str();
+        }
+        std::vector<safebox::MetricPoint> points;
+        store->query(f[1], (int64_t)from, (int64_t)to, points);
+        o << "{\"ok\":true,\"series\":\"" << json_escape(f[1]) << "\",\"points\":[";
+        for (size_t i = 0; i < points.size(); ++i) {
+            std::snprintf(num, sizeof(num), "%.10g", points[i].value);
+            o << (i ? "," : "") << "[" << points[i].t_ms << "," << num << "]";
+        }
+        o << "]}";
+        return o.str();
+    }
+
+    if (cmd == "LATENCY") {
+        const std::string format = f.size() > 1 ? f[1] : "json";
+        if (f.size() > 2 || (format != "json" && format != "openmetrics")) {
+            return error_json("usage: LATENCY [json|openmetrics]");
+        }
+        std::ostringstream o;
+        o << "{\"ok\":true,\"format\":\"" << format << "\",";
+        if (format == "json") {
+            o << "\"stages\":{";
+            for (int s = 0; s < safebox::LATENCY_STAGES; ++s) {
+                o << (s ? "," : "") << "\"" << safebox::LATENCY_STAGE_NAMES[s]
+                  << "\":" << ex.latency((safebox::LatencyStage)s).snapshot().json();
+            }
+            o << "}}";
+            return o.str();
+        }
+        std::string text;
+        for (int s = 0; s < safebox::LATENCY_STAGES; ++s) {
+            const std::string stage = safebox::LATENCY_STAGE_NAMES[s];
+            text += ex.latency((safebox::LatencyStage)s).snapshot().openmetrics(
+                "safebox_job_" + stage + "_seconds", "safebox-executord job " + stage + " latency", "");
+        }
+        o << "\"text\":\"" << json_escape(text + "# EOF\n") << "\"}";
+        return o.str();
+    }
+
+    if (cmd == "CPU_PROFILE") {
+        int id = 0, seconds = 0, hz = 99;
+        const std::string format = f.size() > 3 ? f[3] : "folded";
+        if (f.size() < 3 || f.size() > 5 || !parse_int(f[1], id) || !parse_int(f[2], seconds) ||
+            (format != "folded" && format != "speedscope") || (f.size() == 5 && !parse_int(f[4], hz))) {
+            return error_json("usage: CPU_PROFILE job_id seconds [folded|speedscope] [hz]");
+        }
+        if (seconds < 1 || seconds > CPU_PROFILE_MAX_S) {
+            return error_json("seconds must be 1.." + std::to_string(CPU_PROFILE_MAX_S));
+        }
+        if (hz < 1 || hz > CPU_PROFILE_MAX_HZ) return error_json("hz must be 1.." + std::to_string(CPU_PROFILE_MAX_HZ));
+        if (!ex.cgroups().is_cgroupfs()) return error_json("profiling needs a cgroupfs --cgroup-root");
+        auto job = ex.job(id);
+        if (!job) return error_json("❌ Job " + std::to_string(id) + " not found");
+        // Array members profile the gang's shared cgroup
+        int group_fd = ex.dup_cgroup(id);
+        if (group_fd < 0) return error_json("❌ Job " + std::to_string(id) + " has been released");
+        bool idle = false;
+        if (!profiling.compare_exchange_strong(idle, true)) {
+            close(group_fd);
+            return error_json("another CPU profile is running");
+        }
+        safebox::CpuProfileOptions opts;
+        opts.duration_ms = seconds * 1000;
+        opts.hz = hz;
+        safebox::CpuProfile prof;
+        std::string err;
+        const bool ok = safebox::profile_cgroup(group_fd, opts, prof, err);
+        profiling = false;
+        close(group_fd);
+        if (!ok) return error_json(err);
+        std::ostringstream o;
+        o << "{\"ok\":true,\"job_id\":" << id << ",\"hz\":" << prof.hz << ",\"cpus\":" << prof.cpus
+          << ",\"samples\":" << prof.samples << ",\"lost\":" << prof.lost << ",\"stacks\":" << prof.stacks.size()
+          << ",\"format\":\"" << format << "\",\"profile\":";
+        if (format == "folded") o << "\"" << json_escape(safebox::folded_stacks(prof)) << "\"";
+        else o << safebox::speedscope_json(prof, job->spec.name + " (job " + std::to_string(id) + ")");
+        o << "}";
+        return o.str();
+    }
+
+    return error_json("unknown command: " + cmd);
+}
+
+static void serve_client(safebox::Executor& ex, int fd) {
+    std::string buf;
+    char chunk[4096];
+    for (;;) {
+        ssize_t r = read(fd, chunk, sizeof(chunk));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        buf.append(chunk, (size_t)r);
+        size_t nl;
+        while ((nl = buf.find('\n')) != std::string::npos) {
+            std::string line = buf.substr(0, nl);
+            buf.erase(0, nl + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            std::string reply = handle(ex, line) + "\n";
+            size_t off = 0;
+            while (off < reply.size()) {
+                ssize_t w = write(fd, reply.data() + off, reply.size() - off);
+                if (w < 0 && errno == EINTR) continue;
+                if (w <= 0) {
+                    close(fd);
+                    return;
+                }
+                off += (size_t)w;
+            }
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv) {
+    safebox::ExecutorConfig cfg;
+    cfg.accounting_path = DEFAULT_ACCOUNTING;
+    std::string socket_path = DEFAULT_SOCKET;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) { usage(); std::exit(1); }
+            return argv[++i];
+        };
+        if (a == "--socket") socket_path = next();
+        else if (a == "--cpu") cfg.total_cpu_percent = std::atol(next());
+        else if (a == "--memory") cfg.total_memory_mb = std::atol(next());
+        else if (a == "--cgroup-root") cfg.cgroup_root = next();
+        else if (a == "--cwd") cfg.cwd = next();
+        else if (a == "--no-sandbox") cfg.sandbox = false;
+        else if (a == "--kill-grace-ms") cfg.kill_grace_ms = std::atoi(next());
+        else if (a == "--accounting") cfg.accounting_path = next();
+        else if (a == "--no-accounting") cfg.accounting_path.clear();
+        else if (a == "--workers") cfg.workers = std::max(0, std::atoi(next()));
+        else if (a == "--right-size") cfg.right_size = true;
+        else if (a == "--placement") cfg.placement = true;
+        else if (a == "--controller") cfg.controller = true;
+        else if (a == "--controller-period-ms") cfg.controller_period_ms = std::max(1, std::atoi(next()));
+        else if (a == "--controller-log") cfg.controller_log = next();
+        else if (a == "--controller-record") cfg.controller_record = next();
+        else if (a == "--metrics-interval-ms") cfg.metrics_interval_ms = std::max(0, std::atoi(next()));
+        else if (a == "--metrics-retention-s") cfg.metrics_retention_s = std::atoll(next());
+        else if (a == "--metrics-max-mb") cfg.metrics_max_mb = (size_t)std::max(0L, std::atol(next()));
+        else if (a == "--profile-margin") cfg.profile_margin = std::max(0.0, std::atof(next()));
+        else if (a == "--profile-window") cfg.profile_window = (size_t)std::max(1, std::atoi(next()));
+        else if (a == "--profile-min-runs") cfg.profile_min_runs = (size_t)std::max(1, std::atoi(next()));
+        else { usage(); return 1; }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    safebox::raise_fd_limit();
+
+    std::string dir = socket_path.substr(0, socket_path.rfind('/'));
+    if (!dir.empty() && dir != socket_path) mkdir(dir.c_str(), 0755);
+
+    int srv = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (srv < 0) {
+        std::cerr << "socket failed: " << std::strerror(errno) << "\n";
+        return 2;
+    }
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "socket path too long: " << socket_path << "\n";
+        return 1;
+    }
+    std::strcpy(addr.sun_path, socket_path.c_str());
+    unlink(socket_path.c_str());
+    if (bind(srv, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(srv, 128) != 0) {
+        std::cerr << "bind " << socket_path << " failed: " << std::strerror(errno) << "\n";
+        return 2;
+    }
+
+    safebox::Executor ex(cfg);
+    std::cout << "safebox-executord listening on " << socket_path
+              << " (cpu=" << cfg.total_cpu_percent << "%, memory=" << cfg.total_memory_mb << "MB, "
+              << "cgroups at " << ex.cgroups().root() << ", sandbox " << (cfg.sandbox ? "on" : "off")
+              << ", " << (cfg.workers ? std::to_string(cfg.workers) + " workers" : std::string("no worker pool"))
+              << ")" << std::endl;
+
+    for (;;) {
+        int fd = accept4(srv, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "accept failed: " << std::strerror(errno) << "\n";
+            // Only a broken listening socket is fatal; out of fds or memory
+            // passes, and exiting would orphan every running job
+            if (errno == EBADF || errno == EINVAL || errno == ENOTSOCK) return 2;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        std::thread(serve_client, std::ref(ex), fd).detach();
+    }
+}
@@ -0,0 +1,443 @@
+// safebox-executord-bench - end-to-end job throughput of the native executor.
+//
+// Each client thread loops request_job (admit -> cgroup -> launch -> reap)
+// followed by release_job, exactly what one RUN + RELEASE costs in the
+// daemon minus the socket round trip. Without --cgroup-root a scratch
+// directory stands in for /sys/fs/cgroup, so this runs unprivileged.
+//
+// --workers hands launches and reaps to the work-stealing pool; with
+// --inflight each client keeps that many jobs submitted at once so the
+// pool has something to spread. --sweep repeats the run for 1, 2, 4 .. 64
+// workers and prints one JSON line per worker count. --array N submits
+// the jobs as gangs of N (one admission and one cgroup per gang).
+//
+// --mix N runs a batch of N cpu_intensive and N memory_intensive jobs
+// against a Banker pool the size of the host (100% per CPU), largest
+// requests first, queueing whatever does not fit until a job exits. It
+// reports the batch makespan, jobs/s and the CPU work the cpu_intensive
+// jobs got done; --placement bin-packs them onto CPUs and NUMA nodes and
+// --compare runs the batch both ways.
+//
+// --control N measures the limit controller alone: N job groups (stand-in
+// control files in a scratch root) swept every 100 ms for --seconds, half
+// of them busy and throttled and half idle, so every sweep reads, decides
+// and lends; every fourth group's memory ramps in a sawtooth. It reports
+// the sweep time against the period, how often the ramps sat at
+// memory.high and the forecasts' accuracy; --compare also runs the
+// controller without forecasting.
+//
+//   safebox-executord-bench --app src/quick_job --jobs 5000 --threads 4
+//   safebox-executord-bench --app src/quick_job --inflight 64 --sweep
+//   safebox-executord-bench --mix 16 --compare
+//   safebox-executord-bench --control 4000
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "executor.hpp"
+
+namespace fs = std::filesystem;
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  safebox-executord-bench [--app <path>] [--jobs <n>] [--threads <n>]\n"
+              << "                          [--workers <n> | --sweep] [--inflight <n>] [--array <n>]\n"
+              << "                          [--cgroup-root <dir>] [--sandbox] [--] [app args...]\n"
+              << "  safebox-executord-bench --mix <n> [--placement | --compare] [--memory <mb>]\n"
+              << "                          [--cpu-app <path>] [--mem-app <path>] [--seconds <n>]\n"
+              << "  safebox-executord-bench --control <groups> [--seconds <n>] [--compare] [--cgroup-root <dir>]\n";
+}
+
+struct BenchOptions {
+    std::string app = "src/quick_job";
+    std::vector<std::string> app_args;
+    int jobs = 2000;
+    int threads = 1;
+    int inflight = 1;
+    int array = 0;
+    bool sandbox = false;
+    std::string cgroup_root;
+
+    // --mix
+    int mix = 0;
+    std::string cpu_app = "src/cpu_intensive";
+    std::string mem_app = "src/memory_intensive";
+    int seconds = 2;
+    long memory_mb = 4096;
+
+    // --control
+    int control = 0;
+};
+
+static int run(const BenchOptions& o, int workers) {
+    safebox::ExecutorConfig cfg;
+    cfg.total_cpu_percent = 1 << 20;  // measure launch cost, not admission limits
+    cfg.total_memory_mb = 1 << 20;
+    cfg.sandbox = o.sandbox;
+    cfg.cgroup_root = o.cgroup_root;
+    cfg.workers = workers;
+    safebox::Executor ex(cfg);
+
+    std::atomic<int> next_job{0}, ok_jobs{0}, failed{0};
+    std::atomic<uint64_t> admit_ns{0}, cgroup_ns{0}, spawn_ns{0}, run_ns{0};
+
+    auto finish = [&](const safebox::SubmitResult& r) {
+        if (!r.ok) {
+            if (failed.fetch_add(1) == 0) std::cerr << r.message << "\n";
+            return;
+        }
+        ex.wait(r.job_id);
+        if (auto j = ex.job(r.job_id)) {
+            admit_ns += j->timings.admit_ns;
+            cgroup_ns += j->timings.cgroup_ns;
+            spawn_ns += j->timings.spawn_ns;
+            run_ns += j->end_ns - j->start_ns;
+            if (WIFEXITED(j->wait_status) && WEXITSTATUS(j->wait_status) == 0) ok_jobs++;
+            else failed++;
+        }
+        ex.release_job(r.job_id);
+    };
+
+    auto client = [&]() {
+        safebox::JobSpec spec;
+        spec.name = "bench";
+        spec.app_path = o.app;
+        spec.args = o.app_args;
+        spec.cpu_percent = 1;
+        spec.memory_mb = 16;
+        std::deque<std::future<safebox::SubmitResult>> pending;
+        for (;;) {
+            while ((int)pending.size() < o.inflight && next_job.fetch_add(1) < o.jobs) {
+                pending.push_back(ex.submit_async(spec));
+            }
+            if (pending.empty()) break;
+            finish(pending.front().get());
+            pending.pop_front();
+        }
+    };
+
+    auto array_client = [&]() {
+        safebox::JobSpec spec;
+        spec.name = "bench";
+        spec.app_path = o.app;
+        spec.args = o.app_args;
+        spec.cpu_percent = 1;
+        spec.memory_mb = 16;
+        int n;
+        while ((n = std::min(o.array, o.jobs - next_job.fetch_add(o.array))) > 0) {
+            safebox::ArrayResult r = ex.submit_array(spec, n);
+            if (!r.ok) {
+                if (failed.fetch_add(n) == 0) std::cerr << r.message << "\n";
+                continue;
+            }
+            for (int id : r.job_ids) {
+                ex.wait(id);
+                auto j = ex.job(id);
+                if (!j) continue;
+                admit_ns += j->timings.admit_ns;
+                cgroup_ns += j->timings.cgroup_ns;
+                spawn_ns += j->timings.spawn_ns;
+                run_ns += j->end_ns - j->start_ns;
+                if (WIFEXITED(j->wait_status) && WEXITSTATUS(j->wait_status) == 0) ok_jobs++;
+                else failed++;
+            }
+            ex.release_array(r.array_id);
+        }
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int t = 0; t < o.threads; ++t) {
+        if (o.array > 0) clients.emplace_back(array_client);
+        else clients.emplace_back(client);
+    }
+    for (auto& t : clients) t.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    safebox::WorkStealingPool::Stats ps;
+    if (ex.pool()) ps = ex.pool()->stats();
+
+    int n = std::max(1, ok_jobs.load());
+    auto us = [&](const std::atomic<uint64_t>& v) { return (double)v.load() / n / 1000.0; };
+    std::printf("jobs=%d ok=%d failed=%d threads=%d workers=%d inflight=%d array=%d sandbox=%s\n", o.jobs,
+                ok_jobs.load(), failed.load(), o.threads, workers, o.inflight, o.array, o.sandbox ? "on" : "off");
+    std::printf("elapsed=%.3fs throughput=%.1f jobs/s\n", secs, ok_jobs.load() / secs);
+    std::printf("mean us: admit=%.1f cgroup=%.1f spawn=%.1f run+reap=%.1f\n",
+                us(admit_ns), us(cgroup_ns), us(spawn_ns), us(run_ns));
+    if (ex.pool()) {
+        std::printf("pool: tasks=%llu stolen_local=%llu stolen_remote=%llu numa_nodes=%d\n",
+                    (unsigned long long)ps.executed, (unsigned long long)ps.stolen_local,
+                    (unsigned long long)ps.stolen_remote, ex.pool()->topology().nodes);
+    }
+    std::printf("{\"jobs\":%d,\"ok\":%d,\"failed\":%d,\"threads\":%d,\"workers\":%d,\"inflight\":%d,"
+                "\"sandbox\":%s,\"seconds\":%.6f,\"jobs_per_sec\":%.1f,\"admit_us\":%.1f,\"cgroup_us\":%.1f,"
+                "\"spawn_us\":%.1f,\"run_us\":%.1f,\"stolen_local\":%llu,\"stolen_remote\":%llu}\n",
+                o.jobs, ok_jobs.load(), failed.load(), o.threads, workers, o.inflight,
+                o.sandbox ? "true" : "false", secs, ok_jobs.load() / secs, us(admit_ns), us(cgroup_ns),
+                us(spawn_ns), us(run_ns), (unsigned long long)ps.stolen_local,
+                (unsigned long long)ps.stolen_remote);
+    return failed.load();
+}
+
+// One --mix batch; returns the number of failed jobs
+static int run_mix(const BenchOptions& o, bool placement) {
+    const safebox::CpuTopology topo = safebox::CpuTopology::detect();
+    safebox::ExecutorConfig cfg;
+    cfg.total_cpu_percent = 100 * (long)topo.cpus.size();
+    cfg.total_memory_mb = o.memory_mb;
+    cfg.sandbox = o.sandbox;
+    cfg.cgroup_root = o.cgroup_root;
+    cfg.placement = placement;
+    safebox::Executor ex(cfg);
+
+    // Largest first: with --placement this makes the packing best-fit decreasing
+    std::vector<safebox::JobSpec> batch;
+    const std::string secs = std::to_string(o.seconds);
+    for (int i = 0; i < o.mix; ++i) {
+        safebox::JobSpec c;
+        c.name = "mix-cpu";
+        c.app_path = o.cpu_app;
+        c.args = {secs};
+        c.cpu_percent = 60;
+        c.memory_mb = 16;
+        batch.push_back(c);
+        safebox::JobSpec m;
+        m.name = "mix-mem";
+        m.app_path = o.mem_app;
+        m.args = {"64", secs};
+        m.cpu_percent = 20;
+        m.memory_mb = 96;
+        batch.push_back(m);
+    }
+    std::stable_sort(batch.begin(), batch.end(), [](const safebox::JobSpec& a, const safebox::JobSpec& b) {
+        return a.cpu_percent > b.cpu_percent;
+    });
+
+    int failed = 0, ok = 0;
+    unsigned long long cpu_work = 0;   // million iterations, summed over cpu_intensive jobs
+    std::deque<int> running;
+    auto finish_oldest = [&]() {
+        int id = running.front();
+        running.pop_front();
+        ex.wait(id);
+        const uint64_t from_start[2] = {0, 0};
+        safebox::OutputChunk c;
+        if (ex.read_output(id, from_start, ex.config().output_buffer_bytes, 0, c)) {
+            unsigned long long iters = 0;
+            size_t at = c.data[safebox::STDOUT].find("Completed ");
+            if (at != std::string::npos) iters = std::strtoull(c.data[safebox::STDOUT].c_str() + at + 10, nullptr, 10);
+            cpu_work += iters;
+            if (WIFEXITED(c.wait_status) && WEXITSTATUS(c.wait_status) == 0) ok++;
+            else failed++;
+        }
+        ex.release_job(id);
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& spec : batch) {
+        for (;;) {
+            safebox::SubmitResult r = ex.submit(spec);
+            if (r.ok) {
+                running.push_back(r.job_id);
+                break;
+            }
+            if (running.empty()) {
+                if (failed++ == 0) std::cerr << r.message << "\n";
+                break;
+            }
+            finish_oldest();   // FIFO: wait for room
+        }
+    }
+    while (!running.empty()) finish_oldest();
+    double secs_taken = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    std::printf("mix=%d placement=%s cpus=%zu nodes=%d ok=%d failed=%d\n", o.mix, placement ? "on" : "off",
+                topo.cpus.size(), topo.nodes, ok, failed);
+    std::printf("makespan=%.3fs throughput=%.2f jobs/s cpu_work=%llu Miter (%.1f Miter/s)\n", secs_taken,
+                ok / secs_taken, cpu_work, cpu_work / secs_taken);
+    std::printf("{\"mix\":%d,\"placement\":%s,\"ok\":%d,\"failed\":%d,\"makespan_s\":%.6f,"
+                "\"jobs_per_sec\":%.3f,\"cpu_work_miter\":%llu}\n",
+                o.mix, placement ? "true" : "false", ok, failed, secs_taken, ok / secs_taken, cpu_work);
+    return failed;
+}
+
+// Stand-in cpu.stat for one group at `tick`: busy groups used half a CPU
+// and were throttled for half of every tick, idle ones did nothing
+static void write_cpu_stat(const safebox::CgroupFs& cg, int fd, bool busy, uint64_t tick) {
+    const uint64_t us = busy ? tick * 50000 : 0;
+    cg.write(fd, "cpu.stat", "usage_usec " + std::to_string(us) + "\nnr_periods " + std::to_string(tick) +
+                                 "\nnr_throttled " + std::to_string(busy ? tick : 0) + "\nthrottled_usec " +
+                                 std::to_string(us) + "\n");
+}
+
+static void write_counters(const safebox::CgroupFs& cg, int fd, bool busy) {
+    write_cpu_stat(cg, fd, busy, 0);
+    cg.write(fd, "memory.current", std::to_string(16 << 20) + "\n");
+    cg.write(fd, "memory.events", "low 0\nhigh 0\nmax 0\noom 0\noom_kill 0\n");
+    cg.write(fd, "memory.pressure", "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"
+                                    "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+}
+
+// Every fourth group's working set ramps from 16 MB toward the 64 MB
+// ceiling and drops back, a sawtooth the forecast has to keep ahead of.
+// A ramp that reaches memory.high is held there and counted as a high
+// event, the way the kernel would throttle it.
+static int64_t ramp_memory(uint64_t tick, int i) {
+    const uint64_t t = (tick + (uint64_t)i * 7) % 48;
+    return (16ll << 20) + (int64_t)t * (1ll << 20);
+}
+
+static bool press_memory(const safebox::CgroupFs& cg, int fd, int64_t want, uint64_t& events) {
+    const auto high = cg.read_int(fd, "memory.high");
+    const bool pressed = high && *high > 0 && want > *high;
+    if (pressed) ++events;
+    cg.write(fd, "memory.current", std::to_string(pressed ? *high : want) + "\n");
+    cg.write(fd, "memory.events", "low 0\nhigh " + std::to_string(events) + "\nmax 0\noom 0\noom_kill 0\n");
+    return pressed;
+}
+
+static int control_pass(const BenchOptions& o, const safebox::ControlTuning& tuning, const char* label) {
+    safebox::CgroupFs cg(o.cgroup_root);
+    std::vector<int> fds;
+    std::vector<std::string> names;
+    {
+        safebox::LimitController ctl(cg, 100, tuning);
+        for (int i = 0; i < o.control; ++i) {
+            names.push_back("safebox_job_" + std::to_string(i + 1));
+            int fd = cg.create(names.back());
+            if (fd < 0) {
+                std::perror("create");
+                break;
+            }
+            cg.set_cpu_max(fd, 50000, 100000);
+            cg.set_memory_max(fd, 64ll << 20);
+            if (!cg.is_cgroupfs()) write_counters(cg, fd, i % 2 == 0);
+            safebox::ControlBounds b;
+            b.cpu_ceiling = 50;
+            b.cpu_floor = 5;
+            b.cpu_burst = 100;
+            b.mem_ceiling = 64ll << 20;
+            b.mem_floor = 16ll << 20;
+            ctl.add(i + 1, names.back(), fd, b);
+            fds.push_back(fd);
+        }
+        // A fake root's counters only move when we move them
+        std::vector<uint64_t> events(fds.size(), 0);
+        uint64_t ramp_ticks = 0, pressed = 0;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (uint64_t tick = 1; std::chrono::steady_clock::now() - t0 < std::chrono::seconds(o.seconds); ++tick) {
+            if (!cg.is_cgroupfs()) {
+                for (size_t i = 0; i < fds.size(); i += 2) write_cpu_stat(cg, fds[i], true, tick);
+                for (size_t i = 1; i < fds.size(); i += 4) {
+                    ++ramp_ticks;
+                    if (press_memory(cg, fds[i], ramp_memory(tick, (int)i), events[i])) ++pressed;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        const safebox::ControlStats st = ctl.stats();
+        const double at_high = ramp_ticks ? 100.0 * (double)pressed / (double)ramp_ticks : 0.0;
+        std::printf("%s: groups=%zu ticks=%llu decisions=%llu sweep=%.2fms max=%.2fms (%.1f%% of the 100ms period)\n",
+                    label, st.groups, (unsigned long long)st.ticks, (unsigned long long)st.decisions,
+                    st.last_sweep_ns / 1e6, st.max_sweep_ns / 1e6, st.max_sweep_ns / 1e6);
+        std::printf("  ramping groups at memory.high %.1f%% of ticks; forecast memory wape=%.3f coverage=%.3f, "
+                    "cpu wape=%.3f coverage=%.3f\n",
+                    at_high, st.memory_forecast.wape(), st.memory_forecast.coverage(), st.cpu_forecast.wape(),
+                    st.cpu_forecast.coverage());
+        std::printf("{\"policy\":\"%s\",\"groups\":%zu,\"ticks\":%llu,\"decisions\":%llu,\"sweep_ms\":%.3f,"
+                    "\"max_sweep_ms\":%.3f,\"at_memory_high_pct\":%.2f,\"memory_wape\":%.4f,"
+                    "\"memory_coverage\":%.4f,\"cpu_wape\":%.4f,\"cpu_coverage\":%.4f}\n",
+                    label, st.groups, (unsigned long long)st.ticks, (unsigned long long)st.decisions,
+                    st.last_sweep_ns / 1e6, st.max_sweep_ns / 1e6, at_high, st.memory_forecast.wape(),
+                    st.memory_forecast.coverage(), st.cpu_forecast.wape(), st.cpu_forecast.coverage());
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        close(fds[i]);
+        cg.remove(names[i]);
+    }
+    return (int)fds.size() == o.control ? 0 : 1;
+}
+
+static int run_control(const BenchOptions& o, bool compare) {
+    safebox::raise_fd_limit();
+    safebox::ControlTuning tuning;
+    if (!compare) return control_pass(o, tuning, "forecast");
+    safebox::ControlTuning reactive = tuning;
+    reactive.forecast.horizon = 0;
+    return control_pass(o, reactive, "reactive") + control_pass(o, tuning, "forecast");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions o;
+    int workers = 0;
+    bool sweep = false;
+    bool placement = false, compare = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) { usage(); std::exit(1); }
+            return argv[++i];
+        };
+        if (a == "--app") o.app = next();
+        else if (a == "--jobs") o.jobs = std::atoi(next());
+        else if (a == "--threads") o.threads = std::max(1, std::atoi(next()));
+        else if (a == "--workers") workers = std::max(0, std::atoi(next()));
+        else if (a == "--inflight") o.inflight = std::max(1, std::atoi(next()));
+        else if (a == "--sweep") sweep = true;
+        else if (a == "--array") o.array = std::max(0, std::atoi(next()));
+        else if (a == "--cgroup-root") o.cgroup_root = next();
+        else if (a == "--sandbox") o.sandbox = true;
+        else if (a == "--mix") o.mix = std::max(1, std::atoi(next()));
+        else if (a == "--placement") placement = true;
+        else if (a == "--compare") compare = true;
+        else if (a == "--cpu-app") o.cpu_app = next();
+        else if (a == "--mem-app") o.mem_app = next();
+        else if (a == "--seconds") o.seconds = std::max(1, std::atoi(next()));
+        else if (a == "--memory") o.memory_mb = std::max(1L, std::atol(next()));
+        else if (a == "--control") o.control = std::max(1, std::atoi(next()));
+        else if (a == "--") { o.app_args.assign(argv + i + 1, argv + argc); break; }
+        else { usage(); return 1; }
+    }
+
+    bool scratch = o.cgroup_root.empty();
+    if (scratch) {
+        // --control rewrites thousands of stand-in files per tick; keep them
+        // in memory so the disk does not dominate the sweep time
+        std::string tmpl = (o.control > 0 && fs::is_directory("/dev/shm") ? "/dev/shm" : "/tmp") +
+                           std::string("/safebox-bench-cg.XXXXXX");
+        if (!mkdtemp(tmpl.data())) { perror("mkdtemp"); return 2; }
+        o.cgroup_root = tmpl;
+    }
+
+    int failed = 0;
+    if (o.control > 0) {
+        failed = run_control(o, compare);
+    } else if (o.mix > 0) {
+        if (compare) failed = run_mix(o, false) + run_mix(o, true);
+        else failed = run_mix(o, placement);
+    } else if (sweep) {
+        for (int w = 1; w <= 64; w *= 2) failed += run(o, w);
+    } else {
+        failed = run(o, workers);
+    }
+
+    if (scratch) {
+        std::error_code ec;
+        fs::remove_all(o.cgroup_root, ec);
+    }
+    return failed == 0 ? 0 : 3;
+}
@@ -0,0 +1,60 @@
+#include "forecast.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace safebox {
+
+double HoltForecast::forecast(int h, const ForecastTuning& t) const {
+    // Damped trend: level + (phi + phi^2 + ... + phi^h) x trend
+    double damp = 0, p = 1;
+    for (int i = 0; i < h; ++i) {
+        p *= t.phi;
+        damp += p;
+    }
+    return std::max(0.0, level_ + damp * trend_);
+}
+
+double HoltForecast::upper(const ForecastTuning& t) const {
+    return forecast(t.horizon, t) + z_ * scale_;
+}
+
+void HoltForecast::update(double x, const ForecastTuning& t) {
+    if (t.horizon <= 0) return;
+    const size_t h = (size_t)t.horizon;
+    if (point_.size() != h) {
+        point_.assign(h, -1.0);
+        bound_.assign(h, -1.0);
+    }
+
+    // Score the forecast made `horizon` ticks ago for this tick
+    const size_t slot = (size_t)(n_ % h);
+    if (point_[slot] >= 0) {
+        const double err = x - point_[slot];
+        const bool miss = x > bound_[slot];
+        ++acc_.scored;
+        if (!miss) ++acc_.covered;
+        acc_.abs_error += std::fabs(err);
+        acc_.abs_actual += std::fabs(x);
+        // Quantile tracking: the miss rate settles at 1 - coverage
+        z_ = std::clamp(z_ + t.z_step * ((miss ? 1.0 : 0.0) - (1.0 - t.coverage)), 0.0, t.z_max);
+        scale_ = scale_ > 0 ? 0.9 * scale_ + 0.1 * std::fabs(err) : std::fabs(err);
+    }
+
+    if (n_ == 0) {
+        level_ = x;
+        trend_ = 0;
+    } else {
+        const double prev = level_;
+        level_ = t.alpha * x + (1 - t.alpha) * (level_ + t.phi * trend_);
+        trend_ = t.beta * (level_ - prev) + (1 - t.beta) * t.phi * trend_;
+    }
+    ++n_;
+    ready_ = n_ >= (uint64_t)std::max(1, t.warmup);
+
+    // This tick's forecast for `horizon` ticks on, in the slot just scored
+    point_[slot] = forecast(t.horizon, t);
+    bound_[slot] = upper(t);
+}
+
+}  // namespace safebox
@@ -0,0 +1,74 @@
+// forecast.hpp - short-horizon demand forecasts for the limit controller.
+//
+// HoltForecast smooths one series sampled every tick (memory.current, CPU
+// use) into a level and a damped trend, and forecasts `horizon` ticks
+// ahead. Next to the point forecast it keeps an upper bound: the forecast
+// plus z times the smoothed size of its own past errors at that horizon.
+// z is tuned online by quantile tracking (raised a little on every miss,
+// lowered a little on every hit), so over any run of T scored ticks the
+// share of actuals above the bound stays within (z_max + step) / (step x T)
+// of 1 - coverage, whatever the series does. That is the error guarantee
+// the controller relies on when it sizes limits from the bound.
+//
+// Every forecast is scored when its tick arrives; accuracy() reports the
+// weighted absolute percentage error and the bound's coverage.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace safebox {
+
+struct ForecastTuning {
+    int horizon = 10;          // ticks ahead; 0 turns forecasting off
+    double alpha = 0.5;        // level smoothing
+    double beta = 0.3;         // trend smoothing
+    double phi = 0.9;          // trend damping per tick
+    double coverage = 0.95;    // target share of actuals at or below the bound
+    double z_step = 0.05;      // quantile-tracking step for z
+    double z_max = 10.0;
+    int warmup = 5;            // samples before forecasts are used
+};
+
+struct ForecastAccuracy {
+    uint64_t scored = 0;       // forecasts whose tick has arrived
+    uint64_t covered = 0;      // ... with the actual at or below the bound
+    double abs_error = 0;      // sum |actual - forecast|
+    double abs_actual = 0;     // sum |actual|
+
+    double wape() const { return abs_actual > 0 ? abs_error / abs_actual : 0.0; }
+    double coverage() const { return scored ? (double)covered / (double)scored : 1.0; }
+    void merge(const ForecastAccuracy& o) {
+        scored += o.scored;
+        covered += o.covered;
+        abs_error += o.abs_error;
+        abs_actual += o.abs_actual;
+    }
+};
+
+class HoltForecast {
+public:
+    // One sample per tick
+    void update(double x, const ForecastTuning& t);
+
+    bool ready() const { return ready_; }
+    // Point forecast `h` ticks ahead
+    double forecast(int h, const ForecastTuning& t) const;
+    // Upper bound at the tuning's horizon
+    double upper(const ForecastTuning& t) const;
+    const ForecastAccuracy& accuracy() const { return acc_; }
+
+private:
+    double level_ = 0;
+    double trend_ = 0;
+    double scale_ = 0;          // smoothed |error| at the horizon
+    double z_ = 2.0;
+    uint64_t n_ = 0;
+    bool ready_ = false;
+    // Forecasts made for the next `horizon` ticks, scored on arrival
+    std::vector<double> point_, bound_;
+    ForecastAccuracy acc_;
+};
+
+}  // namespace safebox
@@ -0,0 +1,45 @@
+// json_util.hpp - the few JSON encoding helpers the daemon and tools need.
+// Output only; requests to the daemon use a tab-separated line protocol.
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace safebox {
+
+inline std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 8);
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += (char)c;
+                }
+        }
+    }
+    return out;
+}
+
+template <typename T>
+inline std::string json_ints(const std::vector<T>& v) {
+    std::string out = "[";
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (i) out += ",";
+        out += std::to_string(v[i]);
+    }
+    return out + "]";
+}
+
+}  // namespace safebox
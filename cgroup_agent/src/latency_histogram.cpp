@@ -0,0 +1,142 @@
+#include "latency_histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+namespace safebox {
+
+const char* const LATENCY_STAGE_NAMES[LATENCY_STAGES] = {"admission", "cgroup", "launch", "completion"};
+
+LatencyHistogram::LatencyHistogram() : shards_(new Shard[SHARDS]) {
+    reset();
+}
+
+size_t LatencyHistogram::bucket_of(uint64_t ns) {
+    if (ns < LINEAR) return (size_t)ns;
+    const int msb = 63 - __builtin_clzll(ns);
+    if (msb >= MAX_BITS) return BUCKETS - 1;
+    const int shift = msb - SUB_BITS;
+    return (size_t)(LINEAR + (uint64_t)(shift - 1) * (LINEAR / 2) + ((ns >> shift) - LINEAR / 2));
+}
+
+uint64_t LatencyHistogram::bucket_low(size_t index) {
+    if (index < LINEAR) return index;
+    const uint64_t k = index - LINEAR;
+    return (k % (LINEAR / 2) + LINEAR / 2) << (k / (LINEAR / 2) + 1);
+}
+
+uint64_t LatencyHistogram::bucket_high(size_t index) {
+    if (index < LINEAR) return index;
+    const uint64_t k = index - LINEAR;
+    return ((k % (LINEAR / 2) + LINEAR / 2 + 1) << (k / (LINEAR / 2) + 1)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    // Threads take shards in turn on their first record
+    static std::atomic<unsigned> next_shard{0};
+    thread_local const unsigned mine = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    Shard& s = shards_[mine];
+    s.counts[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    s.count.fetch_add(1, std::memory_order_relaxed);
+    s.sum.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t seen = s.min.load(std::memory_order_relaxed);
+    while (ns < seen && !s.min.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+    }
+    seen = s.max.load(std::memory_order_relaxed);
+    while (ns > seen && !s.max.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+    }
+}
+
+LatencySnapshot LatencyHistogram::snapshot() const {
+    LatencySnapshot out;
+    out.counts.assign(BUCKETS, 0);
+    uint64_t min = UINT64_MAX;
+    for (int i = 0; i < SHARDS; ++i) {
+        const Shard& s = shards_[i];
+        for (size_t b = 0; b < BUCKETS; ++b) out.counts[b] += s.counts[b].load(std::memory_order_relaxed);
+        out.count += s.count.load(std::memory_order_relaxed);
+        out.sum_ns += s.sum.load(std::memory_order_relaxed);
+        min = std::min(min, s.min.load(std::memory_order_relaxed));
+        out.max_ns = std::max(out.max_ns, s.max.load(std::memory_order_relaxed));
+    }
+    out.min_ns = out.count ? min : 0;
+    return out;
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < SHARDS; ++i) {
+        Shard& s = shards_[i];
+        for (auto& c : s.counts) c.store(0, std::memory_order_relaxed);
+        s.count.store(0, std::memory_order_relaxed);
+        s.sum.store(0, std::memory_order_relaxed);
+        s.min.store(UINT64_MAX, std::memory_order_relaxed);
+        s.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencySnapshot::merge(const LatencySnapshot& other) {
+    if (other.count == 0) return;
+    if (counts.size() < other.counts.size()) counts.resize(other.counts.size(), 0);
+    for (size_t b = 0; b < other.counts.size(); ++b) counts[b] += other.counts[b];
+    min_ns = count ? std::min(min_ns, other.min_ns) : other.min_ns;
+    max_ns = std::max(max_ns, other.max_ns);
+    count += other.count;
+    sum_ns += other.sum_ns;
+}
+
+uint64_t LatencySnapshot::percentile(double q) const {
+    if (count == 0) return 0;
+    const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q * (double)count));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < counts.size(); ++b) {
+        seen += counts[b];
+        if (seen >= rank) return std::min(LatencyHistogram::bucket_high(b), max_ns);
+    }
+    return max_ns;
+}
+
+std::string LatencySnapshot::json() const {
+    std::ostringstream o;
+    o << "{\"count\":" << count << ",\"sum_ns\":" << sum_ns << ",\"min_ns\":" << min_ns << ",\"max_ns\":" << max_ns
+      << ",\"mean_ns\":" << (count ? sum_ns / count : 0) << ",\"p50_ns\":" << percentile(0.5)
+      << ",\"p90_ns\":" << percentile(0.9) << ",\"p99_ns\":" << percentile(0.99)
+      << ",\"p999_ns\":" << percentile(0.999) << ",\"sub_bits\":" << LatencyHistogram::SUB_BITS
+      << ",\"buckets\":[";
+    bool first = true;
+    for (size_t b = 0; b < counts.size(); ++b) {
+        if (!counts[b]) continue;
+        o << (first ? "" : ",") << "[" << b << "," << counts[b] << "]";
+        first = false;
+    }
+    o << "]}";
+    return o.str();
+}
+
+std::string LatencySnapshot::openmetrics(const std::string& name, const std::string& help,
+                                         const std::string& labels) const {
+    std::ostringstream o;
+    const std::string sep = labels.empty() ? "" : labels + ",";
+    o << "# TYPE " << name << " histogram\n# UNIT " << name << " seconds\n# HELP " << name << " " << help << "\n";
+    // A bucket counts toward `le` when every value it can hold is <= le
+    size_t b = 0;
+    uint64_t below = 0;
+    char le[32];
+    for (uint64_t decade = 1000; decade <= 1000000000000ull; decade *= 10) {
+        for (uint64_t step : {1, 2, 5}) {
+            const uint64_t bound = decade * step;
+            if (bound > 1000000000000ull) break;
+            while (b < counts.size() && LatencyHistogram::bucket_high(b) <= bound) below += counts[b++];
+            std::snprintf(le, sizeof(le), "%g", (double)bound / 1e9);
+            o << name << "_bucket{" << sep << "le=\"" << le << "\"} " << below << "\n";
+        }
+    }
+    o << name << "_bucket{" << sep << "le=\"+Inf\"} " << count << "\n";
+    const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    std::snprintf(le, sizeof(le), "%.9f", (double)sum_ns / 1e9);
+    o << name << "_count" << braces << " " << count << "\n" << name << "_sum" << braces << " " << le << "\n";
+    return o.str();
+}
+
+}  // namespace safebox
@@ -0,0 +1,77 @@
+// latency_histogram.hpp - lock-free HDR-style latency histograms.
+//
+// Values are nanoseconds in log-linear buckets: exact below 128, then 64
+// buckets per power of two, so any recorded value is reported within
+// 1/64 (1.6%) of itself up to 2^44 ns (4.9 h; larger ones land in the
+// last bucket). record() is a relaxed fetch_add into the calling thread's
+// shard, so threads recording at once do not share cache lines or take a
+// lock; snapshot() merges the shards when someone reads.
+//
+// backend/app/latency.py uses the same bucket layout, so it can merge a
+// snapshot's JSON with its own histograms exactly.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace safebox {
+
+// A merged, immutable copy of a histogram
+struct LatencySnapshot {
+    std::vector<uint64_t> counts;   // per bucket
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t min_ns = 0;
+    uint64_t max_ns = 0;
+
+    void merge(const LatencySnapshot& other);
+    // Highest value of the bucket holding the q-quantile (0..1), at most max_ns
+    uint64_t percentile(double q) const;
+    // count/sum/min/max/mean, p50..p999 and the non-empty buckets as
+    // [index, count] pairs; all times in ns
+    std::string json() const;
+    // One OpenMetrics histogram family `name` in seconds, buckets at 1-2-5
+    // steps from 1 us to 1000 s; labels are `key="value",...` or "". The
+    // caller ends the exposition with "# EOF".
+    std::string openmetrics(const std::string& name, const std::string& help, const std::string& labels) const;
+};
+
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 6;                   // 64 buckets per power of two
+    static constexpr uint64_t LINEAR = 2ull << SUB_BITS;   // exact below this
+    static constexpr int MAX_BITS = 44;
+    static constexpr size_t BUCKETS = LINEAR + (size_t)(MAX_BITS - SUB_BITS - 1) * (LINEAR / 2);
+    static constexpr int SHARDS = 8;
+
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    LatencySnapshot snapshot() const;
+    void reset();
+
+    static size_t bucket_of(uint64_t ns);
+    static uint64_t bucket_low(size_t index);
+    static uint64_t bucket_high(size_t index);
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[BUCKETS];
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> min{UINT64_MAX};
+        std::atomic<uint64_t> max{0};
+    };
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// The executor's stages, each its own histogram
+enum LatencyStage { ADMISSION, CGROUP, LAUNCH, COMPLETION, LATENCY_STAGES };
+extern const char* const LATENCY_STAGE_NAMES[LATENCY_STAGES];
+
+}  // namespace safebox
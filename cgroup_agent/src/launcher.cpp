@@ -0,0 +1,210 @@
+#include "launcher.hpp"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+extern char** environ;
+
+namespace safebox {
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+// Kernel layout of struct clone_args (v2, Linux 5.7+); declared locally so
+// <linux/sched.h> does not have to coexist with glibc's <sched.h>.
+struct Clone3Args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+static const uint64_t SANDBOX_NS_FLAGS = CLONE_NEWPID | CLONE_NEWUTS | CLONE_NEWNS;
+
+Launcher::Launcher(bool sandbox) : sandbox_(sandbox) {
+    devnull_ = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (!sandbox_) return;
+
+    cfg_.drop_privileges = sandbox_lookup_user("nobody", &cfg_.uid, &cfg_.gid) == 0;
+    if (sandbox_build_seccomp_program(&seccomp_) == 0) {
+        cfg_.seccomp = &seccomp_;
+    } else {
+        std::cerr << "launcher: continuing without seccomp\n";
+    }
+}
+
+Launcher::~Launcher() {
+    sandbox_free_seccomp_program(&seccomp_);
+    if (devnull_ >= 0) close(devnull_);
+}
+
+void close_process_fds(LaunchedProcess& p) {
+    for (int* fd : {&p.pidfd, &p.stdout_fd, &p.stderr_fd}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+}
+
+// Fork-style clone: the child continues on a copy of the caller's stack and
+// returns 0. Returns -1 with errno set on failure.
+static pid_t clone_child(uint64_t flags, int cgroup_fd, int* pidfd, bool use_clone3) {
+    if (use_clone3) {
+        Clone3Args args;
+        std::memset(&args, 0, sizeof(args));
+        args.flags = flags | CLONE_PIDFD;
+        args.pidfd = (uint64_t)(uintptr_t)pidfd;
+        args.exit_signal = SIGCHLD;
+        if (cgroup_fd >= 0) {
+            args.flags |= CLONE_INTO_CGROUP;
+            args.cgroup = (uint64_t)cgroup_fd;
+        }
+        return (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+    }
+    // Legacy clone(2): null stack means "share the copied stack" like fork()
+    pid_t pid = (pid_t)syscall(SYS_clone, (unsigned long)flags | SIGCHLD, nullptr, nullptr, nullptr, nullptr);
+    if (pid > 0) *pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    return pid;
+}
+
+void Launcher::probe(int cgroup_fd) {
+    int pidfd = -1;
+    pid_t pid = clone_child(0, cgroup_fd, &pidfd, true);
+    if (pid == 0) _exit(0);
+    if (pid > 0) {
+        waitpid(pid, nullptr, 0);
+        if (pidfd >= 0) close(pidfd);
+        return;
+    }
+    if (errno == ENOSYS) {
+        clone3_ok_.store(false, std::memory_order_relaxed);
+        into_cgroup_ok_.store(false, std::memory_order_relaxed);
+    } else if (errno == EBADF || errno == EINVAL || errno == EOPNOTSUPP) {
+        // Not a cgroup v2 directory (fake root, v1 host)
+        into_cgroup_ok_.store(false, std::memory_order_relaxed);
+    } else {
+        std::cerr << "launcher: CLONE_INTO_CGROUP probe failed: " << std::strerror(errno) << "\n";
+    }
+}
+
+int Launcher::launch(const LaunchSpec& spec, LaunchedProcess& out) {
+    out = LaunchedProcess{};
+
+    // Everything the child needs is prepared here, before clone()
+    std::vector<char*> argv;
+    argv.reserve(spec.args.size() + 2);
+    argv.push_back(const_cast<char*>(spec.path.c_str()));
+    for (const auto& a : spec.args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    int out_pipe[2], err_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) return errno;
+    if (pipe2(err_pipe, O_CLOEXEC) != 0) {
+        int e = errno;
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return e;
+    }
+
+    cpu_set_t affinity;
+    CPU_ZERO(&affinity);
+    for (int c : spec.cpus) {
+        if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &affinity);
+    }
+
+    const uint64_t flags = sandbox_ ? SANDBOX_NS_FLAGS : 0;
+    const char* cwd = spec.cwd.empty() ? nullptr : spec.cwd.c_str();
+    int pidfd = -1;
+    bool placed = false;
+    pid_t pid = -1;
+
+    if (clone3_ok_.load(std::memory_order_relaxed)) {
+        bool into = spec.cgroup_fd >= 0 && into_cgroup_ok_.load(std::memory_order_relaxed);
+        pid = clone_child(flags, into ? spec.cgroup_fd : -1, &pidfd, true);
+        if (pid < 0 && into && (errno == EBADF || errno == EINVAL || errno == EOPNOTSUPP)) {
+            // This job's fd would not take it: attach from the child instead.
+            // Support as a whole is probe()'s call, not one job's.
+            into = false;
+            pid = clone_child(flags, -1, &pidfd, true);
+        }
+        if (pid < 0 && errno == ENOSYS) {
+            clone3_ok_.store(false, std::memory_order_relaxed);
+        } else {
+            placed = into;
+        }
+    }
+    if (pid < 0 && !clone3_ok_.load(std::memory_order_relaxed)) {
+        pid = clone_child(flags, -1, &pidfd, false);
+    }
+
+    if (pid == 0) {
+        // Child: raw syscalls only from here to execve()
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        signal(SIGPIPE, SIG_DFL);
+
+        if (devnull_ >= 0) dup2(devnull_, STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        dup2(err_pipe[1], STDERR_FILENO);
+
+        if (!placed && spec.cgroup_fd >= 0) {
+            int procs = openat(spec.cgroup_fd, "cgroup.procs", O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (procs < 0 || write(procs, "0\n", 2) != 2) {
+                static const char msg[] = "launcher: failed to join job cgroup\n";
+                ssize_t r = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+                (void)r;
+            }
+        }
+        if (!spec.cpus.empty()) sched_setaffinity(0, sizeof(affinity), &affinity);
+        if (sandbox_) sandbox_child_setup(&cfg_);
+        if (cwd && chdir(cwd) != 0) _exit(126);
+
+        execve(argv[0], argv.data(), environ);
+        static const char msg[] = "launcher: execve failed\n";
+        ssize_t r = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        (void)r;
+        _exit(127);
+    }
+
+    int saved = errno;
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    if (pid < 0) {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        return saved;
+    }
+
+    // The reaper polls the read ends; the child keeps blocking writes
+    fcntl(out_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(err_pipe[0], F_SETFL, O_NONBLOCK);
+
+    out.pid = pid;
+    out.pidfd = pidfd;
+    out.stdout_fd = out_pipe[0];
+    out.stderr_fd = err_pipe[0];
+    out.cgroup_atomic = placed;
+    return 0;
+}
+
+}  // namespace safebox
@@ -0,0 +1,69 @@
+// launcher.hpp - in-process replacement for spawning the `safebox` binary.
+//
+// The parent does everything that allocates (argv, seccomp compilation,
+// user lookup) up front; the cloned child only runs sandbox_child_setup()
+// from src/sandbox_core.c and execs. With cgroup v2 the child is created
+// directly inside its job group via clone3(CLONE_INTO_CGROUP), so there is
+// no window in which it runs unaccounted.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "safebox.h"
+
+namespace safebox {
+
+struct LaunchSpec {
+    std::string path;               // binary to exec (no PATH search)
+    std::vector<std::string> args;  // argv[1..]
+    int cgroup_fd = -1;             // job group directory, -1 => launcher's own group
+    std::string cwd;                // "" => inherit
+    std::vector<int> cpus;          // sched_setaffinity() in the child, empty => inherit
+};
+
+struct LaunchedProcess {
+    pid_t pid = -1;
+    int pidfd = -1;       // pollable; readable once the child exits
+    int stdout_fd = -1;   // read ends of the child's stdout/stderr pipes
+    int stderr_fd = -1;
+    bool cgroup_atomic = false;  // placed by CLONE_INTO_CGROUP rather than a cgroup.procs write
+};
+
+class Launcher {
+public:
+    // sandbox=false skips namespaces, privilege drop and seccomp (unprivileged benchmarks)
+    explicit Launcher(bool sandbox);
+    ~Launcher();
+    Launcher(const Launcher&) = delete;
+    Launcher& operator=(const Launcher&) = delete;
+
+    bool sandboxed() const { return sandbox_; }
+
+    // Settle once whether clone3 and CLONE_INTO_CGROUP work here by cloning
+    // a child that exits at once into `cgroup_fd`; call before launching.
+    // Without a probe both are assumed and a job they fail for falls back
+    // on its own.
+    void probe(int cgroup_fd);
+
+    // Returns 0 on success or an errno value; on success `out` owns its fds.
+    int launch(const LaunchSpec& spec, LaunchedProcess& out);
+
+private:
+    bool sandbox_;
+    struct sandbox_config cfg_ {};
+    struct sock_fprog seccomp_ {};
+    int devnull_ = -1;
+    // Cleared by probe() (or clone3's first ENOSYS) on a kernel or root without them
+    std::atomic<bool> clone3_ok_{true};
+    std::atomic<bool> into_cgroup_ok_{true};
+};
+
+// Close whichever fds of a launched process are still open
+void close_process_fds(LaunchedProcess& p);
+
+}  // namespace safebox
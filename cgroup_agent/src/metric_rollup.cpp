@@ -0,0 +1,232 @@
+#include "metric_rollup.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace safebox {
+
+static const char* const TIER_NAMES[ROLLUP_TIERS] = {"10s", "1m", "10m"};
+static const char* const STAT_NAMES[ROLLUP_STATS] = {"min", "max", "avg", "p95", "count"};
+static const double P95 = 0.95;
+
+static int64_t floor_to(int64_t t, int64_t step) {
+    return (t >= 0 ? t / step : (t - step + 1) / step) * step;
+}
+
+static std::string rollup_name(const std::string& name, int tier, int stat) {
+    return name + "@" + TIER_NAMES[tier] + ":" + STAT_NAMES[stat];
+}
+
+// Smallest value with at least 95% of the weight at or below it
+static double weighted_p95(std::vector<std::pair<double, double>>& v) {
+    std::sort(v.begin(), v.end());
+    double total = 0;
+    for (const auto& p : v) total += p.second;
+    const double want = P95 * (double)total;
+    double seen = 0;
+    for (const auto& p : v) {
+        seen += p.second;
+        if (seen >= want) return p.first;
+    }
+    return v.empty() ? 0 : v.back().first;
+}
+
+MetricRollups::MetricRollups(const MetricStore& store, int64_t interval_ms, const MetricRollupOptions& options)
+    : store_(store), interval_ms_(std::max<int64_t>(1, interval_ms)) {
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        MetricStoreOptions o;
+        o.retention_ms = options.retention_ms[tier];
+        o.max_bytes = options.max_bytes[tier];
+        o.chunk_bytes = store.options().chunk_bytes;
+        tiers_[tier] = std::make_unique<MetricStore>(o);
+    }
+}
+
+void MetricRollups::track(uint32_t series, const std::string& name, int decimals) {
+    Track tr;
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        for (int stat = 0; stat < ROLLUP_STATS; ++stat) {
+            // An average needs one more place than the samples it is of
+            const int d = stat == 4 ? 0 : decimals < 0 ? -1 : stat == 2 ? decimals + 1 : decimals;
+            tr.out[tier][stat] = tiers_[tier]->series(rollup_name(name, tier, stat), d);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    tracks_.emplace(series, std::move(tr));
+}
+
+void MetricRollups::untrack(uint32_t series) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = tracks_.find(series);
+    if (it == tracks_.end()) return;
+    // Past every open bucket's end, so they all close
+    if (it->second.open != INT64_MIN) close(it->second, it->second.open + 2 * ROLLUP_STEPS_MS[ROLLUP_TIERS - 1]);
+    tracks_.erase(it);
+}
+
+void MetricRollups::add(int64_t t_ms, const std::vector<MetricValue>& values) {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (const MetricValue& v : values) {
+        auto it = tracks_.find(v.series);
+        if (it != tracks_.end()) add_locked(it->second, t_ms, v.value);
+    }
+}
+
+// mu_ held
+void MetricRollups::add_locked(Track& tr, int64_t t_ms, double value) {
+    const int64_t bucket = floor_to(t_ms, ROLLUP_STEPS_MS[0]);
+    if (tr.open != INT64_MIN && bucket < tr.open) return;   // out of order
+    if (tr.open != INT64_MIN && bucket != tr.open) close(tr, bucket);
+    tr.open = bucket;
+    tr.samples.push_back((float)value);
+}
+
+MetricRollups::Stats MetricRollups::stats_of(const float* v, size_t n) {
+    Stats s;
+    double sum = 0;
+    s.count = (double)n;
+    s.min = s.max = v[0];
+    for (size_t i = 0; i < n; ++i) {
+        s.min = std::min(s.min, (double)v[i]);
+        s.max = std::max(s.max, (double)v[i]);
+        sum += v[i];
+    }
+    s.avg = sum / (double)n;
+    // Nearest rank
+    scratch_.assign(v, v + n);
+    const size_t k = (size_t)std::ceil(P95 * (double)n) - 1;
+    std::nth_element(scratch_.begin(), scratch_.begin() + (long)k, scratch_.end());
+    s.p95 = scratch_[k];
+    return s;
+}
+
+// The open 10 s bucket ends; the next point falls in the one at `next_ms`.
+// Every coarser bucket that `next_ms` is past closes with it.
+void MetricRollups::close(Track& tr, int64_t next_ms) {
+    for (int tier = 0; tier < ROLLUP_TIERS; ++tier) {
+        const int64_t step = ROLLUP_STEPS_MS[tier];
+        if (floor_to(next_ms, step) == floor_to(tr.open, step)) break;
+        const size_t from = tr.start[tier];
+        if (tr.samples.size() > from) {
+            write(tr, tier, floor_to(tr.open, step), stats_of(tr.samples.data() + from, tr.samples.size() - from));
+        }
+        tr.start[tier] = tr.samples.size();
+    }
+    if (tr.start[ROLLUP_TIERS - 1] == tr.samples.size()) {
+        tr.samples.clear();
+        for (size_t& s : tr.start) s = 0;
+    }
+}
+
+void MetricRollups::write(const Track& tr, int tier, int64_t t_ms, const Stats& s) {
+    MetricStore& store = *tiers_[tier];
+    store.append(tr.out[tier][0], t_ms, s.min);
+    store.append(tr.out[tier][1], t_ms, s.max);
+    store.append(tr.out[tier][2], t_ms, s.avg);
+    store.append(tr.out[tier][3], t_ms, s.p95);
+    store.append(tr.out[tier][4], t_ms, s.count);
+}
+
+void MetricRollups::read(const std::string& name, int tier, int64_t from_ms, int64_t to_ms,
+                         std::vector<RollupPoint>& out, std::vector<double>& counts) const {
+    std::vector<MetricPoint> pts;
+    if (tier < 0) {
+        store_.query(name, from_ms, to_ms, pts);
+        for (const MetricPoint& p : pts) {
+            out.push_back({p.t_ms, p.value, p.value, p.value, p.value});
+            counts.push_back(1);
+        }
+        return;
+    }
+    // The stats are written together, but expiry may have cut them at
+    // different chunks: keep the timestamps all of them have
+    std::vector<MetricPoint> stat[ROLLUP_STATS];
+    for (int i = 0; i < ROLLUP_STATS; ++i) tiers_[tier]->query(rollup_name(name, tier, i), from_ms, to_ms, stat[i]);
+    size_t j[ROLLUP_STATS] = {};
+    for (const MetricPoint& p : stat[0]) {
+        bool all = true;
+        for (int i = 1; i < ROLLUP_STATS; ++i) {
+            while (j[i] < stat[i].size() && stat[i][j[i]].t_ms < p.t_ms) ++j[i];
+            all = all && j[i] < stat[i].size() && stat[i][j[i]].t_ms == p.t_ms;
+        }
+        if (!all) continue;
+        out.push_back({p.t_ms, p.value, stat[1][j[1]].value, stat[2][j[2]].value, stat[3][j[3]].value});
+        counts.push_back(stat[4][j[4]].value);
+    }
+}
+
+int64_t MetricRollups::query(const std::string& name, int64_t from_ms, int64_t to_ms, int64_t step_ms,
+                             std::vector<RollupPoint>& out) const {
+    if (from_ms > to_ms) return step_ms;
+    if (step_ms <= 0) step_ms = (to_ms - from_ms) / 300;
+    step_ms = std::max(step_ms, interval_ms_);
+    // Up to the next resolution, so a bucket is whole stored buckets and
+    // only steps past the coarsest merge several of them
+    int tier = -1;
+    if (step_ms >= ROLLUP_STEPS_MS[0]) {
+        tier = 0;
+        while (tier + 1 < ROLLUP_TIERS && step_ms > ROLLUP_STEPS_MS[tier]) ++tier;
+    }
+    const int64_t unit = tier < 0 ? interval_ms_ : ROLLUP_STEPS_MS[tier];
+    step_ms = (step_ms + unit - 1) / unit * unit;
+
+    // That resolution, then raw points for whatever its open bucket has not
+    // covered yet
+    std::vector<RollupPoint> pts;
+    std::vector<double> counts;
+    int64_t from = floor_to(from_ms, step_ms);
+    if (tier >= 0) {
+        read(name, tier, from, to_ms, pts, counts);
+        if (!pts.empty()) from = std::max(from, pts.back().t_ms + ROLLUP_STEPS_MS[tier]);
+    }
+    if (from <= to_ms) read(name, -1, from, to_ms, pts, counts);
+
+    // Merge into the step's buckets
+    std::vector<RollupPoint> merged;
+    std::vector<std::pair<double, double>> p95s;
+    double weight = 0;
+    double sum = 0;
+    auto finish = [&]() {
+        if (merged.empty() || weight == 0) return;
+        merged.back().avg = sum / weight;
+        merged.back().p95 = weighted_p95(p95s);
+    };
+    for (size_t i = 0; i < pts.size(); ++i) {
+        const int64_t bucket = floor_to(pts[i].t_ms, step_ms);
+        if (merged.empty() || merged.back().t_ms != bucket) {
+            finish();
+            merged.push_back({bucket, pts[i].min, pts[i].max, 0, 0});
+            p95s.clear();
+            weight = 0;
+            sum = 0;
+        }
+        RollupPoint& b = merged.back();
+        b.min = std::min(b.min, pts[i].min);
+        b.max = std::max(b.max, pts[i].max);
+        sum += pts[i].avg * counts[i];
+        weight += counts[i];
+        p95s.push_back({pts[i].p95, counts[i]});
+    }
+    finish();
+    out.insert(out.end(), merged.begin(), merged.end());
+    return step_ms;
+}
+
+void MetricRollups::expire(int64_t now_ms) {
+    for (auto& t : tiers_) t->expire(now_ms);
+}
+
+MetricStoreStats MetricRollups::stats() const {
+    MetricStoreStats all;
+    for (const auto& t : tiers_) {
+        const MetricStoreStats st = t->stats();
+        all.series += st.series;
+        all.chunks += st.chunks;
+        all.points += st.points;
+        all.bytes += st.bytes;
+        all.expired_chunks += st.expired_chunks;
+    }
+    return all;
+}
+
+}  // namespace safebox
@@ -0,0 +1,109 @@
+// metric_rollup.hpp - 10 s / 1 min / 10 min rollups of metric series, kept
+// as the points arrive, and range queries at any step.
+//
+// Each tracked series gets min, max, avg, p95 and sample count per 10 s,
+// 1 min and 10 min bucket, written when the bucket closes as series of
+// their own ("<name>@10s:avg", ...) into one MetricStore per resolution,
+// owned here. Each tier has its own retention and size limit, so the raw
+// points filling their store never evict a rollup: under a load whose raw
+// seconds only fit a few hours, the 1 min and 10 min tiers still reach back
+// a day. Buckets sit on the epoch grid. The open 10 minutes' samples are
+// kept (as floats, 2.4 KB a series at 1 s) so every stored p95 is exact.
+//
+// query() rounds the step up to the next resolution (a multiple of the
+// sampling interval below 10 s, of 10 min above it), reads that resolution,
+// takes the tail whose bucket is still open from the raw points, and merges
+// into the step: min of mins, max of maxes, count-weighted avg. Only a
+// step over 10 min spans several stored buckets; its p95 is the weighted
+// 95th percentile of theirs, which is an estimate, as percentiles do not
+// merge. A 24 h panel at a 10 min step reads 144 buckets, not 86400 points,
+// whether or not the raw points still go back that far.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "metric_store.hpp"
+
+namespace safebox {
+
+struct RollupPoint {
+    int64_t t_ms = 0;     // bucket start
+    double min = 0;
+    double max = 0;
+    double avg = 0;
+    double p95 = 0;
+};
+
+// Rollup resolutions, finest first
+const int64_t ROLLUP_STEPS_MS[] = {10000, 60000, 600000};
+const int ROLLUP_TIERS = 3;
+const int ROLLUP_STATS = 5;   // min, max, avg, p95, count
+
+// Per tier, finest first. The defaults hold a day of 1 min and 10 min
+// buckets for 1000 jobs' metrics; the 10 s tier only serves ranges under
+// an hour at the default step, so it keeps that.
+struct MetricRollupOptions {
+    int64_t retention_ms[ROLLUP_TIERS] = {3600 * 1000ll, 24 * 3600 * 1000ll, 24 * 3600 * 1000ll};
+    size_t max_bytes[ROLLUP_TIERS] = {56 << 20, 80 << 20, 32 << 20};   // 0 => no size limit
+};
+
+class MetricRollups {
+public:
+    // `store`: where the tracked series' raw points are, read for the tail
+    // of a query; `interval_ms`: how often they get a point
+    MetricRollups(const MetricStore& store, int64_t interval_ms, const MetricRollupOptions& options = {});
+
+    // Start rolling up a series (a handle from store.series()); `decimals`
+    // as it was created with, or -1
+    void track(uint32_t series, const std::string& name, int decimals = -1);
+    // Close its open buckets and stop
+    void untrack(uint32_t series);
+    // Points just appended to the store; untracked series are skipped
+    void add(int64_t t_ms, const std::vector<MetricValue>& values);
+
+    // Buckets of `step_ms` (0 => about 300 over the range, rounded as
+    // above) covering [from_ms, to_ms], oldest first; returns the step used
+    int64_t query(const std::string& name, int64_t from_ms, int64_t to_ms, int64_t step_ms,
+                  std::vector<RollupPoint>& out) const;
+
+    // Apply each tier's retention limits as of `now_ms`
+    void expire(int64_t now_ms);
+    // One tier's store, finest first
+    const MetricStore& tier(int tier) const { return *tiers_[tier]; }
+    // All tiers together
+    MetricStoreStats stats() const;
+
+private:
+    struct Stats {
+        double min = 0, max = 0, avg = 0, p95 = 0, count = 0;
+    };
+    struct Track {
+        uint32_t out[ROLLUP_TIERS][ROLLUP_STATS];   // series per tier, by stat
+        int64_t open = INT64_MIN;        // start of the open 10 s bucket
+        std::vector<float> samples;      // the open 10 min bucket's
+        size_t start[ROLLUP_TIERS] = {}; // where each open bucket's samples begin
+    };
+
+    void add_locked(Track& tr, int64_t t_ms, double value);
+    void close(Track& tr, int64_t next_ms);
+    void write(const Track& tr, int tier, int64_t t_ms, const Stats& s);
+    Stats stats_of(const float* v, size_t n);
+    // Buckets of one resolution (tier -1: raw points), each with its count
+    void read(const std::string& name, int tier, int64_t from_ms, int64_t to_ms,
+              std::vector<RollupPoint>& out, std::vector<double>& counts) const;
+
+    const MetricStore& store_;
+    std::unique_ptr<MetricStore> tiers_[ROLLUP_TIERS];
+    const int64_t interval_ms_;
+    std::mutex mu_;   // guards tracks_ and scratch_
+    std::unordered_map<uint32_t, Track> tracks_;
+    std::vector<float> scratch_;
+};
+
+}  // namespace safebox
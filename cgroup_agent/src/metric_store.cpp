@@ -0,0 +1,502 @@
+#include "metric_store.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+namespace safebox {
+
+// Bit layout of a chunk, MSB first. The first point is a raw 64-bit
+// timestamp and 64-bit value; every later one is a timestamp code then a
+// value code, except that a run code stands for that many repeats of the
+// previous interval and value:
+//
+//   timestamp  '0'                     same interval as before
+//              '10'    + 7 bits        delta-of-delta in [-63, 64]
+//              '110'   + 9 bits        [-255, 256]
+//              '1110'  + 12 bits       [-2047, 2048]
+//              '11110' + 32 bits       any other that fits in 32 bits
+//              '11111' + 20 bits       run of repeats (no value follows)
+//   value      '0'                     same as before
+//              '10'    + bits          XOR inside the previous window
+//              '11'    + 6 bits leading zeros + 6 bits length - 1 + bits
+//
+// A series kept to a number of decimals holds integers, and codes each one
+// as its difference from the last instead, whose magnitude is small where
+// the XOR of two doubles is not (a gauge moving by a few steps flips low
+// mantissa bits and, across a power of two, the exponent):
+//
+//   value      '0'     + sign + bits   |difference| inside the chunk's window
+//              '10'                    same as before
+//              '11'    + sign + 6 bits lowest bit + 6 bits width - 1 + bits
+//
+// The window only widens within a chunk, to cover every difference so far,
+// so a gauge wandering by up to 2^k steps settles on k + 2 bits a point.
+// An unchanged value mostly goes into a run instead.
+static const int RUN_BITS = 20;
+static const uint32_t RUN_MAX = (1u << RUN_BITS) - 1;
+static const uint32_t RUN_MIN = 4;    // shorter runs cost less as plain repeats
+static const double MAX_EXACT = 9007199254740992.0;   // 2^53: integers past it are not exact
+
+struct MetricStore::Chunk {
+    int64_t t_first = 0;
+    int64_t t_last = 0;
+    uint32_t count = 0;
+    uint32_t nbits = 0;
+    std::unique_ptr<uint8_t[]> data;
+};
+
+struct MetricStore::Series {
+    std::string name;
+    double scale = 0;            // 10^decimals, 0 => values stored exactly
+    std::vector<Chunk> sealed;   // oldest first; expiry erases from the front
+    size_t sealed_bytes = 0;
+    uint64_t points = 0;
+
+    // The open chunk and its encoder state
+    std::vector<uint8_t> buf;
+    uint64_t nbits = 0;
+    int64_t t_first = 0;
+    int64_t t_last = 0;
+    uint32_t count = 0;          // including the pending run
+    int64_t delta = 0;           // previous interval
+    uint64_t value = 0;          // previous value's bits
+    int lead = -1;               // previous XOR window, -1 before the first (integer
+    int trail = 0;               // series: bit length of the window and its lowest bit)
+    uint32_t run = 0;            // repeats not yet written
+};
+
+static uint64_t bits_of(double v) {
+    uint64_t u;
+    std::memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+static double double_of(uint64_t u) {
+    double v;
+    std::memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+static void put_bits(std::vector<uint8_t>& buf, uint64_t& nbits, uint64_t v, int n) {
+    while (n > 0) {
+        const int used = (int)(nbits & 7);
+        if (used == 0) buf.push_back(0);
+        const int take = std::min(n, 8 - used);
+        const uint8_t part = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+        buf.back() |= (uint8_t)(part << (8 - used - take));
+        nbits += (uint64_t)take;
+        n -= take;
+    }
+}
+
+namespace {
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, uint64_t nbits) : data_(data), nbits_(nbits) {}
+    bool more() const { return pos_ < nbits_; }
+    uint64_t bits(int n) {
+        uint64_t v = 0;
+        while (n > 0) {
+            const int used = (int)(pos_ & 7);
+            const int take = std::min(n, 8 - used);
+            const uint8_t byte = data_[pos_ >> 3];
+            v = (v << take) | (uint64_t)((byte >> (8 - used - take)) & ((1u << take) - 1));
+            pos_ += (uint64_t)take;
+            n -= take;
+        }
+        return v;
+    }
+    bool bit() { return bits(1) != 0; }
+
+private:
+    const uint8_t* data_;
+    uint64_t nbits_;
+    uint64_t pos_ = 0;
+};
+
+// Decodes one chunk, handing each point in [from, to] to `emit`; stops
+// early past `to`. `pending` repeats of the last point follow the bits.
+// `ints`: the chunk codes integer differences rather than XORs.
+template <typename Emit>
+void decode(const uint8_t* data, uint64_t nbits, uint32_t pending, bool ints, int64_t from, int64_t to,
+            Emit&& emit) {
+    if (nbits < 128) return;
+    BitReader r(data, nbits);
+    int64_t t = (int64_t)r.bits(64);
+    uint64_t v = r.bits(64);
+    int64_t iv = ints ? (int64_t)double_of(v) : 0;
+    int64_t delta = 0;
+    int lead = 0, trail = 0;
+    auto repeat = [&](uint64_t n) -> bool {
+        // Jump straight to the first repeat in range
+        if (delta > 0 && t + delta < from) {
+            const uint64_t skip = std::min<uint64_t>(n, (uint64_t)((from - t - 1) / delta));
+            t += (int64_t)skip * delta;
+            n -= skip;
+        }
+        for (; n > 0; --n) {
+            t += delta;
+            if (t > to) return false;
+            if (t >= from) emit(t, double_of(v));
+        }
+        return true;
+    };
+    if (t > to) return;
+    if (t >= from) emit(t, double_of(v));
+    while (r.more()) {
+        int64_t dod;
+        if (!r.bit()) dod = 0;
+        else if (!r.bit()) dod = (int64_t)r.bits(7) - 63;
+        else if (!r.bit()) dod = (int64_t)r.bits(9) - 255;
+        else if (!r.bit()) dod = (int64_t)r.bits(12) - 2047;
+        else if (!r.bit()) dod = (int64_t)(int32_t)(uint32_t)r.bits(32);
+        else {
+            if (!repeat(r.bits(RUN_BITS))) return;
+            continue;
+        }
+        delta += dod;
+        t += delta;
+        if (ints) {
+            bool changed = true;
+            bool widened = false;
+            if (r.bit()) {
+                widened = r.bit();
+                changed = widened;
+            }
+            if (changed) {
+                const bool negative = r.bit();
+                if (widened) {
+                    trail = (int)r.bits(6);
+                    lead = trail + (int)r.bits(6) + 1;
+                }
+                const int64_t mag = (int64_t)(r.bits(lead - trail) << trail);
+                iv += negative ? -mag : mag;
+                v = bits_of((double)iv);
+            }
+        } else if (r.bit()) {
+            if (r.bit()) {
+                lead = (int)r.bits(6);
+                const int len = (int)r.bits(6) + 1;
+                trail = 64 - lead - len;
+            }
+            const int len = 64 - lead - trail;
+            v ^= r.bits(len) << trail;
+        }
+        if (t > to) return;
+        if (t >= from) emit(t, double_of(v));
+    }
+    repeat(pending);
+}
+
+}  // namespace
+
+MetricStore::MetricStore(MetricStoreOptions options) : opts_(options) {}
+
+MetricStore::~MetricStore() = default;
+
+uint32_t MetricStore::series(const std::string& name, int decimals) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = ids_.find(name);
+    if (it != ids_.end()) return it->second;
+    uint32_t id;
+    if (!free_.empty()) {
+        id = free_.back();
+        free_.pop_back();
+    } else {
+        id = (uint32_t)series_.size();
+        series_.emplace_back();
+    }
+    series_[id] = std::make_unique<Series>();
+    series_[id]->name = name;
+    if (decimals >= 0) series_[id]->scale = std::pow(10.0, std::min(decimals, 15));
+    ids_.emplace(name, id);
+    bytes_ += series_bytes(*series_[id]);
+    return id;
+}
+
+size_t MetricStore::series_bytes(const Series& s) const {
+    return sizeof(Series) + s.name.capacity() + s.buf.capacity() + s.sealed_bytes;
+}
+
+// Write out the pending run: one run code, or each repeat's own codes
+void MetricStore::flush_run(Series& s) {
+    if (s.run >= RUN_MIN) {
+        put_bits(s.buf, s.nbits, 0x1f, 5);
+        put_bits(s.buf, s.nbits, s.run, RUN_BITS);
+    } else {
+        // Same interval, then same value: '0' '0', or '0' '10' for integers
+        for (uint32_t i = 0; i < s.run; ++i) {
+            if (s.scale > 0) put_bits(s.buf, s.nbits, 0x2, 3);
+            else put_bits(s.buf, s.nbits, 0, 2);
+        }
+    }
+    s.run = 0;
+}
+
+// Flush the pending run and move the open chunk to the sealed list
+void MetricStore::seal(Series& s) {
+    if (s.count == 0) return;
+    flush_run(s);
+    std::vector<uint8_t>& b = s.buf;
+    Chunk c;
+    c.t_first = s.t_first;
+    c.t_last = s.t_last;
+    c.count = s.count;
+    c.nbits = (uint32_t)s.nbits;
+    c.data.reset(new uint8_t[b.size()]);
+    std::memcpy(c.data.get(), b.data(), b.size());
+    s.sealed_bytes += b.size();
+    if (s.sealed.size() == s.sealed.capacity()) {
+        // Grow by half and count it: a day of 1 s points is ~100 chunks
+        s.sealed_bytes -= s.sealed.capacity() * sizeof(Chunk);
+        s.sealed.reserve(s.sealed.size() + s.sealed.size() / 2 + 2);
+        s.sealed_bytes += s.sealed.capacity() * sizeof(Chunk);
+    }
+    s.sealed.push_back(std::move(c));
+    s.buf = std::vector<uint8_t>();
+    s.nbits = 0;
+    s.count = 0;
+    s.run = 0;
+    s.lead = -1;
+}
+
+// An integer series' value code, see the layout above
+void MetricStore::put_difference(Series& s, int64_t d) {
+    if (d == 0) {
+        put_bits(s.buf, s.nbits, 0x2, 2);
+        return;
+    }
+    const uint64_t mag = d < 0 ? (uint64_t)-d : (uint64_t)d;
+    const int low = __builtin_ctzll(mag);
+    const int top = 64 - __builtin_clzll(mag);
+    if (s.lead >= 0 && low >= s.trail && top <= s.lead) {
+        put_bits(s.buf, s.nbits, d < 0 ? 0x1 : 0x0, 2);
+    } else {
+        if (s.lead >= 0) {
+            s.trail = std::min(s.trail, low);
+            s.lead = std::max(s.lead, top);
+        } else {
+            s.trail = low;
+            s.lead = top;
+        }
+        put_bits(s.buf, s.nbits, d < 0 ? 0x7 : 0x6, 3);
+        put_bits(s.buf, s.nbits, (uint64_t)s.trail, 6);
+        put_bits(s.buf, s.nbits, (uint64_t)(s.lead - s.trail - 1), 6);
+    }
+    put_bits(s.buf, s.nbits, mag >> s.trail, s.lead - s.trail);
+}
+
+bool MetricStore::append(uint32_t id, int64_t t_ms, double value) {
+    std::lock_guard<std::mutex> lock(mu_);
+    return append_locked(id, t_ms, value);
+}
+
+size_t MetricStore::append(int64_t t_ms, const std::vector<MetricValue>& values) {
+    std::lock_guard<std::mutex> lock(mu_);
+    size_t n = 0;
+    for (const MetricValue& v : values) n += append_locked(v.series, t_ms, v.value);
+    return n;
+}
+
+// mu_ held
+bool MetricStore::append_locked(uint32_t id, int64_t t_ms, double value) {
+    if (id >= series_.size() || !series_[id]) return false;
+    Series& s = *series_[id];
+    if (s.points && t_ms <= s.t_last) return false;
+    double q = value;
+    if (s.scale > 0) {
+        // + 0.0 turns -0 into 0, which is the same integer
+        q = std::nearbyint(value * s.scale) + 0.0;
+        if (!(std::fabs(q) <= MAX_EXACT)) return false;
+    }
+    const size_t before = series_bytes(s);
+    const uint64_t v = bits_of(q);
+
+    int64_t dod = 0;
+    if (s.count > 0) {
+        const int64_t delta = t_ms - s.t_last;
+        dod = delta - s.delta;
+        // Past 32 bits, or full: start a fresh chunk
+        if (dod < INT32_MIN || dod > INT32_MAX || s.buf.size() >= opts_.chunk_bytes) seal(s);
+    }
+    if (s.count == 0) {
+        s.buf.reserve(std::min<size_t>(opts_.chunk_bytes + 16, 64));
+        put_bits(s.buf, s.nbits, (uint64_t)t_ms, 64);
+        put_bits(s.buf, s.nbits, v, 64);
+        s.t_first = s.t_last = t_ms;
+        s.delta = 0;
+        s.value = v;
+        s.count = 1;
+        ++s.points;
+        bytes_ += series_bytes(s) - before;
+        return true;
+    }
+
+    const int64_t delta = t_ms - s.t_last;
+    if (dod == 0 && v == s.value && s.count > 1) {
+        // Held back until the run ends
+        if (++s.run == RUN_MAX) {
+            put_bits(s.buf, s.nbits, 0x1f, 5);
+            put_bits(s.buf, s.nbits, s.run, RUN_BITS);
+            s.run = 0;
+        }
+    } else {
+        flush_run(s);
+
+        if (dod == 0) put_bits(s.buf, s.nbits, 0, 1);
+        else if (dod >= -63 && dod <= 64) {
+            put_bits(s.buf, s.nbits, 0x2, 2);
+            put_bits(s.buf, s.nbits, (uint64_t)(dod + 63), 7);
+        } else if (dod >= -255 && dod <= 256) {
+            put_bits(s.buf, s.nbits, 0x6, 3);
+            put_bits(s.buf, s.nbits, (uint64_t)(dod + 255), 9);
+        } else if (dod >= -2047 && dod <= 2048) {
+            put_bits(s.buf, s.nbits, 0xe, 4);
+            put_bits(s.buf, s.nbits, (uint64_t)(dod + 2047), 12);
+        } else {
+            put_bits(s.buf, s.nbits, 0x1e, 5);
+            put_bits(s.buf, s.nbits, (uint64_t)(uint32_t)(int32_t)dod, 32);
+        }
+
+        if (s.scale > 0) {
+            put_difference(s, (int64_t)q - (int64_t)double_of(s.value));
+        } else if (v == s.value) {
+            put_bits(s.buf, s.nbits, 0, 1);
+        } else {
+            const uint64_t x = v ^ s.value;
+            const int lead = std::min(63, __builtin_clzll(x));
+            const int trail = __builtin_ctzll(x);
+            if (s.lead >= 0 && lead >= s.lead && trail >= s.trail) {
+                put_bits(s.buf, s.nbits, 0x2, 2);
+                put_bits(s.buf, s.nbits, x >> s.trail, 64 - s.lead - s.trail);
+            } else {
+                const int len = 64 - lead - trail;
+                put_bits(s.buf, s.nbits, 0x3, 2);
+                put_bits(s.buf, s.nbits, (uint64_t)lead, 6);
+                put_bits(s.buf, s.nbits, (uint64_t)(len - 1), 6);
+                put_bits(s.buf, s.nbits, x >> trail, len);
+                s.lead = lead;
+                s.trail = trail;
+            }
+        }
+    }
+    s.delta = delta;
+    s.value = v;
+    s.t_last = t_ms;
+    ++s.count;
+    ++s.points;
+    bytes_ += series_bytes(s) - before;
+    return true;
+}
+
+size_t MetricStore::query(const std::string& name, int64_t from_ms, int64_t to_ms,
+                          std::vector<MetricPoint>& out) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = ids_.find(name);
+    if (it == ids_.end() || from_ms > to_ms) return 0;
+    const Series& s = *series_[it->second];
+    const size_t start = out.size();
+    const double scale = s.scale;
+    const bool ints = scale > 0;
+    auto emit = [&out, scale](int64_t t, double v) { out.push_back({t, scale > 0 ? v / scale : v}); };
+    // Sealed chunks are in time order: skip those ending before `from`
+    auto c = std::lower_bound(s.sealed.begin(), s.sealed.end(), from_ms,
+                              [](const Chunk& ch, int64_t t) { return ch.t_last < t; });
+    for (; c != s.sealed.end() && c->t_first <= to_ms; ++c) decode(c->data.get(), c->nbits, 0, ints, from_ms, to_ms, emit);
+    if (s.count > 0 && s.t_last >= from_ms && s.t_first <= to_ms) {
+        decode(s.buf.data(), s.nbits, s.run, ints, from_ms, to_ms, emit);
+    }
+    return out.size() - start;
+}
+
+std::vector<std::string> MetricStore::list(const std::string& prefix) const {
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (const auto& [name, id] : ids_) {
+            if (name.compare(0, prefix.size(), prefix) == 0) names.push_back(name);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+bool MetricStore::last(const std::string& name, MetricPoint& out) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = ids_.find(name);
+    if (it == ids_.end()) return false;
+    const Series& s = *series_[it->second];
+    if (!s.points) return false;
+    out.t_ms = s.t_last;
+    out.value = s.scale > 0 ? double_of(s.value) / s.scale : double_of(s.value);
+    return true;
+}
+
+void MetricStore::drop_oldest(Series& s) {
+    const Chunk& c = s.sealed.front();
+    s.sealed_bytes -= (c.nbits + 7) / 8;
+    bytes_ -= (c.nbits + 7) / 8;
+    s.points -= c.count;
+    s.sealed.erase(s.sealed.begin());
+    ++expired_chunks_;
+}
+
+void MetricStore::erase_series(uint32_t id) {
+    Series& s = *series_[id];
+    bytes_ -= series_bytes(s);
+    ids_.erase(s.name);
+    series_[id].reset();
+    free_.push_back(id);
+}
+
+void MetricStore::expire(int64_t now_ms) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (opts_.retention_ms > 0) {
+        const int64_t cutoff = now_ms - opts_.retention_ms;
+        for (uint32_t id = 0; id < series_.size(); ++id) {
+            if (!series_[id]) continue;
+            Series& s = *series_[id];
+            while (!s.sealed.empty() && s.sealed.front().t_last < cutoff) drop_oldest(s);
+            // Nothing appended for the whole retention: the series is gone.
+            // One not written yet stays (a rollup's until its first bucket
+            // closes), or its handle would be dead before the first point.
+            if (s.sealed.empty() && s.count > 0 && s.t_last < cutoff) {
+                ++expired_chunks_;
+                erase_series(id);
+            }
+        }
+    }
+    if (opts_.max_bytes == 0 || bytes_ <= opts_.max_bytes) return;
+    // Over the size limit: oldest sealed chunks first, across every series
+    using Entry = std::pair<int64_t, uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> oldest;
+    for (uint32_t id = 0; id < series_.size(); ++id) {
+        if (series_[id] && !series_[id]->sealed.empty()) oldest.push({series_[id]->sealed.front().t_first, id});
+    }
+    while (bytes_ > opts_.max_bytes && !oldest.empty()) {
+        const uint32_t id = oldest.top().second;
+        oldest.pop();
+        Series& s = *series_[id];
+        drop_oldest(s);
+        if (!s.sealed.empty()) oldest.push({s.sealed.front().t_first, id});
+    }
+}
+
+MetricStoreStats MetricStore::stats() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    MetricStoreStats st;
+    st.bytes = bytes_ + series_.capacity() * sizeof(series_[0]) + ids_.size() * (sizeof(uint32_t) + 48);
+    st.expired_chunks = expired_chunks_;
+    for (const auto& s : series_) {
+        if (!s) continue;
+        ++st.series;
+        st.chunks += s->sealed.size() + (s->count > 0);
+        st.points += s->points;
+    }
+    return st;
+}
+
+}  // namespace safebox
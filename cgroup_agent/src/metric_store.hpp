@@ -0,0 +1,116 @@
+// metric_store.hpp - compressed in-memory time series for host and job
+// metrics.
+//
+// Each series is a run of fixed-size chunks (1 KB of encoded points by
+// default) compressed as in Facebook's Gorilla: timestamps as
+// delta-of-delta codes and values XORed against the previous one, so a
+// point sampled on schedule with an unchanged value costs two bits. Flat
+// stretches (same interval, same value) are run-length coded on top, which
+// is what most limits and event counters look like most of the time.
+// Only the newest chunk of a series is open for appends; full chunks are
+// sealed and shrunk to their exact size.
+//
+// Retention is by age (whole chunks older than it are dropped) and by total
+// size, 100 MB unless set otherwise (the oldest chunks anywhere go first).
+// A day of a thousand jobs' per-second gauges does not fit in that: 1000
+// jobs x 12 metrics take ~1.1 bits a point plus ~9 KB of chunk bookkeeping
+// per series, about 10 MB an hour, so 100 MB reaches back ~10 h (a full
+// day up to ~400 jobs). Under load the size limit is what decides how far
+// back the history reaches; MetricRollups keep the day at coarser steps.
+// Range queries find the chunks overlapping [from, to] by their time bounds
+// and decode only those.
+//
+// Thread-safe: one mutex around everything; a dashboard panel's query
+// decodes a chunk or two.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace safebox {
+
+struct MetricPoint {
+    int64_t t_ms = 0;
+    double value = 0;
+};
+
+// One series' value at a batch's timestamp
+struct MetricValue {
+    uint32_t series = 0;
+    double value = 0;
+};
+
+struct MetricStoreOptions {
+    int64_t retention_ms = 24 * 3600 * 1000ll;   // <= 0 => keep everything
+    size_t max_bytes = 100 << 20;                // 0 => no size limit
+    size_t chunk_bytes = 1024;                   // encoded bytes per chunk
+};
+
+struct MetricStoreStats {
+    size_t series = 0;
+    size_t chunks = 0;
+    uint64_t points = 0;
+    size_t bytes = 0;             // encoded data plus bookkeeping, as allocated
+    uint64_t expired_chunks = 0;  // dropped by age or size
+};
+
+class MetricStore {
+public:
+    explicit MetricStore(MetricStoreOptions options = {});
+    ~MetricStore();
+    MetricStore(const MetricStore&) = delete;
+    MetricStore& operator=(const MetricStore&) = delete;
+
+    // Handle for a series name, created on first use; appending by handle
+    // skips the name lookup. A handle is valid until its series expires
+    // (retention drops everything in it), after which it may be reused.
+    // With `decimals` >= 0 a new series keeps values rounded to that many
+    // places, stored as integers: a gauge that moves every tick then codes
+    // as a few bits of difference instead of most of a mantissa.
+    uint32_t series(const std::string& name, int decimals = -1);
+    // Points must arrive in time order per series; one that does not, or
+    // an expired handle, is dropped (false)
+    bool append(uint32_t series, int64_t t_ms, double value);
+    bool append(const std::string& name, int64_t t_ms, double value) { return append(series(name), t_ms, value); }
+    // One timestamp for many series under one lock; returns how many took
+    size_t append(int64_t t_ms, const std::vector<MetricValue>& values);
+
+    // Points with from_ms <= t <= to_ms, oldest first, appended to `out`
+    size_t query(const std::string& name, int64_t from_ms, int64_t to_ms, std::vector<MetricPoint>& out) const;
+    // Names starting with `prefix`, sorted
+    std::vector<std::string> list(const std::string& prefix = "") const;
+    // Newest point of a series, if any
+    bool last(const std::string& name, MetricPoint& out) const;
+
+    // Apply the retention limits as of `now_ms`; series left empty go away
+    void expire(int64_t now_ms);
+    MetricStoreStats stats() const;
+    const MetricStoreOptions& options() const { return opts_; }
+
+private:
+    struct Series;
+    struct Chunk;
+
+    bool append_locked(uint32_t series, int64_t t_ms, double value);
+    void put_difference(Series& s, int64_t d);
+    void flush_run(Series& s);
+    void seal(Series& s);
+    size_t series_bytes(const Series& s) const;
+    void drop_oldest(Series& s);
+    void erase_series(uint32_t id);
+
+    const MetricStoreOptions opts_;
+    mutable std::mutex mu_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::unique_ptr<Series>> series_;   // by handle; nullptr once expired
+    std::vector<uint32_t> free_;                     // expired handles
+    size_t bytes_ = 0;
+    uint64_t expired_chunks_ = 0;
+};
+
+}  // namespace safebox
@@ -0,0 +1,245 @@
+// safebox-metrics-bench - size and query latency of the metric store at the
+// daemon's scale, with no jobs running.
+//
+// Fills a MetricStore as the daemon's MetricsFeed would: every second, one
+// point per metric per job, values quantized the same way (percentages to
+// 0.1, bytes to pages). Each job's metrics are a realistic mix: a few that
+// move every second (CPU use, memory.current, CPU stall), limits that step
+// now and then, and event rates and counters that are zero almost all the
+// time with the odd burst. Every series is rolled up as the feed does it,
+// into the rollups' own per-tier stores at their default limits. It reports
+// the raw store's size, bits per point and append cost, the rollups' size
+// and how far back the raw points and each tier reach, then times
+// dashboard-style range queries (last 5 minutes, last hour, whole window)
+// on random series. The raw store is uncapped unless --max-mb says
+// otherwise, so it reports what the whole window needs; with the daemon's
+// cap it reports how much of the window was kept.
+//
+//   safebox-metrics-bench --jobs 1000 --metrics 20 --hours 24
+//   safebox-metrics-bench --jobs 1000 --metrics 12 --hours 24 --max-mb 100
+//   safebox-metrics-bench --jobs 100 --hours 1 --queries 10000
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "metric_rollup.hpp"
+#include "metric_store.hpp"
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  safebox-metrics-bench [--jobs <n>] [--metrics <n>] [--hours <h>] [--interval-ms <ms>]\n"
+              << "                        [--queries <n>] [--seed <n>] [--max-mb <mb>]\n";
+}
+
+static const double PAGE = 4096;
+
+enum class Shape { BUSY_CPU, MEMORY, STALL, LIMIT, RATE };
+
+// The first three metrics of a job move, the next few are limits, the rest
+// are event rates and counters
+static Shape shape_of(int m) {
+    if (m == 0) return Shape::BUSY_CPU;
+    if (m == 1) return Shape::MEMORY;
+    if (m == 2) return Shape::STALL;
+    if (m < 7) return Shape::LIMIT;
+    return Shape::RATE;
+}
+
+struct Generator {
+    Shape shape;
+    double value = 0;
+    int hold = 0;            // ticks left in a burst or at a step
+};
+
+static double next_value(Generator& g, std::mt19937& rng) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    switch (g.shape) {
+    case Shape::BUSY_CPU:
+        // A random walk in 0..400%, to 0.1
+        g.value = std::clamp(g.value + (u(rng) - 0.5) * 8.0, 0.0, 400.0);
+        return std::round(g.value * 10) / 10;
+    case Shape::MEMORY:
+        // Pages come and go every second
+        g.value = std::max(0.0, g.value + std::round((u(rng) - 0.5) * 64) * PAGE);
+        return g.value;
+    case Shape::STALL:
+        // Mostly 0; stalls in bursts of a few seconds
+        if (g.hold > 0) {
+            --g.hold;
+            return std::round(u(rng) * 300) / 10;
+        }
+        if (u(rng) < 0.01) g.hold = 1 + (int)(u(rng) * 10);
+        return 0;
+    case Shape::LIMIT:
+        // The controller moves a limit about once a minute
+        if (u(rng) < 1.0 / 60) g.value = std::round(g.value * (0.8 + 0.4 * u(rng)));
+        return g.value;
+    case Shape::RATE:
+        if (g.hold > 0) {
+            --g.hold;
+            return std::round(u(rng) * 20);
+        }
+        if (u(rng) < 0.001) g.hold = 1 + (int)(u(rng) * 5);
+        return 0;
+    }
+    return 0;
+}
+
+// Resident set size, bytes; what the store really costs with the allocator's share
+static double rss_bytes() {
+    long pages = 0, resident = 0;
+    FILE* f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    std::fclose(f);
+    return (double)resident * (double)sysconf(_SC_PAGESIZE);
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5))];
+}
+
+int main(int argc, char** argv) {
+    int jobs = 1000, metrics = 20, interval_ms = 1000, queries = 2000;
+    double hours = 24;
+    unsigned seed = 1;
+    size_t max_mb = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) { usage(); std::exit(1); }
+            return argv[++i];
+        };
+        if (a == "--jobs") jobs = std::max(1, std::atoi(next()));
+        else if (a == "--metrics") metrics = std::max(1, std::atoi(next()));
+        else if (a == "--hours") hours = std::max(0.01, std::atof(next()));
+        else if (a == "--interval-ms") interval_ms = std::max(1, std::atoi(next()));
+        else if (a == "--queries") queries = std::max(1, std::atoi(next()));
+        else if (a == "--seed") seed = (unsigned)std::atoi(next());
+        else if (a == "--max-mb") max_mb = (size_t)std::max(0, std::atoi(next()));
+        else { usage(); return 1; }
+    }
+
+    const int64_t span_ms = (int64_t)(hours * 3600 * 1000);
+    const double rss_before = rss_bytes();
+    safebox::MetricStoreOptions opts;
+    opts.retention_ms = span_ms;
+    opts.max_bytes = max_mb << 20;
+    safebox::MetricStore store(opts);
+    safebox::MetricRollups rollups(store, interval_ms);
+    std::mt19937 rng(seed);
+
+    const size_t n = (size_t)jobs * (size_t)metrics;
+    std::vector<uint32_t> ids(n);
+    std::vector<std::string> names(n);
+    std::vector<Generator> gen(n);
+    for (int j = 0; j < jobs; ++j) {
+        for (int m = 0; m < metrics; ++m) {
+            const size_t k = (size_t)j * metrics + m;
+            names[k] = "job." + std::to_string(j + 1) + ".m" + std::to_string(m);
+            gen[k].shape = shape_of(m);
+            // As the feed declares them: percentages to 0.1, the rest whole
+            const int decimals = gen[k].shape == Shape::BUSY_CPU || gen[k].shape == Shape::STALL ? 1 : 0;
+            ids[k] = store.series(names[k], decimals);
+            rollups.track(ids[k], names[k], decimals);
+            gen[k].value = gen[k].shape == Shape::MEMORY ? 256 * PAGE * (1 + j % 64)
+                         : gen[k].shape == Shape::LIMIT  ? 100.0 * (1 + m) : 50.0;
+        }
+    }
+
+    // Points land on the interval grid, as the feed stamps them
+    const int64_t ticks = span_ms / interval_ms;
+    std::vector<safebox::MetricValue> values(n);
+    for (size_t k = 0; k < n; ++k) values[k].series = ids[k];
+    double append_ns = 0;
+    uint64_t points = 0;
+    for (int64_t t = 0; t < ticks; ++t) {
+        for (size_t k = 0; k < n; ++k) values[k].value = next_value(gen[k], rng);
+        const int64_t now = t * interval_ms;
+        const auto t0 = std::chrono::steady_clock::now();
+        store.append(now, values);
+        append_ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - t0).count();
+        rollups.add(now, values);
+        points += n;
+        if (t % 60 == 0) {
+            store.expire(now);
+            rollups.expire(now);
+        }
+    }
+    const safebox::MetricStoreStats st = store.stats();
+    const double mb = st.bytes / 1048576.0;
+    // How far back a moving gauge still reaches once the size cap has bitten
+    std::vector<safebox::MetricPoint> first;
+    store.query(names[0], 0, span_ms, first);
+    const double kept_h = first.empty() ? 0 : (double)(ticks * interval_ms - first.front().t_ms) / 3.6e6;
+    // ... and each rollup tier
+    const safebox::MetricStoreStats rst = rollups.stats();
+    const char* const tiers[] = {"10s", "1m", "10m"};
+    double tier_h[safebox::ROLLUP_TIERS] = {};
+    for (int i = 0; i < safebox::ROLLUP_TIERS; ++i) {
+        std::vector<safebox::MetricPoint> b;
+        rollups.tier(i).query(names[0] + "@" + tiers[i] + ":avg", 0, span_ms, b);
+        if (!b.empty()) tier_h[i] = (double)(ticks * interval_ms - b.front().t_ms) / 3.6e6;
+    }
+    const double rss_mb = (rss_bytes() - rss_before) / 1048576.0;
+    std::printf("jobs=%d metrics=%d hours=%.2f interval=%dms series=%zu points=%llu chunks=%zu\n", jobs, metrics,
+                hours, interval_ms, st.series, (unsigned long long)st.points, st.chunks);
+    std::printf("store=%.1f MB (%.2f bits/point, %.0f bytes/series) rss=+%.1f MB append=%.1f ns/point\n", mb,
+                8.0 * (double)st.bytes / (double)std::max<uint64_t>(1, st.points),
+                (double)st.bytes / (double)std::max<size_t>(1, st.series), rss_mb, append_ns / (double)std::max<uint64_t>(1, points));
+    std::printf("kept=%.2f h of %.2f h, %llu chunks expired\n", kept_h, hours, (unsigned long long)st.expired_chunks);
+    std::printf("rollups=%.1f MB (%zu series) 10s=%.1f MB, %.2f h 1m=%.1f MB, %.2f h 10m=%.1f MB, %.2f h\n",
+                rst.bytes / 1048576.0, rst.series, rollups.tier(0).stats().bytes / 1048576.0, tier_h[0],
+                rollups.tier(1).stats().bytes / 1048576.0, tier_h[1], rollups.tier(2).stats().bytes / 1048576.0,
+                tier_h[2]);
+
+    // Dashboard panels: one random series over a recent window
+    const int64_t end = ticks * interval_ms;
+    struct Panel {
+        const char* name;
+        int64_t window_ms;
+    };
+    const Panel panels[] = {{"last_5m", 5 * 60 * 1000}, {"last_1h", 3600 * 1000}, {"all", span_ms}};
+    std::printf("{\"jobs\":%d,\"metrics\":%d,\"hours\":%.2f,\"points\":%llu,\"store_mb\":%.2f,\"bits_per_point\":%.3f,"
+                "\"rss_mb\":%.2f,\"append_ns\":%.1f,\"max_mb\":%zu,\"kept_hours\":%.2f,\"rollup_mb\":%.2f,"
+                "\"rollup_kept_hours\":[%.2f,%.2f,%.2f]",
+                jobs, metrics, hours, (unsigned long long)st.points, mb,
+                8.0 * (double)st.bytes / (double)std::max<uint64_t>(1, st.points), rss_mb,
+                append_ns / (double)std::max<uint64_t>(1, points), max_mb, kept_h, rst.bytes / 1048576.0,
+                tier_h[0], tier_h[1], tier_h[2]);
+    std::vector<std::string> lines;
+    for (const Panel& p : panels) {
+        std::vector<double> us;
+        std::vector<safebox::MetricPoint> out;
+        size_t returned = 0;
+        for (int q = 0; q < queries; ++q) {
+            const std::string& name = names[rng() % n];
+            out.clear();
+            const auto t0 = std::chrono::steady_clock::now();
+            returned += store.query(name, end - p.window_ms, end, out);
+            us.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - t0).count() / 1000.0);
+        }
+        char line[256];
+        std::snprintf(line, sizeof(line), "query %-8s points=%zu p50=%.1fus p99=%.1fus max=%.1fus", p.name,
+                      returned / (size_t)queries, percentile(us, 0.5), percentile(us, 0.99), percentile(us, 1.0));
+        lines.push_back(line);
+        std::printf(",\"%s_p50_us\":%.2f,\"%s_p99_us\":%.2f", p.name, percentile(us, 0.5), p.name,
+                    percentile(us, 0.99));
+    }
+    std::printf("}\n");
+    for (const auto& l : lines) std::printf("%s\n", l.c_str());
+    return 0;
+}
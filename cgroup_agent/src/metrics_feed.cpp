@@ -0,0 +1,242 @@
+// metrics_feed.cpp - the daemon's once-a-second metric sampler.
+//
+// Series per job ("job.<id>." + name):
+//   cpu_percent            percent of one CPU used over the tick
+//   cpu_throttled          percent of the tick spent throttled at cpu.max
+//   cpu_pressure           percent of the tick runnable but waiting (PSI some)
+//   memory_current         bytes
+//   memory_pressure_some   percent of the tick stalled on memory (PSI)
+//   memory_pressure_full
+//   memory_high_events     memory.events over the tick
+//   memory_max_events
+//   oom_kills
+//   cpu_max                quota as percent of one CPU, 0 => "max"
+//   memory_high            bytes, 0 => "max"
+//   memory_max
+// and for the host ("host." + name): cpu_percent (of every CPU),
+// memory_used, memory_available, load1, load5, load15, jobs.
+
+#include "metrics_feed.hpp"
+
+#include <time.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace safebox {
+
+namespace {
+
+struct MetricDef {
+    const char* name;
+    int decimals;
+};
+
+const MetricDef JOB_METRICS[] = {
+    {"cpu_percent", 1},          {"cpu_throttled", 1},        {"cpu_pressure", 1},
+    {"memory_current", 0},       {"memory_pressure_some", 1}, {"memory_pressure_full", 1},
+    {"memory_high_events", 0},   {"memory_max_events", 0},    {"oom_kills", 0},
+    {"cpu_max", 0},              {"memory_high", 0},          {"memory_max", 0},
+};
+enum JobMetric {
+    CPU_PERCENT, CPU_THROTTLED, CPU_PRESSURE, MEMORY_CURRENT, MEMORY_SOME, MEMORY_FULL,
+    HIGH_EVENTS, MAX_EVENTS, OOM_KILLS, CPU_MAX, MEMORY_HIGH, MEMORY_MAX, JOB_METRIC_COUNT
+};
+
+const MetricDef HOST_METRICS[] = {
+    {"cpu_percent", 1}, {"memory_used", 0}, {"memory_available", 0},
+    {"load1", 2},       {"load5", 2},       {"load15", 2},       {"jobs", 0},
+};
+enum HostMetric { HOST_CPU, HOST_USED, HOST_AVAILABLE, LOAD1, LOAD5, LOAD15, HOST_JOBS };
+
+// Expire once a minute of ticks; dropping whole chunks is all it does
+const int EXPIRE_EVERY = 60;
+
+int64_t realtime_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Counter delta as a share of `dt_us`, percent; -1 when either end is missing
+double share(int64_t now, int64_t before, uint64_t dt_us) {
+    if (now < 0 || before < 0 || dt_us == 0) return -1;
+    return 100.0 * (double)std::max<int64_t>(0, now - before) / (double)dt_us;
+}
+
+double delta(int64_t now, int64_t before) {
+    if (now < 0 || before < 0) return -1;
+    return (double)std::max<int64_t>(0, now - before);
+}
+
+// "max" => 0; absent => -1
+double limit_value(const CgroupFs& cg, int fd, const char* file) {
+    auto v = cg.read(fd, file);
+    if (!v) return -1;
+    if (v->compare(0, 3, "max") == 0) return 0;
+    return std::strtod(v->c_str(), nullptr);
+}
+
+double cpu_max_percent(const CgroupFs& cg, int fd) {
+    auto v = cg.read(fd, "cpu.max");
+    if (!v) return -1;
+    if (v->compare(0, 3, "max") == 0) return 0;
+    long long quota = 0, period = 0;
+    if (std::sscanf(v->c_str(), "%lld %lld", &quota, &period) != 2 || period <= 0) return -1;
+    return 100.0 * (double)quota / (double)period;
+}
+
+}  // namespace
+
+MetricsFeed::MetricsFeed(const CgroupFs& cg, MetricStoreOptions options, int interval_ms)
+    : cg_(cg), interval_ms_(std::max(1, interval_ms)), store_(options), rollups_(store_, interval_ms_) {
+    for (const MetricDef& m : HOST_METRICS) {
+        const std::string name = std::string("host.") + m.name;
+        host_series_.push_back(store_.series(name, m.decimals));
+        rollups_.track(host_series_.back(), name, m.decimals);
+    }
+    thread_ = std::thread(&MetricsFeed::run, this);
+}
+
+MetricsFeed::~MetricsFeed() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+bool MetricsFeed::add(int id, int group_fd) {
+    Job job;
+    job.probe = GroupProbe(group_fd);
+    if (job.probe.group_fd() < 0) return false;
+    job.probe.sample(job.last);
+    job.prefix = "job." + std::to_string(id) + ".";
+    std::lock_guard<std::mutex> lock(mu_);
+    if (jobs_.count(id)) return false;
+    jobs_.emplace(id, std::move(job));
+    return true;
+}
+
+void MetricsFeed::remove(int id) {
+    std::vector<uint32_t> series;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return;
+        series = std::move(it->second.series);
+        jobs_.erase(it);
+    }
+    // Its last buckets close now, partial
+    for (uint32_t s : series) rollups_.untrack(s);
+}
+
+void MetricsFeed::run() {
+    // Ticks land on the wall-clock grid, so series line up across jobs and
+    // a late wakeup does not shift every later point
+    int64_t last = 0;
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stop_) {
+        const int64_t now = realtime_ms();
+        const int64_t next = (now / interval_ms_ + 1) * interval_ms_;
+        cv_.wait_for(lock, std::chrono::milliseconds(next - now), [this] { return stop_; });
+        if (stop_) break;
+        const int64_t t = (realtime_ms() + interval_ms_ / 2) / interval_ms_ * interval_ms_;
+        if (t <= last) continue;   // woke early
+        last = t;
+        tick(t);
+    }
+}
+
+// mu_ held
+void MetricsFeed::tick(int64_t t_ms) {
+    std::vector<MetricValue> values;
+    values.reserve(host_series_.size() + jobs_.size() * JOB_METRIC_COUNT);
+    sample_host(t_ms, values);
+    for (auto& [id, job] : jobs_) sample_job(job, values);
+    store_.append(t_ms, values);
+    rollups_.add(t_ms, values);
+    if ((t_ms / interval_ms_) % EXPIRE_EVERY == 0) {
+        store_.expire(t_ms);
+        rollups_.expire(t_ms);
+    }
+}
+
+void MetricsFeed::sample_host(int64_t, std::vector<MetricValue>& out) {
+    auto put = [&](int m, double v) {
+        if (v >= 0) out.push_back({host_series_[m], v});
+    };
+    if (FILE* f = std::fopen("/proc/stat", "r")) {
+        unsigned long long v[8] = {};
+        if (std::fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+                        &v[6], &v[7]) == 8) {
+            HostCpu now;
+            for (unsigned long long x : v) now.total += x;
+            now.busy = now.total - v[3] - v[4];   // less idle and iowait
+            if (host_cpu_.total > 0 && now.total > host_cpu_.total) {
+                put(HOST_CPU, 100.0 * (double)(now.busy - host_cpu_.busy) / (double)(now.total - host_cpu_.total));
+            }
+            host_cpu_ = now;
+        }
+        std::fclose(f);
+    }
+    if (FILE* f = std::fopen("/proc/meminfo", "r")) {
+        char key[64];
+        long long kb = 0, total = -1, available = -1;
+        while (std::fscanf(f, "%63s %lld kB\n", key, &kb) == 2) {
+            if (std::strcmp(key, "MemTotal:") == 0) total = kb;
+            else if (std::strcmp(key, "MemAvailable:") == 0) available = kb;
+        }
+        std::fclose(f);
+        if (total >= 0 && available >= 0) {
+            put(HOST_USED, (double)(total - available) * 1024);
+            put(HOST_AVAILABLE, (double)available * 1024);
+        }
+    }
+    if (FILE* f = std::fopen("/proc/loadavg", "r")) {
+        double l1, l5, l15;
+        if (std::fscanf(f, "%lf %lf %lf", &l1, &l5, &l15) == 3) {
+            put(LOAD1, l1);
+            put(LOAD5, l5);
+            put(LOAD15, l15);
+        }
+        std::fclose(f);
+    }
+    put(HOST_JOBS, (double)jobs_.size());
+}
+
+void MetricsFeed::sample_job(Job& job, std::vector<MetricValue>& out) {
+    GroupSample now;
+    if (!job.probe.sample(now)) return;
+    if (job.series.empty()) {
+        for (const MetricDef& m : JOB_METRICS) {
+            job.series.push_back(store_.series(job.prefix + m.name, m.decimals));
+            rollups_.track(job.series.back(), job.prefix + m.name, m.decimals);
+        }
+    }
+    const GroupSample& was = job.last;
+    const uint64_t dt_us = now.t_ns > was.t_ns ? (now.t_ns - was.t_ns) / 1000 : 0;
+    auto put = [&](int m, double v) {
+        if (v >= 0) out.push_back({job.series[m], v});
+    };
+    put(CPU_PERCENT, share(now.cpu_usage_us, was.cpu_usage_us, dt_us));
+    put(CPU_THROTTLED, share(now.cpu_throttled_us, was.cpu_throttled_us, dt_us));
+    put(CPU_PRESSURE, share(now.cpu_some_us, was.cpu_some_us, dt_us));
+    put(MEMORY_CURRENT, (double)now.memory_current);
+    put(MEMORY_SOME, share(now.mem_some_us, was.mem_some_us, dt_us));
+    put(MEMORY_FULL, share(now.mem_full_us, was.mem_full_us, dt_us));
+    put(HIGH_EVENTS, delta(now.mem_events_high, was.mem_events_high));
+    put(MAX_EVENTS, delta(now.mem_events_max, was.mem_events_max));
+    put(OOM_KILLS, delta(now.mem_events_oom_kill, was.mem_events_oom_kill));
+    const int fd = job.probe.group_fd();
+    put(CPU_MAX, cpu_max_percent(cg_, fd));
+    put(MEMORY_HIGH, limit_value(cg_, fd, "memory.high"));
+    put(MEMORY_MAX, limit_value(cg_, fd, "memory.max"));
+    job.last = now;
+}
+
+}  // namespace safebox
@@ -0,0 +1,78 @@
+// metrics_feed.hpp - samples the host and every job cgroup into a
+// MetricStore once a second.
+//
+// Series are named "host.<metric>" and "job.<id>.<metric>" (see
+// metrics_feed.cpp for the list). Counters are stored as per-tick rates and
+// shares (CPU percent, share of the tick throttled or stalled, events per
+// tick) so a dashboard can plot a range without diffing it. Percentages are
+// kept to 0.1 and everything else whole, and every point is stamped on the
+// sampling grid, which is what lets the store code most ticks in a few
+// bits. Each series is also rolled up into 10 s, 1 min and 10 min buckets
+// (metric_rollup.hpp). A job's series are only created at its first tick,
+// so one that exits sooner costs nothing; its history outlives it until
+// retention drops it.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cgroup_fs.hpp"
+#include "metric_rollup.hpp"
+#include "metric_store.hpp"
+#include "sampler.hpp"
+
+namespace safebox {
+
+class MetricsFeed {
+public:
+    MetricsFeed(const CgroupFs& cg, MetricStoreOptions options, int interval_ms = 1000);
+    ~MetricsFeed();
+    MetricsFeed(const MetricsFeed&) = delete;
+    MetricsFeed& operator=(const MetricsFeed&) = delete;
+
+    // Start sampling a job's cgroup; `group_fd` is duplicated
+    bool add(int id, int group_fd);
+    void remove(int id);
+
+    const MetricStore& store() const { return store_; }
+    const MetricRollups& rollups() const { return rollups_; }
+    int interval_ms() const { return interval_ms_; }
+
+private:
+    struct Job {
+        GroupProbe probe;
+        GroupSample last;
+        std::string prefix;             // "job.<id>."
+        std::vector<uint32_t> series;   // handles, in JOB_METRICS order; empty until first sampled
+    };
+    struct HostCpu {
+        uint64_t busy = 0;
+        uint64_t total = 0;
+    };
+
+    void run();
+    void tick(int64_t t_ms);
+    void sample_host(int64_t t_ms, std::vector<MetricValue>& out);
+    void sample_job(Job& job, std::vector<MetricValue>& out);
+
+    const CgroupFs& cg_;
+    const int interval_ms_;
+    MetricStore store_;
+    MetricRollups rollups_;   // of every series the feed writes
+
+    std::mutex mu_;   // guards jobs_ and stop_
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::unordered_map<int, Job> jobs_;
+    std::vector<uint32_t> host_series_;
+    HostCpu host_cpu_;
+    std::thread thread_;
+};
+
+}  // namespace safebox
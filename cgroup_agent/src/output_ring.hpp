@@ -0,0 +1,89 @@
+// output_ring.hpp - bounded per-stream output buffer for running jobs.
+//
+// Bytes are addressed by absolute offset since the job started. Only the
+// most recent `capacity` bytes are retained; a reader asking for an offset
+// that has already been overwritten is moved forward and told how many
+// bytes it skipped. Memory per job is therefore fixed no matter how noisy
+// the workload is, and slow readers never hold data back for fast ones.
+//
+// Not synchronised; the owning Job's mutex guards it.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace safebox {
+
+class OutputRing {
+public:
+    explicit OutputRing(size_t capacity = 256 * 1024) : cap_(capacity ? capacity : 1) {}
+
+    void append(const char* data, size_t n) {
+        if (n >= cap_) {  // only the last cap_ bytes can survive
+            data += n - cap_;
+            end_ += n - cap_;
+            n = cap_;
+            buf_.resize(cap_);
+        }
+        // Grow lazily: most jobs print a few lines and never need the full
+        // ring. Until it is full, end_ == buf_.size() and index == offset.
+        if (buf_.size() < cap_) {
+            size_t grow = std::min(n, cap_ - buf_.size());
+            buf_.insert(buf_.end(), data, data + grow);
+            end_ += grow;
+            data += grow;
+            n -= grow;
+        }
+        while (n > 0) {
+            size_t pos = (size_t)(end_ % cap_);
+            size_t chunk = std::min(n, cap_ - pos);
+            std::copy(data, data + chunk, buf_.begin() + (long)pos);
+            end_ += chunk;
+            data += chunk;
+            n -= chunk;
+        }
+    }
+
+    uint64_t begin() const { return end_ - buf_.size(); }
+    uint64_t end() const { return end_; }
+
+    // Copy up to max_bytes starting at `offset` into `out`. Returns the
+    // offset to resume from; `skipped` is how many requested bytes were lost.
+    uint64_t read(uint64_t offset, size_t max_bytes, std::string& out, uint64_t& skipped) const {
+        skipped = 0;
+        if (offset < begin()) {
+            skipped = begin() - offset;
+            offset = begin();
+        }
+        if (offset > end_) offset = end_;
+        size_t n = (size_t)std::min<uint64_t>(end_ - offset, max_bytes);
+        out.reserve(out.size() + n);
+        uint64_t pos = offset;
+        while (n > 0) {
+            size_t idx = (size_t)(pos % cap_);
+            size_t chunk = std::min(n, buf_.size() - idx);
+            out.append(buf_.data() + idx, chunk);
+            pos += chunk;
+            n -= chunk;
+        }
+        return pos;
+    }
+
+    // Everything still retained, oldest first
+    std::string contents() const {
+        std::string out;
+        uint64_t skipped;
+        read(begin(), buf_.size(), out, skipped);
+        return out;
+    }
+
+private:
+    size_t cap_;
+    std::vector<char> buf_;
+    uint64_t end_ = 0;  // total bytes ever appended
+};
+
+}  // namespace safebox
@@ -0,0 +1,235 @@
+#include "placement.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace safebox {
+
+// Weights of the affinity terms against best-fit slack (both in CPU%)
+static const double SIBLING_PENALTY = 30.0;   // per same-kind job on an SMT sibling
+static const double BANDWIDTH_PENALTY = 25.0; // per memory-bound job already on the node
+static const double NODE_FIT_WEIGHT = 50.0;   // per whole node left empty
+static const size_t CPU_CANDIDATES = 8;       // tightest-fitting CPUs scored per node
+
+std::string cpu_list(std::vector<int> ids) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    std::string out;
+    for (size_t i = 0; i < ids.size();) {
+        size_t j = i;
+        while (j + 1 < ids.size() && ids[j + 1] == ids[j] + 1) ++j;
+        if (!out.empty()) out += ",";
+        out += std::to_string(ids[i]);
+        if (j > i) out += "-" + std::to_string(ids[j]);
+        i = j + 1;
+    }
+    return out;
+}
+
+Placer::Placer(const CpuTopology& topo, long memory_mb) {
+    nodes_.resize((size_t)std::max(1, topo.nodes));
+    for (size_t i = 0; i < topo.cpus.size(); ++i) {
+        Cpu c;
+        c.id = topo.cpus[i];
+        c.node = topo.node_of[i];
+        c.core = i < topo.core_of.size() ? topo.core_of[i] : c.id;
+        cpus_.push_back(c);
+        index_of_[c.id] = (int)i;
+        Node& n = nodes_[(size_t)c.node];
+        n.total_cpu += 100;
+        n.by_free.insert({100, (int)i});
+        siblings_[c.core].push_back((int)i);
+    }
+
+    // Memory pool split by each node's MemTotal; evenly when unknown. Nodes
+    // with no CPUs we may use get none.
+    long weight_total = 0;
+    for (size_t n = 0; n < nodes_.size(); ++n) {
+        if (nodes_[n].total_cpu == 0) continue;
+        weight_total += n < topo.node_memory_mb.size() && topo.node_memory_mb[n] > 0 ? topo.node_memory_mb[n] : 1;
+    }
+    long given = 0;
+    int last = -1;
+    for (size_t n = 0; n < nodes_.size(); ++n) {
+        if (nodes_[n].total_cpu == 0) continue;
+        long w = n < topo.node_memory_mb.size() && topo.node_memory_mb[n] > 0 ? topo.node_memory_mb[n] : 1;
+        nodes_[n].total_mem = memory_mb * w / std::max(1L, weight_total);
+        given += nodes_[n].total_mem;
+        last = (int)n;
+    }
+    if (last >= 0) nodes_[(size_t)last].total_mem += memory_mb - given;   // rounding
+    for (auto& n : nodes_) {
+        n.free_mem = n.total_mem;
+        n.free_cpu = n.total_cpu;
+    }
+    mem_per_cpu_ = cpus_.empty() ? 0 : (double)memory_mb / (double)capacity_percent();
+}
+
+// Same-kind jobs on the other hyperthreads of `cpu`'s physical core
+int Placer::sibling_load(int cpu, bool memory_bound) const {
+    int load = 0;
+    auto it = siblings_.find(cpus_[(size_t)cpu].core);
+    if (it == siblings_.end()) return 0;
+    for (int s : it->second) {
+        if (s != cpu) load += cpus_[(size_t)s].jobs[memory_bound ? 1 : 0];
+    }
+    return load;
+}
+
+// Best CPUs for the job on one node, read-only; false if it does not fit
+bool Placer::plan_on(int node, int cpu_percent, long memory_mb, bool memory_bound, Plan& out) const {
+    const Node& n = nodes_[(size_t)node];
+    if (n.free_mem < memory_mb || n.free_cpu < cpu_percent || n.by_free.empty()) return false;
+
+    out.cpus.clear();
+    out.shares.clear();
+    double cpu_score = 0;
+    auto fit = cpu_percent <= 100 ? n.by_free.lower_bound({cpu_percent, -1}) : n.by_free.end();
+    if (fit != n.by_free.end()) {
+        // One CPU: the tightest few, scored by slack and SMT neighbours
+        double best = 1e18;
+        size_t seen = 0;
+        for (auto it = fit; it != n.by_free.end() && seen < CPU_CANDIDATES; ++it, ++seen) {
+            double s = (it->first - cpu_percent) + SIBLING_PENALTY * sibling_load(it->second, memory_bound);
+            if (s < best) {
+                best = s;
+                out.cpus = {it->second};
+            }
+        }
+        out.shares = {cpu_percent};
+        cpu_score = best;
+    } else {
+        // Several CPUs, emptiest first, so big jobs take whole CPUs and
+        // leave the partly used ones to small jobs
+        int left = cpu_percent;
+        for (auto it = n.by_free.rbegin(); it != n.by_free.rend() && left > 0; ++it) {
+            if (it->first == 0) break;
+            int share = std::min(it->first, left);
+            out.cpus.push_back(it->second);
+            out.shares.push_back(share);
+            cpu_score += SIBLING_PENALTY * sibling_load(it->second, memory_bound);
+            left -= share;
+        }
+        if (left > 0) return false;
+        // A split job leaves slack on its last CPU
+        cpu_score += cpus_[(size_t)out.cpus.back()].free - out.shares.back();
+    }
+
+    // Node best fit: the fractions of its CPU and memory left over
+    const double slack = (double)(n.free_cpu - cpu_percent) / n.total_cpu +
+                         (double)(n.free_mem - memory_mb) / (double)std::max(1L, n.total_mem);
+    out.score = cpu_score + NODE_FIT_WEIGHT * slack + (memory_bound ? BANDWIDTH_PENALTY * n.memory_bound : 0.0);
+    return true;
+}
+
+// Move `share` of a CPU from free to used (negative gives it back),
+// keeping its node's index in order
+void Placer::take(int cpu, int share) {
+    Cpu& c = cpus_[(size_t)cpu];
+    Node& n = nodes_[(size_t)c.node];
+    n.by_free.erase({c.free, cpu});
+    c.free -= share;
+    n.by_free.insert({c.free, cpu});
+    n.free_cpu -= share;
+}
+
+std::optional<Placement> Placer::place(int id, int cpu_percent, long memory_mb) {
+    if (cpus_.empty() || placed_.count(id)) return std::nullopt;
+    cpu_percent = std::max(1, cpu_percent);
+    Placement p;
+    p.memory_bound = (double)memory_mb > mem_per_cpu_ * cpu_percent;
+
+    Plan best, trial;
+    int best_node = -1;
+    for (int node = 0; node < (int)nodes_.size(); ++node) {
+        if (!plan_on(node, cpu_percent, memory_mb, p.memory_bound, trial)) continue;
+        if (best_node < 0 || trial.score < best.score) {
+            best = trial;
+            best_node = node;
+        }
+    }
+
+    if (best_node >= 0) {
+        p.node = best_node;
+        p.mems = {best_node};
+        p.mem_mb = {memory_mb};
+        nodes_[(size_t)best_node].free_mem -= memory_mb;
+    } else {
+        // No single node has room: spread CPU and memory over the emptiest
+        // CPUs and nodes host-wide
+        std::vector<int> order(cpus_.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = (int)i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return cpus_[(size_t)a].free > cpus_[(size_t)b].free; });
+        int left = cpu_percent;
+        for (int i : order) {
+            if (left == 0 || cpus_[(size_t)i].free == 0) break;
+            int share = std::min(cpus_[(size_t)i].free, left);
+            best.cpus.push_back(i);
+            best.shares.push_back(share);
+            left -= share;
+        }
+        long mem_left = memory_mb;
+        std::vector<int> by_mem;
+        for (int n = 0; n < (int)nodes_.size(); ++n) by_mem.push_back(n);
+        std::sort(by_mem.begin(), by_mem.end(), [&](int a, int b) { return nodes_[(size_t)a].free_mem > nodes_[(size_t)b].free_mem; });
+        for (int n : by_mem) {
+            long take_mb = std::min(nodes_[(size_t)n].free_mem, mem_left);
+            if (take_mb <= 0) break;
+            p.mems.push_back(n);
+            p.mem_mb.push_back(take_mb);
+            mem_left -= take_mb;
+        }
+        if (left > 0 || mem_left > 0) return std::nullopt;
+        for (size_t k = 0; k < p.mems.size(); ++k) nodes_[(size_t)p.mems[k]].free_mem -= p.mem_mb[k];
+    }
+
+    for (size_t k = 0; k < best.cpus.size(); ++k) {
+        take(best.cpus[k], best.shares[k]);
+        cpus_[(size_t)best.cpus[k]].jobs[p.memory_bound ? 1 : 0]++;
+        p.cpus.push_back(cpus_[(size_t)best.cpus[k]].id);
+        p.shares.push_back(best.shares[k]);
+    }
+    if (p.memory_bound) {
+        for (int n : p.mems) nodes_[(size_t)n].memory_bound++;
+    }
+    placed_[id] = p;
+    return p;
+}
+
+void Placer::release(int id) {
+    auto it = placed_.find(id);
+    if (it == placed_.end()) return;
+    const Placement& p = it->second;
+    for (size_t k = 0; k < p.cpus.size(); ++k) {
+        int i = index_of_.at(p.cpus[k]);
+        take(i, -p.shares[k]);
+        cpus_[(size_t)i].jobs[p.memory_bound ? 1 : 0]--;
+    }
+    for (size_t k = 0; k < p.mems.size(); ++k) {
+        Node& n = nodes_[(size_t)p.mems[k]];
+        n.free_mem += p.mem_mb[k];
+        if (p.memory_bound) n.memory_bound--;
+    }
+    placed_.erase(it);
+}
+
+std::string Placer::state_json() const {
+    std::ostringstream o;
+    o << "{\"nodes\":[";
+    for (size_t n = 0; n < nodes_.size(); ++n) {
+        const Node& nd = nodes_[n];
+        o << (n ? "," : "") << "{\"node\":" << n << ",\"free_cpu\":" << nd.free_cpu << ",\"total_cpu\":" << nd.total_cpu
+          << ",\"free_memory\":" << nd.free_mem << ",\"total_memory\":" << nd.total_mem
+          << ",\"memory_bound_jobs\":" << nd.memory_bound << "}";
+    }
+    o << "],\"cpus\":[";
+    for (size_t i = 0; i < cpus_.size(); ++i) {
+        const Cpu& c = cpus_[i];
+        o << (i ? "," : "") << "{\"cpu\":" << c.id << ",\"node\":" << c.node << ",\"free\":" << c.free
+          << ",\"jobs\":" << c.jobs[0] + c.jobs[1] << "}";
+    }
+    o << "]}";
+    return o.str();
+}
+
+}  // namespace safebox
@@ -0,0 +1,97 @@
+// placement.hpp - bin-packing of admitted jobs onto CPUs and NUMA nodes.
+//
+// The Banker only knows the host as one pool of CPU% and memory. The Placer
+// runs after admission and decides where a job actually goes: every CPU has
+// 100% to give and every NUMA node its share of the memory pool. A job is
+// packed best-fit, onto the CPU whose free share it fills most tightly, on
+// the node where it leaves the least CPU and memory stranded. A few
+// affinity terms then break the ties:
+//
+//   - a memory-bound job (more memory per CPU% than the host average) is
+//     steered away from nodes already running memory-bound jobs, which
+//     would compete for the same memory bandwidth
+//   - a job avoids CPUs whose SMT siblings run a job of the same kind,
+//     which would compete for the same core's execution units and caches
+//
+// Each node keeps its CPUs in an ordered (free, cpu) index that is updated
+// in place on every place/release, so a placement is O(nodes * log cpus).
+// Jobs larger than one CPU take whole free CPUs first. If no single node
+// can hold a job it is spread over all nodes (node -1) rather than refused;
+// admission has already said yes.
+//
+// Not thread-safe; the Executor serialises access.
+
+#pragma once
+
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "work_pool.hpp"
+
+namespace safebox {
+
+struct Placement {
+    int node = -1;               // -1 when spread over several nodes
+    std::vector<int> cpus;       // logical CPU ids
+    std::vector<int> shares;     // percent of each CPU reserved, parallel to cpus
+    std::vector<int> mems;       // NUMA nodes the memory comes from
+    std::vector<long> mem_mb;    // parallel to mems
+    bool memory_bound = false;
+};
+
+// "0-3,8,10-11" from a list of ids
+std::string cpu_list(std::vector<int> ids);
+
+class Placer {
+public:
+    // `memory_mb` is the Banker's memory pool, divided between the nodes in
+    // proportion to their MemTotal
+    Placer(const CpuTopology& topo, long memory_mb);
+
+    // Reserve room for job `id`; nullopt when even spreading cannot fit it
+    std::optional<Placement> place(int id, int cpu_percent, long memory_mb);
+    void release(int id);
+
+    int capacity_percent() const { return 100 * (int)cpus_.size(); }
+    std::string state_json() const;
+
+private:
+    struct Cpu {
+        int id = 0;
+        int node = 0;
+        int core = 0;            // physical core, shared by SMT siblings
+        int free = 100;
+        int jobs[2] = {0, 0};    // resident jobs: [0] CPU-bound, [1] memory-bound
+    };
+    struct Node {
+        long total_mem = 0;
+        long free_mem = 0;
+        int total_cpu = 0;
+        int free_cpu = 0;
+        int memory_bound = 0;    // resident memory-bound jobs
+        std::set<std::pair<int, int>> by_free;   // (free %, index into cpus_)
+    };
+
+    struct Plan {
+        double score = 0;
+        std::vector<int> cpus;   // indexes into cpus_
+        std::vector<int> shares;
+    };
+
+    bool plan_on(int node, int cpu_percent, long memory_mb, bool memory_bound, Plan& out) const;
+    int sibling_load(int cpu, bool memory_bound) const;
+    void take(int cpu, int share);
+
+    std::vector<Cpu> cpus_;
+    std::unordered_map<int, int> index_of_;                // CPU id -> index into cpus_
+    std::vector<Node> nodes_;
+    std::unordered_map<int, std::vector<int>> siblings_;   // core -> indexes into cpus_
+    double mem_per_cpu_ = 0;   // host memory per CPU%, the memory-bound threshold
+    std::unordered_map<int, Placement> placed_;
+};
+
+}  // namespace safebox
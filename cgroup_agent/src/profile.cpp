@@ -0,0 +1,115 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include "json_util.hpp"
+
+namespace safebox {
+
+static const double CPU_PERIOD_NS = 100e6;   // the cpu.max period the executor writes
+
+std::optional<UsageSample> usage_sample(const JobRecord& r) {
+    if (r.wall_ns <= 0) return std::nullopt;
+    UsageSample s;
+
+    // cpu.stat covers everything the job forked; rusage only what was reaped.
+    // A run shorter than one cpu.max period is never throttled (and its wall
+    // time misses the exec that ran before clone() returned), so it is
+    // averaged over a whole period.
+    // An array member's cgroup counters are the gang's, so it is credited
+    // with an even share of them.
+    const int64_t share = std::max<int64_t>(1, r.array_size);
+    int64_t cpu_us = r.cpu_usage_us >= 0 ? r.cpu_usage_us / share : r.ru_utime_us + r.ru_stime_us;
+    double span_ns = std::max((double)r.wall_ns, CPU_PERIOD_NS);
+    s.cpu_percent = 100.0 * (double)cpu_us * 1000.0 / span_ns;
+    if (r.cpu_nr_periods > 0 && r.cpu_nr_throttled * 2 > r.cpu_nr_periods) {
+        s.cpu_percent = std::max(s.cpu_percent, (double)r.cpu_percent);
+    }
+
+    s.memory_mb = r.memory_peak >= 0 ? (double)r.memory_peak / share / (1024.0 * 1024.0) : (double)r.ru_maxrss_kb / 1024.0;
+    if (r.mem_events_max > 0 || r.mem_events_oom_kill > 0) {
+        s.memory_mb = std::max(s.memory_mb, (double)r.memory_mb);
+    }
+    return s;
+}
+
+// Nearest-rank quantile of a sorted, non-empty vector
+static double quantile(const std::vector<double>& sorted, double q) {
+    size_t rank = (size_t)std::ceil(q * (double)sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+std::string advice_json(const std::string& app, const LimitAdvice& a) {
+    std::ostringstream o;
+    o.precision(1);
+    o << std::fixed << "{\"app\":\"" << json_escape(app) << "\",\"ok\":" << (a.ok ? "true" : "false")
+      << ",\"runs\":" << a.runs
+      << ",\"cpu_percent\":{\"p50\":" << a.cpu_p50 << ",\"p95\":" << a.cpu_p95 << ",\"max\":" << a.cpu_max
+      << "},\"memory_mb\":{\"p50\":" << a.mem_p50 << ",\"p95\":" << a.mem_p95 << ",\"max\":" << a.mem_max << "}";
+    if (a.ok) {
+        o << ",\"recommended\":{\"cpu_percent\":" << a.cpu_percent << ",\"memory_mb\":" << a.memory_mb << "}";
+    }
+    o << "}";
+    return o.str();
+}
+
+ProfileStore::ProfileStore(size_t window, size_t min_runs, double margin)
+    : window_(std::max<size_t>(window, 1)), min_runs_(std::max<size_t>(min_runs, 1)), margin_(margin) {}
+
+void ProfileStore::observe(const JobRecord& r, const std::string& app) {
+    auto s = usage_sample(r);
+    if (!s) return;
+    std::lock_guard<std::mutex> lock(mu_);
+    Profile& p = profiles_[(uint64_t)r.app_hash];
+    if (!app.empty()) p.app = app;
+    else if (p.app.empty()) p.app.assign(r.app, strnlen(r.app, sizeof(r.app)));
+    p.runs.push_back(*s);
+    if (p.runs.size() > window_) p.runs.pop_front();
+}
+
+LimitAdvice ProfileStore::advise(uint64_t key) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = profiles_.find(key);
+    return it == profiles_.end() ? LimitAdvice{} : advise_locked(it->second);
+}
+
+// mu_ held
+LimitAdvice ProfileStore::advise_locked(const Profile& p) const {
+    LimitAdvice a;
+    std::vector<double> cpu, mem;
+    for (const auto& s : p.runs) {
+        cpu.push_back(s.cpu_percent);
+        mem.push_back(s.memory_mb);
+    }
+    if (cpu.empty()) return a;
+    std::sort(cpu.begin(), cpu.end());
+    std::sort(mem.begin(), mem.end());
+    a.runs = (int)cpu.size();
+    a.cpu_p50 = quantile(cpu, 0.50);
+    a.cpu_p95 = quantile(cpu, 0.95);
+    a.cpu_max = cpu.back();
+    a.mem_p50 = quantile(mem, 0.50);
+    a.mem_p95 = quantile(mem, 0.95);
+    a.mem_max = mem.back();
+    if (cpu.size() < min_runs_) return a;
+
+    a.ok = true;
+    a.cpu_percent = std::clamp((int)std::ceil(a.cpu_p95 * (1.0 + margin_)), 1, 100);
+    a.memory_mb = std::max(1, (int)std::ceil(a.mem_max * (1.0 + margin_)));
+    return a;
+}
+
+std::vector<std::pair<std::string, LimitAdvice>> ProfileStore::all() const {
+    std::vector<std::pair<std::string, LimitAdvice>> out;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (const auto& [key, p] : profiles_) out.emplace_back(p.app, advise_locked(p));
+    }
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    return out;
+}
+
+}  // namespace safebox
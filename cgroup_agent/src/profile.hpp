@@ -0,0 +1,80 @@
+// profile.hpp - per-application usage profiles built from exit accounting,
+// and the right-sized limits they suggest.
+//
+// Each exit record is reduced to one sample: average CPU% over the run and
+// peak memory. A profile keeps the newest samples per application path
+// (by hash of the whole path, as records hold at most 127 bytes of it) and
+// recommends cpu = p95 and memory = max over that window, each scaled up by
+// a safety margin. CPU is a throttle, so an occasional run above the
+// suggestion only slows down; memory.max is a hard wall, so it is sized for
+// the worst run seen.
+//
+// Runs that hit their limit only tell us the demand was at least the limit
+// (memory.events max/oom_kill, or throttled in most cpu.max periods), so
+// such samples are raised to the limit rather than taken at face value.
+//
+// Thread-safe.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "accounting.hpp"
+
+namespace safebox {
+
+struct UsageSample {
+    double cpu_percent = 0;   // CPU time / wall time, in percent of one core
+    double memory_mb = 0;     // memory.peak, else ru_maxrss of the main process
+};
+
+// nullopt for records with nothing usable (zero wall time)
+std::optional<UsageSample> usage_sample(const JobRecord& r);
+
+struct LimitAdvice {
+    bool ok = false;          // enough runs to recommend anything
+    int runs = 0;
+    double cpu_p50 = 0, cpu_p95 = 0, cpu_max = 0;
+    double mem_p50 = 0, mem_p95 = 0, mem_max = 0;
+    int cpu_percent = 0;      // recommended limits, margin included
+    int memory_mb = 0;
+};
+
+std::string advice_json(const std::string& app, const LimitAdvice& a);
+
+class ProfileStore {
+public:
+    // Recommend once an app has `min_runs` samples; keep the newest `window`
+    ProfileStore(size_t window, size_t min_runs, double margin);
+
+    // Keyed by the record's app_hash; `app` is the full path when the
+    // caller has it, else the record's (possibly truncated) copy names it
+    void observe(const JobRecord& r, const std::string& app = "");
+    LimitAdvice advise(const std::string& app) const { return advise(app_key(app)); }
+    LimitAdvice advise(uint64_t key) const;
+    // Every app with at least one sample and its advice, by name
+    std::vector<std::pair<std::string, LimitAdvice>> all() const;
+
+private:
+    struct Profile {
+        std::string app;
+        std::deque<UsageSample> runs;
+    };
+    LimitAdvice advise_locked(const Profile& p) const;
+
+    size_t window_;
+    size_t min_runs_;
+    double margin_;
+
+    mutable std::mutex mu_;   // guards profiles_
+    std::unordered_map<uint64_t, Profile> profiles_;
+};
+
+}  // namespace safebox
@@ -0,0 +1,621 @@
+// safebox-replay - score limit policies against recorded job group traces,
+// deterministically and with no cgroups or processes.
+//
+// A trace (trace_file.hpp) comes from `safebox-executord --controller
+// --controller-record <file>` on a real host, or from --synthesize. From
+// each group's consecutive samples the replay recovers what it asked for
+// every tick:
+//
+//   CPU     usage plus throttled time: what it would have run unthrottled
+//   memory  memory.current (a lower bound while it was held at memory.high)
+//
+// and feeds that demand to a simulated group under each policy's limits.
+// CPU a quota does not cover is queued, not lost; memory above memory.high
+// is held there (a high event, half the tick stalled) and memory above
+// memory.max is an OOM kill. The simulated cpu.stat, memory.events and
+// pressure counters advance as the kernel's would, and every tick each
+// policy sees them and may move cpu.max, memory.high and memory.max:
+//
+//   reserved    limits stay at the Banker reservation
+//   controller  control_step() + allocate_cpu(), as the daemon's
+//               --controller runs them, with a pool that always grants
+//   --policy-cmd <command>
+//               any other policy, run as a child process speaking the line
+//               protocol below; `python3 -m app.replay_policy` (in backend/)
+//               puts the Python Optimizer behind it
+//
+// Each policy is scored on throttled time, work still queued at the end,
+// time held at memory.high, OOM kills, reserved against used CPU and
+// memory, limit writes, and decision latency per tick (for a child process
+// that includes the pipe round trip).
+//
+// Line protocol, tab-separated, one block per tick to the child's stdin:
+//
+//   tick <seconds>
+//   group <cgroup> <reserved_cpu_percent> <reserved_memory> <cpu_percent>
+//         <memory_high> <memory_max> <usage_usec> <nr_periods> <nr_throttled>
+//         <throttled_usec> <cpu_some_usec> <memory_current> <high_events>
+//         <max_events> <oom_kill>                        (one line per group)
+//   end
+//
+// and back from its stdout, as `safebox_cgroup apply` takes them:
+//
+//   <cgroup> <cpu.max|memory.high|memory.max> <value>    (any number)
+//   end
+//
+//   safebox-replay --synthesize demo.sbt --groups 16 --seconds 600
+//   safebox-replay --trace demo.sbt
+//   safebox-replay --trace demo.sbt --policy-cmd "cd backend && python3 -m app.replay_policy"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "controller.hpp"
+#include "trace_file.hpp"
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  safebox-replay --trace <file> [--policy reserved|controller]... [--policy-cmd <command>]...\n"
+              << "  safebox-replay --synthesize <file> [--groups <n>] [--seconds <s>] [--seed <n>]\n";
+}
+
+static const int64_t PERIOD_US = 100000;   // cpu.max period
+static const int64_t MB = 1 << 20;
+
+// ---- the recorded trace, as per-tick demand ----
+
+struct Demand {
+    int id = 0;
+    double dt_us = 0;
+    double cpu_us = 0;           // CPU time it asked for this tick
+    int64_t memory = 0;          // bytes
+};
+
+struct Recording {
+    int period_ms = 100;
+    std::map<int, safebox::TraceGroupInfo> groups;
+    std::vector<std::vector<Demand>> ticks;
+    std::vector<std::vector<int>> exits;   // groups gone after each tick
+};
+
+static bool load(const std::string& path, Recording& rec) {
+    safebox::TraceReader in;
+    if (!in.open(path)) {
+        std::cerr << in.error() << "\n";
+        return false;
+    }
+    rec.period_ms = std::max(1, in.period_ms());
+    std::map<int, safebox::GroupSample> prev;
+    safebox::TraceRecord r;
+    while (in.next(r)) {
+        switch (r.kind) {
+        case 'G':
+            rec.groups[r.id] = r.group;
+            break;
+        case 'T':
+            rec.ticks.emplace_back();
+            rec.exits.emplace_back();
+            break;
+        case 'S': {
+            if (rec.ticks.empty()) break;
+            auto it = prev.find(r.id);
+            if (it != prev.end() && r.sample.t_ns > it->second.t_ns) {
+                const safebox::GroupSample& p = it->second;
+                Demand d;
+                d.id = r.id;
+                d.dt_us = (double)(r.sample.t_ns - p.t_ns) / 1000.0;
+                d.cpu_us = (double)std::max<int64_t>(0, r.sample.cpu_usage_us - p.cpu_usage_us);
+                if (r.sample.cpu_throttled_us >= 0 && p.cpu_throttled_us >= 0) {
+                    d.cpu_us += (double)std::max<int64_t>(0, r.sample.cpu_throttled_us - p.cpu_throttled_us);
+                }
+                d.memory = std::max<int64_t>(0, r.sample.memory_current);
+                rec.ticks.back().push_back(d);
+            }
+            prev[r.id] = r.sample;
+            break;
+        }
+        case 'X':
+            prev.erase(r.id);
+            if (!rec.exits.empty()) rec.exits.back().push_back(r.id);
+            break;
+        }
+    }
+    if (!in.error().empty()) {
+        // A recording cut off by a crash is still worth replaying
+        std::cerr << "⚠️  Warning: " << path << ": " << in.error() << "; replaying what came before\n";
+    }
+    return true;
+}
+
+// ---- a synthetic recording, for trying the tool without a host ----
+
+static int synthesize(const std::string& path, int groups, double seconds, unsigned seed) {
+    safebox::TraceWriter out;
+    if (!out.open(path, 100)) return 2;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    const char* shapes[] = {"steady", "bursty", "ramp", "periodic", "idle"};
+    std::vector<safebox::GroupSample> s(groups);
+    std::vector<double> burst(groups, 0.0);
+    std::vector<std::string> shape(groups);
+    for (int i = 0; i < groups; ++i) {
+        shape[i] = shapes[i % 5];
+        safebox::TraceGroupInfo g;
+        g.id = i + 1;
+        g.cgroup = "safebox_job_" + std::to_string(g.id);
+        g.cpu_reserved = 50 + 50 * (int)(u(rng) * 3);
+        g.cpu_floor = std::max(1, g.cpu_reserved / 10);
+        g.cpu_burst = 400;
+        g.mem_reserved = (256 + 128 * (int64_t)(u(rng) * 3)) * MB;
+        g.mem_floor = g.mem_reserved / 4;
+        out.group(g);
+        s[i].cpu_usage_us = s[i].cpu_nr_periods = s[i].cpu_nr_throttled = s[i].cpu_throttled_us = 0;
+        s[i].mem_events_high = s[i].mem_events_max = s[i].mem_events_oom_kill = 0;
+        s[i].cpu_some_us = s[i].mem_some_us = s[i].mem_full_us = 0;
+    }
+    const size_t ticks = (size_t)(seconds * 10);
+    for (size_t t = 0; t <= ticks; ++t) {
+        const uint64_t now = (uint64_t)t * 100000000ull;
+        out.tick(now);
+        for (int i = 0; i < groups; ++i) {
+            const double phase = (double)t / 10.0;
+            double cpu = 0, mem_mb = 32;
+            if (shape[i] == "steady") {
+                cpu = 60 + 10 * u(rng);
+                mem_mb = 96;
+            } else if (shape[i] == "bursty") {
+                if (burst[i] <= 0 && u(rng) < 0.01) burst[i] = 30 + 50 * u(rng);
+                cpu = burst[i] > 0 ? 250 : 5;
+                burst[i] -= 1;
+                mem_mb = burst[i] > 0 ? 200 : 64;
+            } else if (shape[i] == "ramp") {
+                // A working set that grows for a minute and is then freed
+                const double age = std::fmod(phase, 60.0);
+                cpu = 40;
+                mem_mb = 32 + 3 * age;
+            } else if (shape[i] == "periodic") {
+                cpu = 50 + 50 * std::sin(phase / 10.0);
+                mem_mb = 128 + 64 * std::sin(phase / 10.0);
+            } else {
+                cpu = 1;
+                mem_mb = 24;
+            }
+            auto& c = s[i];
+            c.t_ns = now;
+            c.cpu_usage_us += (int64_t)(cpu * 1000);
+            c.cpu_nr_periods += cpu > 0 ? 1 : 0;
+            c.memory_current = (int64_t)(mem_mb * MB);
+            safebox::TraceLimits limits;
+            limits.cpu_percent = 400;
+            limits.memory_high = limits.memory_max = 1024 * MB;
+            out.sample(i + 1, c, limits);
+        }
+    }
+    const bool ok = out.flush();
+    std::printf("wrote %s: %d groups, %.0f s, %llu bytes\n", path.c_str(), groups, seconds,
+                (unsigned long long)out.bytes());
+    return ok ? 0 : 2;
+}
+
+// ---- simulated groups and the policies that set their limits ----
+
+struct SimGroup {
+    safebox::TraceGroupInfo info;
+    int64_t cpu_percent = 0;
+    int64_t memory_high = 0;     // <= 0: none
+    int64_t memory_max = 0;
+    safebox::GroupSample counters;
+    double backlog_us = 0;
+};
+
+class ReplayPolicy {
+public:
+    virtual ~ReplayPolicy() = default;
+    virtual std::string name() const = 0;
+    virtual bool start() { return true; }
+    virtual void add(const SimGroup&) {}
+    virtual void remove(int) {}
+    // Every live group, by id, after the tick's counters were advanced
+    virtual bool decide(double t_s, std::map<int, SimGroup>& groups) = 0;
+};
+
+class ReservedPolicy : public ReplayPolicy {
+public:
+    std::string name() const override { return "reserved"; }
+    bool decide(double, std::map<int, SimGroup>&) override { return true; }
+};
+
+class ControllerPolicy : public ReplayPolicy {
+public:
+    std::string name() const override { return "controller"; }
+
+    void add(const SimGroup& g) override {
+        Entry e;
+        e.bounds.cpu_ceiling = g.info.cpu_reserved;
+        e.bounds.cpu_floor = g.info.cpu_floor;
+        e.bounds.cpu_burst = g.info.cpu_burst;
+        e.bounds.mem_ceiling = g.info.mem_reserved;
+        e.bounds.mem_floor = g.info.mem_floor;
+        // As LimitController::add() takes a group over, with a pool
+        e.state.cpu_percent = e.state.cpu_want = g.info.cpu_reserved;
+        if (g.info.mem_reserved > 0) e.state.memory_high = e.state.memory_max = g.info.mem_reserved;
+        e.state.last = g.counters;
+        entries_[g.info.id] = e;
+    }
+
+    void remove(int id) override { entries_.erase(id); }
+
+    bool decide(double, std::map<int, SimGroup>& groups) override {
+        decisions_.clear();
+        std::vector<safebox::ControlTarget> targets;
+        targets.reserve(entries_.size());
+        for (auto& [id, e] : entries_) {
+            safebox::control_step(tuning_, e.bounds, e.state, groups[id].counters, id, decisions_);
+            targets.push_back({id, &e.bounds, &e.state});
+        }
+        safebox::allocate_cpu(tuning_, targets, decisions_);
+        // A raised memory.max is only a request until the pool grants it
+        for (const auto& d : decisions_) {
+            if (std::strcmp(d.knob, "memory.max") != 0 || d.to <= d.from) continue;
+            auto& st = entries_[d.id].state;
+            st.memory_max = d.to;
+            st.pool_wait = 3 * tuning_.calm_ticks;
+        }
+        for (auto& [id, e] : entries_) {
+            SimGroup& g = groups[id];
+            g.cpu_percent = e.state.cpu_percent;
+            if (e.state.memory_high > 0) g.memory_high = e.state.memory_high;
+            if (e.state.memory_max > 0) g.memory_max = e.state.memory_max;
+        }
+        return true;
+    }
+
+private:
+    struct Entry {
+        safebox::ControlBounds bounds;
+        safebox::ControlState state;
+    };
+    safebox::ControlTuning tuning_;
+    std::map<int, Entry> entries_;
+    std::vector<safebox::ControlDecision> decisions_;
+};
+
+// A policy in another process, over the line protocol in the header
+class CommandPolicy : public ReplayPolicy {
+public:
+    explicit CommandPolicy(std::string command) : command_(std::move(command)) {}
+
+    ~CommandPolicy() override {
+        if (to_) std::fclose(to_);
+        if (from_) std::fclose(from_);
+        if (pid_ > 0) waitpid(pid_, nullptr, 0);
+    }
+
+    std::string name() const override { return "cmd:" + command_; }
+
+    bool start() override {
+        int in[2], out[2];
+        if (pipe(in) != 0 || pipe(out) != 0) {
+            std::perror("pipe");
+            return false;
+        }
+        pid_ = fork();
+        if (pid_ < 0) {
+            std::perror("fork");
+            return false;
+        }
+        if (pid_ == 0) {
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            close(in[0]);
+            close(in[1]);
+            close(out[0]);
+            close(out[1]);
+            execl("/bin/sh", "sh", "-c", command_.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        close(in[0]);
+        close(out[1]);
+        to_ = fdopen(in[1], "w");
+        from_ = fdopen(out[0], "r");
+        return to_ && from_;
+    }
+
+    bool decide(double t_s, std::map<int, SimGroup>& groups) override {
+        std::ostringstream o;
+        o << "tick\t" << t_s << "\n";
+        std::map<std::string, SimGroup*> by_name;
+        for (auto& [id, g] : groups) {
+            const auto& c = g.counters;
+            o << "group\t" << g.info.cgroup << "\t" << g.info.cpu_reserved << "\t" << g.info.mem_reserved << "\t"
+              << g.cpu_percent << "\t" << g.memory_high << "\t" << g.memory_max << "\t" << c.cpu_usage_us << "\t"
+              << c.cpu_nr_periods << "\t" << c.cpu_nr_throttled << "\t" << c.cpu_throttled_us << "\t"
+              << c.cpu_some_us << "\t" << c.memory_current << "\t" << c.mem_events_high << "\t"
+              << c.mem_events_max << "\t" << c.mem_events_oom_kill << "\n";
+            by_name[g.info.cgroup] = &g;
+        }
+        o << "end\n";
+        const std::string block = o.str();
+        if (std::fwrite(block.data(), 1, block.size(), to_) != block.size() || std::fflush(to_) != 0) {
+            std::cerr << name() << ": the policy went away\n";
+            return false;
+        }
+
+        char line[512];
+        while (std::fgets(line, sizeof(line), from_)) {
+            std::string l(line);
+            while (!l.empty() && (l.back() == '\n' || l.back() == '\r')) l.pop_back();
+            if (l == "end") return true;
+            std::istringstream in(l);
+            std::string group, file, value;
+            if (!std::getline(in, group, '\t') || !std::getline(in, file, '\t') || !std::getline(in, value)) {
+                std::cerr << name() << ": bad line: " << l << "\n";
+                continue;
+            }
+            auto it = by_name.find(group);
+            if (it == by_name.end()) continue;
+            SimGroup& g = *it->second;
+            const bool unlimited = value.compare(0, 3, "max") == 0;
+            if (file == "cpu.max") {
+                // "<quota> <period>" in microseconds
+                long long quota = 0, period = PERIOD_US;
+                if (unlimited) g.cpu_percent = g.info.cpu_burst > 0 ? g.info.cpu_burst : 100000;
+                else if (std::sscanf(value.c_str(), "%lld %lld", &quota, &period) >= 1 && period > 0)
+                    g.cpu_percent = std::max<long long>(1, quota * 100 / period);
+            } else if (file == "memory.high") {
+                g.memory_high = unlimited ? 0 : std::atoll(value.c_str());
+            } else if (file == "memory.max") {
+                g.memory_max = unlimited ? 0 : std::atoll(value.c_str());
+            }
+        }
+        std::cerr << name() << ": the policy exited mid-tick\n";
+        return false;
+    }
+
+private:
+    std::string command_;
+    pid_t pid_ = -1;
+    FILE* to_ = nullptr;
+    FILE* from_ = nullptr;
+};
+
+// ---- the replay ----
+
+struct Score {
+    double group_seconds = 0;
+    double throttled_s = 0;        // group-seconds spent throttled
+    double backlog = 0;            // core-seconds still queued at the end
+    double high_s = 0;             // group-seconds held at memory.high
+    uint64_t oom_kills = 0;
+    double cpu_reserved = 0;       // mean cpu.max, cores
+    double cpu_used = 0;           // mean CPU run, cores
+    double mem_reserved = 0;       // mean memory.max, MB
+    double mem_used = 0;           // mean memory.current, MB
+    uint64_t writes = 0;           // limit changes
+    std::vector<double> latency_us;
+    bool completed = true;
+};
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5))];
+}
+
+static Score replay(const Recording& rec, ReplayPolicy& policy) {
+    Score sc;
+    if (!policy.start()) {
+        sc.completed = false;
+        return sc;
+    }
+    std::map<int, SimGroup> live;
+    uint64_t t_ns = 0;
+    for (size_t t = 0; t < rec.ticks.size(); ++t) {
+        double dt_tick = rec.period_ms * 1000.0;
+        for (const Demand& d : rec.ticks[t]) {
+            auto it = live.find(d.id);
+            if (it == live.end()) {
+                SimGroup g;
+                auto info = rec.groups.find(d.id);
+                if (info != rec.groups.end()) g.info = info->second;
+                g.info.id = d.id;
+                if (g.info.cgroup.empty()) g.info.cgroup = "safebox_job_" + std::to_string(d.id);
+                if (g.info.cpu_reserved <= 0) g.info.cpu_reserved = 100;
+                g.cpu_percent = g.info.cpu_reserved;
+                g.memory_high = g.memory_max = g.info.mem_reserved;
+                auto& c = g.counters;
+                c.t_ns = t_ns;
+                c.cpu_usage_us = c.cpu_nr_periods = c.cpu_nr_throttled = c.cpu_throttled_us = 0;
+                c.memory_current = 0;
+                c.mem_events_high = c.mem_events_max = c.mem_events_oom_kill = 0;
+                c.cpu_some_us = c.mem_some_us = c.mem_full_us = 0;
+                it = live.emplace(d.id, g).first;
+                policy.add(it->second);
+            }
+            SimGroup& g = it->second;
+            auto& c = g.counters;
+            dt_tick = d.dt_us;
+
+            // CPU: the backlog runs up to the quota; the rest waits
+            const double want = g.backlog_us + d.cpu_us;
+            const double allowed = (double)g.cpu_percent * d.dt_us / 100.0;
+            const double ran = std::min(want, allowed);
+            g.backlog_us = want - ran;
+            const int64_t periods = std::max<int64_t>(1, (int64_t)(d.dt_us / PERIOD_US));
+            c.cpu_usage_us += (int64_t)ran;
+            if (want > 0) c.cpu_nr_periods += periods;
+            if (want > allowed) {
+                const double throttled = 1.0 - allowed / want;
+                c.cpu_nr_throttled += periods;
+                c.cpu_throttled_us += (int64_t)(throttled * d.dt_us * std::ceil(want / d.dt_us));
+                sc.throttled_s += throttled * d.dt_us / 1e6;
+            }
+
+            // Memory: held at memory.high, killed past memory.max
+            int64_t current = d.memory;
+            if (g.memory_max > 0 && current > g.memory_max) {
+                ++c.mem_events_max;
+                ++c.mem_events_oom_kill;
+                ++sc.oom_kills;
+                current = g.memory_max;
+            }
+            if (g.memory_high > 0 && current > g.memory_high) {
+                ++c.mem_events_high;
+                c.mem_some_us += (int64_t)(d.dt_us / 2);
+                sc.high_s += d.dt_us / 1e6;
+                current = g.memory_high;
+            }
+            c.memory_current = current;
+
+            sc.group_seconds += d.dt_us / 1e6;
+            sc.cpu_reserved += (double)g.cpu_percent / 100.0 * d.dt_us / 1e6;
+            sc.cpu_used += ran / 1e6;
+            sc.mem_reserved += (double)(g.memory_max > 0 ? g.memory_max : current) / MB * d.dt_us / 1e6;
+            sc.mem_used += (double)current / MB * d.dt_us / 1e6;
+        }
+        t_ns += (uint64_t)(dt_tick * 1000.0);
+        for (auto& [id, g] : live) g.counters.t_ns = t_ns;
+
+        // The policy's turn, timed
+        std::map<int, std::tuple<int64_t, int64_t, int64_t>> before;
+        for (const auto& [id, g] : live) before[id] = {g.cpu_percent, g.memory_high, g.memory_max};
+        const auto t0 = std::chrono::steady_clock::now();
+        const bool ok = policy.decide((double)t_ns / 1e9, live);
+        sc.latency_us.push_back(
+            (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count() /
+            1000.0);
+        if (!ok) {
+            sc.completed = false;
+            break;
+        }
+        for (const auto& [id, g] : live) {
+            const auto& [cpu, high, max] = before[id];
+            sc.writes += (g.cpu_percent != cpu) + (g.memory_high != high) + (g.memory_max != max);
+        }
+
+        for (int id : rec.exits[t]) {
+            auto it = live.find(id);
+            if (it == live.end()) continue;
+            sc.backlog += it->second.backlog_us / 1e6;
+            policy.remove(id);
+            live.erase(it);
+        }
+    }
+    for (const auto& [id, g] : live) sc.backlog += g.backlog_us / 1e6;
+    const double seconds = (double)t_ns / 1e9;
+    if (seconds > 0) {
+        sc.cpu_reserved /= seconds;
+        sc.cpu_used /= seconds;
+        sc.mem_reserved /= seconds;
+        sc.mem_used /= seconds;
+    }
+    return sc;
+}
+
+static void print_score(const std::string& name, const Score& s) {
+    const double throttled = s.group_seconds > 0 ? s.throttled_s / s.group_seconds : 0.0;
+    std::printf("%-12s throttled=%.1f%% (%.1f group-s) backlog=%.1f core-s memory.high=%.1f group-s oom_kills=%llu%s\n",
+                name.c_str(), 100 * throttled, s.throttled_s, s.backlog, s.high_s, (unsigned long long)s.oom_kills,
+                s.completed ? "" : " (incomplete)");
+    std::printf("%-12s cpu reserved=%.2f used=%.2f cores (%.0f%%) memory reserved=%.0f used=%.0f MB (%.0f%%)\n", "",
+                s.cpu_reserved, s.cpu_used, s.cpu_reserved > 0 ? 100 * s.cpu_used / s.cpu_reserved : 0.0,
+                s.mem_reserved, s.mem_used, s.mem_reserved > 0 ? 100 * s.mem_used / s.mem_reserved : 0.0);
+    std::printf("%-12s writes=%llu decision p50=%.1fus p99=%.1fus max=%.1fus\n", "", (unsigned long long)s.writes,
+                percentile(s.latency_us, 0.5), percentile(s.latency_us, 0.99), percentile(s.latency_us, 1.0));
+}
+
+static void print_json(const std::string& name, const Score& s) {
+    std::string escaped;
+    for (char ch : name) {
+        if (ch == '"' || ch == '\\') escaped += '\\';
+        escaped += ch;
+    }
+    std::printf("{\"policy\":\"%s\",\"completed\":%s,\"throttled_s\":%.3f,\"throttled\":%.4f,\"backlog\":%.3f,"
+                "\"memory_high_s\":%.3f,\"oom_kills\":%llu,\"cpu_reserved\":%.3f,\"cpu_used\":%.3f,"
+                "\"memory_reserved_mb\":%.1f,\"memory_used_mb\":%.1f,\"writes\":%llu,\"decision_p50_us\":%.2f,"
+                "\"decision_p99_us\":%.2f,\"decision_max_us\":%.2f}\n",
+                escaped.c_str(), s.completed ? "true" : "false", s.throttled_s,
+                s.group_seconds > 0 ? s.throttled_s / s.group_seconds : 0.0, s.backlog, s.high_s,
+                (unsigned long long)s.oom_kills, s.cpu_reserved, s.cpu_used, s.mem_reserved, s.mem_used,
+                (unsigned long long)s.writes, percentile(s.latency_us, 0.5), percentile(s.latency_us, 0.99),
+                percentile(s.latency_us, 1.0));
+}
+
+int main(int argc, char** argv) {
+    std::string trace, synth;
+    int groups = 16;
+    double seconds = 600;
+    unsigned seed = 1;
+    std::vector<std::string> builtin, commands;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) { usage(); std::exit(1); }
+            return argv[++i];
+        };
+        if (a == "--trace") trace = next();
+        else if (a == "--synthesize") synth = next();
+        else if (a == "--groups") groups = std::max(1, std::atoi(next()));
+        else if (a == "--seconds") seconds = std::max(1.0, std::atof(next()));
+        else if (a == "--seed") seed = (unsigned)std::atoi(next());
+        else if (a == "--policy") builtin.push_back(next());
+        else if (a == "--policy-cmd") commands.push_back(next());
+        else { usage(); return 1; }
+    }
+    if (!synth.empty()) return synthesize(synth, groups, seconds, seed);
+    if (trace.empty()) {
+        usage();
+        return 1;
+    }
+
+    Recording rec;
+    if (!load(trace, rec)) return 2;
+    if (rec.ticks.empty()) {
+        std::cerr << trace << ": no sweeps recorded\n";
+        return 2;
+    }
+    // A policy child that dies must not take the replay with it
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<ReplayPolicy>> policies;
+    if (builtin.empty() && commands.empty()) builtin = {"reserved", "controller"};
+    for (const auto& b : builtin) {
+        if (b == "reserved") policies.push_back(std::make_unique<ReservedPolicy>());
+        else if (b == "controller") policies.push_back(std::make_unique<ControllerPolicy>());
+        else {
+            std::cerr << "unknown policy " << b << " (reserved, controller, or --policy-cmd)\n";
+            return 1;
+        }
+    }
+    for (const auto& c : commands) policies.push_back(std::make_unique<CommandPolicy>(c));
+
+    std::printf("trace=%s groups=%zu ticks=%zu period=%dms\n", trace.c_str(), rec.groups.size(), rec.ticks.size(),
+                rec.period_ms);
+    std::vector<Score> scores;
+    for (auto& p : policies) {
+        scores.push_back(replay(rec, *p));
+        print_score(p->name(), scores.back());
+    }
+    int failed = 0;
+    for (size_t k = 0; k < policies.size(); ++k) {
+        print_json(policies[k]->name(), scores[k]);
+        failed += !scores[k].completed;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+#include "sampler.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+namespace safebox {
+
+static int open_ro(int dir_fd, const char* file) {
+    return openat(dir_fd, file, O_RDONLY | O_CLOEXEC);
+}
+
+// Whole file into buf (NUL-terminated); false if unreadable
+static bool pread_all(int fd, char* buf, size_t cap) {
+    if (fd < 0) return false;
+    ssize_t r = pread(fd, buf, cap - 1, 0);
+    if (r < 0) return false;
+    buf[r] = '\0';
+    return true;
+}
+
+// Value after "key " at the start of a line of a flat-keyed file
+static int64_t kv_field(const char* text, const char* key) {
+    const size_t n = std::strlen(key);
+    for (const char* p = text; p && *p;) {
+        if (std::strncmp(p, key, n) == 0 && p[n] == ' ') return std::strtoll(p + n + 1, nullptr, 10);
+        p = std::strchr(p, '\n');
+        if (p) ++p;
+    }
+    return -1;
+}
+
+void parse_pressure(const char* text, int64_t& some_us, int64_t& full_us) {
+    some_us = full_us = -1;
+    for (const char* p = text; p && *p;) {
+        const char* total = std::strstr(p, "total=");
+        const char* eol = std::strchr(p, '\n');
+        if (total && (!eol || total < eol)) {
+            int64_t v = std::strtoll(total + 6, nullptr, 10);
+            if (std::strncmp(p, "some", 4) == 0) some_us = v;
+            else if (std::strncmp(p, "full", 4) == 0) full_us = v;
+        }
+        p = eol ? eol + 1 : nullptr;
+    }
+}
+
+GroupProbe::GroupProbe(int group_fd) {
+    group_fd_ = fcntl(group_fd, F_DUPFD_CLOEXEC, 0);
+    if (group_fd_ < 0) return;
+    cpu_stat_ = open_ro(group_fd_, "cpu.stat");
+    mem_current_ = open_ro(group_fd_, "memory.current");
+    mem_events_ = open_ro(group_fd_, "memory.events");
+    mem_stat_ = open_ro(group_fd_, "memory.stat");
+    cpu_pressure_ = open_ro(group_fd_, "cpu.pressure");
+    mem_pressure_ = open_ro(group_fd_, "memory.pressure");
+}
+
+GroupProbe::~GroupProbe() {
+    close_all();
+}
+
+void GroupProbe::close_all() {
+    for (int* fd : {&cpu_stat_, &mem_current_, &mem_events_, &mem_stat_, &cpu_pressure_, &mem_pressure_, &mem_trigger_,
+                    &group_fd_}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+}
+
+GroupProbe::GroupProbe(GroupProbe&& other) noexcept {
+    *this = std::move(other);
+}
+
+GroupProbe& GroupProbe::operator=(GroupProbe&& other) noexcept {
+    if (this != &other) {
+        close_all();
+        group_fd_ = std::exchange(other.group_fd_, -1);
+        cpu_stat_ = std::exchange(other.cpu_stat_, -1);
+        mem_current_ = std::exchange(other.mem_current_, -1);
+        mem_events_ = std::exchange(other.mem_events_, -1);
+        mem_stat_ = std::exchange(other.mem_stat_, -1);
+        cpu_pressure_ = std::exchange(other.cpu_pressure_, -1);
+        mem_pressure_ = std::exchange(other.mem_pressure_, -1);
+        mem_trigger_ = std::exchange(other.mem_trigger_, -1);
+    }
+    return *this;
+}
+
+bool GroupProbe::sample(GroupSample& out, bool memory_stat) const {
+    out = GroupSample{};
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    out.t_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+    char buf[1024];
+    bool any = false;
+    if (pread_all(cpu_stat_, buf, sizeof(buf))) {
+        out.cpu_usage_us = kv_field(buf, "usage_usec");
+        out.cpu_nr_periods = kv_field(buf, "nr_periods");
+        out.cpu_nr_throttled = kv_field(buf, "nr_throttled");
+        out.cpu_throttled_us = kv_field(buf, "throttled_usec");
+        any = true;
+    }
+    if (pread_all(mem_current_, buf, sizeof(buf))) {
+        out.memory_current = std::strtoll(buf, nullptr, 10);
+        any = true;
+    }
+    if (pread_all(mem_events_, buf, sizeof(buf))) {
+        out.mem_events_high = kv_field(buf, "high");
+        out.mem_events_max = kv_field(buf, "max");
+        out.mem_events_oom_kill = kv_field(buf, "oom_kill");
+    }
+    if (memory_stat) {
+        // A few KB on current kernels
+        char stat[8192];
+        if (pread_all(mem_stat_, stat, sizeof(stat))) {
+            const int64_t anon = kv_field(stat, "inactive_anon"), file = kv_field(stat, "inactive_file");
+            if (anon >= 0 && file >= 0) out.mem_inactive = anon + file;
+            // Split into _anon/_file since 5.9
+            const int64_t ra = kv_field(stat, "workingset_refault_anon");
+            const int64_t rf = kv_field(stat, "workingset_refault_file");
+            out.mem_refault = ra >= 0 && rf >= 0 ? ra + rf : kv_field(stat, "workingset_refault");
+        }
+    }
+    int64_t unused;
+    if (pread_all(cpu_pressure_, buf, sizeof(buf))) parse_pressure(buf, out.cpu_some_us, unused);
+    if (pread_all(mem_pressure_, buf, sizeof(buf))) parse_pressure(buf, out.mem_some_us, out.mem_full_us);
+    return any;
+}
+
+int GroupProbe::arm_memory_trigger(const std::string& trigger) {
+    if (mem_trigger_ >= 0 || group_fd_ < 0) return mem_trigger_;
+    // A trigger lives as long as the fd it was written to
+    int fd = openat(group_fd_, "memory.pressure", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (::write(fd, trigger.c_str(), trigger.size() + 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    mem_trigger_ = fd;
+    return fd;
+}
+
+}  // namespace safebox
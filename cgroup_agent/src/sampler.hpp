@@ -0,0 +1,78 @@
+// sampler.hpp - cheap repeated reads of one cgroup's usage and pressure.
+//
+// A GroupProbe opens the control files it needs once and re-reads them
+// with pread(), so a 100 ms control loop costs one syscall per file per
+// tick instead of an openat/read/close each. Files the host does not
+// provide (no controller, fake root) stay closed and their fields read -1.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace safebox {
+
+// Cumulative counters, as the kernel reports them; controllers diff them
+struct GroupSample {
+    uint64_t t_ns = 0;               // CLOCK_MONOTONIC at the read
+
+    // cpu.stat
+    int64_t cpu_usage_us = -1;
+    int64_t cpu_nr_periods = -1;
+    int64_t cpu_nr_throttled = -1;
+    int64_t cpu_throttled_us = -1;
+
+    // memory.current / memory.events
+    int64_t memory_current = -1;     // bytes
+    int64_t mem_events_high = -1;
+    int64_t mem_events_max = -1;
+    int64_t mem_events_oom_kill = -1;
+
+    // memory.stat, only when asked for: the reclaim policy's inputs
+    int64_t mem_inactive = -1;       // inactive_anon + inactive_file, bytes
+    int64_t mem_refault = -1;        // workingset_refault_anon + _file, pages
+
+    // PSI "total=" stall time, microseconds
+    int64_t cpu_some_us = -1;
+    int64_t mem_some_us = -1;
+    int64_t mem_full_us = -1;
+};
+
+class GroupProbe {
+public:
+    GroupProbe() = default;
+    // dup()s group_fd; the caller keeps its own
+    explicit GroupProbe(int group_fd);
+    ~GroupProbe();
+
+    GroupProbe(GroupProbe&& other) noexcept;
+    GroupProbe& operator=(GroupProbe&& other) noexcept;
+    GroupProbe(const GroupProbe&) = delete;
+    GroupProbe& operator=(const GroupProbe&) = delete;
+
+    int group_fd() const { return group_fd_; }
+    // memory.stat is costlier than the rest to produce, so it is only read
+    // when `memory_stat` is set
+    bool sample(GroupSample& out, bool memory_stat = false) const;
+
+    // Arm a PSI trigger ("some 100000 1000000") on memory.pressure; returns
+    // an fd that polls POLLPRI when it fires, or -1. Owned by the probe.
+    int arm_memory_trigger(const std::string& trigger);
+
+private:
+    void close_all();
+
+    int group_fd_ = -1;
+    int cpu_stat_ = -1;
+    int mem_current_ = -1;
+    int mem_events_ = -1;
+    int mem_stat_ = -1;
+    int cpu_pressure_ = -1;
+    int mem_pressure_ = -1;
+    int mem_trigger_ = -1;
+};
+
+// "some avg10=0.00 avg60=0.00 avg300=0.00 total=1234" -> some/full totals
+void parse_pressure(const char* text, int64_t& some_us, int64_t& full_us);
+
+}  // namespace safebox
@@ -0,0 +1,330 @@
+// safebox-sandbox-bench - what the sandbox and cgroup limits cost each
+// workload in src/.
+//
+// Every workload runs under three conditions through the executor's own
+// Launcher (the in-process `safebox`):
+//
+//   native    plain fork/exec, no namespaces, seccomp or privilege drop
+//   sandbox   PID/UTS/mount namespaces, drop to nobody, seccomp filter
+//   limits    sandbox, cloned into a cgroup with cpu.max and memory.max
+//
+// Each combination gets --warmup untimed runs and then --runs timed ones,
+// interleaved across the conditions so drift on the host lands on all
+// three alike. A run's wall time is launch to reap, its CPU time the
+// child's rusage, and its throughput the ops/s, IOPS or MB/s from the
+// workload's JSON result line where it prints one. Results are mean,
+// standard deviation and 95% confidence interval (Student's t), plus the
+// change against native with the intervals combined. --out writes them as JSON, tagged with
+// --label (make bench uses the commit), to diff across commits. A condition
+// that could not run, or whose workload failed in any run, is reported in
+// the JSON as {"workload", "condition", "error"} instead of its numbers.
+//
+//   safebox-sandbox-bench --apps src --runs 10 --out bench.json
+//   safebox-sandbox-bench --apps src --workloads cpu_intensive,quick_job
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cgroup_fs.hpp"
+#include "json_util.hpp"
+#include "launcher.hpp"
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  safebox-sandbox-bench [--apps <dir>] [--workloads <a,b,..>] [--runs <n>] [--warmup <n>]\n"
+              << "                        [--cpu <percent>] [--memory <mb>] [--cgroup-root <dir>]\n"
+              << "                        [--out <file.json>] [--label <text>]\n";
+}
+
+struct Workload {
+    const char* name;
+    std::vector<std::string> args;   // short, fixed-size runs
+};
+
+// Fixed work where the workload has it, so wall time is comparable
+static const std::vector<Workload> WORKLOADS = {
+    {"cpu_intensive", {"--kernel", "scalar", "--work", "300"}},
+    {"io_intensive", {"--mode", "direct", "--rw", "write", "--pattern", "rand", "--size", "16m", "--seconds", "1"}},
+    {"memory_intensive", {"--mode", "seq", "--mb", "64", "--seconds", "1"}},
+    {"quick_job", {"100000"}},
+    {"sleep_job", {"1"}},
+};
+
+enum Condition { NATIVE, SANDBOX, LIMITS, CONDITIONS };
+static const char* CONDITION_NAMES[CONDITIONS] = {"native", "sandbox", "limits"};
+
+struct Run {
+    double wall_s = 0;
+    double cpu_s = 0;
+    double throughput = -1;   // -1 => the workload reports none
+};
+
+struct Summary {
+    size_t n = 0;
+    double mean = 0;
+    double sd = 0;
+    double ci95 = 0;   // half-width
+};
+
+// Two-sided 95% Student's t for n-1 degrees of freedom
+static double t95(size_t n) {
+    static const double T[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                               2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                               2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (n < 2) return 0;
+    return n - 1 <= 30 ? T[n - 2] : 1.96;
+}
+
+static Summary summarize(const std::vector<double>& v) {
+    Summary s;
+    s.n = v.size();
+    if (v.empty()) return s;
+    for (double x : v) s.mean += x;
+    s.mean /= (double)v.size();
+    for (double x : v) s.sd += (x - s.mean) * (x - s.mean);
+    s.sd = v.size() > 1 ? std::sqrt(s.sd / (double)(v.size() - 1)) : 0;
+    s.ci95 = t95(v.size()) * s.sd / std::sqrt((double)v.size());
+    return s;
+}
+
+// Percent change of b against a, and the half-width of its 95% interval
+// from both relative errors
+static std::pair<double, double> delta_pct(const Summary& a, const Summary& b) {
+    if (a.n == 0 || b.n == 0 || a.mean == 0 || b.mean == 0) return {0, 0};
+    const double r = b.mean / a.mean;
+    return {100.0 * (r - 1), 100.0 * r * std::hypot(a.ci95 / a.mean, b.ci95 / b.mean)};
+}
+
+// The first of ops_per_sec / iops / mb_per_sec in the output's last JSON line
+static double throughput_of(const std::string& out, std::string& metric) {
+    size_t start = out.rfind("\n{");
+    start = start == std::string::npos ? (out.rfind('{', 0) == 0 ? 0 : std::string::npos) : start + 1;
+    if (start == std::string::npos) return -1;
+    for (const char* key : {"ops_per_sec", "iops", "mb_per_sec"}) {
+        const std::string k = std::string("\"") + key + "\":";
+        size_t at = out.find(k, start);
+        if (at == std::string::npos) continue;
+        metric = key;
+        return std::strtod(out.c_str() + at + k.size(), nullptr);
+    }
+    return -1;
+}
+
+// Launch, collect stdout, reap; false if it could not start or exited non-zero
+static bool run_once(safebox::Launcher& launcher, const safebox::LaunchSpec& spec, Run& run, std::string& metric,
+                     std::string& error) {
+    const auto t0 = std::chrono::steady_clock::now();
+    safebox::LaunchedProcess p;
+    if (int err = launcher.launch(spec, p)) {
+        error = std::string("launch: ") + std::strerror(err);
+        return false;
+    }
+    std::string out;
+    char buf[4096];
+    pollfd fds[2] = {{p.stdout_fd, POLLIN, 0}, {p.stderr_fd, POLLIN, 0}};
+    for (int open = 2; open > 0;) {
+        if (poll(fds, 2, -1) < 0) break;
+        for (pollfd& f : fds) {
+            if (f.fd < 0 || !(f.revents & (POLLIN | POLLHUP))) continue;
+            ssize_t n = read(f.fd, buf, sizeof(buf));
+            if (n > 0 && f.fd == p.stdout_fd) out.append(buf, (size_t)n);
+            if (n <= 0) {
+                f.fd = -1;
+                --open;
+            }
+        }
+    }
+    int status = 0;
+    struct rusage ru {};
+    wait4(p.pid, &status, 0, &ru);
+    run.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    run.cpu_s = (double)ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + (double)ru.ru_stime.tv_sec +
+                ru.ru_stime.tv_usec / 1e6;
+    run.throughput = throughput_of(out, metric);
+    safebox::close_process_fds(p);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        error = "exited with status " + std::to_string(status);
+        return false;
+    }
+    return true;
+}
+
+static std::string summary_json(const Summary& s) {
+    char b[160];
+    std::snprintf(b, sizeof(b), "{\"n\":%zu,\"mean\":%.6g,\"sd\":%.6g,\"ci95\":%.6g}", s.n, s.mean, s.sd, s.ci95);
+    return b;
+}
+
+int main(int argc, char** argv) {
+    std::string apps = "src", out_path, label, cgroup_root = safebox::CgroupFs::default_root();
+    std::vector<std::string> only;
+    int runs = 10, warmup = 2, cpu_percent = 100, memory_mb = 512;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) { usage(); std::exit(1); }
+            return argv[++i];
+        };
+        if (a == "--apps") apps = next();
+        else if (a == "--runs") runs = std::max(1, std::atoi(next()));
+        else if (a == "--warmup") warmup = std::max(0, std::atoi(next()));
+        else if (a == "--cpu") cpu_percent = std::max(1, std::atoi(next()));
+        else if (a == "--memory") memory_mb = std::max(1, std::atoi(next()));
+        else if (a == "--cgroup-root") cgroup_root = next();
+        else if (a == "--out") out_path = next();
+        else if (a == "--label") label = next();
+        else if (a == "--workloads") {
+            std::stringstream ss(next());
+            for (std::string w; std::getline(ss, w, ',');) only.push_back(w);
+        } else { usage(); return 1; }
+    }
+
+    safebox::Launcher native(false), sandboxed(true);
+    safebox::Launcher* launchers[CONDITIONS] = {&native, &sandboxed, &sandboxed};
+    bool enabled[CONDITIONS] = {true, geteuid() == 0, geteuid() == 0};
+    std::string disabled[CONDITIONS];   // why a condition does not run
+    if (!enabled[SANDBOX]) {
+        std::cerr << "⚠️  Warning: not root, sandbox and limits runs are skipped\n";
+        disabled[SANDBOX] = disabled[LIMITS] = "skipped: needs root";
+    }
+
+    // One group for every limits run, emptied between them
+    safebox::CgroupFs cg(cgroup_root);
+    const std::string group = "safebox_bench_" + std::to_string(getpid());
+    int group_fd = -1;
+    if (enabled[LIMITS]) {
+        group_fd = cg.is_cgroupfs() ? cg.create(group) : -1;
+        if (group_fd < 0 || !cg.set_cpu_max(group_fd, (int64_t)cpu_percent * 1000, 100000) ||
+            !cg.set_memory_max(group_fd, (int64_t)memory_mb * 1024 * 1024)) {
+            std::cerr << "⚠️  Warning: cannot set limits on a group under " << cgroup_root
+                      << ", limits runs are skipped\n";
+            enabled[LIMITS] = false;
+            disabled[LIMITS] = "skipped: cannot set limits under " + cgroup_root;
+        }
+    }
+
+    struct utsname uts {};
+    uname(&uts);
+    std::ostringstream json;
+    json << "{\"label\":\"" << safebox::json_escape(label) << "\",\"kernel\":\"" << safebox::json_escape(uts.release)
+         << "\",\"cpus\":" << sysconf(_SC_NPROCESSORS_ONLN) << ",\"runs\":" << runs << ",\"warmup\":" << warmup
+         << ",\"limits\":{\"cpu_percent\":" << cpu_percent << ",\"memory_mb\":" << memory_mb << "},\"results\":[";
+    bool first_result = true;
+
+    std::printf("%-17s %-8s %16s %16s %20s %12s %12s %12s\n", "workload", "cond", "wall s (±95%)", "cpu s (±95%)",
+                "throughput (±95%)", "wall Δ%", "cpu Δ%", "tput Δ%");
+    for (const Workload& w : WORKLOADS) {
+        if (!only.empty() && std::find(only.begin(), only.end(), w.name) == only.end()) continue;
+        safebox::LaunchSpec spec;
+        spec.path = apps + "/" + w.name;
+        spec.args = w.args;
+        if (access(spec.path.c_str(), X_OK) != 0) {
+            std::cerr << "⚠️  Warning: " << spec.path << " is missing (make build-c), skipped\n";
+            continue;
+        }
+        std::vector<double> wall[CONDITIONS], cpu[CONDITIONS], tput[CONDITIONS];
+        std::string metric, error[CONDITIONS];
+        for (int c = 0; c < CONDITIONS; ++c) error[c] = disabled[c];
+        for (int r = -warmup; r < runs; ++r) {
+            for (int c = 0; c < CONDITIONS; ++c) {
+                if (!error[c].empty()) continue;
+                spec.cgroup_fd = c == LIMITS ? group_fd : -1;
+                Run run;
+                if (!run_once(*launchers[c], spec, run, metric, error[c])) {
+                    std::cerr << "⚠️  Warning: " << w.name << " (" << CONDITION_NAMES[c] << "): " << error[c] << "\n";
+                    continue;
+                }
+                if (c == LIMITS) cg.wait_empty(group_fd, 1000);
+                if (r < 0) continue;
+                wall[c].push_back(run.wall_s);
+                cpu[c].push_back(run.cpu_s);
+                if (run.throughput >= 0) tput[c].push_back(run.throughput);
+            }
+        }
+        Summary base[3];
+        for (int c = 0; c < CONDITIONS; ++c) {
+            // A failed run leaves the condition's numbers incomplete: report
+            // the failure in their place
+            if (!error[c].empty()) {
+                std::printf("%-17s %-8s %s\n", w.name, CONDITION_NAMES[c], error[c].c_str());
+                json << (first_result ? "" : ",") << "{\"workload\":\"" << w.name << "\",\"condition\":\""
+                     << CONDITION_NAMES[c] << "\",\"error\":\"" << safebox::json_escape(error[c]) << "\"}";
+                first_result = false;
+                continue;
+            }
+            if (wall[c].empty()) continue;
+            const Summary sw = summarize(wall[c]), sc = summarize(cpu[c]), st = summarize(tput[c]);
+            if (c == NATIVE) {
+                base[0] = sw;
+                base[1] = sc;
+                base[2] = st;
+            }
+            const auto dw = delta_pct(base[0], sw), dc = delta_pct(base[1], sc), dt = delta_pct(base[2], st);
+            const bool compared = c != NATIVE && base[0].n;
+            char t[32] = "-", dws[32] = "-", dcs[32] = "-", dts[32] = "-";
+            if (st.n) std::snprintf(t, sizeof(t), "%.4g ±%.2g", st.mean, st.ci95);
+            if (compared) {
+                std::snprintf(dws, sizeof(dws), "%+.1f±%.1f", dw.first, dw.second);
+                std::snprintf(dcs, sizeof(dcs), "%+.1f±%.1f", dc.first, dc.second);
+            }
+            if (compared && st.n && base[2].n) std::snprintf(dts, sizeof(dts), "%+.1f±%.1f", dt.first, dt.second);
+            std::printf("%-17s %-8s %9.4f ±%.4f %9.4f ±%.4f %20s %12s %12s %12s\n", w.name, CONDITION_NAMES[c],
+                        sw.mean, sw.ci95, sc.mean, sc.ci95, t, dws, dcs, dts);
+
+            json << (first_result ? "" : ",") << "{\"workload\":\"" << w.name << "\",\"condition\":\""
+                 << CONDITION_NAMES[c] << "\",\"wall_s\":" << summary_json(sw) << ",\"cpu_s\":" << summary_json(sc)
+                 << ",\"throughput\":";
+            if (st.n) json << "{\"metric\":\"" << metric << "\",\"summary\":" << summary_json(st) << "}";
+            else json << "null";
+            json << ",\"vs_native\":";
+            if (compared) {
+                char d[256];
+                std::snprintf(d, sizeof(d), "{\"wall_pct\":%.3f,\"wall_ci95\":%.3f,\"cpu_pct\":%.3f,\"cpu_ci95\":%.3f",
+                              dw.first, dw.second, dc.first, dc.second);
+                json << d;
+                if (st.n && base[2].n) {
+                    std::snprintf(d, sizeof(d), ",\"throughput_pct\":%.3f,\"throughput_ci95\":%.3f", dt.first,
+                                  dt.second);
+                    json << d;
+                }
+                json << "}";
+            } else {
+                json << "null";
+            }
+            json << "}";
+            first_result = false;
+        }
+    }
+    json << "]}";
+
+    if (group_fd >= 0) {
+        close(group_fd);
+        cg.remove(group);
+    }
+    std::printf("%s\n", json.str().c_str());
+    if (!out_path.empty()) {
+        FILE* f = std::fopen(out_path.c_str(), "w");
+        if (!f) {
+            std::perror(out_path.c_str());
+            return 1;
+        }
+        std::fprintf(f, "%s\n", json.str().c_str());
+        std::fclose(f);
+        std::printf("results written to %s\n", out_path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "trace_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace safebox {
+
+static const char MAGIC[8] = {'S', 'B', 'T', 'R', 'A', 'C', 'E', '1'};
+static const uint32_t VERSION = 1;
+static const size_t FLUSH_AT = 64 * 1024;
+
+// Every delta-coded field of a sample, in file order
+#define TRACE_SAMPLE_FIELDS(X)                                                                         \
+    X(sample.cpu_usage_us) X(sample.cpu_nr_periods) X(sample.cpu_nr_throttled) X(sample.cpu_throttled_us) \
+    X(sample.memory_current) X(sample.mem_events_high) X(sample.mem_events_max)                          \
+    X(sample.mem_events_oom_kill) X(sample.mem_inactive) X(sample.mem_refault) X(sample.cpu_some_us)     \
+    X(sample.mem_some_us) X(sample.mem_full_us) X(limits.cpu_percent) X(limits.memory_high)              \
+    X(limits.memory_max)
+
+static void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+static void put_svarint(std::string& out, int64_t v) {
+    put_varint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out += (char)(v >> (8 * i));
+}
+
+TraceWriter::~TraceWriter() {
+    if (!f_) return;
+    flush();
+    std::fclose(f_);
+}
+
+bool TraceWriter::open(const std::string& path, int period_ms) {
+    f_ = std::fopen(path.c_str(), "wb");
+    if (!f_) {
+        std::cerr << "⚠️  Warning: cannot write trace " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    buf_.assign(MAGIC, sizeof(MAGIC));
+    put_u32(buf_, VERSION);
+    put_u32(buf_, (uint32_t)period_ms);
+    return flush();
+}
+
+void TraceWriter::group(const TraceGroupInfo& g) {
+    if (!f_) return;
+    buf_ += 'G';
+    put_varint(buf_, (uint64_t)g.id);
+    put_varint(buf_, g.cgroup.size());
+    buf_ += g.cgroup;
+    put_svarint(buf_, g.cpu_reserved);
+    put_svarint(buf_, g.cpu_floor);
+    put_svarint(buf_, g.cpu_burst);
+    put_svarint(buf_, g.mem_reserved);
+    put_svarint(buf_, g.mem_floor);
+    // Deltas start from an all-missing sample
+    last_[g.id] = Last{};
+}
+
+void TraceWriter::tick(uint64_t t_ns) {
+    if (!f_) return;
+    buf_ += 'T';
+    put_varint(buf_, t_ns);
+}
+
+void TraceWriter::sample(int id, const GroupSample& s, const TraceLimits& limits) {
+    if (!f_) return;
+    Last& last = last_[id];
+    buf_ += 'S';
+    put_varint(buf_, (uint64_t)id);
+    put_svarint(buf_, (int64_t)(s.t_ns - last.sample.t_ns));
+    const Last now{s, limits};
+#define PUT(field) put_svarint(buf_, now.field - last.field);
+    TRACE_SAMPLE_FIELDS(PUT)
+#undef PUT
+    last = now;
+    if (buf_.size() >= FLUSH_AT) flush();
+}
+
+void TraceWriter::exit(int id) {
+    if (!f_) return;
+    buf_ += 'X';
+    put_varint(buf_, (uint64_t)id);
+    last_.erase(id);
+}
+
+bool TraceWriter::flush() {
+    if (!f_ || buf_.empty()) return f_ != nullptr;
+    const bool ok = std::fwrite(buf_.data(), 1, buf_.size(), f_) == buf_.size() && std::fflush(f_) == 0;
+    bytes_ += buf_.size();
+    buf_.clear();
+    if (!ok) {
+        std::cerr << "⚠️  Warning: trace write failed: " << std::strerror(errno) << "; recording stops\n";
+        std::fclose(f_);
+        f_ = nullptr;
+    }
+    return ok;
+}
+
+TraceReader::~TraceReader() {
+    if (f_) std::fclose(f_);
+}
+
+bool TraceReader::open(const std::string& path) {
+    f_ = std::fopen(path.c_str(), "rb");
+    if (!f_) {
+        error_ = path + ": " + std::strerror(errno);
+        return false;
+    }
+    unsigned char h[16];
+    if (std::fread(h, 1, sizeof(h), f_) != sizeof(h) || std::memcmp(h, MAGIC, sizeof(MAGIC)) != 0) {
+        error_ = path + ": not a safebox trace";
+        return false;
+    }
+    const uint32_t version = h[8] | h[9] << 8 | h[10] << 16 | (uint32_t)h[11] << 24;
+    if (version != VERSION) {
+        error_ = path + ": trace version " + std::to_string(version) + ", expected " + std::to_string(VERSION);
+        return false;
+    }
+    period_ms_ = (int)(h[12] | h[13] << 8 | h[14] << 16 | (uint32_t)h[15] << 24);
+    return true;
+}
+
+bool TraceReader::varint(uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const int c = std::getc(f_);
+        if (c == EOF) return false;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+bool TraceReader::svarint(int64_t& v) {
+    uint64_t u;
+    if (!varint(u)) return false;
+    v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return true;
+}
+
+bool TraceReader::next(TraceRecord& r) {
+    if (!f_) return false;
+    const int kind = std::getc(f_);
+    if (kind == EOF) return false;
+    uint64_t u = 0;
+    int64_t v = 0;
+    bool ok = true;
+    r.kind = (char)kind;
+    switch (kind) {
+    case 'G': {
+        ok = varint(u);
+        r.id = (int)u;
+        TraceGroupInfo g;
+        g.id = r.id;
+        uint64_t len = 0;
+        ok = ok && varint(len) && len < 4096;
+        if (ok) {
+            g.cgroup.resize(len);
+            ok = std::fread(g.cgroup.data(), 1, len, f_) == len;
+        }
+        ok = ok && svarint(v);
+        g.cpu_reserved = (int)v;
+        ok = ok && svarint(v);
+        g.cpu_floor = (int)v;
+        ok = ok && svarint(v);
+        g.cpu_burst = (int)v;
+        ok = ok && svarint(g.mem_reserved) && svarint(g.mem_floor);
+        r.group = g;
+        last_[r.id] = TraceRecord{};
+        break;
+    }
+    case 'T':
+        ok = varint(r.t_ns);
+        break;
+    case 'S': {
+        ok = varint(u);
+        r.id = (int)u;
+        TraceRecord& last = last_[r.id];
+        ok = ok && svarint(v);
+        r.sample.t_ns = last.sample.t_ns + (uint64_t)v;
+#define GET(field) ok = ok && svarint(v); r.field = last.field + v;
+        TRACE_SAMPLE_FIELDS(GET)
+#undef GET
+        last.sample = r.sample;
+        last.limits = r.limits;
+        break;
+    }
+    case 'X':
+        ok = varint(u);
+        r.id = (int)u;
+        last_.erase(r.id);
+        break;
+    default:
+        error_ = "unknown record '" + std::string(1, (char)kind) + "'";
+        return false;
+    }
+    if (!ok) error_ = "truncated record '" + std::string(1, (char)kind) + "'";
+    return ok;
+}
+
+}  // namespace safebox
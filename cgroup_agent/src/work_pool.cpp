@@ -0,0 +1,241 @@
+#include "work_pool.hpp"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace safebox {
+
+static thread_local int tls_worker = -1;
+
+int WorkStealingPool::current() {
+    return tls_worker;
+}
+
+// "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+static std::vector<int> parse_cpulist(const std::string& s) {
+    std::vector<int> out;
+    const char* p = s.c_str();
+    while (*p) {
+        char* end = nullptr;
+        long a = std::strtol(p, &end, 10);
+        if (end == p) break;
+        long b = a;
+        p = end;
+        if (*p == '-') {
+            b = std::strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long c = a; c <= b; ++c) out.push_back((int)c);
+        if (*p == ',') ++p;
+    }
+    return out;
+}
+
+static long read_long(const std::string& path, long fallback) {
+    std::ifstream f(path);
+    long v;
+    return f >> v ? v : fallback;
+}
+
+// package and core_id folded into one key; SMT siblings share it
+static int physical_core(int cpu) {
+    const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+    long core = read_long(dir + "core_id", cpu);
+    long pkg = read_long(dir + "physical_package_id", 0);
+    return (int)(pkg * 4096 + core);
+}
+
+// "Node 0 MemTotal:  16318412 kB"
+static long read_node_memory_mb(int node) {
+    std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/meminfo");
+    std::string line;
+    while (std::getline(f, line)) {
+        size_t k = line.find("MemTotal:");
+        if (k != std::string::npos) return std::strtol(line.c_str() + k + 9, nullptr, 10) / 1024;
+    }
+    return 0;
+}
+
+CpuTopology CpuTopology::detect() {
+    CpuTopology t;
+    std::map<int, int> node_of_cpu;
+    if (DIR* d = opendir("/sys/devices/system/node")) {
+        while (struct dirent* e = readdir(d)) {
+            if (std::strncmp(e->d_name, "node", 4) != 0 || !std::isdigit((unsigned char)e->d_name[4])) continue;
+            int node = std::atoi(e->d_name + 4);
+            std::ifstream f(std::string("/sys/devices/system/node/") + e->d_name + "/cpulist");
+            std::string list;
+            if (!std::getline(f, list)) continue;
+            for (int c : parse_cpulist(list)) node_of_cpu[c] = node;
+            t.nodes = std::max(t.nodes, node + 1);
+        }
+        closedir(d);
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (!CPU_ISSET(c, &set)) continue;
+            t.cpus.push_back(c);
+            auto it = node_of_cpu.find(c);
+            t.node_of.push_back(it == node_of_cpu.end() ? 0 : it->second);
+            t.core_of.push_back(physical_core(c));
+        }
+    }
+    if (t.cpus.empty()) {
+        t.cpus.push_back(0);
+        t.node_of.push_back(0);
+        t.core_of.push_back(0);
+    }
+    for (int n = 0; n < t.nodes; ++n) t.node_memory_mb.push_back(read_node_memory_mb(n));
+    return t;
+}
+
+WorkStealingPool::WorkStealingPool(int workers, bool pin) : topo_(CpuTopology::detect()) {
+    workers = std::max(1, workers);
+    for (int i = 0; i < workers; ++i) {
+        auto w = std::make_unique<Worker>();
+        size_t slot = (size_t)i % topo_.cpus.size();
+        w->cpu = pin ? topo_.cpus[slot] : -1;
+        w->node = topo_.node_of[slot];
+        workers_.push_back(std::move(w));
+    }
+    // Victim order: same node, then remote, each rotated to start just
+    // after the thief so workers don't all raid worker 0 first
+    for (int i = 0; i < workers; ++i) {
+        std::vector<int> local, remote;
+        for (int k = 1; k < workers; ++k) {
+            int v = (i + k) % workers;
+            (workers_[v]->node == workers_[i]->node ? local : remote).push_back(v);
+        }
+        workers_[i]->victims = local;
+        workers_[i]->victims.insert(workers_[i]->victims.end(), remote.begin(), remote.end());
+    }
+    for (int i = 0; i < workers; ++i) {
+        workers_[i]->thread = std::thread(&WorkStealingPool::run, this, i);
+        if (workers_[i]->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(workers_[i]->cpu, &set);
+            pthread_setaffinity_np(workers_[i]->thread.native_handle(), sizeof(set), &set);
+        }
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lk(park_mu_);
+        stop_ = true;
+    }
+    park_cv_.notify_all();
+    for (auto& w : workers_) w->thread.join();
+}
+
+int WorkStealingPool::least_loaded() const {
+    const int n = size();
+    int start = (int)(rr_.fetch_add(1, std::memory_order_relaxed) % (unsigned)n);
+    int best = start;
+    int best_load = workers_[start]->load.load(std::memory_order_relaxed);
+    for (int k = 1; k < n && best_load > 0; ++k) {
+        int i = (start + k) % n;
+        int l = workers_[i]->load.load(std::memory_order_relaxed);
+        if (l < best_load) {
+            best = i;
+            best_load = l;
+        }
+    }
+    return best;
+}
+
+int WorkStealingPool::push(int worker, Task task) {
+    if (worker < 0 || worker >= size()) worker = least_loaded();
+    Worker& w = *workers_[worker];
+    w.load.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lk(w.mu);
+        w.q.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    // Pairs with the sleeping_ increment in run(): either the parked worker
+    // sees queued_ > 0 or we see it asleep and wake it
+    if (sleeping_.load() > 0) {
+        { std::lock_guard<std::mutex> lk(park_mu_); }
+        park_cv_.notify_one();
+    }
+    return worker;
+}
+
+bool WorkStealingPool::pop_own(Worker& w, Task& out) {
+    std::lock_guard<std::mutex> lk(w.mu);
+    if (w.q.empty()) return false;
+    out = std::move(w.q.back());
+    w.q.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(int self, Task& out) {
+    Worker& me = *workers_[self];
+    for (int v : me.victims) {
+        Worker& victim = *workers_[v];
+        if (victim.load.load(std::memory_order_relaxed) == 0) continue;
+        {
+            std::unique_lock<std::mutex> lk(victim.mu, std::try_to_lock);
+            if (!lk.owns_lock() || victim.q.empty()) continue;
+            out = std::move(victim.q.front());
+            victim.q.pop_front();
+        }
+        // The task now runs here; move its load over
+        victim.load.fetch_sub(1);
+        me.load.fetch_add(1);
+        (victim.node == me.node ? me.stolen_local : me.stolen_remote).fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::run(int self) {
+    Worker& me = *workers_[self];
+    tls_worker = self;
+    Task task;
+    for (;;) {
+        if (pop_own(me, task) || steal(self, task)) {
+            queued_.fetch_sub(1);
+            task();
+            task = nullptr;
+            me.load.fetch_sub(1);
+            me.executed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(park_mu_);
+        sleeping_.fetch_add(1);
+        // queued_ can read > 0 for a task another worker is just taking, or
+        // one behind a contended try_lock; either way one more pass is cheap
+        park_cv_.wait_for(lk, std::chrono::milliseconds(10), [&] { return queued_.load() > 0 || stop_; });
+        sleeping_.fetch_sub(1);
+        if (stop_ && queued_.load() == 0) return;
+    }
+}
+
+WorkStealingPool::Stats WorkStealingPool::stats() const {
+    Stats s;
+    for (const auto& w : workers_) {
+        s.executed += w->executed.load(std::memory_order_relaxed);
+        s.stolen_local += w->stolen_local.load(std::memory_order_relaxed);
+        s.stolen_remote += w->stolen_remote.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+}  // namespace safebox
@@ -0,0 +1,97 @@
+// work_pool.hpp - work-stealing thread pool for the executor's launch and
+// reap tasks.
+//
+// Every worker owns a deque. Tasks are pushed to a chosen worker (the
+// executor hands each admitted job to the least-loaded one); the owner
+// pops newest-first so the job it just touched is still in cache, and an
+// idle worker steals oldest-first from others. Victims on the thief's own
+// NUMA node are tried before remote ones, so a job's cgroup, pipes and
+// task_struct only cross the interconnect when the local node has nothing
+// left to give. Each deque has its own small lock; there is no global
+// queue for launches to serialise on.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace safebox {
+
+// Online CPUs this process may run on and the NUMA node of each
+struct CpuTopology {
+    std::vector<int> cpus;
+    std::vector<int> node_of;   // parallel to cpus
+    std::vector<int> core_of;   // parallel to cpus; SMT siblings share a value
+    int nodes = 1;
+    std::vector<long> node_memory_mb;   // MemTotal per node, 0 when unknown
+
+    static CpuTopology detect();
+};
+
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    struct Stats {
+        uint64_t executed = 0;
+        uint64_t stolen_local = 0;    // from a worker on the same node
+        uint64_t stolen_remote = 0;
+    };
+
+    // `pin` binds worker i to the i-th allowed CPU (round-robin)
+    WorkStealingPool(int workers, bool pin);
+    // Runs whatever is still queued, then joins
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    int size() const { return (int)workers_.size(); }
+    // Worker with the fewest queued + running tasks
+    int least_loaded() const;
+    // Queue on `worker`, or on least_loaded() when worker < 0. Returns the
+    // worker actually used.
+    int push(int worker, Task task);
+
+    // Index of the pool worker running the caller, -1 off-pool
+    static int current();
+
+    Stats stats() const;
+    const CpuTopology& topology() const { return topo_; }
+
+private:
+    struct Worker {
+        std::mutex mu;              // guards q
+        std::deque<Task> q;
+        std::atomic<int> load{0};   // queued here + running here
+        int cpu = -1;
+        int node = 0;
+        std::vector<int> victims;   // same node first, then the rest
+        std::atomic<uint64_t> executed{0}, stolen_local{0}, stolen_remote{0};
+        std::thread thread;
+    };
+
+    bool pop_own(Worker& w, Task& out);
+    bool steal(int self, Task& out);
+    void run(int self);
+
+    CpuTopology topo_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    mutable std::atomic<unsigned> rr_{0};   // tie-breaker for least_loaded()
+
+    // Idle workers park here; queued_ counts tasks sitting in any deque
+    std::mutex park_mu_;
+    std::condition_variable park_cv_;
+    std::atomic<int> queued_{0};
+    std::atomic<int> sleeping_{0};
+    bool stop_ = false;
+};
+
+}  // namespace safebox
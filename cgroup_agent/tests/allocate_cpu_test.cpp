@@ -0,0 +1,140 @@
+// allocate_cpu_test - the CPU sharing rules of allocate_cpu() on synthetic
+// groups: quotas never add up to more than the reservations, idle groups'
+// slack goes to throttled ones in proportion to their shortfall, and a
+// lender that wants its reservation back has it on the same call.
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "controller.hpp"
+
+using safebox::ControlBounds;
+using safebox::ControlDecision;
+using safebox::ControlState;
+using safebox::ControlTarget;
+using safebox::ControlTuning;
+
+struct Groups {
+    std::vector<ControlBounds> bounds;
+    std::vector<ControlState> states;
+
+    explicit Groups(const std::vector<int>& reservations) : bounds(reservations.size()), states(reservations.size()) {
+        for (size_t i = 0; i < reservations.size(); ++i) {
+            bounds[i].cpu_ceiling = reservations[i];
+            bounds[i].cpu_burst = reservations[i] * 4;
+            states[i].cpu_percent = reservations[i];
+        }
+    }
+
+    std::vector<ControlDecision> allocate(const ControlTuning& t = ControlTuning{}) {
+        std::vector<ControlTarget> targets;
+        for (size_t i = 0; i < states.size(); ++i) targets.push_back({(int)i, &bounds[i], &states[i]});
+        std::vector<ControlDecision> out;
+        safebox::allocate_cpu(t, targets, out);
+        return out;
+    }
+
+    int reserved() const {
+        int n = 0;
+        for (const auto& b : bounds) n += b.cpu_ceiling;
+        return n;
+    }
+    int allocated() const {
+        int n = 0;
+        for (const auto& s : states) n += s.cpu_percent;
+        return n;
+    }
+};
+
+static void random_wants_stay_within_reservations() {
+    std::mt19937 rng(11);
+    const std::vector<int> res = {10, 25, 50, 100, 100, 200, 25, 50, 400, 10};
+    Groups g(res);
+    for (int tick = 0; tick < 5000; ++tick) {
+        for (size_t i = 0; i < res.size(); ++i) {
+            const int choice = (int)(rng() % 6);
+            const int want[] = {0, 1, res[i] / 2, res[i], 2 * res[i], 5 * res[i]};
+            g.states[i].cpu_want = want[choice];
+        }
+        const std::vector<ControlDecision> out = g.allocate();
+        CHECK(g.allocated() <= g.reserved());
+        for (size_t i = 0; i < res.size(); ++i) CHECK(g.states[i].cpu_percent >= g.bounds[i].cpu_floor);
+        // Decisions describe exactly the moves made
+        for (const ControlDecision& d : out) CHECK(g.states[(size_t)d.id].cpu_percent == d.to);
+    }
+}
+
+static void idle_lends_to_throttled() {
+    Groups g({100, 100});
+    g.states[0].cpu_want = 10;
+    g.states[1].cpu_want = 190;
+    g.allocate();
+    CHECK(g.states[0].cpu_percent == 10);
+    CHECK(g.states[1].cpu_percent == 190);
+    CHECK(g.allocated() <= 200);
+}
+
+static void pool_shared_by_shortfall() {
+    Groups g({100, 50, 50});
+    g.states[0].cpu_want = 10;    // lends 90
+    g.states[1].cpu_want = 200;   // 150 short
+    g.states[2].cpu_want = 100;   //  50 short
+    g.allocate();
+    // 90 over 200 short: 0.45 of each shortfall, rounded down
+    CHECK(g.states[1].cpu_percent == 50 + 67);
+    CHECK(g.states[2].cpu_percent == 50 + 22);
+    CHECK(g.allocated() <= 200);
+}
+
+static void lender_gets_reservation_back() {
+    Groups g({100, 100});
+    for (int i = 0; i < 3; ++i) {
+        g.states[0].cpu_want = 5;
+        g.states[1].cpu_want = 400;
+        g.allocate();
+    }
+    CHECK(g.states[0].cpu_percent == 5);
+    CHECK(g.states[1].cpu_percent == 195);
+    // The lender is throttled again and asks for its whole reservation
+    g.states[0].cpu_want = 100;
+    g.allocate();
+    CHECK(g.states[0].cpu_percent == 100);
+    CHECK(g.states[1].cpu_percent == 100);
+}
+
+static void unknown_want_keeps_quota_within_total() {
+    // A group with no want yet counts its current quota; above the
+    // reservation that is a shortfall like any other
+    Groups g({100, 100, 50});
+    g.states[0].cpu_want = 10;
+    g.states[1].cpu_want = 300;
+    g.states[2].cpu_percent = 150;
+    g.states[2].cpu_want = 0;
+    g.allocate();
+    CHECK(g.allocated() <= 250);
+    CHECK(g.states[2].cpu_percent >= 50);
+    CHECK(g.states[2].cpu_percent < 150);
+}
+
+static void deadband_skips_small_moves_only() {
+    Groups g({100});
+    g.states[0].cpu_want = 99;   // inside the 3% band
+    CHECK(g.allocate().empty());
+    CHECK(g.states[0].cpu_percent == 100);
+    g.states[0].cpu_want = 80;
+    CHECK(g.allocate().size() == 1);
+    CHECK(g.states[0].cpu_percent == 80);
+}
+
+int main() {
+    random_wants_stay_within_reservations();
+    idle_lends_to_throttled();
+    pool_shared_by_shortfall();
+    lender_gets_reservation_back();
+    unknown_want_keeps_quota_within_total();
+    deadband_skips_small_moves_only();
+    return check_failures();
+}
@@ -0,0 +1,29 @@
+// check.hpp - the few assertions the native tests need (registered with
+// ctest in CMakeLists.txt). A failed CHECK reports and counts; main()
+// returns check_failures() so ctest sees the test fail.
+
+#pragma once
+
+#include <cstdio>
+
+namespace safebox_test {
+
+inline int& failures() {
+    static int n = 0;
+    return n;
+}
+
+}  // namespace safebox_test
+
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++safebox_test::failures();                                                 \
+        }                                                                               \
+    } while (0)
+
+inline int check_failures() {
+    if (safebox_test::failures()) std::fprintf(stderr, "%d check(s) failed\n", safebox_test::failures());
+    return safebox_test::failures() ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+// control_step_test - one group through control_step() on synthetic samples:
+// a sample between ticks (a PSI wakeup) moves memory.high on a stall but
+// leaves the CPU want, the PI integral, the forecasts and the calm count to
+// the next tick, which then sees one tick's worth of change.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "controller.hpp"
+
+using safebox::ControlBounds;
+using safebox::ControlDecision;
+using safebox::ControlState;
+using safebox::ControlTuning;
+using safebox::GroupSample;
+
+static const int64_t MB = 1 << 20;
+static const uint64_t TICK_NS = 100000000;   // 100 ms
+
+struct Group {
+    ControlTuning tuning;
+    ControlBounds bounds;
+    ControlState state;
+    GroupSample s;
+
+    Group() {
+        bounds.cpu_ceiling = 100;
+        bounds.mem_ceiling = 512 * MB;
+        state.cpu_percent = state.cpu_want = 100;
+        state.memory_high = 256 * MB;
+        s.t_ns = TICK_NS;
+        s.cpu_usage_us = s.cpu_nr_periods = s.cpu_nr_throttled = s.cpu_throttled_us = 0;
+        s.memory_current = 200 * MB;
+        s.mem_events_high = s.mem_events_oom_kill = 0;
+        s.cpu_some_us = s.mem_some_us = 0;
+        state.last = s;
+    }
+
+    // Advance the counters by `ns` of a throttled, memory-stalled group
+    std::vector<ControlDecision> step(uint64_t ns, bool tick, double mem_stall = 0) {
+        s.t_ns += ns;
+        s.cpu_usage_us += (int64_t)(ns / 1000);
+        s.cpu_throttled_us += (int64_t)(ns / 2000);
+        s.cpu_nr_periods += 10;
+        s.cpu_nr_throttled += 5;
+        s.mem_some_us += (int64_t)(mem_stall * (double)ns / 1000);
+        std::vector<ControlDecision> out;
+        safebox::control_step(tuning, bounds, state, s, 1, out, tick);
+        return out;
+    }
+};
+
+static void wakeup_moves_only_memory_high() {
+    Group g;
+    for (int i = 0; i < 20; ++i) g.step(TICK_NS, true);
+    const ControlState before = g.state;
+
+    const std::vector<ControlDecision> out = g.step(TICK_NS / 4, false, 0.5);
+    CHECK(out.size() == 1 && std::string(out[0].knob) == "memory.high");
+    CHECK(g.state.memory_high > before.memory_high);
+    CHECK(g.state.cpu_want == before.cpu_want);
+    CHECK(g.state.integral == before.integral);
+    CHECK(g.state.calm == before.calm);
+    CHECK(g.state.last.t_ns == before.last.t_ns);
+    CHECK(g.state.cpu_forecast.accuracy().scored == before.cpu_forecast.accuracy().scored);
+    CHECK(g.state.mem_forecast.accuracy().scored == before.mem_forecast.accuracy().scored);
+    CHECK(g.state.mem_forecast.forecast(1, g.tuning.forecast) == before.mem_forecast.forecast(1, g.tuning.forecast));
+}
+
+static void tick_after_wakeup_sees_one_tick() {
+    // Same run with and without a wakeup in the middle of a tick: the
+    // integral and the forecasts come out the same
+    Group plain, woken;
+    for (int i = 0; i < 20; ++i) {
+        plain.step(TICK_NS, true);
+        woken.step(TICK_NS, true);
+    }
+    plain.step(TICK_NS, true);
+    woken.step(TICK_NS / 4, false);
+    woken.step(TICK_NS - TICK_NS / 4, true);
+    CHECK(woken.state.integral == plain.state.integral);
+    CHECK(woken.state.cpu_want == plain.state.cpu_want);
+    CHECK(woken.state.last.t_ns == plain.state.last.t_ns);
+    CHECK(woken.state.cpu_forecast.accuracy().scored == plain.state.cpu_forecast.accuracy().scored);
+    CHECK(woken.state.mem_forecast.accuracy().scored == plain.state.mem_forecast.accuracy().scored);
+}
+
+static void stall_is_measured_since_the_wakeup() {
+    // A stall the wakeup already acted on is not counted again on the tick
+    Group g;
+    for (int i = 0; i < 20; ++i) g.step(TICK_NS, true);
+    g.step(TICK_NS / 2, false, 0.5);
+    const int64_t raised = g.state.memory_high;
+    g.step(TICK_NS / 2, true, 0);
+    CHECK(g.state.memory_high == raised);
+}
+
+int main() {
+    wakeup_moves_only_memory_high();
+    tick_after_wakeup_sees_one_tick();
+    stall_is_measured_since_the_wakeup();
+    return check_failures();
+}
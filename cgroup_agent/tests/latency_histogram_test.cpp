@@ -0,0 +1,108 @@
+// latency_histogram_test - the bucket layout, and the fixture that pins it
+// for backend/app/latency.py.
+//
+// Every value lands in a bucket whose bounds hold it, within 1/64 above
+// 128 ns, buckets tile the range without gaps, and everything from 2^44 ns
+// on shares the last one. tests/fixtures/latency_native.json holds, for a
+// spread of values, the bucket this code puts each in, every bucket's
+// bounds and the LATENCY JSON of a histogram of them all; the Python side
+// checks its own layout against it (tests/test_latency.py). Run with
+// --write to regenerate it after a deliberate layout change.
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "latency_histogram.hpp"
+
+using safebox::LatencyHistogram;
+
+static const char* const FIXTURE = SAFEBOX_TEST_FIXTURES "/latency_native.json";
+
+// Both ends of the linear range, each side of every power of two, the
+// clamp at 2^44 and past it, and a seeded spread in between
+static std::vector<uint64_t> fixture_values() {
+    std::vector<uint64_t> v;
+    for (uint64_t ns = 0; ns < 140; ++ns) v.push_back(ns);
+    for (int bit = 8; bit <= 52; ++bit) {
+        const uint64_t p = 1ull << bit;
+        for (uint64_t ns : {p - 1, p, p + 1, p + p / 64 - 1, p + p / 64, p + p / 2}) v.push_back(ns);
+    }
+    std::mt19937_64 rng(44);
+    for (int i = 0; i < 300; ++i) v.push_back(rng() >> (12 + rng() % 52));
+    return v;
+}
+
+static std::string fixture_json() {
+    const std::vector<uint64_t> values = fixture_values();
+    LatencyHistogram h;
+    for (uint64_t ns : values) h.record(ns);
+    std::ostringstream o;
+    o << "{\n\"sub_bits\": " << LatencyHistogram::SUB_BITS << ",\n\"max_bits\": " << LatencyHistogram::MAX_BITS
+      << ",\n\"buckets\": " << LatencyHistogram::BUCKETS << ",\n\"values\": [";
+    for (size_t i = 0; i < values.size(); ++i) {
+        o << (i ? "," : "") << (i % 8 ? " " : "\n  ") << "[" << values[i] << ", " << LatencyHistogram::bucket_of(values[i])
+          << "]";
+    }
+    o << "\n],\n\"bounds\": [";
+    for (size_t b = 0; b < LatencyHistogram::BUCKETS; ++b) {
+        o << (b ? "," : "") << (b % 8 ? " " : "\n  ") << "[" << LatencyHistogram::bucket_low(b) << ", "
+          << LatencyHistogram::bucket_high(b) << "]";
+    }
+    o << "\n],\n\"latency\": " << h.snapshot().json() << "\n}\n";
+    return o.str();
+}
+
+static void buckets_hold_their_values() {
+    for (uint64_t ns : fixture_values()) {
+        const size_t b = LatencyHistogram::bucket_of(ns);
+        CHECK(b < LatencyHistogram::BUCKETS);
+        if (ns >= (1ull << LatencyHistogram::MAX_BITS)) {
+            CHECK(b == LatencyHistogram::BUCKETS - 1);
+            continue;
+        }
+        const uint64_t lo = LatencyHistogram::bucket_low(b), hi = LatencyHistogram::bucket_high(b);
+        CHECK(lo <= ns && ns <= hi);
+        if (ns >= LatencyHistogram::LINEAR) CHECK((double)(hi - lo + 1) / (double)lo <= 1.0 / 64);
+        else CHECK(lo == ns && hi == ns);
+    }
+}
+
+static void buckets_tile_the_range() {
+    CHECK(LatencyHistogram::bucket_low(0) == 0);
+    for (size_t b = 1; b < LatencyHistogram::BUCKETS; ++b) {
+        if (LatencyHistogram::bucket_low(b) != LatencyHistogram::bucket_high(b - 1) + 1) {
+            CHECK(LatencyHistogram::bucket_low(b) == LatencyHistogram::bucket_high(b - 1) + 1);
+            break;
+        }
+    }
+    CHECK(LatencyHistogram::bucket_high(LatencyHistogram::BUCKETS - 1) == (1ull << LatencyHistogram::MAX_BITS) - 1);
+}
+
+static void fixture_is_current() {
+    std::ifstream in(FIXTURE);
+    std::stringstream file;
+    file << in.rdbuf();
+    CHECK(in.good() || in.eof());
+    if (file.str() != fixture_json()) {
+        std::cerr << FIXTURE << " is stale: regenerate it with --write\n";
+        CHECK(file.str() == fixture_json());
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && std::strcmp(argv[1], "--write") == 0) {
+        std::ofstream(FIXTURE) << fixture_json();
+        return 0;
+    }
+    buckets_hold_their_values();
+    buckets_tile_the_range();
+    fixture_is_current();
+    return check_failures();
+}
@@ -0,0 +1,126 @@
+// metric_rollup_test - MetricRollups against a raw store whose size limit
+// only holds a few hours: a 24 h query at the 10 min step still returns
+// every bucket of the day, with the values the raw points had, and each
+// bucket's stats match a direct computation over its samples.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "metric_rollup.hpp"
+#include "metric_store.hpp"
+
+using safebox::MetricPoint;
+using safebox::MetricRollups;
+using safebox::MetricStore;
+using safebox::MetricStoreOptions;
+using safebox::MetricValue;
+using safebox::RollupPoint;
+
+static const int64_t HOUR_MS = 3600 * 1000;
+static const int64_t STEP_MS = 600 * 1000;
+static const int SERIES = 200;
+
+// A sawtooth of period 600 s, offset per series: each 10 min bucket holds
+// the values i .. i + 599 once, so min, max and avg are known exactly
+static double value_at(int series, int64_t t_ms) {
+    return (double)(series + (t_ms / 1000) % 600);
+}
+
+static void day_survives_raw_eviction() {
+    MetricStoreOptions o;
+    o.retention_ms = 24 * HOUR_MS;
+    o.max_bytes = 2 << 20;
+    MetricStore raw(o);
+    MetricRollups rollups(raw, 1000);
+    std::vector<uint32_t> ids;
+    for (int i = 0; i < SERIES; ++i) {
+        const std::string name = "job." + std::to_string(i) + ".m";
+        ids.push_back(raw.series(name, 0));
+        rollups.track(ids.back(), name, 0);
+    }
+
+    // 25 h, so the day before `end` is all closed buckets
+    const int64_t end = 25 * HOUR_MS;
+    std::vector<MetricValue> values(SERIES);
+    for (int64_t t = 0; t < end; t += 1000) {
+        for (int i = 0; i < SERIES; ++i) values[(size_t)i] = {ids[(size_t)i], value_at(i, t)};
+        raw.append(t, values);
+        rollups.add(t, values);
+        if (t % 60000 == 0) {
+            raw.expire(t);
+            rollups.expire(t);
+        }
+    }
+
+    // The raw cap has bitten: the seconds no longer reach back a day
+    CHECK(raw.stats().expired_chunks > 0);
+    std::vector<MetricPoint> first;
+    raw.query("job.7.m", 0, end, first);
+    CHECK(!first.empty() && first.front().t_ms > end - 12 * HOUR_MS);
+
+    for (int i : {0, 7, SERIES - 1}) {
+        std::vector<RollupPoint> day;
+        const int64_t from = end - 24 * HOUR_MS;
+        const int64_t step = rollups.query("job." + std::to_string(i) + ".m", from, end - 1, STEP_MS, day);
+        CHECK(step == STEP_MS);
+        CHECK(day.size() == 144);
+        if (day.empty()) continue;
+        CHECK(day.front().t_ms == from);
+        CHECK(day.back().t_ms == end - STEP_MS);
+        for (const RollupPoint& b : day) {
+            if (b.min != i || b.max != i + 599 || std::fabs(b.avg - (i + 299.5)) > 1e-6) {
+                CHECK(b.min == i && b.max == i + 599 && std::fabs(b.avg - (i + 299.5)) <= 1e-6);
+                break;
+            }
+        }
+    }
+}
+
+static void stats_match_the_samples() {
+    // Random values at 1 s over 2 h; every 10 s, 1 min and 10 min bucket
+    // against min / max / avg / nearest-rank p95 of its own samples
+    MetricStoreOptions o;
+    o.retention_ms = 0;
+    o.max_bytes = 0;
+    MetricStore raw(o);
+    MetricRollups rollups(raw, 1000);
+    const uint32_t id = raw.series("x");
+    rollups.track(id, "x");
+    std::vector<float> samples;
+    uint64_t seed = 3;
+    for (int64_t t = 0; t < 2 * HOUR_MS + 1000; t += 1000) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const float v = (float)(seed >> 40) / 1000.0f;
+        samples.push_back(v);
+        raw.append(id, t, v);
+        rollups.add(t, {{id, v}});
+    }
+    for (int64_t step : {(int64_t)10000, (int64_t)60000, STEP_MS}) {
+        std::vector<RollupPoint> got;
+        rollups.query("x", 0, 2 * HOUR_MS - 1, step, got);
+        CHECK(got.size() == (size_t)(2 * HOUR_MS / step));
+        for (const RollupPoint& b : got) {
+            std::vector<float> in(samples.begin() + b.t_ms / 1000, samples.begin() + (b.t_ms + step) / 1000);
+            double sum = 0;
+            for (float v : in) sum += v;
+            std::sort(in.begin(), in.end());
+            const float p95 = in[(size_t)std::ceil(0.95 * (double)in.size()) - 1];
+            if (b.min != in.front() || b.max != in.back() || std::fabs(b.avg - sum / (double)in.size()) > 1e-3 ||
+                b.p95 != p95) {
+                CHECK(b.min == in.front() && b.max == in.back() && b.p95 == p95);
+                CHECK(std::fabs(b.avg - sum / (double)in.size()) <= 1e-3);
+                break;
+            }
+        }
+    }
+}
+
+int main() {
+    day_survives_raw_eviction();
+    stats_match_the_samples();
+    return check_failures();
+}
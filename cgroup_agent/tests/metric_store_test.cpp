@@ -0,0 +1,195 @@
+// metric_store_test - encode/decode round trips through MetricStore on
+// random series: every code path of the chunk format (delta-of-delta
+// widths, runs, XOR windows, integer differences of every width, sealed
+// and open chunks) must give back exactly what went in, over the whole
+// range and any part of it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "metric_store.hpp"
+
+using safebox::MetricPoint;
+using safebox::MetricStore;
+using safebox::MetricStoreOptions;
+using safebox::MetricValue;
+
+static bool same(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+struct Expected {
+    std::string name;
+    int decimals = -1;
+    std::vector<MetricPoint> points;
+};
+
+// What the store keeps of `v` at `decimals` places
+static double kept(double v, int decimals) {
+    if (decimals < 0) return v;
+    const double scale = std::pow(10.0, decimals);
+    return (std::nearbyint(v * scale) + 0.0) / scale;
+}
+
+static std::vector<MetricPoint> random_series(std::mt19937_64& rng, int kind, size_t n) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::vector<MetricPoint> pts;
+    int64_t t = (int64_t)(rng() % 1000000000000ll);
+    int64_t interval = 1 + (int64_t)(rng() % 5000);
+    double v = (u(rng) - 0.5) * 1e6;
+    for (size_t i = 0; i < n; ++i) {
+        // Mostly on schedule; now and then late, early, or after a gap of
+        // any size the timestamp codes have a width for
+        const double r = u(rng);
+        int64_t step = interval;
+        if (r < 0.05) step += (int64_t)(rng() % 100);
+        else if (r < 0.07) step += (int64_t)(rng() % 4000);
+        else if (r < 0.08) step += (int64_t)(rng() % 3000000000ll);
+        else if (r < 0.085) interval = 1 + (int64_t)(rng() % 5000);
+        t += std::max<int64_t>(1, step);
+
+        switch (kind) {
+        case 0:   // anything, every point
+            v = (u(rng) - 0.5) * std::pow(10.0, (double)(rng() % 40) - 20);
+            break;
+        case 1:   // a walk of small steps
+            v += (u(rng) - 0.5) * 10;
+            break;
+        case 2:   // long flat stretches
+            if (u(rng) < 0.02) v = std::round(u(rng) * 1000);
+            break;
+        case 3:   // bursts of zeros and spikes
+            v = u(rng) < 0.9 ? 0 : u(rng) * 1e9;
+            break;
+        default:  // walks that cross powers of two and zero
+            v = v * -0.5 + (u(rng) - 0.5) * 1e3;
+            break;
+        }
+        pts.push_back({t, v});
+    }
+    return pts;
+}
+
+static void check_range(const MetricStore& store, const Expected& e, int64_t from, int64_t to) {
+    std::vector<MetricPoint> got;
+    const size_t n = store.query(e.name, from, to, got);
+    std::vector<MetricPoint> want;
+    for (const MetricPoint& p : e.points) {
+        if (p.t_ms >= from && p.t_ms <= to) want.push_back({p.t_ms, kept(p.value, e.decimals)});
+    }
+    CHECK(n == want.size());
+    CHECK(got.size() == want.size());
+    for (size_t i = 0; i < std::min(got.size(), want.size()); ++i) {
+        if (got[i].t_ms != want[i].t_ms || !same(got[i].value, want[i].value)) {
+            CHECK(got[i].t_ms == want[i].t_ms && same(got[i].value, want[i].value));
+            return;
+        }
+    }
+}
+
+static void round_trips(size_t chunk_bytes, uint64_t seed) {
+    MetricStoreOptions o;
+    o.retention_ms = 0;
+    o.max_bytes = 0;
+    o.chunk_bytes = chunk_bytes;
+    MetricStore store(o);
+    std::mt19937_64 rng(seed);
+
+    std::vector<Expected> all(100);
+    for (size_t i = 0; i < all.size(); ++i) {
+        Expected& e = all[i];
+        e.name = "s" + std::to_string(i);
+        e.decimals = (int)(rng() % 5) - 1;   // -1 (exact) to 3 places
+        e.points = random_series(rng, (int)(rng() % 5), 1 + rng() % 3000);
+        const uint32_t id = store.series(e.name, e.decimals);
+        // Values past 2^53 once scaled are refused, not stored wrong
+        std::vector<MetricPoint> in;
+        for (const MetricPoint& p : e.points) {
+            const bool fits =
+                e.decimals < 0 || std::fabs(std::nearbyint(p.value * std::pow(10.0, e.decimals))) <= 9007199254740992.0;
+            CHECK(store.append(id, p.t_ms, p.value) == fits);
+            if (fits) in.push_back(p);
+        }
+        e.points = std::move(in);
+    }
+
+    for (const Expected& e : all) {
+        if (e.points.empty()) continue;
+        const int64_t first = e.points.front().t_ms, last = e.points.back().t_ms;
+        check_range(store, e, INT64_MIN, INT64_MAX);
+        for (int q = 0; q < 20; ++q) {
+            int64_t a = first + (int64_t)(rng() % (uint64_t)(last - first + 1));
+            int64_t b = first + (int64_t)(rng() % (uint64_t)(last - first + 1));
+            if (a > b) std::swap(a, b);
+            check_range(store, e, a, b);
+        }
+        // Exactly one point, and just either side of it
+        const MetricPoint& p = e.points[rng() % e.points.size()];
+        check_range(store, e, p.t_ms, p.t_ms);
+        check_range(store, e, p.t_ms + 1, p.t_ms + 1);
+
+        MetricPoint newest;
+        CHECK(store.last(e.name, newest));
+        CHECK(newest.t_ms == last && same(newest.value, kept(e.points.back().value, e.decimals)));
+    }
+}
+
+static void out_of_order_is_dropped() {
+    MetricStore store;
+    const uint32_t id = store.series("x");
+    CHECK(store.append(id, 1000, 1.0));
+    CHECK(!store.append(id, 1000, 2.0));
+    CHECK(!store.append(id, 999, 3.0));
+    CHECK(store.append(id, 1001, 4.0));
+    std::vector<MetricPoint> got;
+    store.query("x", 0, 2000, got);
+    CHECK(got.size() == 2 && got[0].value == 1.0 && got[1].value == 4.0);
+}
+
+static void batch_matches_single() {
+    // append(t, values) stores what one append per series would
+    MetricStore a, b;
+    std::mt19937_64 rng(5);
+    std::vector<uint32_t> ia, ib;
+    for (int i = 0; i < 50; ++i) {
+        ia.push_back(a.series("s" + std::to_string(i), i % 3 - 1));
+        ib.push_back(b.series("s" + std::to_string(i), i % 3 - 1));
+    }
+    std::vector<MetricValue> values(ia.size());
+    for (int64_t t = 0; t < 5000; ++t) {
+        for (size_t i = 0; i < ia.size(); ++i) {
+            const double v = (double)(rng() % 1000) / 7;
+            values[i] = {ia[i], v};
+            b.append(ib[i], t * 1000, v);
+        }
+        CHECK(a.append(t * 1000, values) == ia.size());
+    }
+    for (int i = 0; i < 50; ++i) {
+        std::vector<MetricPoint> pa, pb;
+        a.query("s" + std::to_string(i), 0, INT64_MAX, pa);
+        b.query("s" + std::to_string(i), 0, INT64_MAX, pb);
+        CHECK(pa.size() == pb.size());
+        for (size_t k = 0; k < std::min(pa.size(), pb.size()); ++k) {
+            if (pa[k].t_ms != pb[k].t_ms || !same(pa[k].value, pb[k].value)) {
+                CHECK(false);
+                break;
+            }
+        }
+    }
+}
+
+int main() {
+    round_trips(64, 1);
+    round_trips(256, 2);
+    round_trips(1024, 3);
+    round_trips(4096, 4);
+    out_of_order_is_dropped();
+    batch_matches_single();
+    return check_failures();
+}
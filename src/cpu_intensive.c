@@ -1,41 +1,201 @@
 /*
  * cpu_intensive.c - CPU-bound workload
  * Performs intensive calculations to stress CPU
+ *
+ * Usage: cpu_intensive [seconds]
+ *        cpu_intensive [--threads N] [--seconds S | --work M] [--kernel K]
+ *
+ * Every thread runs the same kernel, either for S seconds (fixed time,
+ * default 5) or for M million ops (fixed work), and is timed on its own
+ * with CLOCK_MONOTONIC from a common start, so a cpu.max quota split
+ * across threads shows up as per-thread ops/s and as wall time over CPU
+ * time (CLOCK_THREAD_CPUTIME_ID). Kernels, and what one op is:
+ *
+ *   trig    sqrt(i * pi) * sin(i) * cos(i), the original loop; one op per i
+ *   scalar  four dependent double multiply-add chains; one op per step
+ *   simd    multiply-add over 8-float vectors the compiler packs for the
+ *           target; one op per float lane
+ *
+ * The last line printed is a JSON object with the totals and per-thread
+ * results.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+
+#define MAX_THREADS 1024
+#define BATCH 65536   /* ops between clock reads */
+
+enum kernel { TRIG, SCALAR, SIMD };
+static const char *kernel_names[] = {"trig", "scalar", "simd"};
+
+typedef float v8f __attribute__((vector_size(32)));
+
+struct thread_result {
+    pthread_t tid;
+    int index;
+    unsigned long long ops;
+    double seconds;       /* wall, from the common start */
+    double cpu_seconds;   /* this thread's CPU time */
+    double result;        /* keeps the work from being optimised away */
+};
+
+static enum kernel kernel = TRIG;
+static double duration = 5;            /* fixed-time mode */
+static unsigned long long work = 0;    /* fixed-work mode: ops per thread, 0 => time */
+static pthread_barrier_t start_line;
+static double start_time;
+
+static double now(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* One batch of ops starting at op number `from`; returns the batch's value */
+static double run_batch(unsigned long long from) {
+    double r = 0.0;
+    if (kernel == TRIG) {
+        for (unsigned long long i = from; i < from + BATCH; i++) {
+            double x = (double)(i % 1000000);
+            r += sqrt(x * 3.14159) * sin(x) * cos(x);
+        }
+    } else if (kernel == SCALAR) {
+        double a = 1.0 + from % 7, b = 2.0, c = 3.0, d = 4.0;
+        for (int i = 0; i < BATCH / 4; i++) {
+            a = a * 0.999999 + 0.5;
+            b = b * 0.999998 + 0.25;
+            c = c * 0.999997 + 0.125;
+            d = d * 0.999996 + 0.0625;
+        }
+        r = a + b + c + d;
+    } else {
+        v8f acc[4];
+        const v8f mul = {0.999999f, 0.999998f, 0.999997f, 0.999996f, 0.999995f, 0.999994f, 0.999993f, 0.999992f};
+        const v8f add = {0.5f, 0.25f, 0.125f, 0.0625f, 0.5f, 0.25f, 0.125f, 0.0625f};
+        for (int k = 0; k < 4; k++) acc[k] = add * (float)(k + 1 + from % 3);
+        for (int i = 0; i < BATCH / 32; i++) {
+            for (int k = 0; k < 4; k++) acc[k] = acc[k] * mul + add;
+        }
+        for (int k = 0; k < 4; k++) {
+            for (int l = 0; l < 8; l++) r += acc[k][l];
+        }
+    }
+    return r;
+}
+
+static void *worker(void *arg) {
+    struct thread_result *t = arg;
+    pthread_barrier_wait(&start_line);
+    const double cpu0 = now(CLOCK_THREAD_CPUTIME_ID);
+    const double end = start_time + duration;
+    double result = 0.0;
+    unsigned long long ops = 0;
+    for (;;) {
+        if (work ? ops >= work : now(CLOCK_MONOTONIC) >= end) break;
+        result += run_batch(ops);
+        ops += BATCH;
+    }
+    t->seconds = now(CLOCK_MONOTONIC) - start_time;
+    t->cpu_seconds = now(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    t->ops = ops;
+    t->result = result;
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [seconds]\n"
+                    "       %s [--threads N] [--seconds S | --work M] [--kernel trig|scalar|simd]\n"
+                    "  --work M   fixed work: M million ops per thread\n", prog, prog);
+}
 
 int main(int argc, char *argv[]) {
-    int duration = 5; // default 5 seconds
-    
-    if (argc > 1) {
-        duration = atoi(argv[1]);
-        if (duration <= 0) duration = 5;
+    int threads = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--threads") == 0 && v) {
+            threads = atoi(v);
+            i++;
+        } else if (strcmp(a, "--seconds") == 0 && v) {
+            duration = atof(v);
+            i++;
+        } else if (strcmp(a, "--work") == 0 && v) {
+            work = strtoull(v, NULL, 10) * 1000000ULL;
+            i++;
+        } else if (strcmp(a, "--kernel") == 0 && v) {
+            if (strcmp(v, "trig") == 0) kernel = TRIG;
+            else if (strcmp(v, "scalar") == 0) kernel = SCALAR;
+            else if (strcmp(v, "simd") == 0) kernel = SIMD;
+            else { usage(argv[0]); return 2; }
+            i++;
+        } else if (a[0] != '-' && i == 1) {
+            duration = atoi(a);
+            if (duration <= 0) duration = 5;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
     }
-    
+    if (threads < 1 || threads > MAX_THREADS || duration <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
     printf("CPU Intensive Job Started\n");
-    printf("Will perform calculations for %d seconds\n", duration);
+    if (work) printf("Will perform %llu million %s ops on %d thread(s)\n", work / 1000000, kernel_names[kernel], threads);
+    else printf("Will perform calculations for %g seconds on %d thread(s)\n", duration, threads);
     fflush(stdout);
-    
-    time_t start = time(NULL);
-    unsigned long long iterations = 0;
-    double result = 0.0;
-    
-    // CPU-intensive calculations
-    while (time(NULL) - start < duration) {
-        for (int i = 0; i < 1000000; i++) {
-            result += sqrt(i * 3.14159) * sin(i) * cos(i);
-        }
-        iterations++;
+
+    struct thread_result *t = calloc((size_t)threads, sizeof(*t));
+    if (!t) {
+        fprintf(stderr, "Failed to allocate %d threads\n", threads);
+        return 1;
+    }
+    pthread_barrier_init(&start_line, NULL, (unsigned)threads + 1);
+    int started = 0;
+    for (; started < threads; started++) {
+        t[started].index = started;
+        if (pthread_create(&t[started].tid, NULL, worker, &t[started]) != 0) break;
+    }
+    if (started < threads) {
+        fprintf(stderr, "Failed to start thread %d\n", started);
+        return 1;
+    }
+    start_time = now(CLOCK_MONOTONIC);
+    pthread_barrier_wait(&start_line);
+
+    unsigned long long ops = 0;
+    double wall = 0.0, cpu = 0.0, result = 0.0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(t[i].tid, NULL);
+        ops += t[i].ops;
+        cpu += t[i].cpu_seconds;
+        result += t[i].result;
+        if (t[i].seconds > wall) wall = t[i].seconds;
     }
-    
-    printf("Completed %llu million iterations\n", iterations);
+
+    printf("Completed %llu million iterations\n", ops / 1000000);
     printf("Final result: %f\n", result);
     printf("CPU Intensive Job Completed!\n");
+    printf("{\"workload\":\"cpu_intensive\",\"kernel\":\"%s\",\"mode\":\"%s\",\"threads\":%d,"
+           "\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f,\"ops\":%llu,\"ops_per_sec\":%.1f,\"per_thread\":[",
+           kernel_names[kernel], work ? "work" : "time", threads, wall, cpu, ops, wall > 0 ? ops / wall : 0.0);
+    for (int i = 0; i < threads; i++) {
+        printf("%s{\"thread\":%d,\"ops\":%llu,\"seconds\":%.6f,\"cpu_seconds\":%.6f,\"ops_per_sec\":%.1f}",
+               i ? "," : "", i, t[i].ops, t[i].seconds, t[i].cpu_seconds,
+               t[i].seconds > 0 ? t[i].ops / t[i].seconds : 0.0);
+    }
+    printf("]}\n");
     fflush(stdout);
-    
+
+    pthread_barrier_destroy(&start_line);
+    free(t);
     return 0;
 }
@@ -1,59 +1,378 @@
 /*
  * io_intensive.c - I/O-bound workload
  * Performs file operations repeatedly
+ *
+ * Usage: io_intensive [seconds]
+ *        io_intensive [--mode M] [--rw read|write] [--pattern seq|rand]
+ *                     [--bs SIZE] [--size SIZE] [--qd N] [--seconds S]
+ *                     [--file PATH]
+ *
+ * Lays out a file of --size (64m), then issues --bs (4k) reads or writes
+ * at sequential or random block offsets in it for S seconds (5). Modes:
+ *
+ *   buffered  pread/pwrite through the page cache (reads start cold: the
+ *             file's pages are dropped after it is laid out)
+ *   direct    O_DIRECT pread/pwrite; bs and size must be 512-byte multiples
+ *   fsync     buffered, with fdatasync after every write
+ *   mmap      memcpy to and from a shared mapping of the file
+ *   uring     O_DIRECT reads or writes through io_uring, --qd (32) in flight
+ *
+ * Only direct, fsync and uring reach the device on every op, which is what
+ * io.max and io.weight throttle; buffered and mmap mostly measure the page
+ * cache. The file lives in /var/tmp by default since /tmp is often tmpfs,
+ * which refuses O_DIRECT. Every mode runs under SafeBox's seccomp filter:
+ * fsync, fdatasync, fadvise64, io_uring_setup and io_uring_enter are on
+ * its allow-list.
+ *
+ * Reports IOPS, MB/s and per-op latency percentiles; the last line printed
+ * is a JSON object with them.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 
-int main(int argc, char *argv[]) {
-    int duration = 5; // default 5 seconds
-    
-    if (argc > 1) {
-        duration = atoi(argv[1]);
-        if (duration <= 0) duration = 5;
+#define ALIGN 4096
+#define LAT_SUB 16                 /* latency buckets per power of two */
+#define LAT_BUCKETS (64 * LAT_SUB)
+
+enum mode { BUFFERED, DIRECT, FSYNC, MMAP, URING };
+static const char *mode_names[] = {"buffered", "direct", "fsync", "mmap", "uring"};
+
+static struct {
+    enum mode mode;
+    int write;
+    int random;
+    size_t bs;
+    size_t size;
+    int qd;
+    double seconds;
+    char path[4096];
+} opt = {BUFFERED, 1, 0, 4096, 64 << 20, 32, 5, ""};
+
+/* Log-linear latency histogram, nanoseconds */
+static unsigned long long lat_count[LAT_BUCKETS];
+static uint64_t lat_max;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void record_latency(uint64_t ns) {
+    int b;
+    if (ns < LAT_SUB) {
+        b = (int)ns;
+    } else {
+        int msb = 63 - __builtin_clzll(ns);
+        b = (msb - 3) * LAT_SUB + (int)((ns >> (msb - 4)) & (LAT_SUB - 1));
     }
-    
-    printf("I/O Intensive Job Started\n");
-    printf("Will perform file operations for %d seconds\n", duration);
-    fflush(stdout);
-    
-    char filename[] = "/tmp/safebox_io_test.tmp";
-    time_t start = time(NULL);
-    int iterations = 0;
-    
-    while (time(NULL) - start < duration) {
-        // Write data
-        FILE *f = fopen(filename, "w");
-        if (f) {
-            for (int i = 0; i < 1000; i++) {
-                fprintf(f, "Line %d: This is test data for I/O operations\n", i);
-            }
-            fclose(f);
+    lat_count[b]++;
+    if (ns > lat_max) lat_max = ns;
+}
+
+/* Lower edge of a bucket */
+static uint64_t bucket_ns(int b) {
+    if (b < LAT_SUB) return (uint64_t)b;
+    int msb = b / LAT_SUB + 3;
+    return ((uint64_t)(LAT_SUB + b % LAT_SUB)) << (msb - 4);
+}
+
+static double percentile_us(unsigned long long total, double q) {
+    unsigned long long want = (unsigned long long)(q * total), seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        seen += lat_count[b];
+        if (seen > want) return bucket_ns(b) / 1000.0;
+    }
+    return lat_max / 1000.0;
+}
+
+static size_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+        case 'k': case 'K': v *= 1024; break;
+        case 'm': case 'M': v *= 1024 * 1024; break;
+        case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+    }
+    return v > 0 ? (size_t)v : 0;
+}
+
+static uint64_t rng = 88172645463325252ULL;
+
+static off_t next_offset(unsigned long long i) {
+    const unsigned long long blocks = opt.size / opt.bs;
+    if (!opt.random) return (off_t)((i % blocks) * opt.bs);
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (off_t)((rng % blocks) * opt.bs);
+}
+
+/* Write the whole file once so reads hit real blocks, then drop its cache */
+static int lay_out(int fd) {
+    const size_t chunk = 1 << 20;
+    char *buf;
+    if (posix_memalign((void **)&buf, ALIGN, chunk) != 0) return -1;
+    memset(buf, 0x5a, chunk);
+    int rc = 0;
+    for (size_t at = 0; rc == 0 && at < opt.size; at += chunk) {
+        size_t n = opt.size - at < chunk ? opt.size - at : chunk;
+        if (pwrite(fd, buf, n, (off_t)at) != (ssize_t)n) rc = -1;
+    }
+    free(buf);
+    if (rc == 0 && fsync(fd) != 0) rc = -1;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    return rc;
+}
+
+/* One synchronous op of the buffered/direct/fsync/mmap modes */
+static int sync_op(int fd, char *map, char *buf, off_t off) {
+    if (opt.mode == MMAP) {
+        if (opt.write) memcpy(map + off, buf, opt.bs);
+        else memcpy(buf, map + off, opt.bs);
+        return 0;
+    }
+    ssize_t n = opt.write ? pwrite(fd, buf, opt.bs, off) : pread(fd, buf, opt.bs, off);
+    if (n != (ssize_t)opt.bs) return -1;
+    if (opt.write && opt.mode == FSYNC && fdatasync(fd) != 0) return -1;
+    return 0;
+}
+
+static unsigned long long run_sync(int fd) {
+    char *buf, *map = NULL;
+    if (posix_memalign((void **)&buf, ALIGN, opt.bs) != 0) return 0;
+    memset(buf, 0xa5, opt.bs);
+    if (opt.mode == MMAP) {
+        map = mmap(NULL, opt.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            free(buf);
+            return 0;
+        }
+    }
+    const uint64_t end = now_ns() + (uint64_t)(opt.seconds * 1e9);
+    unsigned long long ops = 0;
+    for (uint64_t t = now_ns(); t < end; ops++) {
+        if (sync_op(fd, map, buf, next_offset(ops)) != 0) {
+            perror(opt.write ? "write" : "read");
+            break;
+        }
+        uint64_t done = now_ns();
+        record_latency(done - t);
+        t = done;
+    }
+    if (map) munmap(map, opt.size);
+    free(buf);
+    return ops;
+}
+
+/* A bare io_uring: one SQ/CQ pair, no liburing */
+struct uring {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+static int uring_init(struct uring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+    size_t sq_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) sq_bytes = cq_bytes = sq_bytes > cq_bytes ? sq_bytes : cq_bytes;
+    char *sq = mmap(NULL, sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) return -1;
+    char *cq = sq;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) return -1;
+    }
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) return -1;
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_queue(struct uring *r, int fd, char *buf, off_t off, uint64_t slot) {
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opt.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (unsigned)opt.bs;
+    sqe->off = (uint64_t)off;
+    sqe->user_data = slot;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned long long run_uring(int fd) {
+    struct uring r;
+    if (uring_init(&r, (unsigned)opt.qd) != 0) {
+        perror("io_uring_setup");
+        return 0;
+    }
+    char *bufs;
+    uint64_t *issued = calloc((size_t)opt.qd, sizeof(uint64_t));
+    if (!issued || posix_memalign((void **)&bufs, ALIGN, opt.bs * (size_t)opt.qd) != 0) return 0;
+    memset(bufs, 0xa5, opt.bs * (size_t)opt.qd);
+
+    const uint64_t end = now_ns() + (uint64_t)(opt.seconds * 1e9);
+    unsigned long long ops = 0, next = 0;
+    int inflight = 0, to_submit = 0, failed = 0;
+    for (int s = 0; s < opt.qd; s++) {
+        issued[s] = now_ns();
+        uring_queue(&r, fd, bufs + (size_t)s * opt.bs, next_offset(next++), (uint64_t)s);
+        inflight++;
+        to_submit++;
+    }
+    while (inflight > 0) {
+        if (syscall(__NR_io_uring_enter, r.fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+            perror("io_uring_enter");
+            break;
         }
-        
-        // Read data
-        f = fopen(filename, "r");
-        if (f) {
-            char buffer[256];
-            while (fgets(buffer, sizeof(buffer), f)) {
-                // Just read and discard
+        to_submit = 0;
+        unsigned head = *r.cq_head;
+        const unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        const uint64_t t = now_ns();
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+            const int slot = (int)cqe->user_data;
+            inflight--;
+            if (cqe->res != (int)opt.bs) {
+                if (!failed++) fprintf(stderr, "io_uring op: %s\n", strerror(cqe->res < 0 ? -cqe->res : EIO));
+                continue;
+            }
+            ops++;
+            record_latency(t - issued[slot]);
+            if (t < end && !failed) {
+                issued[slot] = t;
+                uring_queue(&r, fd, bufs + (size_t)slot * opt.bs, next_offset(next++), (uint64_t)slot);
+                inflight++;
+                to_submit++;
             }
-            fclose(f);
         }
-        
-        iterations++;
-    }
-    
-    // Cleanup
-    remove(filename);
-    
-    printf("Completed %d I/O cycles\n", iterations);
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+    }
+    close(r.fd);
+    free(bufs);
+    free(issued);
+    return ops;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [seconds]\n"
+                    "       %s [--mode buffered|direct|fsync|mmap|uring] [--rw read|write]\n"
+                    "          [--pattern seq|rand] [--bs SIZE] [--size SIZE] [--qd N]\n"
+                    "          [--seconds S] [--file PATH]\n"
+                    "All modes, uring included, are allowed by the SafeBox sandbox.\n", prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a[0] != '-' && i == 1) {
+            opt.seconds = atoi(a);
+            if (opt.seconds <= 0) opt.seconds = 5;
+            continue;
+        }
+        if (!v) { usage(argv[0]); return 2; }
+        i++;
+        if (strcmp(a, "--mode") == 0) {
+            int m = 0;
+            while (m <= URING && strcmp(v, mode_names[m]) != 0) m++;
+            if (m > URING) { usage(argv[0]); return 2; }
+            opt.mode = (enum mode)m;
+        } else if (strcmp(a, "--rw") == 0) {
+            opt.write = strcmp(v, "write") == 0;
+            if (!opt.write && strcmp(v, "read") != 0) { usage(argv[0]); return 2; }
+        } else if (strcmp(a, "--pattern") == 0) {
+            opt.random = strcmp(v, "rand") == 0;
+            if (!opt.random && strcmp(v, "seq") != 0) { usage(argv[0]); return 2; }
+        } else if (strcmp(a, "--bs") == 0) {
+            opt.bs = parse_size(v);
+        } else if (strcmp(a, "--size") == 0) {
+            opt.size = parse_size(v);
+        } else if (strcmp(a, "--qd") == 0) {
+            opt.qd = atoi(v);
+        } else if (strcmp(a, "--seconds") == 0) {
+            opt.seconds = atof(v);
+        } else if (strcmp(a, "--file") == 0) {
+            snprintf(opt.path, sizeof(opt.path), "%s", v);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    const int direct = opt.mode == DIRECT || opt.mode == URING;
+    if (opt.bs == 0 || opt.size < opt.bs || opt.qd < 1 || opt.qd > 4096 || opt.seconds <= 0 ||
+        (direct && (opt.bs % 512 || opt.size % 512))) {
+        usage(argv[0]);
+        return 2;
+    }
+    opt.size -= opt.size % opt.bs;
+    if (!opt.path[0]) snprintf(opt.path, sizeof(opt.path), "/var/tmp/safebox_io_test.%d.tmp", (int)getpid());
+
+    printf("I/O Intensive Job Started\n");
+    printf("Will perform %s %s %zu-byte %ss on a %zu MB file for %g seconds\n", opt.random ? "random" : "sequential",
+           mode_names[opt.mode], opt.bs, opt.write ? "write" : "read", opt.size >> 20, opt.seconds);
+    fflush(stdout);
+
+    int fd = open(opt.path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 || lay_out(fd) != 0) {
+        perror(opt.path);
+        return 1;
+    }
+    close(fd);
+    fd = open(opt.path, O_RDWR | (direct ? O_DIRECT : 0));
+    if (fd < 0) {
+        perror(opt.path);
+        unlink(opt.path);
+        return 1;
+    }
+
+    const uint64_t t0 = now_ns();
+    const unsigned long long ops = opt.mode == URING ? run_uring(fd) : run_sync(fd);
+    const double secs = (now_ns() - t0) / 1e9;
+    close(fd);
+    unlink(opt.path);
+
+    const double iops = secs > 0 ? ops / secs : 0;
+    const double mbps = iops * opt.bs / (1024.0 * 1024.0);
+    printf("Completed %llu I/O operations\n", ops);
+    printf("%.0f IOPS, %.1f MB/s, p50 %.1f us, p99 %.1f us\n", iops, mbps, percentile_us(ops, 0.50),
+           percentile_us(ops, 0.99));
     printf("I/O Intensive Job Completed!\n");
+    printf("{\"workload\":\"io_intensive\",\"mode\":\"%s\",\"rw\":\"%s\",\"pattern\":\"%s\",\"bs\":%zu,"
+           "\"file_size\":%zu,\"qd\":%d,\"seconds\":%.6f,\"ops\":%llu,\"iops\":%.1f,\"mb_per_sec\":%.2f,"
+           "\"latency_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+           mode_names[opt.mode], opt.write ? "write" : "read", opt.random ? "rand" : "seq", opt.bs, opt.size,
+           opt.mode == URING ? opt.qd : 1, secs, ops, iops, mbps, percentile_us(ops, 0.50), percentile_us(ops, 0.90),
+           percentile_us(ops, 0.99), percentile_us(ops, 0.999), lat_max / 1000.0);
     fflush(stdout);
-    
-    return 0;
+    return ops > 0 ? 0 : 1;
 }
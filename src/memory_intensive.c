@@ -1,62 +1,276 @@
 /*
  * memory_intensive.c - Memory-bound workload
  * Allocates and uses memory intensively
+ *
+ * Usage: memory_intensive [mb] [seconds]
+ *        memory_intensive [--mb N] [--seconds S] [--mode M] [--stride BYTES]
+ *                         [--rate MB_PER_S] [--thp on|off]
+ *
+ * Maps an N MB (50) anonymous working set and, for S seconds (5):
+ *
+ *   hold    touches every page, then sleeps (the original behaviour)
+ *   seq     sweeps it front to back, read-modify-write of every word
+ *   stride  read-modify-writes one word every --stride bytes (4096)
+ *   random  read-modify-writes one word in a random cache line, each
+ *           independent of the last
+ *   chase   follows a random cycle through every cache line, each load
+ *           depending on the one before: the access latency
+ *
+ * With --rate the working set is faulted in at that many MB/s instead of
+ * all at once, and the access modes only touch what is there so far, so
+ * the set grows under the workload (chase needs it whole and ignores it).
+ * --thp on/off applies MADV_HUGEPAGE / MADV_NOHUGEPAGE to the mapping.
+ *
+ * Reports bandwidth (cache lines touched x 64 B), ns per access, page
+ * faults while setting up and while running, the THP-backed part of the
+ * set, and MB/s per second of the run, which is where memory.high
+ * throttling and reclaim show. The last line printed is a JSON object.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #define MB (1024 * 1024)
+#define LINE 64
+#define HUGE_PAGE (2 * MB)
+#define FAULT_CHUNK (64 * 1024)   /* faulted in per step at --rate */
+#define MAX_SECONDS 3600
+
+enum mode { HOLD, SEQ, STRIDE, RANDOM, CHASE };
+static const char *mode_names[] = {"hold", "seq", "stride", "random", "chase"};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void faults(long *minor, long *major) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    *minor = ru.ru_minflt;
+    *major = ru.ru_majflt;
+}
+
+/* AnonHugePages of the whole process, kB; -1 if unknown */
+static long anon_huge_kb(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb;
+}
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* Link every cache line into one random cycle; returns the first line */
+static size_t build_chase(char *base, size_t lines) {
+    size_t *order = malloc(lines * sizeof(size_t));
+    if (!order) return 0;
+    for (size_t i = 0; i < lines; i++) order[i] = i;
+    for (size_t i = lines - 1; i > 0; i--) {
+        size_t j = next_random() % (i + 1);
+        size_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (size_t i = 0; i < lines; i++) *(size_t *)(base + order[i] * LINE) = order[(i + 1) % lines] * LINE;
+    size_t first = order[0] * LINE;
+    free(order);
+    return first;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [mb] [seconds]\n"
+                    "       %s [--mb N] [--seconds S] [--mode hold|seq|stride|random|chase]\n"
+                    "          [--stride BYTES] [--rate MB_PER_S] [--thp on|off]\n", prog, prog);
+}
 
 int main(int argc, char *argv[]) {
     int mem_mb = 50; // default 50MB
     int duration = 5; // default 5 seconds
-    
-    if (argc > 1) {
-        mem_mb = atoi(argv[1]);
-        if (mem_mb <= 0) mem_mb = 50;
+    enum mode mode = HOLD;
+    size_t stride = 4096;
+    double rate = 0;   /* MB/s, 0 => all at once */
+    int thp = -1;      /* -1 => leave the system default */
+
+    for (int i = 1, positional = 0; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (a[0] != '-') {
+            if (positional == 0) mem_mb = atoi(a);
+            else if (positional == 1) duration = atoi(a);
+            else { usage(argv[0]); return 2; }
+            if (mem_mb <= 0) mem_mb = 50;
+            if (duration <= 0) duration = 5;
+            positional++;
+            continue;
+        }
+        if (!v) { usage(argv[0]); return 2; }
+        i++;
+        if (strcmp(a, "--mb") == 0) mem_mb = atoi(v);
+        else if (strcmp(a, "--seconds") == 0) duration = atoi(v);
+        else if (strcmp(a, "--stride") == 0) stride = (size_t)atol(v);
+        else if (strcmp(a, "--rate") == 0) rate = atof(v);
+        else if (strcmp(a, "--thp") == 0 && strcmp(v, "on") == 0) thp = 1;
+        else if (strcmp(a, "--thp") == 0 && strcmp(v, "off") == 0) thp = 0;
+        else if (strcmp(a, "--mode") == 0) {
+            int m = 0;
+            while (m <= CHASE && strcmp(v, mode_names[m]) != 0) m++;
+            if (m > CHASE) { usage(argv[0]); return 2; }
+            mode = (enum mode)m;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
     }
-    if (argc > 2) {
-        duration = atoi(argv[2]);
-        if (duration <= 0) duration = 5;
+    if (mem_mb <= 0 || duration <= 0 || duration > MAX_SECONDS || stride < sizeof(uint64_t) || rate < 0) {
+        usage(argv[0]);
+        return 2;
     }
-    
+    stride -= stride % sizeof(uint64_t);
+    if (mode == CHASE) rate = 0;
+
     printf("Memory Intensive Job Started\n");
     printf("Allocating %dMB for %d seconds\n", mem_mb, duration);
     fflush(stdout);
-    
-    // Allocate memory
-    char *buffer = (char*)malloc(mem_mb * MB);
-    if (!buffer) {
+
+    // Allocate memory, on a huge page boundary so THP can back all of it
+    const size_t bytes = (size_t)mem_mb * MB;
+    char *raw = mmap(NULL, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
         fprintf(stderr, "Failed to allocate %dMB\n", mem_mb);
         return 1;
     }
-    
+    char *buffer = (char *)(((uintptr_t)raw + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+    if (thp >= 0 && madvise(buffer, bytes, thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) != 0) perror("madvise");
+
+    long minor0, major0, minor1, major1, minor2, major2;
+    faults(&minor0, &major0);
+    const double t0 = now();
+    size_t faulted = 0;   /* bytes touched so far, from the front */
+
     // Touch all pages to ensure allocation
-    printf("Touching memory pages...\n");
-    fflush(stdout);
-    for (int i = 0; i < mem_mb; i++) {
-        memset(buffer + (i * MB), i % 256, MB);
+    if (rate == 0) {
+        printf("Touching memory pages...\n");
+        fflush(stdout);
+        for (int i = 0; i < mem_mb; i++) {
+            memset(buffer + ((size_t)i * MB), i % 256, MB);
+        }
+        faulted = bytes;
+        printf("Memory allocated and initialized\n");
+        fflush(stdout);
     }
-    
-    printf("Memory allocated and initialized\n");
-    printf("Holding memory for %d seconds...\n", duration);
-    fflush(stdout);
-    
-    sleep(duration);
-    
+    size_t chase = mode == CHASE ? build_chase(buffer, bytes / LINE) : 0;
+    faults(&minor1, &major1);
+    const double setup = now() - t0;
+
+    unsigned long long lines = 0, accesses = 0;
+    double per_second[MAX_SECONDS] = {0};
+    uint64_t sum = 0;
+    size_t cursor = 0;
+    const double start = now(), end = start + duration;
+    if (mode == HOLD && rate == 0) {
+        printf("Holding memory for %d seconds...\n", duration);
+        fflush(stdout);
+        sleep(duration);
+    }
+    for (double t = start; t < end && !(mode == HOLD && rate == 0); t = now()) {
+        // Grow the set at --rate; hold is done once all of it is there
+        if (faulted < bytes) {
+            size_t want = rate > 0 ? (size_t)((t - start) * rate * MB) : bytes;
+            for (; faulted < bytes && faulted < want; faulted += FAULT_CHUNK) {
+                memset(buffer + faulted, (int)(faulted / MB), bytes - faulted < FAULT_CHUNK ? bytes - faulted : FAULT_CHUNK);
+            }
+            if (faulted > bytes) faulted = bytes;
+        }
+        if (mode == HOLD) {
+            if (faulted == bytes) {
+                double left = end - now();
+                if (left > 0) usleep((useconds_t)(left * 1e6));
+                break;
+            }
+            usleep(1000);
+            continue;
+        }
+        if (faulted == 0) continue;
+        const size_t active = faulted - faulted % LINE;
+        unsigned long long batch_lines = 0, batch = 0;
+        if (mode == SEQ) {
+            // About 1 MB per batch
+            uint64_t *w = (uint64_t *)(buffer + cursor);
+            size_t n = (active - cursor < MB ? active - cursor : MB) / sizeof(uint64_t);
+            for (size_t i = 0; i < n; i++) w[i] += ++sum;
+            batch = n;
+            batch_lines = n * sizeof(uint64_t) / LINE;
+            cursor += n * sizeof(uint64_t);
+            if (cursor >= active) cursor = 0;
+        } else if (mode == STRIDE) {
+            for (int i = 0; i < 16384; i++) {
+                *(uint64_t *)(buffer + cursor) += ++sum;
+                cursor += stride;
+                if (cursor >= active) cursor = (cursor + sizeof(uint64_t)) % stride % active;
+            }
+            batch = 16384;
+            batch_lines = stride >= LINE ? batch : batch * stride / LINE;
+        } else if (mode == RANDOM) {
+            const size_t nlines = active / LINE;
+            for (int i = 0; i < 16384; i++) *(uint64_t *)(buffer + next_random() % nlines * LINE) += ++sum;
+            batch = batch_lines = 16384;
+        } else {
+            for (int i = 0; i < 16384; i++) chase = *(size_t *)(buffer + chase);
+            sum += chase;
+            batch = batch_lines = 16384;
+        }
+        accesses += batch;
+        lines += batch_lines;
+        int sec = (int)(t - start);
+        if (sec < duration) per_second[sec] += batch_lines * (double)LINE / MB;
+    }
+    const double run = now() - start;
+    faults(&minor2, &major2);
+    const long huge_kb = anon_huge_kb();
+
     // Verify some data
     unsigned long checksum = 0;
-    for (int i = 0; i < mem_mb * MB; i += 4096) {
+    for (size_t i = 0; i < faulted; i += 4096) {
         checksum += buffer[i];
     }
-    
+    checksum += sum;
+
+    const double mbps = run > 0 ? lines * (double)LINE / MB / run : 0;
+    const double ns = accesses ? run * 1e9 / accesses : 0;
     printf("Checksum: %lu\n", checksum);
+    if (mode != HOLD) printf("%.1f MB/s, %.1f ns per access\n", mbps, ns);
     printf("Memory Intensive Job Completed!\n");
+    printf("{\"workload\":\"memory_intensive\",\"mode\":\"%s\",\"mb\":%d,\"stride\":%zu,\"rate_mb_per_sec\":%g,"
+           "\"thp\":\"%s\",\"setup_seconds\":%.6f,\"seconds\":%.6f,\"accesses\":%llu,\"mb_per_sec\":%.1f,"
+           "\"ns_per_access\":%.2f,\"faults\":{\"setup_minor\":%ld,\"setup_major\":%ld,\"run_minor\":%ld,"
+           "\"run_major\":%ld},\"anon_huge_kb\":%ld,\"per_second_mb\":[",
+           mode_names[mode], mem_mb, stride, rate, thp < 0 ? "default" : thp ? "on" : "off", setup, run, accesses,
+           mbps, ns, minor1 - minor0, major1 - major0, minor2 - minor1, major2 - major1, huge_kb);
+    for (int i = 0; i < duration && mode != HOLD; i++) printf("%s%.1f", i ? "," : "", per_second[i]);
+    printf("]}\n");
     fflush(stdout);
-    
-    free(buffer);
+
+    munmap(raw, bytes + HUGE_PAGE);
     return 0;
 }
@@ -1,12 +1,20 @@
 /*
  * quick_job.c - Fast completing job
  * Useful for testing rapid job submission/completion
+ *
+ * The last line printed is a JSON object whose start_ns is CLOCK_MONOTONIC
+ * at entry to main(), so a load generator on the same host can tell when
+ * the job actually started running.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 int main(int argc, char *argv[]) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     int count = 100;
     
     if (argc > 1) {
@@ -18,13 +26,15 @@ int main(int argc, char *argv[]) {
     printf("Processing %d items...\n", count);
     fflush(stdout);
     
-    int sum = 0;
+    long long sum = 0;   /* 1..count overflows an int past count 65535 */
     for (int i = 1; i <= count; i++) {
         sum += i;
     }
     
-    printf("Sum of 1 to %d = %d\n", count, sum);
+    printf("Sum of 1 to %d = %lld\n", count, sum);
     printf("Quick Job Completed!\n");
+    printf("{\"workload\":\"quick_job\",\"count\":%d,\"sum\":%lld,\"start_ns\":%lld}\n", count, sum,
+           (long long)start.tv_sec * 1000000000LL + start.tv_nsec);
     fflush(stdout);
     
     return 0;
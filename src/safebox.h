@@ -1,17 +1,34 @@
+
 // File: src/safebox.h
 
 #ifndef SAFBOX_H
 #define SAFBOX_H
 
 #include <sys/types.h>
+#include <linux/filter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-// --- Functions from src/namespaces.c ---
-pid_t create_sandbox(void);
+/* Options for the child-side setup; prepared by the parent before clone() */
+struct sandbox_config {
+    uid_t uid;                         /* user to drop to (normally nobody) */
+    gid_t gid;
+    int drop_privileges;               /* 0 => keep the launcher's credentials */
+    const char *new_root;              /* chroot target, NULL to skip */
+    const char *hostname;              /* UTS hostname, NULL => "safebox" */
+    const struct sock_fprog *seccomp;  /* from sandbox_build_seccomp_program() */
+};
 
-// --- Functions from src/seccomp_policy.c ---
-int apply_seccomp_filter(void);
+// --- Functions from src/sandbox_core.c ---
+int sandbox_build_seccomp_program(struct sock_fprog *prog);
+void sandbox_free_seccomp_program(struct sock_fprog *prog);
+int sandbox_lookup_user(const char *name, uid_t *uid, gid_t *gid);
+int sandbox_child_setup(const struct sandbox_config *cfg);
 
-// --- Functions from src/cgroups_attach.c ---
-int attach_to_cgroup(pid_t pid);
+#ifdef __cplusplus
+}
+#endif
 
 #endif // SAFBOX_H
@@ -0,0 +1,310 @@
+/* sandbox_core.c
+ *
+ * Child-side sandbox setup shared by the safebox CLI and the native executor
+ * (cgroup_agent/src/launcher.cpp):
+ *  - private mounts and a fresh /proc for the PID namespace
+ *  - hostname, NO_NEW_PRIVS, privilege drop
+ *  - a seccomp whitelist compiled once in the parent and loaded in the child
+ *
+ * Everything that allocates or takes locks (getpwnam, libseccomp) happens in
+ * the parent before clone(). The child only issues raw syscalls, which keeps
+ * it safe to run after cloning a multi-threaded process.
+ *
+ * Build with -DSAFEBOX_NO_SECCOMP when libseccomp is not installed; the
+ * launcher then warns and continues without a filter.
+ */
+
+#define _GNU_SOURCE
+#include "safebox.h"
+
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <pwd.h>
+#include <grp.h>
+#include <fcntl.h>
+
+#ifndef SAFEBOX_NO_SECCOMP
+#include <seccomp.h>
+#endif
+
+/* write(2) a string to stderr without stdio (usable in the cloned child) */
+static void child_warn(const char *msg) {
+    ssize_t r = write(STDERR_FILENO, msg, strlen(msg));
+    (void)r;
+}
+
+#ifndef SAFEBOX_NO_SECCOMP
+
+#ifndef SCMP_SYS_newfstatat
+#define SCMP_SYS_newfstatat SCMP_SYS(fstatat)
+#endif
+
+/* Build a permissive-but-sane seccomp whitelist using libseccomp.
+ * Default action is KILL on violation. The filter is exported as a raw BPF
+ * program so the child installs it with a single prctl() instead of
+ * rebuilding it on every launch.
+ */
+int sandbox_build_seccomp_program(struct sock_fprog *prog) {
+    memset(prog, 0, sizeof(*prog));
+
+    scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL);
+    if (!ctx) {
+        fprintf(stderr, "seccomp_init failed\n");
+        return -1;
+    }
+
+    int allow_list[] = {
+        /* io / process control */
+        SCMP_SYS(read), SCMP_SYS(write), SCMP_SYS(exit), SCMP_SYS(exit_group),
+        SCMP_SYS(close), SCMP_SYS(readlink), SCMP_SYS(lseek), SCMP_SYS(readlinkat),
+        SCMP_SYS(pread64), SCMP_SYS(pwrite64), SCMP_SYS(writev), SCMP_SYS(readv),
+
+        /* memory / brk / mmap */
+        SCMP_SYS(brk), SCMP_SYS(mmap), SCMP_SYS(munmap), SCMP_SYS(mremap), SCMP_SYS(mprotect),
+        SCMP_SYS(madvise), SCMP_SYS(msync), SCMP_SYS(mincore),
+
+        /* file ops */
+        SCMP_SYS(open), SCMP_SYS(openat), SCMP_SYS(fstat), SCMP_SYS(stat), SCMP_SYS(lstat),
+        SCMP_SYS(newfstatat), SCMP_SYS(access), SCMP_SYS(faccessat), SCMP_SYS(faccessat2),
+        SCMP_SYS(getdents), SCMP_SYS(getdents64), SCMP_SYS(getcwd), SCMP_SYS(statx), 
+        SCMP_SYS(fcntl), SCMP_SYS(fstatfs), SCMP_SYS(statfs), SCMP_SYS(truncate), 
+        SCMP_SYS(ftruncate), SCMP_SYS(rename), SCMP_SYS(renameat), SCMP_SYS(renameat2),
+        SCMP_SYS(unlink), SCMP_SYS(unlinkat), SCMP_SYS(mkdir), SCMP_SYS(mkdirat),
+        SCMP_SYS(rmdir), SCMP_SYS(link), SCMP_SYS(linkat), SCMP_SYS(symlink), 
+        SCMP_SYS(symlinkat), SCMP_SYS(chmod), SCMP_SYS(fchmod), SCMP_SYS(fchmodat),
+
+        /* flushes, cache hints and io_uring (io_intensive's fsync and uring modes;
+         * io_uring ops are not seen by seccomp, but open/read/write are allowed anyway) */
+        SCMP_SYS(fsync), SCMP_SYS(fdatasync), SCMP_SYS(fadvise64),
+        SCMP_SYS(io_uring_setup), SCMP_SYS(io_uring_enter),
+
+        /* signals */
+        SCMP_SYS(rt_sigaction), SCMP_SYS(rt_sigprocmask), SCMP_SYS(rt_sigreturn),
+        SCMP_SYS(sigaltstack), SCMP_SYS(sigreturn), SCMP_SYS(rt_sigsuspend),
+        SCMP_SYS(kill), SCMP_SYS(tkill), SCMP_SYS(tgkill),
+
+        /* time / random */
+        SCMP_SYS(clock_gettime), SCMP_SYS(clock_nanosleep), SCMP_SYS(nanosleep), 
+        SCMP_SYS(gettimeofday), SCMP_SYS(getrandom), SCMP_SYS(time),
+
+        /* threads / futexes */
+        SCMP_SYS(futex), SCMP_SYS(set_robust_list), SCMP_SYS(set_tid_address),
+        SCMP_SYS(get_robust_list), SCMP_SYS(rseq),
+
+        /* process lifecycle */
+        SCMP_SYS(clone), SCMP_SYS(clone3), SCMP_SYS(execve), SCMP_SYS(execveat), 
+        SCMP_SYS(wait4), SCMP_SYS(waitid), SCMP_SYS(getpid), SCMP_SYS(vfork), SCMP_SYS(fork),
+
+        /* uid/gid and prctl */
+        SCMP_SYS(getuid), SCMP_SYS(geteuid), SCMP_SYS(getppid), SCMP_SYS(getgid), SCMP_SYS(getegid),
+        SCMP_SYS(getgroups), SCMP_SYS(prctl), SCMP_SYS(arch_prctl), SCMP_SYS(capget), SCMP_SYS(capset),
+        SCMP_SYS(setuid), SCMP_SYS(setgid), SCMP_SYS(setgroups),
+        SCMP_SYS(setreuid), SCMP_SYS(setregid), SCMP_SYS(setresuid), SCMP_SYS(setresgid),
+
+        /* resource limits */
+        SCMP_SYS(getrlimit), SCMP_SYS(setrlimit), SCMP_SYS(prlimit64), SCMP_SYS(getrusage),
+
+        /* sockets basics (for shells that might use network tools) */
+        SCMP_SYS(socket), SCMP_SYS(connect), SCMP_SYS(bind), SCMP_SYS(listen),
+        SCMP_SYS(accept), SCMP_SYS(accept4), SCMP_SYS(sendto), SCMP_SYS(recvfrom),
+        SCMP_SYS(sendmsg), SCMP_SYS(recvmsg), SCMP_SYS(socketpair), SCMP_SYS(getsockname),
+        SCMP_SYS(getpeername), SCMP_SYS(getsockopt), SCMP_SYS(setsockopt),
+        SCMP_SYS(shutdown),
+
+        /* epoll/poll/select */
+        SCMP_SYS(poll), SCMP_SYS(ppoll), SCMP_SYS(select), SCMP_SYS(pselect6),
+        SCMP_SYS(epoll_create), SCMP_SYS(epoll_create1),
+        SCMP_SYS(epoll_ctl), SCMP_SYS(epoll_wait), SCMP_SYS(epoll_pwait),
+
+        /* pipes */
+        SCMP_SYS(pipe), SCMP_SYS(pipe2),
+
+        /* misc */
+        SCMP_SYS(ioctl), SCMP_SYS(dup), SCMP_SYS(dup2), SCMP_SYS(dup3), 
+        SCMP_SYS(chdir), SCMP_SYS(fchdir),
+        SCMP_SYS(uname), SCMP_SYS(setpgid), SCMP_SYS(getpgid), SCMP_SYS(getsid), SCMP_SYS(setsid),
+        SCMP_SYS(getpriority), SCMP_SYS(setpriority),
+        SCMP_SYS(sysinfo), SCMP_SYS(umask), SCMP_SYS(getpgrp),
+        SCMP_SYS(eventfd), SCMP_SYS(eventfd2), SCMP_SYS(signalfd), SCMP_SYS(signalfd4),
+        SCMP_SYS(timerfd_create), SCMP_SYS(timerfd_settime), SCMP_SYS(timerfd_gettime),
+       SCMP_SYS(gettid),
+SCMP_SYS(futex_waitv),
+SCMP_SYS(getcpu),
+SCMP_SYS(prlimit64),
+SCMP_SYS(sched_getaffinity),
+SCMP_SYS(sched_yield),
+SCMP_SYS(set_robust_list),
+SCMP_SYS(set_tid_address),
+SCMP_SYS(sched_setparam),
+SCMP_SYS(sched_getparam),
+SCMP_SYS(sched_setscheduler),
+SCMP_SYS(sched_getscheduler),
+SCMP_SYS(sched_get_priority_max),
+SCMP_SYS(sched_get_priority_min), 
+        /* terminal control - critical for interactive shells */
+        SCMP_SYS(ioctl)  /* already listed but emphasizing importance */
+    };
+
+    /* Add syscalls by number for architecture-specific ones that may not have names */
+    int raw_syscalls[] = { 62, 111 };  /* ustat/lstat variants, getpgrp variants */
+    for (size_t i = 0; i < sizeof(raw_syscalls)/sizeof(raw_syscalls[0]); ++i) {
+        if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, raw_syscalls[i], 0) < 0) {
+            /* May fail if syscall doesn't exist on this arch, continue */
+        }
+    }
+
+    size_t n = sizeof(allow_list)/sizeof(allow_list[0]);
+    for (size_t i = 0; i < n; ++i) {
+        if (seccomp_rule_add(ctx, SCMP_ACT_ALLOW, allow_list[i], 0) < 0) {
+            perror("seccomp_rule_add");
+            seccomp_release(ctx);
+            return -1;
+        }
+    }
+
+    /* libseccomp can only export to an fd; round-trip through a memfd */
+    int fd = memfd_create("safebox-seccomp", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("memfd_create");
+        seccomp_release(ctx);
+        return -1;
+    }
+    if (seccomp_export_bpf(ctx, fd) < 0) {
+        perror("seccomp_export_bpf");
+        close(fd);
+        seccomp_release(ctx);
+        return -1;
+    }
+    seccomp_release(ctx);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+        st.st_size % (off_t)sizeof(struct sock_filter) != 0) {
+        fprintf(stderr, "seccomp export produced an invalid program\n");
+        close(fd);
+        return -1;
+    }
+    struct sock_filter *filter = malloc((size_t)st.st_size);
+    if (!filter || pread(fd, filter, (size_t)st.st_size, 0) != st.st_size) {
+        perror("read seccomp program");
+        free(filter);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    prog->len = (unsigned short)(st.st_size / (off_t)sizeof(struct sock_filter));
+    prog->filter = filter;
+    return 0;
+}
+
+#else /* SAFEBOX_NO_SECCOMP */
+
+int sandbox_build_seccomp_program(struct sock_fprog *prog) {
+    memset(prog, 0, sizeof(*prog));
+    fprintf(stderr, "safebox built without libseccomp; no syscall filter available\n");
+    return -1;
+}
+
+#endif /* SAFEBOX_NO_SECCOMP */
+
+void sandbox_free_seccomp_program(struct sock_fprog *prog) {
+    free(prog->filter);
+    prog->filter = NULL;
+    prog->len = 0;
+}
+
+/* Resolve a user name to uid/gid in the parent (getpwnam is not fork-safe) */
+int sandbox_lookup_user(const char *name, uid_t *uid, gid_t *gid) {
+    struct passwd *pw = getpwnam(name); //Fetches UID/GID of the Linux user nobody.
+    if (!pw) {
+        fprintf(stderr, "user '%s' not found\n", name);
+        return -1;
+    }
+    *uid = pw->pw_uid;
+    *gid = pw->pw_gid;
+    return 0;
+}
+
+/* Optionally chroot, then drop to cfg->uid:cfg->gid.
+ * Uses raw syscalls: glibc's setuid()/setgid() broadcast to every thread the
+ * library believes exists, which is wrong in a child cloned from a threaded
+ * parent without going through fork().
+ */
+static int drop_privileges_and_chroot(const struct sandbox_config *cfg) {
+    if (cfg->new_root) {
+        if (chdir(cfg->new_root) != 0) { //Moves the current working directory into the directory that will become root.
+            child_warn("chdir new_root failed\n");
+            return -1;
+        }
+        if (chroot(cfg->new_root) != 0) { //Changes the process's root directory (/) to new_root.
+            child_warn("chroot failed\n");
+            return -1;
+        }
+    }
+
+    if (syscall(SYS_setgroups, 0, NULL) != 0) {
+        // non-fatal: may lack CAP_SETGID when not started as root
+    }
+    if (syscall(SYS_setgid, cfg->gid) != 0) {
+        child_warn("setgid failed\n");
+        return -1;
+    }
+    if (syscall(SYS_setuid, cfg->uid) != 0) {
+        child_warn("setuid failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Runs inside the new namespaces, right before exec */
+int sandbox_child_setup(const struct sandbox_config *cfg) {
+    /* Make mounts private so changes inside don't escape */
+    if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0) {
+        child_warn("mount MS_PRIVATE failed\n");
+        // non-fatal
+    }
+
+    /* mount a new proc for the PID namespace */
+    if (mkdir("/proc", 0555) < 0 && errno != EEXIST) {
+        child_warn("mkdir /proc failed\n");
+    }
+    if (mount("proc", "/proc", "proc", MS_NOSUID | MS_NOEXEC | MS_NODEV, NULL) != 0) {
+        child_warn("mount /proc failed\n");
+        // non-fatal for demo
+    }
+
+    const char *hostname = cfg->hostname ? cfg->hostname : "safebox";
+    if (sethostname(hostname, strlen(hostname)) != 0) {
+        // non-fatal
+    }
+
+    /* Prevent any new privileges before anything else */
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        child_warn("prctl(NO_NEW_PRIVS) in child failed\n");
+        // continue anyway
+    }
+
+    /* drop privileges BEFORE applying seccomp */
+    if (cfg->drop_privileges && drop_privileges_and_chroot(cfg) != 0) {
+        child_warn("Warning: failed to drop privileges\n");
+    }
+
+    /* install the precompiled filter AFTER dropping privileges */
+    if (!cfg->seccomp || !cfg->seccomp->filter ||
+        prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, cfg->seccomp, 0, 0) != 0) {
+        child_warn("Warning: seccomp policy not loaded; continuing without seccomp\n");
+        // Insecure fallback — for demo only
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+"""
+Unit Tests for the latency histograms (backend/app/latency.py)
+Testing Framework: pytest
+
+The Python histograms merge with the daemon's LATENCY JSON bucket for
+bucket, so their layout has to be the native one exactly. The fixture
+tests/fixtures/latency_native.json comes from cgroup_agent's
+latency_histogram test (safebox-latency_histogram-test --write regenerates
+it, and that test fails when it is stale). It holds:
+- The native bucket of a spread of values, up to and past the 2^44 ns clamp
+- Every native bucket's low and high bound
+- The native LATENCY JSON of a histogram of all those values
+"""
+
+import json
+import sys
+from pathlib import Path
+
+import pytest
+
+# Add backend to path
+sys.path.insert(0, str(Path(__file__).parent.parent / 'backend'))
+
+from app.latency import BUCKETS, MAX_BITS, SUB_BITS, LatencyHistogram, LatencySnapshot, bucket_high, bucket_of
+
+FIXTURE = Path(__file__).parent / "fixtures" / "latency_native.json"
+
+
+@pytest.fixture(scope="module")
+def native():
+    return json.loads(FIXTURE.read_text())
+
+
+# ============================================================================
+# BUCKET LAYOUT
+# ============================================================================
+
+class TestBucketLayout:
+    """bucket_of / bucket_high against latency_histogram.cpp"""
+
+    def test_same_constants(self, native):
+        assert native["sub_bits"] == SUB_BITS
+        assert native["max_bits"] == MAX_BITS
+        assert native["buckets"] == BUCKETS
+
+    def test_bucket_of_matches(self, native):
+        """Every fixture value lands in the native bucket"""
+        wrong = [(ns, b, bucket_of(ns)) for ns, b in native["values"] if bucket_of(ns) != b]
+        assert wrong == []
+
+    def test_bucket_high_matches(self, native):
+        """Every bucket's upper bound is the native one"""
+        assert len(native["bounds"]) == BUCKETS
+        wrong = [(i, hi, bucket_high(i)) for i, (_, hi) in enumerate(native["bounds"]) if bucket_high(i) != hi]
+        assert wrong == []
+
+    def test_bounds_hold_values(self, native):
+        """bucket_of(low) and bucket_of(high) are the bucket itself"""
+        for i, (lo, hi) in enumerate(native["bounds"]):
+            assert bucket_of(lo) == i
+            assert bucket_of(hi) == i
+
+    @pytest.mark.parametrize("ns", [2 ** 44 - 1, 2 ** 44, 2 ** 44 + 1, 2 ** 50, 2 ** 63, 2 ** 64 - 1])
+    def test_clamp_at_2_44(self, ns):
+        """Everything from 2^44 ns on shares the last bucket; just below it is the last bucket too"""
+        assert bucket_of(ns) == BUCKETS - 1
+        assert bucket_high(BUCKETS - 1) == 2 ** MAX_BITS - 1
+
+    def test_clamp_in_fixture(self, native):
+        past = [b for ns, b in native["values"] if ns >= 2 ** MAX_BITS]
+        assert past and all(b == BUCKETS - 1 for b in past)
+
+    def test_negative_is_bucket_zero(self):
+        assert bucket_of(-5) == 0
+
+
+# ============================================================================
+# MERGING WITH THE DAEMON'S JSON
+# ============================================================================
+
+class TestNativeSnapshot:
+    """A Python histogram of the same values is the native LATENCY JSON"""
+
+    def test_same_json(self, native):
+        h = LatencyHistogram()
+        for ns, _ in native["values"]:
+            h.record(ns)
+        assert h.snapshot().to_json() == native["latency"]
+
+    def test_from_json_round_trip(self, native):
+        s = LatencySnapshot.from_json(native["latency"])
+        assert s.to_json() == native["latency"]
+
+    def test_merge_doubles_counts(self, native):
+        """Merging the native snapshot with a local copy of it doubles every bucket"""
+        local = LatencyHistogram()
+        for ns, _ in native["values"]:
+            local.record(ns)
+        merged = local.snapshot().merge(LatencySnapshot.from_json(native["latency"]))
+        buckets = dict(native["latency"]["buckets"])
+        assert merged.counts == {b: 2 * c for b, c in buckets.items()}
+        assert merged.count == 2 * native["latency"]["count"]
+        assert merged.percentile(0.99) == native["latency"]["p99_ns"]
+
+    def test_other_sub_bits_rejected(self, native):
+        with pytest.raises(ValueError):
+            LatencySnapshot.from_json(dict(native["latency"], sub_bits=SUB_BITS + 1))
@@ -0,0 +1,298 @@
+"""
+Unit Tests for the /ws/metrics delta stream (backend/app/metrics_stream.py)
+Testing Framework: pytest
+
+FrameEncoder and FrameDecoder are driven with synthetic flat frames, and a
+decoder fed what an encoder sent must always hold the encoder's values:
+- Round trips of every value type over many random frames
+- Key indexes freed by removal and reused by later keys
+- Keyframes that renumber the keys, and ones that do not
+- A subscriber resyncing from a keyframe mid-stream
+- metrics_hub._Channel replacing frames a slow subscriber has not taken
+"""
+
+import random
+import sys
+from pathlib import Path
+
+import pytest
+
+# Add backend to path
+sys.path.insert(0, str(Path(__file__).parent.parent / 'backend'))
+
+from app.metrics_hub import _Channel, _Mailbox
+from app.metrics_stream import DELTA, HEADER, KEYFRAME, FrameDecoder, FrameEncoder, Subscription
+
+
+def same(a: dict, b: dict) -> bool:
+    """Equal values of equal types (True is not 1, 1 is not 1.0)"""
+    return a == b and all(type(a[k]) is type(b[k]) for k in a)
+
+
+def random_value(rng: random.Random, previous=None):
+    kind = rng.randrange(8)
+    if kind == 0:
+        return None
+    if kind == 1:
+        return rng.choice([True, False])
+    if kind in (2, 3):
+        # Counters that grow, and ones that jump anywhere
+        if isinstance(previous, int) and not isinstance(previous, bool):
+            return previous + rng.randrange(-5, 1000)
+        return rng.randrange(-2 ** 62, 2 ** 62)
+    if kind == 4:
+        return rng.choice([0.0, -0.0, 1.5, rng.random() * 1e12, float("inf"), -1e-300])
+    if kind == 5:
+        return rng.choice(["", "max", "über", "x" * 300])
+    return previous if previous is not None else 0
+
+
+def random_keys(rng: random.Random, n: int) -> list:
+    keys = ["system.load.1m", "system.memory.percent", "cgroups.memory_usage_ratio"]
+    for g in range(n):
+        for field in ("cpu_stat.usage_usec", "cpu_stat.nr_throttled", "memory_current", "memory_max"):
+            keys.append(f"group.safebox_job_{g}.{field}")
+    return keys
+
+
+def kind_of(frame: bytes) -> int:
+    return HEADER.unpack_from(frame)[1]
+
+
+# ============================================================================
+# ROUND TRIPS
+# ============================================================================
+
+class TestRoundTrip:
+    """Whatever the encoder adopts, the decoder ends up holding"""
+
+    @pytest.mark.parametrize("seed", range(5))
+    def test_random_frames(self, seed):
+        """Keys come and go and values change type over 300 frames"""
+        rng = random.Random(seed)
+        pool = random_keys(rng, 40)
+        enc, dec = FrameEncoder(), FrameDecoder()
+        values = {}
+        dec.apply(enc.keyframe(0, 0.0))
+        for seq in range(1, 300):
+            # Some keys leave, some arrive, some values change
+            values = {k: v for k, v in values.items() if rng.random() > 0.05}
+            for k in rng.sample(pool, rng.randrange(len(pool) // 2)):
+                values[k] = random_value(rng, values.get(k))
+            got_seq, got = dec.apply(enc.update(dict(values), seq, float(seq)))
+            assert got_seq == seq
+            assert dec.t == float(seq)
+            assert same(got, values)
+            assert same(enc.values, values)
+
+    def test_unchanged_frame_is_header_only(self):
+        """A frame where nothing changed carries no keys or values"""
+        enc = FrameEncoder()
+        values = {"system.load.1m": 0.5, "group.a.memory_current": 4096}
+        enc.update(values, 1, 1.0)
+        frame = enc.update(dict(values), 2, 2.0)
+        assert len(frame) == HEADER.size
+        assert kind_of(frame) == DELTA
+
+    def test_type_changes_survive(self):
+        """1 -> True -> 1.0 -> "1" -> None -> 1 are all distinct on the wire"""
+        enc, dec = FrameEncoder(), FrameDecoder()
+        for seq, v in enumerate([1, True, 1.0, "1", None, 1, 2], start=1):
+            _, got = dec.apply(enc.update({"k": v}, seq, 0.0))
+            assert same(got, {"k": v})
+
+    def test_shared_prefixes_decode(self):
+        """Keys sent as the prefix shared with the key before them plus the rest"""
+        enc, dec = FrameEncoder(), FrameDecoder()
+        keys = ["group.a.cpu", "group.a.cpu_stat.usage_usec", "group.ab", "g", "group.a" * 40, "group.a" * 41]
+        _, got = dec.apply(enc.update({k: i for i, k in enumerate(keys)}, 1, 0.0))
+        assert got == {k: i for i, k in enumerate(keys)}
+
+    def test_bad_magic_rejected(self):
+        frame = bytearray(FrameEncoder().keyframe(1, 0.0))
+        frame[0:2] = b"XX"
+        with pytest.raises(ValueError):
+            FrameDecoder().apply(bytes(frame))
+
+
+# ============================================================================
+# KEY REUSE AND KEYFRAMES
+# ============================================================================
+
+class TestKeyIndexes:
+    """Removed keys' indexes come back, keyframes may renumber"""
+
+    def test_removed_index_reused_next_frame(self):
+        """A freed index is not handed out in the frame that frees it"""
+        enc, dec = FrameEncoder(), FrameDecoder()
+        dec.apply(enc.update({"a": 1, "b": 2, "c": 3}, 1, 0.0))
+        freed = enc.index["b"]
+        _, got = dec.apply(enc.update({"a": 1, "c": 3, "d": 4}, 2, 0.0))
+        assert got == {"a": 1, "c": 3, "d": 4}
+        assert enc.index["d"] != freed
+        _, got = dec.apply(enc.update({"a": 1, "c": 3, "d": 4, "e": 5}, 3, 0.0))
+        assert enc.index["e"] == freed
+        assert got == {"a": 1, "c": 3, "d": 4, "e": 5}
+
+    def test_remove_and_readd_same_key(self):
+        """A key that leaves and comes back is sent as new, with its value in full"""
+        enc, dec = FrameEncoder(), FrameDecoder()
+        dec.apply(enc.update({"a": 100, "b": 1}, 1, 0.0))
+        dec.apply(enc.update({"b": 1}, 2, 0.0))
+        _, got = dec.apply(enc.update({"a": 7, "b": 1}, 3, 0.0))
+        assert got == {"a": 7, "b": 1}
+
+    def test_renumbered_keyframe(self):
+        """After churn a renumbering keyframe packs indexes 0..n-1 and deltas follow it"""
+        rng = random.Random(11)
+        enc, dec = FrameEncoder(), FrameDecoder()
+        values = {f"k{i}": i for i in range(50)}
+        dec.apply(enc.update(dict(values), 1, 0.0))
+        for k in rng.sample(sorted(values), 30):
+            del values[k]
+        dec.apply(enc.update(dict(values), 2, 0.0))
+        frame = enc.keyframe(3, 0.0, renumber=True)
+        assert kind_of(frame) == KEYFRAME
+        assert sorted(enc.index.values()) == list(range(len(values)))
+        assert enc.free == []
+        _, got = dec.apply(frame)
+        assert got == values
+        values.update({"new0": 0, "k49": -1})
+        _, got = dec.apply(enc.update(dict(values), 4, 0.0))
+        assert got == values
+        assert enc.index["new0"] == len(values) - 1
+
+    def test_keyframe_without_renumber_keeps_indexes(self):
+        """A resync keyframe leaves the numbering other subscribers' deltas use"""
+        enc = FrameEncoder()
+        enc.update({"a": 1, "b": 2, "c": 3}, 1, 0.0)
+        enc.update({"a": 1, "c": 3}, 2, 0.0)
+        before = dict(enc.index)
+        free = list(enc.free)
+        enc.keyframe(3, 0.0)
+        assert enc.index == before
+        assert enc.free == free
+
+
+class TestResync:
+    """A subscriber joining or falling behind picks up from a keyframe"""
+
+    def test_late_joiner_mid_stream(self):
+        """A decoder that starts at a non-renumbering keyframe tracks later deltas"""
+        rng = random.Random(3)
+        pool = random_keys(rng, 10)
+        enc, first = FrameEncoder(), FrameDecoder()
+        late = None
+        values = {}
+        for seq in range(1, 200):
+            values = {k: v for k, v in values.items() if rng.random() > 0.1}
+            for k in rng.sample(pool, 10):
+                values[k] = random_value(rng, values.get(k))
+            delta = enc.update(dict(values), seq, 0.0)
+            first.apply(delta)
+            if seq == 97:
+                late = FrameDecoder()
+                late.apply(enc.keyframe(seq, 0.0))
+            elif late is not None:
+                late.apply(delta)
+            if late is not None:
+                assert same(late.values, values)
+            assert same(first.values, values)
+
+    def test_missed_delta_recovered_by_keyframe(self):
+        """Skipping a delta breaks the state; the next keyframe restores it"""
+        enc, dec = FrameEncoder(), FrameDecoder()
+        dec.apply(enc.update({"c": 10, "g": 1.5}, 1, 0.0))
+        enc.update({"c": 20, "g": 2.5}, 2, 0.0)           # lost
+        _, got = dec.apply(enc.update({"c": 25, "g": 2.5}, 3, 0.0))
+        assert got["c"] != 25 or got["g"] != 2.5
+        _, got = dec.apply(enc.keyframe(4, 0.0))
+        assert got == {"c": 25, "g": 2.5}
+        _, got = dec.apply(enc.update({"c": 30, "g": 2.5}, 5, 0.0))
+        assert got == {"c": 30, "g": 2.5}
+
+
+# ============================================================================
+# CHANNEL: PERIODIC KEYFRAMES AND DROPPED FRAMES
+# ============================================================================
+
+def flat_frame(i: int) -> dict:
+    return {
+        "system.load.1m": i / 10,
+        "group.safebox_job_1.cpu_stat.usage_usec": 1000 * i,
+        "group.safebox_job_2.cpu_stat.usage_usec": 500 * i,
+        "group.safebox_job_2.memory_current": 4096 * (i % 7),
+    }
+
+
+class TestChannel:
+    """_Channel.tick encodes once and hands every mailbox a frame it can use"""
+
+    def test_keyframe_first_and_periodically(self):
+        channel = _Channel(Subscription(keyframe=5))
+        box = _Mailbox()
+        channel.mailboxes.add(box)
+        dec = FrameDecoder()
+        kinds = []
+        for seq in range(1, 13):
+            assert channel.tick(flat_frame(seq), seq, float(seq)) == 0
+            frame = box.queue.get_nowait()
+            kinds.append(kind_of(frame))
+            _, got = dec.apply(frame)
+            assert got == flat_frame(seq)
+        assert kinds == [KEYFRAME] + [DELTA] * 4 + [KEYFRAME] + [DELTA] * 4 + [KEYFRAME, DELTA]
+
+    def test_every_skips_periods(self):
+        channel = _Channel(Subscription(every=3))
+        box = _Mailbox()
+        channel.mailboxes.add(box)
+        sent = []
+        for seq in range(1, 10):
+            channel.tick(flat_frame(seq), seq, 0.0)
+            if not box.queue.empty():
+                sent.append(HEADER.unpack_from(box.queue.get_nowait())[3])
+        assert sent == [1, 4, 7]
+
+    def test_filters_groups_and_fields(self):
+        channel = _Channel(Subscription(groups=["safebox_job_2"], fields=["group.memory_current"]))
+        box = _Mailbox()
+        channel.mailboxes.add(box)
+        channel.tick(flat_frame(3), 1, 0.0)
+        _, got = FrameDecoder().apply(box.queue.get_nowait())
+        assert got == {"group.safebox_job_2.memory_current": 4096 * 3}
+
+    def test_slow_subscriber_gets_keyframe(self):
+        """A frame not taken is replaced; the replacement is a keyframe that resyncs"""
+        channel = _Channel(Subscription(keyframe=1000))
+        fast, slow = _Mailbox(), _Mailbox()
+        channel.mailboxes.update({fast, slow})
+        fast_dec, slow_dec = FrameDecoder(), FrameDecoder()
+        dropped = 0
+        for seq in range(1, 40):
+            dropped += channel.tick(flat_frame(seq), seq, float(seq))
+            fast_dec.apply(fast.queue.get_nowait())
+            assert fast_dec.values == flat_frame(seq)
+            # The slow one only reads every fifth frame
+            if seq % 5 == 0:
+                frame = slow.queue.get_nowait()
+                assert kind_of(frame) == KEYFRAME
+                _, got = slow_dec.apply(frame)
+                assert got == flat_frame(seq)
+        # Four replaced between each read, none for the first frame
+        assert dropped == 7 * 4 + 3
+        assert slow.resync is False
+
+    def test_keeping_up_after_resync_gets_deltas(self):
+        channel = _Channel(Subscription(keyframe=1000))
+        box = _Mailbox()
+        channel.mailboxes.add(box)
+        dec = FrameDecoder()
+        channel.tick(flat_frame(1), 1, 0.0)
+        assert channel.tick(flat_frame(2), 2, 0.0) == 1
+        dec.apply(box.queue.get_nowait())
+        for seq in range(3, 8):
+            assert channel.tick(flat_frame(seq), seq, 0.0) == 0
+            frame = box.queue.get_nowait()
+            assert kind_of(frame) == DELTA
+            _, got = dec.apply(frame)
+            assert got == flat_frame(seq)
@@ -0,0 +1,194 @@
+"""
+Unit Tests for the global CPU optimizer (backend/app/optimizer.py)
+Testing Framework: pytest
+
+Optimizer.plan() is pure: it takes a sweep in collect_job_group_metrics()
+shape and each group's Banker reservation, so these tests drive it with
+synthetic sweeps over several ticks and check the allocation rules:
+- Quotas never add up to more than the reservations
+- Slack from idle groups is lent to throttled ones
+- A lender gets its reservation back the tick it needs it
+- A group seen for the first time keeps its quota up to its reservation
+"""
+
+import random
+import sys
+from pathlib import Path
+
+import pytest
+
+# Add backend to path
+sys.path.insert(0, str(Path(__file__).parent.parent / 'backend'))
+
+from app.optimizer import Optimizer, PERIOD
+
+MB = 1 << 20
+
+
+class FakeCluster:
+    """
+    Job groups with a CPU demand each, advanced one second per tick under
+    whatever quotas the last plan set: a group uses min(demand, quota) and
+    is throttled for the rest.
+    """
+
+    def __init__(self, reserved):
+        self.reserved = reserved                      # group -> (cpu%, memory bytes)
+        self.quota = {g: r[0] for g, r in reserved.items()}
+        self.usage = {g: 0 for g in reserved}         # cumulative usec
+        self.throttled = {g: 0 for g in reserved}
+        self.periods = {g: 0 for g in reserved}
+        self.t = 0.0
+        self.optimizer = Optimizer(cgroup_root_dir="/nonexistent", client=object())
+
+    def sweep(self):
+        return {
+            g: {
+                "t": self.t,
+                "cpu_max": {"quota": self.quota[g] * PERIOD // 100, "period": PERIOD},
+                "cpu_stat": {"usage_usec": self.usage[g], "throttled_usec": self.throttled[g],
+                             "nr_throttled": self.periods[g]},
+                "cpu_pressure": {},
+                "memory_current": self.reserved[g][1] // 2,
+                "memory_max": self.reserved[g][1],
+                "memory_high": None,
+            }
+            for g in self.reserved
+        }
+
+    def tick(self, demand):
+        """Run one second at `demand` (group -> cpu%), then plan and apply."""
+        self.t += 1.0
+        for g, want in demand.items():
+            used = min(want, self.quota[g])
+            self.usage[g] += int(used * 10000)
+            if want > self.quota[g]:
+                self.throttled[g] += int(min(1.0, (want - self.quota[g]) / want) * 1e6)
+                self.periods[g] += 10
+        plan = self.optimizer.plan(self.sweep(), self.reserved)
+        for g, p in plan["groups"].items():
+            if "cpu_percent" in p:
+                self.quota[g] = p["cpu_percent"]
+        return plan
+
+
+# ============================================================================
+# TOTAL NEVER EXCEEDS THE RESERVATIONS
+# ============================================================================
+
+class TestReservationBound:
+    """The sum of planned quotas stays within what the Banker granted"""
+
+    def test_allocated_within_reserved_random(self):
+        """Random demand over many ticks never over-allocates"""
+        rng = random.Random(7)
+        reserved = {f"safebox_job_{i}": (rng.choice([10, 25, 50, 100]), 256 * MB) for i in range(12)}
+        cluster = FakeCluster(reserved)
+        total = sum(r[0] for r in reserved.values())
+        for _ in range(200):
+            demand = {g: rng.choice([0, 1, 5, r[0] // 2, r[0], 2 * r[0], 400]) for g, r in reserved.items()}
+            plan = cluster.tick(demand)
+            assert plan["reserved_cpu_percent"] == total
+            assert plan["allocated_cpu_percent"] <= total
+            assert sum(cluster.quota.values()) <= total
+
+    def test_everyone_busy_gets_exactly_reservation(self):
+        """With no idle group there is nothing to lend"""
+        reserved = {"safebox_job_1": (50, 0), "safebox_job_2": (50, 0)}
+        cluster = FakeCluster(reserved)
+        for _ in range(5):
+            plan = cluster.tick({"safebox_job_1": 200, "safebox_job_2": 200})
+        for g in reserved:
+            assert plan["groups"][g]["cpu_percent"] == 50
+
+
+# ============================================================================
+# LENDING AND GIVING BACK
+# ============================================================================
+
+class TestLending:
+    """Idle reservation goes to throttled groups and comes back on demand"""
+
+    def test_idle_lends_to_throttled(self):
+        """A throttled group borrows what an idle one leaves"""
+        reserved = {"safebox_job_1": (100, 0), "safebox_job_2": (100, 0)}
+        cluster = FakeCluster(reserved)
+        for _ in range(10):
+            plan = cluster.tick({"safebox_job_1": 2, "safebox_job_2": 190})
+        idle, busy = plan["groups"]["safebox_job_1"], plan["groups"]["safebox_job_2"]
+        assert idle["cpu_percent"] < 100
+        assert busy["cpu_percent"] > 100
+        assert "borrowing" in busy["reason"]
+        assert idle["cpu_percent"] + busy["cpu_percent"] <= 200
+
+    def test_lender_gets_reservation_back_next_tick(self):
+        """The tick after a lender is throttled it is back at its reservation"""
+        reserved = {"safebox_job_1": (100, 0), "safebox_job_2": (100, 0)}
+        cluster = FakeCluster(reserved)
+        for _ in range(10):
+            cluster.tick({"safebox_job_1": 2, "safebox_job_2": 190})
+        assert cluster.quota["safebox_job_1"] < 50
+        # The lender wakes up while the borrower still wants everything
+        plan = cluster.tick({"safebox_job_1": 100, "safebox_job_2": 190})
+        assert plan["groups"]["safebox_job_1"]["cpu_percent"] >= 100
+        assert plan["groups"]["safebox_job_2"]["cpu_percent"] <= 100
+        assert plan["allocated_cpu_percent"] <= 200
+
+    def test_short_groups_split_pool_in_proportion(self):
+        """Two borrowers share a pool smaller than their shortfall pro rata"""
+        reserved = {"safebox_job_1": (100, 0), "safebox_job_2": (50, 0), "safebox_job_3": (50, 0)}
+        cluster = FakeCluster(reserved)
+        for _ in range(15):
+            plan = cluster.tick({"safebox_job_1": 0, "safebox_job_2": 400, "safebox_job_3": 400})
+        a = plan["groups"]["safebox_job_2"]["cpu_percent"]
+        b = plan["groups"]["safebox_job_3"]["cpu_percent"]
+        assert a > 50 and b > 50
+        assert abs(a - b) <= 1
+        assert plan["allocated_cpu_percent"] <= 200
+
+
+# ============================================================================
+# FIRST SIGHT AND MEMORY
+# ============================================================================
+
+class TestFirstSweep:
+    """A group needs two samples before its quota is touched"""
+
+    def test_new_group_keeps_quota(self):
+        """No cpu_percent is planned for a group seen once"""
+        opt = Optimizer(cgroup_root_dir="/nonexistent", client=object())
+        sweep = FakeCluster({"safebox_job_1": (40, 64 * MB)}).sweep()
+        plan = opt.plan(sweep, {"safebox_job_1": (40, 64 * MB)})
+        assert "cpu_percent" not in plan["groups"]["safebox_job_1"]
+        assert "cpu.max" not in plan["groups"]["safebox_job_1"]
+
+    def test_new_group_over_reservation_is_short(self):
+        """Quota a new group borrowed before this sweep is shared like any shortfall"""
+        reserved = {"safebox_job_1": (100, 0), "safebox_job_2": (100, 0)}
+        cluster = FakeCluster(reserved)
+        for _ in range(5):
+            cluster.tick({"safebox_job_1": 0, "safebox_job_2": 300})
+        # Lent to by an earlier optimizer, which this one has never seen
+        cluster.reserved["safebox_job_3"] = (50, 0)
+        cluster.quota["safebox_job_3"] = 150
+        for g in ("usage", "throttled", "periods"):
+            getattr(cluster, g)["safebox_job_3"] = 0
+        plan = cluster.tick({"safebox_job_1": 0, "safebox_job_2": 300, "safebox_job_3": 300})
+        new = plan["groups"]["safebox_job_3"]
+        assert 50 <= new["cpu_percent"] < 150
+        assert "cpu.max" in new
+        assert plan["allocated_cpu_percent"] <= 250
+        assert sum(cluster.quota.values()) <= 250
+
+
+class TestMemoryHigh:
+    """memory.high follows usage inside the reservation"""
+
+    @pytest.mark.parametrize("current", [0, 10 * MB, 100 * MB, 300 * MB])
+    def test_high_within_bounds(self, current):
+        opt = Optimizer(cgroup_root_dir="/nonexistent", client=object())
+        reserved = {"safebox_job_1": (50, 256 * MB)}
+        sweep = FakeCluster(reserved).sweep()
+        sweep["safebox_job_1"]["memory_current"] = current
+        high = opt.plan(sweep, reserved)["groups"]["safebox_job_1"].get("memory.high", 256 * MB)
+        assert 256 * MB // 4 <= high <= 256 * MB